@@ -20,7 +20,7 @@ PROFILE ?= 0		# boolean: 0=no, 1=yes
 # Use '+=' variable assignment so ENV variables can be used.
 
 DEFS += -D_GNU_SOURCE
-LIBS += -lgmpxx -lgmp
+LIBS += -lgmpxx -lgmp -lpthread -lrt -lm
 LIBS_DYN += -lstdc++
 MAKEFLAGS += --no-print-directory
 
@@ -44,8 +44,8 @@ export PROFILE ?= 0     # boolean: 0=no, 1=yes
 # LDFLAGS       # extra linker flags
 # LIBS          # extra linker libs, linked statically for non-zero STATIC=
 # LIBS_DYN      # extra linker libs, linked dynamically unless STATIC=1
-# TRACE         # a list of trace names (e.g.: TRACE="FOO BAR" turns into
-#               #   -DTRACE_FOO -DTRACE_BAR)
+# TRACE         # a list of trace categories to turn on at startup (e.g.:
+#               #   TRACE="SCOPES TYPES"); see trace.h
 
 
 # Build tools
@@ -70,7 +70,9 @@ PRJ_CXXWARNS   = $(PRJ_CWARNS) -Woverloaded-virtual $(CXXWARNS)
 PRJ_VER_DEFS   = -DPRJ_VER_MAJOR=$(PRJ_VER_MAJOR) \
                  -DPRJ_VER_MINOR=$(PRJ_VER_MINOR) \
                  -DPRJ_VER_MICRO=$(PRJ_VER_MICRO)
-PRJ_DEFS       = $(DEFS) $(PRJ_VER_DEFS)
+PRJ_TRACE      = $(if $(strip $(TRACE)), \
+                   -DHWPP_TRACE_DEFAULT='"$(strip $(TRACE))"')
+PRJ_DEFS       = $(DEFS) $(PRJ_VER_DEFS) $(PRJ_TRACE)
 PRJ_INCLUDES   = -iquote $(TOPDIR) $(INCLUDES)
 PRJ_LDLIBS     = $(LIBS)
 PRJ_LDLIBS_DYN = $(LIBS_DYN)
@@ -95,11 +97,11 @@ endif
 
 # Debug options should go last
 ifeq ($(strip $(DEBUG)),1)
-PRJ_TRACE    = $(foreach trace, $(TRACE), -DTRACE_$(trace)=1)
-PRJ_CDEBUG   = -O0 -ggdb -DDEBUG -UNDEBUG $(PRJ_TRACE)
+PRJ_CDEBUG   = -O0 -ggdb -DDEBUG -UNDEBUG
 PRJ_CXXDEBUG = $(PRJ_CDEBUG) -fno-default-inline
 else
 PRJ_CDEBUG   = -O2 -UDEBUG -DNDEBUG
+PRJ_CXXDEBUG = $(PRJ_CDEBUG)
 endif
 
 CPPFLAGS += $(PRJ_DEFS) $(PRJ_INCLUDES)
@@ -219,6 +221,13 @@ run_tests:
 		$(RM) -f $$f.err; \
 	done 2>/dev/null
 
+.PHONY: run_benches
+run_benches:
+	@for f in $(RUN_BENCHES); do \
+		echo "BENCH $$f:"; \
+		./$$f $(BENCH_ARGS) | sed 's/^/  /'; \
+	done
+
 # Include any dependency files we can find.  If none exist, they will get
 # created as object files are built.  We're assuming here that nobody has
 # done anything stupid like delete all the dependency files from underneath
@@ -0,0 +1,89 @@
+#include "hwpp.h"
+#include "field_types.h"
+#include "datatype_types.h"
+#include "register_types.h"
+#include "regbits.h"
+#include "mem_binding.h"
+#include "util/bignum_lambda.h"
+#include "util/bench.h"
+
+// Time DirectField::evaluate() over one 32-bit register.
+static void
+bench_evaluate(const hwpp::ConstDatatypePtr &datatype, uint64_t n,
+               const hwpp::Value &value = 0x3)
+{
+	hwpp::BindingPtr bind = new_mem_binding();
+	hwpp::RegisterPtr reg = new_hwpp_bound_register(bind, 4,
+	                                                 hwpp::BITS32);
+	reg->write(value);
+	hwpp::DirectField field(datatype, hwpp::RegBits(reg));
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < n; i++) {
+		string s = field.evaluate();
+		BENCH_KEEP(s);
+	}
+}
+
+BENCH(bench_evaluate_int)
+{
+	bench_evaluate(new_hwpp_int_datatype(), BENCH_N);
+}
+
+BENCH(bench_evaluate_int_units)
+{
+	bench_evaluate(new_hwpp_int_datatype("MHz"), BENCH_N);
+}
+
+BENCH(bench_evaluate_hex)
+{
+	bench_evaluate(new_hwpp_hex_datatype(hwpp::BITS32), BENCH_N);
+}
+
+BENCH(bench_evaluate_enum)
+{
+	hwpp::EnumDatatypePtr dt = new_hwpp_enum_datatype();
+	for (int i = 0; i < 16; i++) {
+		dt->add_value(sprintfxx("value%d", i), i);
+	}
+	bench_evaluate(dt, BENCH_N);
+}
+
+BENCH(bench_evaluate_bool)
+{
+	bench_evaluate(new_hwpp_bool_datatype("yes", "no"), BENCH_N, 1);
+}
+
+BENCH(bench_evaluate_bitmask)
+{
+	hwpp::BitmaskDatatypePtr dt = new_hwpp_bitmask_datatype();
+	for (int i = 0; i < 32; i++) {
+		dt->add_bit(sprintfxx("bit%d", i), i);
+	}
+	bench_evaluate(dt, BENCH_N, 0x0f0f0f0f);
+}
+
+BENCH(bench_evaluate_string)
+{
+	bench_evaluate(new_hwpp_string_datatype(), BENCH_N, 0x6c6c6548);
+}
+
+BENCH(bench_evaluate_multi)
+{
+	hwpp::MultiDatatypePtr dt = new_hwpp_multi_datatype();
+	dt->add_range(new_hwpp_int_datatype(), 0, 10);
+	dt->add_range(new_hwpp_hex_datatype(), 11, 20);
+	dt->add_range(new_hwpp_int_datatype(), 21, 0xffffffff);
+	bench_evaluate(dt, BENCH_N, 15);
+}
+
+BENCH(bench_evaluate_transform)
+{
+	bench_evaluate(new_hwpp_transform_datatype(new_hwpp_int_datatype(),
+	                                           _1 * 2, _1 / 2),
+	               BENCH_N);
+}
+
+BENCH(bench_evaluate_fixed)
+{
+	bench_evaluate(new_hwpp_fixed_datatype(8), BENCH_N, 0x1280);
+}
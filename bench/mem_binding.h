@@ -0,0 +1,57 @@
+#ifndef HWPP_BENCH_MEM_BINDING_H__
+#define HWPP_BENCH_MEM_BINDING_H__
+
+#include "hwpp.h"
+#include "binding.h"
+#include <vector>
+
+/*
+ * MemBinding - a binding backed by an array in memory.
+ *
+ * Each address is a separate register, so this costs about what a real
+ * binding does minus the actual I/O, which is what the benchmarks want to
+ * leave out.  Addresses wrap around the size of the array.
+ */
+class MemBinding: public hwpp::Binding
+{
+    public:
+	explicit MemBinding(size_t n_regs = 256)
+	    : m_regs(n_regs)
+	{
+		for (size_t i = 0; i < n_regs; i++) {
+			m_regs[i] = 0x0123456789abcdefULL ^ (i * 0x1111);
+		}
+	}
+
+	virtual hwpp::Value
+	read(const hwpp::Value &address, const hwpp::BitWidth width) const
+	{
+		return m_regs[slot(address)] & hwpp::MASK(width);
+	}
+
+	virtual void
+	write(const hwpp::Value &address, const hwpp::BitWidth width,
+	    const hwpp::Value &value) const
+	{
+		m_regs[slot(address)] = value & hwpp::MASK(width);
+	}
+
+	virtual string
+	to_string() const
+	{
+		return "mem";
+	}
+
+    private:
+	size_t
+	slot(const hwpp::Value &address) const
+	{
+		return address.get_ui() % m_regs.size();
+	}
+
+	mutable std::vector<hwpp::Value> m_regs;
+};
+
+#define new_mem_binding(...) hwpp::BindingPtr(new MemBinding(__VA_ARGS__))
+
+#endif // HWPP_BENCH_MEM_BINDING_H__
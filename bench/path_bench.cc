@@ -0,0 +1,52 @@
+#include "hwpp.h"
+#include "path.h"
+#include "util/bench.h"
+
+static void
+bench_parse(const string &str, uint64_t n)
+{
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < n; i++) {
+		hwpp::Path path(str);
+		BENCH_KEEP(path);
+	}
+}
+
+BENCH(bench_parse_short)
+{
+	bench_parse("foo", BENCH_N);
+}
+
+BENCH(bench_parse_absolute)
+{
+	bench_parse("/pci/bus/dev[31]/func[0]/vendor", BENCH_N);
+}
+
+BENCH(bench_parse_arrays)
+{
+	bench_parse("/cpu[3]/msr/mtrr_phys[7]/base", BENCH_N);
+}
+
+BENCH(bench_parse_long)
+{
+	bench_parse("/a/b/c/d/e/f/g/h/i/j/k/l/m/n/o/p/q/r/s/t/u/v/w/x",
+	            BENCH_N);
+}
+
+BENCH(bench_parse_element)
+{
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		hwpp::Path::Element elem("mtrr_phys[7]");
+		BENCH_KEEP(elem);
+	}
+}
+
+BENCH(bench_to_string)
+{
+	hwpp::Path path("/cpu[3]/msr/mtrr_phys[7]/base");
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		string s = path.to_string();
+		BENCH_KEEP(s);
+	}
+}
@@ -0,0 +1,467 @@
+// An end-to-end benchmark of building and walking a whole device tree.
+//
+// This makes up a platform with some number of PCI functions and CPUs,
+// saves it as a snapshot file, and then does what hwpp_read does when it
+// dumps everything: it loads the device definitions, runs discovery
+// against the snapshot, and reads every field, register and alias.  The
+// real device definitions and drivers are used throughout; only the
+// hardware access is faked, by the snapshot.
+//
+// Unlike the microbenchmarks, each phase is run exactly once, since
+// discovery can only be done once per process.  For each phase the wall
+// time, the number and size of heap allocations, and the peak RSS so far
+// are reported.
+//
+// The BENCH_PCI_FUNCS and BENCH_CPUS environment variables set the size
+// of the platform (default 64 and 8).
+//
+// Build benchmarks with DEBUG=0, or the numbers mean very little.
+
+#include "hwpp.h"
+#include "drivers.h"
+#include "device_init.h"
+#include "field.h"
+#include "register.h"
+#include "scope.h"
+#include "array.h"
+#include "alias.h"
+#include "snapshot.h"
+#include "util/filesystem.h"
+#include "util/printfxx.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+//
+// Heap accounting
+//
+
+static uint64_t n_allocs;
+static uint64_t n_alloc_bytes;
+
+static void *
+counted_alloc(size_t size)
+{
+	__sync_fetch_and_add(&n_allocs, 1);
+	__sync_fetch_and_add(&n_alloc_bytes, size);
+	void *p = malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *
+operator new(size_t size) throw(std::bad_alloc)
+{
+	return counted_alloc(size);
+}
+
+void *
+operator new[](size_t size) throw(std::bad_alloc)
+{
+	return counted_alloc(size);
+}
+
+void
+operator delete(void *p) throw()
+{
+	free(p);
+}
+
+void
+operator delete[](void *p) throw()
+{
+	free(p);
+}
+
+//
+// Phase timing
+//
+
+static uint64_t
+now_nsecs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+class Phase
+{
+    public:
+	explicit Phase(const char *name)
+	    : m_name(name), m_start(now_nsecs()), m_allocs(n_allocs),
+	      m_bytes(n_alloc_bytes)
+	{
+	}
+	~Phase()
+	{
+		uint64_t nsecs = now_nsecs() - m_start;
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+		printf("%-24s %10.3f ms %10llu allocs %12llu bytes"
+		       " %8ld KB peak RSS\n",
+		       m_name, nsecs / 1e6,
+		       (unsigned long long)(n_allocs - m_allocs),
+		       (unsigned long long)(n_alloc_bytes - m_bytes),
+		       ru.ru_maxrss);
+		fflush(stdout);
+	}
+
+    private:
+	const char *m_name;
+	uint64_t m_start;
+	uint64_t m_allocs;
+	uint64_t m_bytes;
+};
+
+//
+// The synthetic platform
+//
+
+// Save every naturally aligned 8, 16 and 32 bit register of a block of
+// little-endian bytes.
+static void
+add_bytes(hwpp::SnapshotWriter *writer, const string &binding,
+          const uint8_t *bytes, size_t size)
+{
+	for (size_t addr = 0; addr < size; addr++) {
+		for (unsigned len = 1; len <= 4 && addr % len == 0; len *= 2) {
+			if (addr + len > size) {
+				break;
+			}
+			uint32_t val = 0;
+			for (unsigned i = 0; i < len; i++) {
+				val |= uint32_t(bytes[addr + i]) << (i * 8);
+			}
+			writer->add_register(binding, addr, len * 8, val);
+		}
+	}
+}
+
+static void
+put16(uint8_t *p, uint16_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+static void
+put32(uint8_t *p, uint32_t val)
+{
+	put16(p, val);
+	put16(p + 2, val >> 16);
+}
+
+// A PCI Express endpoint with power management, MSI and AER.  The IDs
+// are ones which no device definition claims, so the generic PCI code
+// does all the work.
+static void
+add_pci_function(hwpp::SnapshotWriter *writer, unsigned bus, unsigned dev)
+{
+	uint8_t cfg[4096];
+	memset(cfg, 0, sizeof(cfg));
+
+	put16(cfg + 0x00, 0x1d0f);		// vendor
+	put16(cfg + 0x02, 0xbe00 + dev);	// device
+	put16(cfg + 0x06, 0x0010);		// status: capability list
+	put32(cfg + 0x08, 0x02000001);		// class: ethernet, rev 1
+	put32(cfg + 0x10, 0xfe000000 + (bus << 16) + (dev << 12));
+	cfg[0x34] = 0x40;			// capability pointer
+	cfg[0x3c] = 0x0b;			// interrupt line
+	cfg[0x3d] = 0x01;			// interrupt pin
+
+	put16(cfg + 0x40, 0x5001);		// power management
+	put16(cfg + 0x42, 0x0003);
+	put16(cfg + 0x50, 0x7005);		// MSI
+	put16(cfg + 0x52, 0x0080);		// 64 bit
+	put16(cfg + 0x70, 0x0010);		// PCI Express
+	put16(cfg + 0x72, 0x0002);		// v2 endpoint
+	put32(cfg + 0x74, 0x00008fc2);
+	put32(cfg + 0x7c, 0x00437c43);		// link: x4 gen3
+	put16(cfg + 0x82, 0x1043);
+	put32(cfg + 0x100, 0x00010001);		// AER
+
+	add_bytes(writer, sprintfxx("pci<0,%d,%d,0>", bus, dev),
+	          cfg, sizeof(cfg));
+}
+
+// A 128 bit CPUID value, as EAX, EBX, ECX and EDX.
+static hwpp::Value
+cpuid_value(uint32_t eax, uint32_t ebx, uint32_t ecx, uint32_t edx)
+{
+	return (hwpp::Value(edx) << 96) | (hwpp::Value(ecx) << 64)
+	     | (hwpp::Value(ebx) << 32) | hwpp::Value(eax);
+}
+
+static void
+add_cpuid(hwpp::SnapshotWriter *writer, const string &name,
+          uint32_t function, uint32_t argument, const hwpp::Value &val)
+{
+	hwpp::Value address = (hwpp::Value(argument) << 32) | function;
+	writer->add_register(name, address, hwpp::BITS128, val);
+}
+
+// An Intel CPU with caches, topology and a full set of MTRRs.
+static void
+add_cpu(hwpp::SnapshotWriter *writer, unsigned cpu)
+{
+	string cpuid = sprintfxx("cpuid<%d>", cpu);
+
+	// "GenuineIntel", family 6 model 0x3c
+	add_cpuid(writer, cpuid, 0x0, 0,
+	          cpuid_value(0xb, 0x756e6547, 0x6c65746e, 0x49656e69));
+	add_cpuid(writer, cpuid, 0x1, 0,
+	          cpuid_value(0x000306c3, (cpu << 24) | 0x00100800,
+	                      0x7ffafbff, 0xbfebfbff));
+	add_cpuid(writer, cpuid, 0x2, 0,
+	          cpuid_value(0x76036301, 0x00f0b5ff, 0, 0x00c10000));
+	// data, instruction, L2 and L3 caches
+	static const uint32_t caches[] = {
+		0x1c004121, 0x1c004122, 0x1c004143, 0x1c03c163, 0
+	};
+	for (unsigned i = 0; i < sizeof(caches)/sizeof(caches[0]); i++) {
+		add_cpuid(writer, cpuid, 0x4, i,
+		          cpuid_value(caches[i], caches[i] ? 0x01c0003f : 0,
+		                      caches[i] ? 0x3f : 0, 0));
+	}
+	for (uint32_t fn = 0x5; fn <= 0xa; fn++) {
+		add_cpuid(writer, cpuid, fn, 0,
+		          cpuid_value(fn == 0xa ? 0x07300403 : 0x40,
+		                      0x40, 0x3, 0x00042120));
+	}
+	// SMT and core levels
+	add_cpuid(writer, cpuid, 0xb, 0,
+	          cpuid_value(0x1, 0x2, 0x100, cpu));
+	add_cpuid(writer, cpuid, 0xb, 1,
+	          cpuid_value(0x4, 0x8, 0x201, cpu));
+	add_cpuid(writer, cpuid, 0xb, 2, cpuid_value(0, 0, 0x2, cpu));
+
+	add_cpuid(writer, cpuid, 0x80000000, 0,
+	          cpuid_value(0x80000008, 0, 0, 0));
+	add_cpuid(writer, cpuid, 0x80000001, 0,
+	          cpuid_value(0, 0, 0x21, 0x2c100800));
+	for (uint32_t fn = 0x80000002; fn <= 0x80000004; fn++) {
+		// "Synthetic CPU" padded out with spaces
+		add_cpuid(writer, cpuid, fn, 0,
+		          cpuid_value(0x746e7953, 0x69746568, 0x50432063,
+		                      0x20202055));
+	}
+	for (uint32_t fn = 0x80000005; fn <= 0x80000008; fn++) {
+		add_cpuid(writer, cpuid, fn, 0,
+		          cpuid_value(fn == 0x80000008 ? 0x3027 : 0,
+		                      0, 0x01006040, 0));
+	}
+
+	// every MSR the generic definitions know about lives below 0x300
+	string msr = sprintfxx("msr<%d>", cpu);
+	for (unsigned addr = 0; addr < 0x300; addr++) {
+		uint64_t val = 0;
+		switch (addr) {
+		    case 0x1b:	// APIC_BASE
+			val = 0xfee00800ULL | (cpu == 0 ? 0x100 : 0);
+			break;
+		    case 0xfe:	// MTRRCap: 8 variable, fixed, WC
+			val = 0x508;
+			break;
+		    case 0x2ff:	// MTRRDefType: enabled, WB
+			val = 0xc06;
+			break;
+		    case 0x277:	// PAT
+			val = 0x0007040600070406ULL;
+			break;
+		    default:
+			val = (uint64_t(cpu) << 32) | addr;
+		}
+		writer->add_register(msr, addr, hwpp::BITS64, val);
+	}
+}
+
+static void
+write_platform(const string &filename, unsigned n_pci, unsigned n_cpus)
+{
+	hwpp::SnapshotWriter writer;
+	for (unsigned i = 0; i < n_pci; i++) {
+		add_pci_function(&writer, 1 + i / 32, i % 32);
+	}
+	for (unsigned i = 0; i < n_cpus; i++) {
+		add_cpu(&writer, i);
+	}
+	writer.write(filename);
+}
+
+//
+// The hwpp_read-style dump
+//
+
+// A stream buffer which counts and throws away what it is given, so the
+// cost of formatting is measured but not the cost of any output device.
+class CountingBuf: public std::streambuf
+{
+    public:
+	CountingBuf(): n_bytes(0) {}
+
+	uint64_t n_bytes;
+
+    protected:
+	virtual int_type
+	overflow(int_type c)
+	{
+		n_bytes++;
+		return traits_type::not_eof(c);
+	}
+	virtual std::streamsize
+	xsputn(const char *s, std::streamsize n)
+	{
+		(void)s;
+		n_bytes += n;
+		return n;
+	}
+};
+
+struct DumpStats {
+	uint64_t n_dirents;
+	uint64_t n_errors;
+};
+
+static void
+dump_dirent(std::ostream &out, const string &name,
+            const hwpp::ConstDirentPtr &de, DumpStats *stats);
+
+static void
+dump_scope(std::ostream &out, const string &name,
+           const hwpp::ConstScopePtr &scope, DumpStats *stats)
+{
+	out << name << "/";
+	if (scope->is_bound()) {
+		out << " (@" << *scope->binding() << ")";
+	}
+	out << "\n";
+
+	// this populates lazy scopes
+	for (size_t i = 0; i < scope->n_dirents(); i++) {
+		dump_dirent(out, name + "/" + scope->dirent_name(i),
+		            scope->dirent(i), stats);
+	}
+}
+
+static void
+dump_dirent(std::ostream &out, const string &name,
+            const hwpp::ConstDirentPtr &de, DumpStats *stats)
+{
+	stats->n_dirents++;
+	try {
+		if (de->is_field()) {
+			hwpp::ConstFieldPtr field = hwpp::field_from_dirent(de);
+			out << name << ": " << field->evaluate()
+			    << std::hex << " (0x" << field->read() << ")"
+			    << std::dec << "\n";
+		} else if (de->is_register()) {
+			hwpp::ConstRegisterPtr reg =
+			    hwpp::register_from_dirent(de);
+			out << name << ": " << std::hex << "0x" << reg->read()
+			    << std::dec << "\n";
+		} else if (de->is_scope()) {
+			dump_scope(out, name, hwpp::scope_from_dirent(de),
+			           stats);
+		} else if (de->is_array()) {
+			hwpp::ConstArrayPtr array = hwpp::array_from_dirent(de);
+			for (size_t i = 0; i < array->size(); i++) {
+				dump_dirent(out, sprintfxx("%s[%d]", name, i),
+				            array->at(i), stats);
+			}
+		} else if (de->is_alias()) {
+			hwpp::ConstAliasPtr alias = hwpp::alias_from_dirent(de);
+			out << name << ": ->" << alias->link_path() << "\n";
+		}
+	} catch (std::exception &e) {
+		// registers which the definitions read but the synthetic
+		// platform does not have
+		stats->n_errors++;
+	}
+}
+
+static unsigned
+env_count(const char *var, unsigned dflt)
+{
+	const char *val = getenv(var);
+	if (val && atoi(val) > 0) {
+		return atoi(val);
+	}
+	return dflt;
+}
+
+int
+main()
+{
+	unsigned n_pci = env_count("BENCH_PCI_FUNCS", 64);
+	unsigned n_cpus = env_count("BENCH_CPUS", 8);
+
+#if DEBUG
+	fprintf(stderr, "warning: benchmarks built with DEBUG=1\n");
+#endif
+	printf("platform: %u PCI functions, %u CPUs\n", n_pci, n_cpus);
+	fflush(stdout);
+
+	// Making the snapshot takes far more memory than using it, so it
+	// is done in a child process, to keep it out of the peak RSS.
+	string filename = filesystem::File::tempname(string(""));
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return EXIT_FAILURE;
+	}
+	if (pid == 0) {
+		{
+			Phase phase("write_snapshot");
+			write_platform(filename, n_pci, n_cpus);
+		}
+		_exit(EXIT_SUCCESS);
+	}
+	int status;
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+	 || WEXITSTATUS(status) != EXIT_SUCCESS) {
+		fprintf(stderr, "can't write the synthetic platform\n");
+		return EXIT_FAILURE;
+	}
+	{
+		Phase phase("open_snapshot");
+		hwpp::set_snapshot(hwpp::Snapshot::open(filename));
+	}
+	filesystem::File::unlink(filename);
+
+	hwpp::ScopePtr root;
+	{
+		Phase phase("initialize_device_tree");
+		root = hwpp::initialize_device_tree();
+	}
+	{
+		Phase phase("do_discovery");
+		hwpp::do_discovery();
+	}
+
+	CountingBuf buf;
+	std::ostream out(&buf);
+	DumpStats stats = { 0, 0 };
+	{
+		Phase phase("dump");
+		dump_scope(out, "", root, &stats);
+	}
+	printf("dumped %llu dirents, %llu bytes, %llu errors\n",
+	       (unsigned long long)stats.n_dirents,
+	       (unsigned long long)buf.n_bytes,
+	       (unsigned long long)stats.n_errors);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include "hwpp.h"
+#include "register_types.h"
+#include "regbits.h"
+#include "mem_binding.h"
+#include "util/bench.h"
+
+BENCH(bench_bound_register_read)
+{
+	hwpp::BindingPtr bind = new_mem_binding();
+	hwpp::RegisterPtr reg = new_hwpp_bound_register(bind, 4,
+	                                                 hwpp::BITS32);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		hwpp::Value v = reg->read();
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_bound_register_write)
+{
+	hwpp::BindingPtr bind = new_mem_binding();
+	hwpp::RegisterPtr reg = new_hwpp_bound_register(bind, 4,
+	                                                 hwpp::BITS32);
+	hwpp::Value v(0x12345678);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		reg->write(v);
+	}
+}
+
+BENCH(bench_regbits_simple_read)
+{
+	hwpp::BindingPtr bind = new_mem_binding();
+	hwpp::RegisterPtr reg = new_hwpp_bound_register(bind, 4,
+	                                                 hwpp::BITS32);
+	hwpp::RegBits rb(reg, 11, 4);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		hwpp::Value v = rb.read();
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_regbits_simple_write)
+{
+	hwpp::BindingPtr bind = new_mem_binding();
+	hwpp::RegisterPtr reg = new_hwpp_bound_register(bind, 4,
+	                                                 hwpp::BITS32);
+	hwpp::RegBits rb(reg, 11, 4);
+	hwpp::Value v(0x5a);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		rb.write(v);
+	}
+}
+
+// A field split over three registers, like a 64-bit BAR or an MSR pair.
+static hwpp::RegBits
+composite_regbits(const hwpp::BindingPtr &bind)
+{
+	hwpp::RegisterPtr r0 = new_hwpp_bound_register(bind, 0, hwpp::BITS32);
+	hwpp::RegisterPtr r1 = new_hwpp_bound_register(bind, 1, hwpp::BITS32);
+	hwpp::RegisterPtr r2 = new_hwpp_bound_register(bind, 2, hwpp::BITS16);
+	return hwpp::RegBits(r2, 7, 0)
+	     + hwpp::RegBits(r1, 31, 0)
+	     + hwpp::RegBits(r0, 31, 4);
+}
+
+BENCH(bench_regbits_composite_read)
+{
+	hwpp::BindingPtr bind = new_mem_binding();
+	hwpp::RegBits rb = composite_regbits(bind);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		hwpp::Value v = rb.read();
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_regbits_composite_write)
+{
+	hwpp::BindingPtr bind = new_mem_binding();
+	hwpp::RegBits rb = composite_regbits(bind);
+	hwpp::Value v = hwpp::MASK(rb.width()) / 3;
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		rb.write(v);
+	}
+}
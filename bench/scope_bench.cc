@@ -0,0 +1,99 @@
+#include "hwpp.h"
+#include "scope.h"
+#include "array.h"
+#include "field_types.h"
+#include "datatype_types.h"
+#include "path.h"
+#include "util/bench.h"
+
+// How many levels, and how many dirents at each level.
+static const int TREE_DEPTH = 8;
+static const int TREE_WIDTH = 32;
+
+// Build a tree in which each scope holds TREE_WIDTH fields, an array of
+// TREE_WIDTH scopes, and (above the bottom) a child scope "sub".
+static hwpp::ScopePtr
+build_tree()
+{
+	hwpp::DatatypePtr dt = new_hwpp_int_datatype();
+	hwpp::ScopePtr root = new_hwpp_scope();
+	hwpp::ScopePtr scope = root;
+	for (int depth = 0; depth < TREE_DEPTH; depth++) {
+		for (int i = 0; i < TREE_WIDTH; i++) {
+			scope->add_dirent(sprintfxx("field%d", i),
+			                  new_hwpp_constant_field(dt, i));
+		}
+		hwpp::ArrayPtr array = new_hwpp_array(hwpp::DIRENT_TYPE_SCOPE);
+		for (int i = 0; i < TREE_WIDTH; i++) {
+			hwpp::ScopePtr elem = new_hwpp_scope();
+			elem->set_parent(scope);
+			elem->add_dirent("value",
+			                 new_hwpp_constant_field(dt, i));
+			array->append(elem);
+		}
+		scope->add_dirent("array", array);
+
+		hwpp::ScopePtr sub = new_hwpp_scope();
+		sub->set_parent(scope);
+		scope->add_dirent("sub", sub);
+		scope = sub;
+	}
+	return root;
+}
+
+static string
+deep_path(const string &leaf)
+{
+	string path;
+	for (int depth = 0; depth < TREE_DEPTH - 1; depth++) {
+		path += "sub/";
+	}
+	return path + leaf;
+}
+
+static void
+bench_lookup(const hwpp::Path &path, uint64_t n)
+{
+	hwpp::ScopePtr root = build_tree();
+	if (root->lookup_dirent(path) == NULL) {
+		fprintf(stderr, "%s: not found\n", path.to_string().c_str());
+		exit(EXIT_FAILURE);
+	}
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < n; i++) {
+		hwpp::ConstDirentPtr de = root->lookup_dirent(path);
+		BENCH_KEEP(de);
+	}
+}
+
+BENCH(bench_lookup_shallow)
+{
+	bench_lookup(hwpp::Path("field31"), BENCH_N);
+}
+
+BENCH(bench_lookup_deep)
+{
+	bench_lookup(hwpp::Path(deep_path("field31")), BENCH_N);
+}
+
+BENCH(bench_lookup_array)
+{
+	bench_lookup(hwpp::Path("array[17]/value"), BENCH_N);
+}
+
+BENCH(bench_lookup_deep_array)
+{
+	bench_lookup(hwpp::Path(deep_path("array[17]/value")), BENCH_N);
+}
+
+BENCH(bench_lookup_string)
+{
+	// the common case in tools: a string converted on every call
+	hwpp::ScopePtr root = build_tree();
+	string path = deep_path("field31");
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		hwpp::ConstDirentPtr de = root->lookup_dirent(path);
+		BENCH_KEEP(de);
+	}
+}
@@ -0,0 +1,292 @@
+//
+// I/O statistics for bindings.
+//
+#include "binding_stats.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "hwpp.h"
+#include "util/printfxx.h"
+
+namespace hwpp {
+
+//
+// LatencyHistogram
+//
+
+void
+LatencyHistogram::reset()
+{
+	for (unsigned i = 0; i < N_BUCKETS; i++) {
+		m_buckets[i] = 0;
+	}
+	m_total_nsecs = 0;
+}
+
+uint64_t
+LatencyHistogram::count() const
+{
+	uint64_t n = 0;
+	for (unsigned i = 0; i < N_BUCKETS; i++) {
+		n += m_buckets[i];
+	}
+	return n;
+}
+
+uint64_t
+LatencyHistogram::percentile(double percent) const
+{
+	uint64_t total = count();
+	if (total == 0) {
+		return 0;
+	}
+	// The rank of the sample we want, counting from 1.
+	uint64_t rank = (uint64_t)(total * percent / 100.0 + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < N_BUCKETS; i++) {
+		seen += m_buckets[i];
+		if (seen >= rank) {
+			return bucket_max(i);
+		}
+	}
+	// Only reachable if samples arrived while we were looking.
+	return bucket_max(N_BUCKETS - 1);
+}
+
+unsigned
+LatencyHistogram::bucket_of(uint64_t value)
+{
+	if (value < SUB_BUCKETS) {
+		return value;
+	}
+	unsigned msb = 63 - __builtin_clzll(value);
+	unsigned shift = msb - SUB_BUCKET_BITS;
+	unsigned sub = (value >> shift) & (SUB_BUCKETS - 1);
+	return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t
+LatencyHistogram::bucket_min(unsigned bucket)
+{
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+	unsigned shift = bucket / SUB_BUCKETS - 1;
+	uint64_t sub = bucket % SUB_BUCKETS;
+	return (SUB_BUCKETS + sub) << shift;
+}
+
+uint64_t
+LatencyHistogram::bucket_max(unsigned bucket)
+{
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+	unsigned shift = bucket / SUB_BUCKETS - 1;
+	return bucket_min(bucket) + ((1ULL << shift) - 1);
+}
+
+//
+// BindingStats
+//
+
+void
+BindingStats::reset()
+{
+	for (unsigned op = 0; op < N_OPS; op++) {
+		for (unsigned w = 0; w < N_WIDTHS; w++) {
+			m_counters[op][w].errors = 0;
+			m_counters[op][w].latency.reset();
+		}
+	}
+}
+
+uint64_t
+BindingStats::count(Op op) const
+{
+	uint64_t n = 0;
+	for (unsigned w = 0; w < N_WIDTHS; w++) {
+		n += m_counters[op][w].latency.count();
+	}
+	return n;
+}
+
+uint64_t
+BindingStats::errors(Op op) const
+{
+	uint64_t n = 0;
+	for (unsigned w = 0; w < N_WIDTHS; w++) {
+		n += m_counters[op][w].errors;
+	}
+	return n;
+}
+
+uint64_t
+BindingStats::total_nsecs() const
+{
+	uint64_t n = 0;
+	for (unsigned op = 0; op < N_OPS; op++) {
+		for (unsigned w = 0; w < N_WIDTHS; w++) {
+			n += m_counters[op][w].latency.total_nsecs();
+		}
+	}
+	return n;
+}
+
+// The widths that width_index() maps to, with 0 for "anything else".
+static const BitWidth stats_widths[BindingStats::N_WIDTHS] = {
+	BITS8, BITS16, BITS32, BITS64, BITS0
+};
+
+unsigned
+BindingStats::width_index(BitWidth width)
+{
+	for (unsigned i = 0; i < N_WIDTHS - 1; i++) {
+		if (stats_widths[i] == width) {
+			return i;
+		}
+	}
+	return N_WIDTHS - 1;
+}
+
+void
+BindingStats::dump(std::ostream &out) const
+{
+	static const char *op_names[N_OPS] = { "read", "write" };
+
+	for (unsigned op = 0; op < N_OPS; op++) {
+		for (unsigned w = 0; w < N_WIDTHS; w++) {
+			const Counters &c = m_counters[op][w];
+			uint64_t n = c.latency.count();
+			if (n == 0) {
+				continue;
+			}
+			string width = stats_widths[w]
+			             ? printfxx::sprintfxx("%d", stats_widths[w])
+			             : string("other");
+			out << printfxx::sprintfxx(
+			    "%s %s%s: count=%d errors=%d"
+			    " mean=%dns p50=%dns p90=%dns p99=%dns max=%dns\n",
+			    m_name, op_names[op], width, n, c.errors,
+			    c.latency.total_nsecs() / n,
+			    c.latency.percentile(50),
+			    c.latency.percentile(90),
+			    c.latency.percentile(99),
+			    c.latency.percentile(100));
+		}
+	}
+}
+
+//
+// StatsBinding
+//
+
+static uint64_t
+now_nsecs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+Value
+StatsBinding::read(const Value &address, const BitWidth width) const
+{
+	uint64_t start = now_nsecs();
+	try {
+		Value ret = m_binding->read(address, width);
+		m_stats->record(BindingStats::OP_READ, width,
+		                now_nsecs() - start, false);
+		return ret;
+	} catch (...) {
+		m_stats->record(BindingStats::OP_READ, width,
+		                now_nsecs() - start, true);
+		throw;
+	}
+}
+
+void
+StatsBinding::write(const Value &address, const BitWidth width,
+    const Value &value) const
+{
+	uint64_t start = now_nsecs();
+	try {
+		m_binding->write(address, width, value);
+		m_stats->record(BindingStats::OP_WRITE, width,
+		                now_nsecs() - start, false);
+	} catch (...) {
+		m_stats->record(BindingStats::OP_WRITE, width,
+		                now_nsecs() - start, true);
+		throw;
+	}
+}
+
+//
+// The registry of stats
+//
+
+typedef std::map<string, BindingStatsPtr> StatsMap;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// this avoids the static initialization order fiasco
+static StatsMap &
+stats_map()
+{
+	static StatsMap the_stats_map;
+	return the_stats_map;
+}
+
+BindingPtr
+new_stats_binding(const BindingPtr &binding)
+{
+	const string name = binding->to_string();
+
+	pthread_mutex_lock(&stats_lock);
+	BindingStatsPtr &stats = stats_map()[name];
+	if (!stats) {
+		stats.reset(new BindingStats(name));
+	}
+	BindingStatsPtr found = stats;
+	pthread_mutex_unlock(&stats_lock);
+
+	return BindingPtr(new StatsBinding(binding, found));
+}
+
+std::vector<ConstBindingStatsPtr>
+all_binding_stats()
+{
+	std::vector<ConstBindingStatsPtr> ret;
+	pthread_mutex_lock(&stats_lock);
+	StatsMap::const_iterator it;
+	for (it = stats_map().begin(); it != stats_map().end(); ++it) {
+		ret.push_back(it->second);
+	}
+	pthread_mutex_unlock(&stats_lock);
+	return ret;
+}
+
+static bool
+busier(const ConstBindingStatsPtr &lhs, const ConstBindingStatsPtr &rhs)
+{
+	return lhs->total_nsecs() > rhs->total_nsecs();
+}
+
+void
+dump_binding_stats(std::ostream &out)
+{
+	std::vector<ConstBindingStatsPtr> stats = all_binding_stats();
+	std::stable_sort(stats.begin(), stats.end(), busier);
+	for (size_t i = 0; i < stats.size(); i++) {
+		stats[i]->dump(out);
+	}
+}
+
+}  // namespace hwpp
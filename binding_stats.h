@@ -0,0 +1,253 @@
+#ifndef HWPP_BINDING_STATS_H__
+#define HWPP_BINDING_STATS_H__
+
+#include "hwpp.h"
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+#include "binding.h"
+
+namespace hwpp {
+
+/*
+ * LatencyHistogram - a log-linear histogram of durations, in nanoseconds.
+ *
+ * Each power of two is split into SUB_BUCKETS equal buckets, so a value is
+ * never off by more than 1/SUB_BUCKETS of itself.  Values below
+ * SUB_BUCKETS get a bucket each.  Recording is an atomic add, so threads
+ * can share a histogram without locking.  Reads are not synchronized with
+ * writes, so a histogram read while it is being written may be a few
+ * samples behind.
+ */
+class LatencyHistogram
+{
+    public:
+	static const unsigned SUB_BUCKET_BITS = 2;
+	static const unsigned SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const unsigned N_BUCKETS = (64 - SUB_BUCKET_BITS + 1)
+	                                  * SUB_BUCKETS;
+
+	LatencyHistogram()
+	{
+		reset();
+	}
+
+	/* add one sample */
+	void
+	record(uint64_t nsecs)
+	{
+		__sync_fetch_and_add(&m_buckets[bucket_of(nsecs)], 1);
+		__sync_fetch_and_add(&m_total_nsecs, nsecs);
+	}
+
+	/* forget all samples */
+	void
+	reset();
+
+	/* the number of samples */
+	uint64_t
+	count() const;
+
+	/* the sum of all samples */
+	uint64_t
+	total_nsecs() const
+	{
+		return m_total_nsecs;
+	}
+
+	/* the number of samples in a bucket */
+	uint64_t
+	bucket_count(unsigned bucket) const
+	{
+		return m_buckets[bucket];
+	}
+
+	/*
+	 * Get the smallest value which is greater than or equal to
+	 * 'percent' percent of the samples, rounded up to the top of its
+	 * bucket.  Returns 0 if there are no samples.
+	 */
+	uint64_t
+	percentile(double percent) const;
+
+	/* find the bucket for a value */
+	static unsigned
+	bucket_of(uint64_t value);
+
+	/* the range of values in a bucket, inclusive */
+	static uint64_t
+	bucket_min(unsigned bucket);
+	static uint64_t
+	bucket_max(unsigned bucket);
+
+    private:
+	uint64_t m_buckets[N_BUCKETS];
+	uint64_t m_total_nsecs;
+};
+
+/*
+ * BindingStats - counters and latencies for the I/O through one binding.
+ *
+ * Reads and writes are kept apart, and each is broken down by access
+ * width.  Accesses which throw are counted as errors, and their latency
+ * is recorded too.
+ */
+class BindingStats;
+typedef boost::shared_ptr<BindingStats> BindingStatsPtr;
+typedef boost::shared_ptr<const BindingStats> ConstBindingStatsPtr;
+
+class BindingStats
+{
+    public:
+	enum Op {
+		OP_READ,
+		OP_WRITE,
+		N_OPS
+	};
+
+	/* accesses of 8, 16, 32 and 64 bits, and anything else */
+	static const unsigned N_WIDTHS = 5;
+
+	explicit BindingStats(const string &name)
+	    : m_name(name)
+	{
+		reset();
+	}
+
+	/* the name of the binding, from Binding::to_string() */
+	const string &
+	name() const
+	{
+		return m_name;
+	}
+
+	/* add one access */
+	void
+	record(Op op, BitWidth width, uint64_t nsecs, bool failed)
+	{
+		Counters &c = m_counters[op][width_index(width)];
+		c.latency.record(nsecs);
+		if (failed) {
+			__sync_fetch_and_add(&c.errors, 1);
+		}
+	}
+
+	/* forget all accesses */
+	void
+	reset();
+
+	/* the number of accesses, in total or of one width */
+	uint64_t
+	count(Op op) const;
+	uint64_t
+	count(Op op, BitWidth width) const
+	{
+		return m_counters[op][width_index(width)].latency.count();
+	}
+
+	/* the number of accesses which failed */
+	uint64_t
+	errors(Op op) const;
+	uint64_t
+	errors(Op op, BitWidth width) const
+	{
+		return m_counters[op][width_index(width)].errors;
+	}
+
+	/* the time spent in accesses, in nanoseconds */
+	uint64_t
+	total_nsecs() const;
+
+	/* the latencies of accesses of one width */
+	const LatencyHistogram &
+	latency(Op op, BitWidth width) const
+	{
+		return m_counters[op][width_index(width)].latency;
+	}
+
+	/* print one line per op and width which saw any accesses */
+	void
+	dump(std::ostream &out) const;
+
+    private:
+	struct Counters {
+		uint64_t errors;
+		LatencyHistogram latency;
+	};
+
+	static unsigned
+	width_index(BitWidth width);
+
+	string m_name;
+	Counters m_counters[N_OPS][N_WIDTHS];
+};
+
+/*
+ * StatsBinding - a decorator which records the I/O through another binding.
+ *
+ * This works around any Binding, such as a SimpleBinding<Tio,Taddress>.
+ * It passes everything through unchanged, including to_string(), so it
+ * can be used anywhere the binding it wraps could be.
+ */
+class StatsBinding: public Binding
+{
+    public:
+	explicit StatsBinding(const BindingPtr &binding)
+	    : m_binding(binding),
+	      m_stats(new BindingStats(binding->to_string()))
+	{
+	}
+	StatsBinding(const BindingPtr &binding, const BindingStatsPtr &stats)
+	    : m_binding(binding), m_stats(stats)
+	{
+	}
+
+	virtual Value
+	read(const Value &address, const BitWidth width) const;
+
+	virtual void
+	write(const Value &address, const BitWidth width,
+	    const Value &value) const;
+
+	virtual string
+	to_string() const
+	{
+		return m_binding->to_string();
+	}
+
+	const BindingPtr &
+	binding() const
+	{
+		return m_binding;
+	}
+
+	const ConstBindingStatsPtr
+	stats() const
+	{
+		return m_stats;
+	}
+
+    private:
+	BindingPtr m_binding;
+	BindingStatsPtr m_stats;
+};
+
+// Wrap a binding in a StatsBinding, and remember its stats so they can
+// be found by all_binding_stats().  Bindings with the same name share
+// their stats.
+extern BindingPtr
+new_stats_binding(const BindingPtr &binding);
+
+// Get the stats of every binding made by new_stats_binding(), sorted
+// by name.
+extern std::vector<ConstBindingStatsPtr>
+all_binding_stats();
+
+// Print the stats of every binding made by new_stats_binding(), the
+// busiest first.
+extern void
+dump_binding_stats(std::ostream &out);
+
+}  // namespace hwpp
+
+#endif // HWPP_BINDING_STATS_H__
@@ -2,59 +2,26 @@
 #ifndef HWPP_DEBUG_H__
 #define HWPP_DEBUG_H__
 
-#if DEBUG
-
-#include <iostream>
-
-#define DTRACE(condition, message) do { \
-	if (condition) { \
-		std::cerr \
-		  << "DBG: " \
-		  << message \
-		  << std::endl; \
+#include <sstream>
+#include "trace.h"
+
+// Record a trace event if all of the TRACE_* categories in 'categories'
+// are on.  The message is anything which can be written to a stream, and
+// is not evaluated unless the event is recorded.  See trace.h.
+#define DTRACE(categories, message) do { \
+	if (::hwpp::trace::enabled(categories)) { \
+		std::ostringstream dtrace_oss; \
+		dtrace_oss << message; \
+		::hwpp::trace::record_instant(categories, dtrace_oss.str()); \
 	} \
 } while (0)
 
-// trace dirents?
-#ifndef TRACE_DIRENTS
-#  define TRACE_DIRENTS 0
-#endif
-// trace register creation?
-#ifndef TRACE_REGS
-#  define TRACE_REGS 0
-#endif
-// trace field creation?
-#ifndef TRACE_FIELDS
-#  define TRACE_FIELDS 0
-#endif
-#ifndef TRACE_FIELD_BITS
-#  define TRACE_FIELD_BITS 0
-#endif
-// trace scope creation?
-#ifndef TRACE_SCOPES
-#  define TRACE_SCOPES 0
-#endif
-// trace datatype creation?
-#ifndef TRACE_TYPES
-#  define TRACE_TYPES 0
-#endif
-// trace driver utils?
-#ifndef TRACE_DRIVER_UTILS
-#  define TRACE_DRIVER_UTILS 0
-#endif
-// trace driver utils?
-#ifndef TRACE_DISCOVERY
-#  define TRACE_DISCOVERY 0
-#endif
-// trace object lifetimes?
-#ifndef TRACE_LIFETIMES
-#  define TRACE_LIFETIMES 0
-#endif
-
-#else // !DEBUG
-
-#define DTRACE(condition, message)
-
-#endif // DEBUG
+// Record how long the rest of the enclosing block takes, if all of the
+// TRACE_* categories in 'categories' are on.  The name must be a string
+// literal.
+#define DTRACE_SPAN(categories, name) \
+	::hwpp::trace::Span DTRACE_SPAN_VAR(__LINE__)(categories, name)
+#define DTRACE_SPAN_VAR(line) DTRACE_SPAN_VAR2(line)
+#define DTRACE_SPAN_VAR2(line) dtrace_span_ ## line
 
 #endif // HWPP_DEBUG_H__
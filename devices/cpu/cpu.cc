@@ -1,5 +1,6 @@
 #include "hwpp.h"
 #include <vector>
+#include <boost/bind.hpp>
 #include "fake_language.h"
 #include "devices/cpuid/generic_device.h"
 #include "devices/msr/generic_device.h"
@@ -8,20 +9,23 @@ namespace hwpp {
 namespace device {
 
 static void
-cpu_discovered(const std::vector<Value> &args)
+cpu_device(const Value &cpu)
 {
-	Value cpu = args[0];
-
-	OPEN_SCOPE("cpu." + to_string(cpu));
 	BOOKMARK("cpu");
 
-		CPUID_SCOPE("cpuid", cpu);
-		CLOSE_SCOPE();
-
-		MSR_SCOPE("msr", cpu);
-		CLOSE_SCOPE();
+	CPUID_SCOPE("cpuid", cpu);
+	CLOSE_SCOPE();
 
+	MSR_SCOPE("msr", cpu);
 	CLOSE_SCOPE();
+}
+
+static void
+cpu_discovered(const std::vector<Value> &args)
+{
+	Value cpu = args[0];
+
+	LAZY_SCOPE("cpu." + to_string(cpu), boost::bind(cpu_device, cpu));
 	ALIAS("cpu[]", "cpu." + to_string(cpu));
 }
 
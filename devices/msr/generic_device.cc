@@ -5,12 +5,10 @@
 namespace hwpp {
 namespace device {
 
-// populate the current scope with generic MSR device fields
+// the generic MSR fields which come before the MTRRs
 static void
-msr_generic_device()
+msr_generic_static()
 {
-	BOOKMARK("msr");
-
 	/* timestamp counter */
 	FIELD("TSC", "hex64_t", REG64(0x10));
 
@@ -28,10 +26,12 @@ msr_generic_device()
 	CLOSE_SCOPE(); // apic
 
 	FIELD("PATCH_LEVEL", "hex64_t", REG64(0x8b));
+}
 
-	//FIXME: need to wrap this with a CPUID check for MTRR capability
-	OPEN_SCOPE("mtrr");
-
+// the fixed MTRRs
+static void
+msr_mtrr_static()
+{
 	REG64("%MTRRCap", 0xfe);
 	FIELD("MtrrCapFix", "yesno_t", BITS("%MTRRCap", 8));
 	FIELD("MtrrCapVCnt", "int_t", BITS("%MTRRCap", 7, 0));
@@ -243,6 +243,34 @@ msr_generic_device()
 			BITS("%MTRRFix4K_F8000", 63, 56));
 
 	CLOSE_SCOPE(); // fixed
+}
+
+// the SYSENTER MSRs
+static void
+msr_sysenter_static()
+{
+	REG64("%SYSENTER_CS", 0x174);
+	REG64("%SYSENTER_ESP", 0x175);
+	REG64("%SYSENTER_EIP", 0x176);
+
+	FIELD("SYSENTER_CS", "hex16_t", BITS("%SYSENTER_CS", 15, 0));
+	FIELD("SYSENTER_ESP", "addr32_t", BITS("%SYSENTER_ESP", 31, 0));
+	FIELD("SYSENTER_EIP", "addr32_t", BITS("%SYSENTER_EIP", 31, 0));
+}
+
+// populate the current scope with generic MSR device fields
+static void
+msr_generic_device()
+{
+	BOOKMARK("msr");
+
+	// the parts which do not depend on the CPU are shared by all CPUs
+	TEMPLATE("msr.generic", msr_generic_static);
+
+	//FIXME: need to wrap this with a CPUID check for MTRR capability
+	OPEN_SCOPE("mtrr");
+
+	TEMPLATE("msr.mtrr", msr_mtrr_static);
 
 	for (int i = 0; i < READ("MtrrCapVCnt"); i++) {
 		OPEN_SCOPE("variable[]");
@@ -264,13 +292,7 @@ msr_generic_device()
 
 	OPEN_SCOPE("sysenter");
 
-	REG64("%SYSENTER_CS", 0x174);
-	REG64("%SYSENTER_ESP", 0x175);
-	REG64("%SYSENTER_EIP", 0x176);
-
-	FIELD("SYSENTER_CS", "hex16_t", BITS("%SYSENTER_CS", 15, 0));
-	FIELD("SYSENTER_ESP", "addr32_t", BITS("%SYSENTER_ESP", 31, 0));
-	FIELD("SYSENTER_EIP", "addr32_t", BITS("%SYSENTER_EIP", 31, 0));
+	TEMPLATE("msr.sysenter", msr_sysenter_static);
 
 	CLOSE_SCOPE(); // sysenter
 
@@ -1601,23 +1601,19 @@ create_device()
 	FIELD("maxlat", ANON_INT("1/4 usecs"), REG8(0x3f));
 }
 
-/* populate the current scope with generic PCI device fields */
+// the raw config space registers
 static void
-pci_generic_device()
+pci_config_regs(unsigned size)
 {
-	BOOKMARK("pci");
-
-	// all PCI devices have a 256 Byte config space
-	for (unsigned i = 0; i < 256; i += 4) {
+	for (unsigned i = 0; i < size; i += 4) {
 		REG32(to_string(boost::format("%%PCI.%03x") %i), i);
 	}
-	// if 0x100 is not FFFFFFFF, we have a 4 KByte config space
-	if (READ(REG32(0x100)) != 0xffffffff) {
-		for (unsigned i = 256; i < 4096; i += 4) {
-			REG32(to_string(boost::format("%%PCI.%03x") %i), i);
-		}
-	}
+}
 
+// the fields of the standard header which every device has
+static void
+pci_header_common()
+{
 	FIELD("vendor", "pci_vendor_t", REG16(0x00));
 	FIELD("device", "hex16_t", REG16(0x02));
 
@@ -1657,6 +1653,38 @@ pci_generic_device()
 	CLOSE_SCOPE();
 
 	FIELD("class", "pci_class_t", REG8(0x0b));
+}
+
+// all PCI devices have a 256 Byte config space
+static void
+pci_header()
+{
+	pci_config_regs(256);
+	pci_header_common();
+}
+
+// some have a 4 KByte config space
+static void
+pci_header_4k()
+{
+	pci_config_regs(4096);
+	pci_header_common();
+}
+
+/* populate the current scope with generic PCI device fields */
+static void
+pci_generic_device()
+{
+	BOOKMARK("pci");
+
+	// The standard header does not depend on the device, so all devices
+	// with the same size of config space share one template of it.  If
+	// 0x100 is not FFFFFFFF, we have a 4 KByte config space.
+	if (READ(REG32(0x100)) != 0xffffffff) {
+		TEMPLATE("pci.header.4k", pci_header_4k);
+	} else {
+		TEMPLATE("pci.header", pci_header);
+	}
 
 	//FIXME: figure the best way to use the types in pci.c
 	if (FIELD_EQ("class", "pre_classcode")) {
@@ -1758,5 +1786,13 @@ PCI_SCOPE(const string &name, const Value &seg, const Value &bus,
 	pci_generic_device();
 }
 
+void
+PCI_LAZY_SCOPE(const string &name, const Value &seg, const Value &bus,
+		const Value &dev, const Value &func)
+{
+	LAZY_SCOPE(name, BIND("pci", ARGS(seg, bus, dev, func)),
+	           pci_generic_device);
+}
+
 }  // namespace device
 }  // namespace hwpp
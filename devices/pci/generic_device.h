@@ -8,6 +8,12 @@ extern void
 PCI_SCOPE(const string &name, const Value &seg, const Value &bus,
     const Value &dev, const Value &func);
 
+// Like PCI_SCOPE(), but the device is not built until it is accessed,
+// and the current scope is not changed.
+extern void
+PCI_LAZY_SCOPE(const string &name, const Value &seg, const Value &bus,
+    const Value &dev, const Value &func);
+
 }  // namespace device
 }  // namespace hwpp
 
@@ -157,8 +157,7 @@ pci_discovered(const std::vector<Value> &args)
 	Value func = args[3];
 
 	string name = sprintfxx("pci.%d.%d.%d.%d", seg, bus, dev, func);
-	PCI_SCOPE(name, seg, bus, dev, func);
-	CLOSE_SCOPE();
+	PCI_LAZY_SCOPE(name, seg, bus, dev, func);
 }
 
 class PciDiscovery
@@ -0,0 +1,234 @@
+//
+// Compare register values from two sources, and decode what changed.
+//
+#include "hwpp.h"
+#include "diff.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "field_index.h"
+#include "regbits.h"
+#include "driver.h"
+
+namespace hwpp {
+
+//
+// Sources.
+//
+
+void
+SnapshotDiffSource::registers(std::set<RegisterKey> *out) const
+{
+	for (size_t b = 0; b < m_snapshot->n_bindings(); b++) {
+		string name = m_snapshot->binding_name(b);
+		for (size_t i = 0; i < m_snapshot->n_registers(b); i++) {
+			out->insert(RegisterKey(name,
+			    m_snapshot->register_address(b, i).as_uint(),
+			    m_snapshot->register_width(b, i)));
+		}
+	}
+}
+
+bool
+SnapshotDiffSource::read(const RegisterKey &key, Value *result) const
+{
+	int b = m_snapshot->find_binding(key.binding);
+	if (b < 0) {
+		return false;
+	}
+	return m_snapshot->read(b, Value(key.address), key.width, result);
+}
+
+LiveDiffSource::LiveDiffSource(const ConstScopePtr &root)
+{
+	init(FieldIndex(root));
+}
+
+LiveDiffSource::LiveDiffSource(const FieldIndex &index)
+{
+	init(index);
+}
+
+void
+LiveDiffSource::init(const FieldIndex &index)
+{
+	const std::map<RegisterKey, ConstRegisterPtr> &regs =
+	    index.registers();
+	std::map<RegisterKey, ConstRegisterPtr>::const_iterator it;
+	for (it = regs.begin(); it != regs.end(); it++) {
+		Entry &entry = m_registers[it->first];
+		entry.reg = it->second;
+		entry.done = false;
+		entry.valid = false;
+	}
+}
+
+void
+LiveDiffSource::registers(std::set<RegisterKey> *out) const
+{
+	std::map<RegisterKey, Entry>::const_iterator it;
+	for (it = m_registers.begin(); it != m_registers.end(); it++) {
+		out->insert(it->first);
+	}
+}
+
+bool
+LiveDiffSource::read(const RegisterKey &key, Value *result) const
+{
+	std::map<RegisterKey, Entry>::const_iterator it =
+	    m_registers.find(key);
+	if (it == m_registers.end()) {
+		return false;
+	}
+	const Entry &entry = it->second;
+	if (!entry.done) {
+		entry.done = true;
+		try {
+			entry.value = entry.reg->read();
+			entry.valid = true;
+		} catch (Driver::IoError &e) {
+			entry.valid = false;
+		}
+	}
+	if (entry.valid) {
+		*result = entry.value;
+	}
+	return entry.valid;
+}
+
+//
+// The diff itself.
+//
+
+// Register values read so far from one source, so each is read once.
+class DiffCache
+{
+    public:
+	explicit DiffCache(const DiffSource &source): m_source(source)
+	{
+	}
+
+	bool
+	read(const RegisterKey &key, Value *result)
+	{
+		std::map<RegisterKey, Slot>::iterator it = m_slots.find(key);
+		if (it == m_slots.end()) {
+			Slot &slot = m_slots[key];
+			slot.valid = m_source.read(key, &slot.value);
+			it = m_slots.find(key);
+		}
+		if (it->second.valid) {
+			*result = it->second.value;
+		}
+		return it->second.valid;
+	}
+
+    private:
+	struct Slot {
+		bool valid;
+		Value value;
+	};
+	const DiffSource &m_source;
+	std::map<RegisterKey, Slot> m_slots;
+};
+
+// Put a field's raw value back together from its register ranges, the
+// same way RegBits::read() does.
+static bool
+diff_decode(const FieldIndex::Entry &df, DiffCache *cache, Value *result)
+{
+	Value value = 0;
+	for (size_t i = 0; i < df.ranges.size(); i++) {
+		const RegBits::Range &range = df.ranges[i];
+		Value reg;
+		if (!cache->read(df.keys[i], &reg)) {
+			return false;
+		}
+		BitWidth width = range.hi_bit - range.lo_bit + 1;
+		value <<= width;
+		reg >>= range.lo_bit;
+		reg &= MASK(width);
+		value |= reg;
+	}
+	*result = value;
+	return true;
+}
+
+void
+diff_tree(const ConstScopePtr &root, const DiffSource &before,
+    const DiffSource &after, TreeDiff *result)
+{
+	diff_tree(FieldIndex(root), before, after, result);
+}
+
+void
+diff_tree(const FieldIndex &index, const DiffSource &before,
+    const DiffSource &after, TreeDiff *result)
+{
+	std::set<RegisterKey> keys;
+	before.registers(&keys);
+	after.registers(&keys);
+
+	DiffCache old_cache(before);
+	DiffCache new_cache(after);
+
+	// compare every register, and note which fields they dirty
+	std::map<RegisterKey, Value> changes;
+	std::set<RegisterKey>::const_iterator it;
+	for (it = keys.begin(); it != keys.end(); it++) {
+		RegisterChange rc;
+		rc.key = *it;
+		rc.old_valid = old_cache.read(*it, &rc.old_value);
+		rc.new_valid = new_cache.read(*it, &rc.new_value);
+		if (rc.old_valid && rc.new_valid) {
+			if (rc.old_value == rc.new_value) {
+				continue;
+			}
+			rc.changed_bits = rc.old_value ^ rc.new_value;
+		} else if (!rc.old_valid && !rc.new_valid) {
+			continue;
+		} else {
+			rc.changed_bits = MASK(it->width);
+		}
+		if (!rc.old_valid) {
+			rc.old_value = 0;
+		}
+		if (!rc.new_valid) {
+			rc.new_value = 0;
+		}
+		result->registers.push_back(rc);
+		changes[*it] = rc.changed_bits;
+	}
+
+	// decode only the fields that may have changed
+	std::vector<size_t> dirty;
+	index.affected_fields(changes, &dirty);
+	for (size_t i = 0; i < dirty.size(); i++) {
+		const FieldIndex::Entry &df = index.field(dirty[i]);
+		FieldChange fc;
+		fc.path = df.path;
+		fc.old_valid = diff_decode(df, &old_cache, &fc.old_value);
+		fc.new_valid = diff_decode(df, &new_cache, &fc.new_value);
+		if (fc.old_valid == fc.new_valid
+		 && (!fc.old_valid || fc.old_value == fc.new_value)) {
+			continue;
+		}
+		if (fc.old_valid) {
+			fc.old_string = df.field->datatype()->evaluate(
+			    fc.old_value);
+		} else {
+			fc.old_value = 0;
+		}
+		if (fc.new_valid) {
+			fc.new_string = df.field->datatype()->evaluate(
+			    fc.new_value);
+		} else {
+			fc.new_value = 0;
+		}
+		result->fields.push_back(fc);
+	}
+}
+
+}  // namespace hwpp
@@ -0,0 +1,162 @@
+#ifndef HWPP_DIFF_H__
+#define HWPP_DIFF_H__
+
+#include "hwpp.h"
+#include <map>
+#include <set>
+#include <vector>
+#include "scope.h"
+#include "snapshot.h"
+#include "field_index.h"
+
+namespace hwpp {
+
+/*
+ * DiffSource - a place to get raw register values from, for a diff.
+ */
+class DiffSource
+{
+    public:
+	virtual ~DiffSource()
+	{
+	}
+
+	/*
+	 * DiffSource::registers(out)
+	 *
+	 * Add the keys of all registers this source has values for to
+	 * 'out'.
+	 */
+	virtual void
+	registers(std::set<RegisterKey> *out) const = 0;
+
+	/*
+	 * DiffSource::read(key, result)
+	 *
+	 * Read the raw value of a register.
+	 *
+	 * Returns: false if the register is not known to this source, or
+	 * can not be read.
+	 */
+	virtual bool
+	read(const RegisterKey &key, Value *result) const = 0;
+};
+
+/*
+ * SnapshotDiffSource - serve register values from a snapshot.
+ */
+class SnapshotDiffSource: public DiffSource
+{
+    public:
+	explicit SnapshotDiffSource(const ConstSnapshotPtr &snapshot)
+	    : m_snapshot(snapshot)
+	{
+	}
+
+	virtual void
+	registers(std::set<RegisterKey> *out) const;
+	virtual bool
+	read(const RegisterKey &key, Value *result) const;
+
+    private:
+	ConstSnapshotPtr m_snapshot;
+};
+
+/*
+ * LiveDiffSource - serve register values by reading the registers of a
+ * tree.  Each register is read at most once, the first time it is asked
+ * for, so a diff sees one consistent value per register.
+ *
+ * Note that a tree built in snapshot mode (see set_snapshot()) reads from
+ * that snapshot, not from hardware.
+ */
+class LiveDiffSource: public DiffSource
+{
+    public:
+	explicit LiveDiffSource(const ConstScopePtr &root);
+	explicit LiveDiffSource(const FieldIndex &index);
+
+	virtual void
+	registers(std::set<RegisterKey> *out) const;
+	virtual bool
+	read(const RegisterKey &key, Value *result) const;
+
+    private:
+	void
+	init(const FieldIndex &index);
+
+	struct Entry {
+		ConstRegisterPtr reg;
+		mutable bool done;
+		mutable bool valid;
+		mutable Value value;
+	};
+	std::map<RegisterKey, Entry> m_registers;
+};
+
+/*
+ * RegisterChange - one register which differs between two sources.
+ */
+struct RegisterChange
+{
+	RegisterKey key;
+	bool old_valid;
+	bool new_valid;
+	Value old_value;
+	Value new_value;
+	// the bits which differ, or all bits if either side is not valid
+	Value changed_bits;
+};
+
+/*
+ * FieldChange - one field whose raw value differs between two sources.
+ */
+struct FieldChange
+{
+	string path;
+	bool old_valid;
+	bool new_valid;
+	Value old_value;
+	Value new_value;
+	// the evaluated values, or "" if not valid
+	string old_string;
+	string new_string;
+};
+
+/*
+ * TreeDiff - the result of a diff.
+ */
+struct TreeDiff
+{
+	// sorted by key
+	std::vector<RegisterChange> registers;
+	// in tree order
+	std::vector<FieldChange> fields;
+};
+
+/*
+ * diff_tree(root, before, after, result)
+ * diff_tree(index, before, after, result)
+ *
+ * Compare two sources of register values, register by register, and
+ * decode only the fields which sit on bits that changed.  The tree at
+ * 'root' is only used to find fields and their paths - all values come
+ * from 'before' and 'after'.
+ *
+ * Every register known to either source is compared.  Fields are only
+ * reported if they can be indexed (see FieldIndex), and if their raw
+ * value differs.  Lazy scopes are populated along the way.
+ *
+ * When diffing the same tree many times, build a FieldIndex once and use
+ * the second form, which does not walk the tree.
+ */
+extern void
+diff_tree(const ConstScopePtr &root, const DiffSource &before,
+    const DiffSource &after, TreeDiff *result);
+extern void
+diff_tree(const FieldIndex &index, const DiffSource &before,
+    const DiffSource &after, TreeDiff *result);
+
+}  // namespace hwpp
+
+#endif // HWPP_DIFF_H__
@@ -55,12 +55,12 @@ class Dirent
 	explicit Dirent(DirentType type): m_type(type)
 	{
 		DASSERT_MSG(type < DIRENT_TYPE_MAX, "invalid DirentType");
-		DTRACE(TRACE_DIRENTS && TRACE_LIFETIMES,
+		DTRACE(TRACE_DIRENTS | TRACE_LIFETIMES,
 		       sprintfxx("new dirent @ %p", this));
 	}
 	virtual ~Dirent()
 	{
-		DTRACE(TRACE_DIRENTS && TRACE_LIFETIMES,
+		DTRACE(TRACE_DIRENTS | TRACE_LIFETIMES,
 		       sprintfxx("del dirent @ %p", this));
 	}
 
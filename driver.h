@@ -63,6 +63,23 @@ class Driver
 				"binding not supported for this driver");
 	}
 
+	//
+	// Driver::binding_name(args)
+	//
+	// Get the name that new_binding(args)->to_string() would return,
+	// without touching any hardware.  This is used to find bindings
+	// in a snapshot.
+	//
+	// Throws: Driver::ArgsError
+	//
+	virtual string
+	binding_name(const std::vector<Value> &args) const
+	{
+		(void)args;
+		throw NotSupportedError(this->name() + ": " +
+				"snapshots not supported for this driver");
+	}
+
 	//
 	// Driver::discover()
 	//
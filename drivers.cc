@@ -8,8 +8,10 @@
 #include <exception>
 
 #include "hwpp.h"
+#include "binding_stats.h"
 #include "driver.h"
 #include "util/filesystem.h"
+#include "util/parallel.h"
 
 namespace hwpp {
 
@@ -72,10 +74,78 @@ init_devices()
 	hwpp::device::force_devices_linkage = 1;
 }
 
+//
+// Routines for bindings
+//
+
+static ConstSnapshotPtr the_snapshot;
+
+void
+set_snapshot(const ConstSnapshotPtr &snapshot)
+{
+	the_snapshot = snapshot;
+}
+
+const ConstSnapshotPtr &
+current_snapshot()
+{
+	return the_snapshot;
+}
+
+static bool the_binding_stats;
+
+void
+set_binding_stats(bool enabled)
+{
+	the_binding_stats = enabled;
+}
+
+bool
+binding_stats_enabled()
+{
+	return the_binding_stats;
+}
+
+BindingPtr
+new_binding(const string &driver_name, const std::vector<Value> &args)
+{
+	const Driver *driver = find_driver(driver_name);
+	BindingPtr binding;
+	if (the_snapshot) {
+		binding = new_snapshot_binding(the_snapshot,
+		                               driver->binding_name(args));
+	} else {
+		binding = driver->new_binding(args);
+	}
+	if (the_binding_stats) {
+		binding = new_stats_binding(binding);
+	}
+	DTRACE(TRACE_BINDINGS, "new binding " + binding->to_string());
+	return binding;
+}
+
 //
 // Routines for discovery
 //
 
+// 0 means "not set yet"
+static unsigned the_discovery_threads;
+
+void
+set_discovery_threads(unsigned n_threads)
+{
+	the_discovery_threads = n_threads ? n_threads : 1;
+}
+
+unsigned
+discovery_threads()
+{
+	if (the_discovery_threads == 0) {
+		the_discovery_threads = parallel::online_cpus();
+	}
+	return the_discovery_threads;
+}
+
 void
 register_discovery(const string &driver_name,
                    const std::vector<Value> &args,
@@ -88,6 +158,8 @@ register_discovery(const string &driver_name,
 void
 do_discovery(const string &driver_name)
 {
+	DTRACE_SPAN(TRACE_DISCOVERY, "discovery");
+
 	// if the caller specified a driver, use just that driver
 	if (driver_name != "") {
 		const Driver *driver = find_driver(driver_name);
@@ -98,6 +170,8 @@ do_discovery(const string &driver_name)
 	// otherwise, let each driver do it's own discovery
 	DriverMap::iterator driver_iter = driver_list().begin();
 	while (driver_iter != driver_list().end()) {
+		DTRACE(TRACE_DISCOVERY,
+		       "discovery: driver " + driver_iter->first);
 		driver_iter->second->discover();
 		driver_iter++;
 	}
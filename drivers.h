@@ -4,6 +4,7 @@
 #include "hwpp.h"
 #include "driver.h"
 #include "runtime.h"
+#include "snapshot.h"
 
 namespace hwpp {
 
@@ -21,6 +22,41 @@ register_discovery(const string &driver_name,
 extern void
 do_discovery(const string &driver_name);
 
+// Create a binding through the named driver.  In snapshot mode, this
+// returns a binding which reads from the snapshot instead.
+extern BindingPtr
+new_binding(const string &driver_name, const std::vector<Value> &args);
+
+// Set or get the snapshot that drivers use instead of hardware.  When a
+// snapshot is set, discovery finds the devices recorded in it, and all
+// new bindings read from it.  Set an empty pointer to go back to
+// hardware.
+extern void
+set_snapshot(const ConstSnapshotPtr &snapshot);
+
+extern const ConstSnapshotPtr &
+current_snapshot();
+
+// Turn on or off I/O statistics for new bindings.  When on, new_binding()
+// wraps each binding in a StatsBinding, and dump_binding_stats() can
+// report on them.  This is off by default, and has no effect on bindings
+// which already exist.
+extern void
+set_binding_stats(bool enabled);
+
+extern bool
+binding_stats_enabled();
+
+// Set or get the number of threads drivers may use to probe hardware
+// during discovery.  Discovery callbacks are always run serially, in a
+// stable order, regardless of this setting.  The default is the number
+// of online CPUs.  A value of 1 disables threading.
+extern void
+set_discovery_threads(unsigned n_threads);
+
+extern unsigned
+discovery_threads();
+
 inline void
 do_discovery()
 {
@@ -12,6 +12,10 @@
 #include "util/filesystem.h"
 #include "util/simple_regex.h"
 #include "util/bit_buffer.h"
+#include "util/parallel.h"
+#include "drivers.h"
+#include <stdio.h>
+#include <map>
 
 namespace hwpp {
 
@@ -40,26 +44,117 @@ CpuDriver::name() const
 	return "cpu";
 }
 
+// the result of probing one CPU
+struct CpuProbeResult {
+	Value vendor;
+	Value family;
+	Value model;
+	Value stepping;
+	string error;
+};
+
+// Read the signature of each CPU.  This is called in parallel, once per
+// CPU, so each call only touches its own result.  Errors are saved and
+// reported in CPU order by the caller.
+struct CpuProber {
+	const std::vector<CpuAddress> &addresses;
+	std::vector<CpuProbeResult> &results;
+
+	CpuProber(const std::vector<CpuAddress> &a,
+	          std::vector<CpuProbeResult> &r)
+	    : addresses(a), results(r)
+	{
+	}
+
+	void
+	operator()(size_t i) const
+	{
+		DTRACE_SPAN(TRACE_DISCOVERY, "cpu probe");
+		CpuProbeResult &r = results[i];
+		try {
+			CpuDriver::signature(addresses[i], &r.vendor,
+			    &r.family, &r.model, &r.stepping);
+		} catch (std::exception &e) {
+			r.error = e.what();
+		}
+	}
+};
+
+// Find all CPUs and their signatures in a snapshot.  Each CPU is found
+// by its cpuid<> binding.
+static void
+probe_snapshot(const ConstSnapshotPtr &snap,
+               std::vector<CpuAddress> *addresses,
+               std::vector<CpuProbeResult> *results)
+{
+	std::map<int, CpuProbeResult> found;
+	for (size_t i = 0; i < snap->n_bindings(); i++) {
+		string name = snap->binding_name(i);
+		int cpu;
+		int len = 0;
+		if (sscanf(name.c_str(), "cpuid<%d>%n", &cpu, &len) != 1
+		 || size_t(len) != name.size() || cpu < 0) {
+			continue;
+		}
+
+		CpuProbeResult &r = found[cpu];
+		Value fn0, fn1;
+		if (snap->read(i, 0, BITS128, &fn0)
+		 && snap->read(i, 1, BITS128, &fn1)) {
+			CpuDriver::decode_signature(fn0, fn1, &r.vendor,
+			    &r.family, &r.model, &r.stepping);
+		} else {
+			r.error = name + ": cpuid not in snapshot";
+		}
+	}
+
+	// std::map keeps them sorted by CPU number
+	std::map<int, CpuProbeResult>::iterator it;
+	for (it = found.begin(); it != found.end(); it++) {
+		addresses->push_back(CpuAddress(it->first));
+		results->push_back(it->second);
+	}
+}
+
 void
 CpuDriver::discover() const
 {
 	std::vector<CpuAddress> addresses;
+	std::vector<CpuProbeResult> sigs;
+
+	if (current_snapshot()) {
+		// find all CPUs in the snapshot
+		probe_snapshot(current_snapshot(), &addresses, &sigs);
+	} else {
+		// find all CPU addresses
+		enumerate(CPU_SYSFS_DIR, &addresses);
+
+		// probe all CPUs at once, since each probe migrates to
+		// its CPU
+		sigs.resize(addresses.size());
+		parallel::for_each_index(addresses.size(),
+		                         discovery_threads(),
+		                         CpuProber(addresses, sigs));
+	}
 
-	// find all CPU addresses
-	enumerate(CPU_SYSFS_DIR, &addresses);
+	// for each CPU device in the system, in order
+	for (size_t i = 0; i < addresses.size(); i++) {
+		const CpuAddress &addr = addresses[i];
+		const CpuProbeResult &sig = sigs[i];
+		if (sig.error != "") {
+			throw Driver::IoError(sig.error);
+		}
 
-	// for each CPU device in the system
-	std::vector<CpuAddress>::iterator it;
-	for (it = addresses.begin(); it != addresses.end(); it++) {
 		// check if anyone registered for this device
-		const DiscoveryRequest *dr = find_discovery_request(*it);
+		const DiscoveryRequest *dr = find_discovery_request(addr,
+		    sig.vendor, sig.family, sig.model, sig.stepping);
 		if (dr && dr->function == NULL) {
 			continue;
 		}
 
 		// call the callback
 		std::vector<Value> args;
-		args.push_back(it->cpu);
+		args.push_back(addr.cpu);
 		if (dr) {
 			// call the callback
 			dr->function(args);
@@ -101,39 +196,53 @@ CpuDriver::register_discovery(const std::vector<Value> &args,
 	m_callbacks.push_back(dr);
 }
 
-const CpuDriver::DiscoveryRequest *
-CpuDriver::find_discovery_request(const CpuAddress &addr) const
+void
+CpuDriver::signature(const CpuAddress &addr, Value *vendor, Value *family,
+                     Value *model, Value *stepping)
+{
+	decode_signature(cpuid(addr, 0), cpuid(addr, 1),
+	                 vendor, family, model, stepping);
+}
+
+void
+CpuDriver::decode_signature(const Value &function_0,
+                            const Value &function_1,
+                            Value *vendor, Value *family,
+                            Value *model, Value *stepping)
 {
-	Value vendor;
-	Value family;
-	Value model;
-	Value stepping;
 	Value tmp;
 
 	// This is the ordering the CPU vendors use.  I don't know why.
-	tmp = cpuid(addr, 0);
-	vendor = ((((tmp >> 32*1) & MASK(32)) << 0)
+	tmp = function_0;
+	*vendor = ((((tmp >> 32*1) & MASK(32)) << 0)
 		| (((tmp >> 32*3) & MASK(32)) << 32)
 		| (((tmp >> 32*2) & MASK(32)) << 64));
 
-	tmp = cpuid(addr, 1);
-	family = (tmp & Value(0xf00)) >> 8;
-	model = (tmp & Value(0xf0)) >> 4;
-	stepping = tmp & Value(0xf);
+	tmp = function_1;
+	*family = (tmp & Value(0xf00)) >> 8;
+	*model = (tmp & Value(0xf0)) >> 4;
+	*stepping = tmp & Value(0xf);
 
 	// handle slight differences in AMD and Intel specs
-	if (vendor == Value("0x6c65746e49656e69756e6547")) {
+	if (*vendor == Value("0x6c65746e49656e69756e6547")) {
 		// intel
-		family += (tmp & Value(0xff00000)) >> 20;
-		model |= (tmp & Value(0xf0000)) >> 12;
-	} else if (vendor == Value("0x444d416369746e6568747541")) {
+		*family += (tmp & Value(0xff00000)) >> 20;
+		*model |= (tmp & Value(0xf0000)) >> 12;
+	} else if (*vendor == Value("0x444d416369746e6568747541")) {
 		// amd
-		if (family == 0xf) {
-			family += (tmp & Value(0xff00000)) >> 20;
-			model |= (tmp & Value(0xf0000)) >> 12;
+		if (*family == 0xf) {
+			*family += (tmp & Value(0xff00000)) >> 20;
+			*model |= (tmp & Value(0xf0000)) >> 12;
 		}
 	}
+}
 
+const CpuDriver::DiscoveryRequest *
+CpuDriver::find_discovery_request(const CpuAddress &addr,
+                                  const Value &vendor, const Value &family,
+                                  const Value &model,
+                                  const Value &stepping) const
+{
 	DTRACE(TRACE_DISCOVERY, "discovery: cpu "
 			+ to_string(boost::format("0x%x") %vendor)
 			+ " " + to_string(family)
@@ -163,17 +272,17 @@ CpuDriver::find_discovery_request(const CpuAddress &addr) const
 Value
 CpuDriver::cpuid(const CpuAddress &address, unsigned function)
 {
-	// save original affinity
+	// save original affinity (of this thread, not the whole process)
 	cpu_set_t new_set, orig_set;
 
-	if (sched_getaffinity(getpid(), sizeof(orig_set), &orig_set) < 0) {
+	if (sched_getaffinity(0, sizeof(orig_set), &orig_set) < 0) {
 		do_io_error(address, "cannot get CPU affinity");
 	}
 
 	// set affinity to desired CPU
 	CPU_ZERO(&new_set);
 	CPU_SET(address.cpu, &new_set);
-	if (sched_setaffinity(getpid(), sizeof(new_set), &new_set) < 0) {
+	if (sched_setaffinity(0, sizeof(new_set), &new_set) < 0) {
 		do_io_error(address, to_string(
 		    boost::format("cannot set affinity to CPU %d")
 		    %address.cpu));
@@ -191,7 +300,7 @@ CpuDriver::cpuid(const CpuAddress &address, unsigned function)
 		);
 	
 	// set affinity back to original
-	if (sched_setaffinity(getpid(), sizeof(orig_set), &orig_set) < 0) {
+	if (sched_setaffinity(0, sizeof(orig_set), &orig_set) < 0) {
 		do_io_error(address, "cannot reset CPU affinity");
 	}
 
@@ -50,9 +50,23 @@ class CpuDriver: public Driver
 	static void
 	enumerate(const string &path, std::vector<CpuAddress> *addresses);
 
+	// This is thread-safe: it changes the affinity of the calling
+	// thread only.
 	static Value
 	cpuid(const CpuAddress &address, unsigned function);
 
+	// Read the vendor, family, model, and stepping of a CPU.
+	static void
+	signature(const CpuAddress &address, Value *vendor, Value *family,
+			Value *model, Value *stepping);
+
+	// Decode the vendor, family, model, and stepping from the results
+	// of CPUID functions 0 and 1.
+	static void
+	decode_signature(const Value &function_0, const Value &function_1,
+			Value *vendor, Value *family, Value *model,
+			Value *stepping);
+
     private:
 	struct DiscoveryRequest {
 		Value vendor;
@@ -66,7 +80,9 @@ class CpuDriver: public Driver
 	};
 
 	const DiscoveryRequest *
-	find_discovery_request(const CpuAddress &addr) const;
+	find_discovery_request(const CpuAddress &addr,
+			const Value &vendor, const Value &family,
+			const Value &model, const Value &stepping) const;
 
 	std::vector<DiscoveryRequest> m_callbacks;
 	DiscoveryCallback m_catchall;
@@ -28,8 +28,9 @@ CpuidDriver::name() const
 	return "cpuid";
 }
 
-BindingPtr
-CpuidDriver::new_binding(const std::vector<Value> &args) const
+/* validate the args of a cpuid<> binding */
+static CpuidAddress
+cpuid_address_from_args(const std::vector<Value> &args)
 {
 	if (args.size() != 1) {
 		throw Driver::ArgsError("cpuid<>: <cpu>");
@@ -41,7 +42,19 @@ CpuidDriver::new_binding(const std::vector<Value> &args) const
 		throw Driver::ArgsError("cpuid<>: invalid cpu");
 	}
 
-	return new_cpuid_binding(CpuidAddress(cpu.as_uint()));
+	return CpuidAddress(cpu.as_uint());
+}
+
+BindingPtr
+CpuidDriver::new_binding(const std::vector<Value> &args) const
+{
+	return new_cpuid_binding(cpuid_address_from_args(args));
+}
+
+string
+CpuidDriver::binding_name(const std::vector<Value> &args) const
+{
+	return to_string(cpuid_address_from_args(args));
 }
 
 }  // namespace hwpp
@@ -34,6 +34,16 @@ class CpuidDriver: public Driver
 	 */
 	virtual BindingPtr
 	new_binding(const std::vector<Value> &args) const;
+
+	/*
+	 * CpuidDriver::binding_name(args)
+	 *
+	 * Get the name of the Binding that new_binding(args) would create.
+	 *
+	 * Throws: Driver::ArgsError
+	 */
+	virtual string
+	binding_name(const std::vector<Value> &args) const;
 };
 
 #define new_cpuid_driver(...) DriverPtr(new CpuidDriver(__VA_ARGS__))
@@ -29,8 +29,9 @@ IoDriver::name() const
 	return "io";
 }
 
-BindingPtr
-IoDriver::new_binding(const std::vector<Value> &args) const
+/* validate the args of an io<> binding */
+static IoAddress
+io_address_from_args(const std::vector<Value> &args)
 {
 	Value base, size;
 
@@ -48,7 +49,19 @@ IoDriver::new_binding(const std::vector<Value> &args) const
 		throw Driver::ArgsError("io<>: invalid size");
 	}
 
-	return new_io_binding(IoAddress(base.as_uint(), size.as_uint()));
+	return IoAddress(base.as_uint(), size.as_uint());
+}
+
+BindingPtr
+IoDriver::new_binding(const std::vector<Value> &args) const
+{
+	return new_io_binding(io_address_from_args(args));
+}
+
+string
+IoDriver::binding_name(const std::vector<Value> &args) const
+{
+	return to_string(io_address_from_args(args));
 }
 
 }  // namespace hwpp
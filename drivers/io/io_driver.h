@@ -34,6 +34,16 @@ class IoDriver: public Driver
 	 */
 	virtual BindingPtr
 	new_binding(const std::vector<Value> &args) const;
+
+	/*
+	 * IoDriver::binding_name(args)
+	 *
+	 * Get the name of the Binding that new_binding(args) would create.
+	 *
+	 * Throws: Driver::ArgsError
+	 */
+	virtual string
+	binding_name(const std::vector<Value> &args) const;
 };
 
 #define new_io_driver(...) DriverPtr(new IoDriver(__VA_ARGS__))
@@ -27,8 +27,9 @@ MemDriver::name() const
 	return "mem";
 }
 
-BindingPtr
-MemDriver::new_binding(const std::vector<Value> &args) const
+/* validate the args of a mem<> binding */
+static MemAddress
+mem_address_from_args(const std::vector<Value> &args)
 {
 	Value base, size;
 
@@ -46,7 +47,19 @@ MemDriver::new_binding(const std::vector<Value> &args) const
 		throw Driver::ArgsError("mem<>: invalid size");
 	}
 
-	return new_mem_binding(MemAddress(base.as_uint(), size.as_uint()));
+	return MemAddress(base.as_uint(), size.as_uint());
+}
+
+BindingPtr
+MemDriver::new_binding(const std::vector<Value> &args) const
+{
+	return new_mem_binding(mem_address_from_args(args));
+}
+
+string
+MemDriver::binding_name(const std::vector<Value> &args) const
+{
+	return to_string(mem_address_from_args(args));
 }
 
 }  // namespace hwpp
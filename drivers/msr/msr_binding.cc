@@ -45,13 +45,22 @@ MsrIo::read(const Value &address, const BitWidth width) const
 	check_width(width);
 	check_bounds(address, BITS_TO_BYTES(width));
 
-	seek(address);
+	// pread() saves a seek, and leaves the file offset alone, so
+	// one MsrIo can be read from more than one thread
 	util::BitBuffer bb(width);
-	if (m_file->read(bb.get(), bb.size_bytes()) != bb.size_bytes()) {
+	ssize_t r = pread(m_file->fd(), bb.get(), bb.size_bytes(),
+	                  address.as_uint());
+	if (r < 0) {
 		// We already did bounds checking, so this must be bad.
 		do_io_error(sprintfxx("error reading register 0x%x: %s",
 		                      address, strerror(errno)));
 	}
+	if (size_t(r) != bb.size_bytes()) {
+		// errno is not set for a short read
+		do_io_error(sprintfxx("error reading register 0x%x: "
+		                      "short read (%d of %d bytes)",
+		                      address, r, bb.size_bytes()));
+	}
 
 	return Value(bb);
 }
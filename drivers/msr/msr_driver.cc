@@ -28,8 +28,9 @@ MsrDriver::name() const
 	return "msr";
 }
 
-BindingPtr
-MsrDriver::new_binding(const std::vector<Value> &args) const
+/* validate the args of a msr<> binding */
+static MsrAddress
+msr_address_from_args(const std::vector<Value> &args)
 {
 	if (args.size() != 1) {
 		throw Driver::ArgsError("msr<>: <cpu>");
@@ -41,7 +42,19 @@ MsrDriver::new_binding(const std::vector<Value> &args) const
 		throw Driver::ArgsError("msr<>: invalid cpu");
 	}
 
-	return new_msr_binding(MsrAddress(cpu.as_uint()));
+	return MsrAddress(cpu.as_uint());
+}
+
+BindingPtr
+MsrDriver::new_binding(const std::vector<Value> &args) const
+{
+	return new_msr_binding(msr_address_from_args(args));
+}
+
+string
+MsrDriver::binding_name(const std::vector<Value> &args) const
+{
+	return to_string(msr_address_from_args(args));
 }
 
 }  // namespace hwpp
@@ -34,6 +34,16 @@ class MsrDriver: public Driver
 	 */
 	virtual BindingPtr
 	new_binding(const std::vector<Value> &args) const;
+
+	/*
+	 * MsrDriver::binding_name(args)
+	 *
+	 * Get the name of the Binding that new_binding(args) would create.
+	 *
+	 * Throws: Driver::ArgsError
+	 */
+	virtual string
+	binding_name(const std::vector<Value> &args) const;
 };
 
 #define new_msr_driver(...) DriverPtr(new MsrDriver(__VA_ARGS__))
@@ -0,0 +1,223 @@
+#include "hwpp.h"
+#include "msr_sampler.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "driver.h"
+#include "util/filesystem.h"
+#include "util/parallel.h"
+
+namespace hwpp {
+
+#define MSR_DEVICE_DIR	"/dev/cpu"
+
+MsrSampler::MsrSampler(const std::vector<unsigned> &cpus,
+                       const string &devdir)
+    : m_threads(0), m_stopping(false), m_reading(false), m_generation(0),
+      m_started(0), m_wanted(0), m_busy(0), m_msrs(NULL), m_values(NULL),
+      m_failed(false), m_next(0)
+{
+	m_ios.reserve(cpus.size());
+	for (size_t i = 0; i < cpus.size(); i++) {
+		m_ios.push_back(MsrIo(MsrAddress(cpus[i]), devdir));
+	}
+
+	pthread_mutex_init(&m_lock, NULL);
+	pthread_cond_init(&m_wake, NULL);
+	pthread_cond_init(&m_done, NULL);
+
+	// The calling thread counts as a worker.  If threads can not be
+	// created, the reads are done by the ones that were.
+	size_t n_threads = std::min<size_t>(parallel::online_cpus(),
+	                                    m_ios.size());
+	for (size_t i = 1; i < n_threads; i++) {
+		pthread_t tid;
+		if (pthread_create(&tid, NULL, run_thread, this) != 0) {
+			break;
+		}
+		m_pool.push_back(tid);
+	}
+}
+
+MsrSampler::~MsrSampler()
+{
+	pthread_mutex_lock(&m_lock);
+	m_stopping = true;
+	pthread_cond_broadcast(&m_wake);
+	pthread_mutex_unlock(&m_lock);
+	for (size_t i = 0; i < m_pool.size(); i++) {
+		pthread_join(m_pool[i], NULL);
+	}
+
+	pthread_cond_destroy(&m_done);
+	pthread_cond_destroy(&m_wake);
+	pthread_mutex_destroy(&m_lock);
+}
+
+void
+MsrSampler::enumerate(std::vector<unsigned> *cpus, const string &devdir)
+{
+	filesystem::DirectoryPtr dir = filesystem::Directory::open(
+	    devdir.empty() ? MSR_DEVICE_DIR : devdir);
+
+	size_t start = cpus->size();
+	filesystem::DirentryPtr de;
+	while ((de = dir->read())) {
+		// each CPU gets a dir named N
+		const string &name = de->name();
+		if (!de->is_dir() || name.empty()
+		 || name.find_first_not_of("0123456789") != string::npos) {
+			continue;
+		}
+		cpus->push_back(strtoul(name.c_str(), NULL, 10));
+	}
+	std::sort(cpus->begin() + start, cpus->end());
+}
+
+void *
+MsrSampler::run_thread(void *arg)
+{
+	MsrSampler *sampler = static_cast<MsrSampler *>(arg);
+
+	// Each thread takes the next id.  The pool may still be being
+	// started, so m_pool can not tell us.
+	pthread_mutex_lock(&sampler->m_lock);
+	unsigned id = sampler->m_started++;
+	pthread_mutex_unlock(&sampler->m_lock);
+
+	sampler->run(id);
+	return NULL;
+}
+
+// Wait for each read, and help with it if this thread is wanted.  This
+// starts from the first generation, not the current one, so a thread
+// which starts late still joins a read which is waiting for it.
+void
+MsrSampler::run(unsigned id)
+{
+	uint64_t generation = 0;
+	pthread_mutex_lock(&m_lock);
+	while (true) {
+		while (!m_stopping && m_generation == generation) {
+			pthread_cond_wait(&m_wake, &m_lock);
+		}
+		if (m_stopping) {
+			break;
+		}
+		generation = m_generation;
+		if (id >= m_wanted) {
+			continue;
+		}
+
+		pthread_mutex_unlock(&m_lock);
+		work();
+		pthread_mutex_lock(&m_lock);
+		if (--m_busy == 0) {
+			// a read waiting its turn may be woken too
+			pthread_cond_broadcast(&m_done);
+		}
+	}
+	pthread_mutex_unlock(&m_lock);
+}
+
+// Read the current list of MSRs on CPUs until there are none left, or
+// one has failed.  Each CPU is claimed by one thread, which only touches
+// that CPU's values.
+void
+MsrSampler::work() const
+{
+	size_t n_cpus = m_ios.size();
+	const std::vector<uint32_t> &msrs = *m_msrs;
+	while (!__atomic_load_n(&m_failed, __ATOMIC_RELAXED)) {
+		size_t i = __sync_fetch_and_add(&m_next, 1);
+		if (i >= n_cpus) {
+			break;
+		}
+
+		std::vector<Value> &cpu_values = (*m_values)[i];
+		cpu_values.resize(msrs.size());
+		try {
+			for (size_t j = 0; j < msrs.size(); j++) {
+				cpu_values[j] = m_ios[i].read(msrs[j], BITS64);
+			}
+		} catch (std::exception &e) {
+			pthread_mutex_lock(&m_lock);
+			if (!m_failed) {
+				m_error = e.what();
+				__atomic_store_n(&m_failed, true,
+				                 __ATOMIC_RELAXED);
+			}
+			pthread_mutex_unlock(&m_lock);
+		}
+	}
+}
+
+void
+MsrSampler::read(const std::vector<uint32_t> &msrs,
+                 std::vector<std::vector<Value> > *values) const
+{
+	values->resize(m_ios.size());
+
+	// the calling thread counts as one
+	size_t n_threads = m_pool.size() + 1;
+	if (m_threads && m_threads < n_threads) {
+		n_threads = m_threads;
+	}
+
+	pthread_mutex_lock(&m_lock);
+	// one read at a time
+	while (m_reading) {
+		pthread_cond_wait(&m_done, &m_lock);
+	}
+	m_reading = true;
+	m_msrs = &msrs;
+	m_values = values;
+	m_failed = false;
+	m_error.clear();
+	m_next = 0;
+	m_wanted = n_threads - 1;
+	m_busy = m_wanted;
+	if (m_busy) {
+		m_generation++;
+		pthread_cond_broadcast(&m_wake);
+	}
+	pthread_mutex_unlock(&m_lock);
+
+	work();
+
+	pthread_mutex_lock(&m_lock);
+	while (m_busy) {
+		pthread_cond_wait(&m_done, &m_lock);
+	}
+	bool failed = m_failed;
+	string error = m_error;
+	m_reading = false;
+	m_msrs = NULL;
+	m_values = NULL;
+	// wake any other read waiting for this one
+	pthread_cond_broadcast(&m_done);
+	pthread_mutex_unlock(&m_lock);
+
+	if (failed) {
+		throw Driver::IoError(error);
+	}
+}
+
+std::vector<Value>
+MsrSampler::read(uint32_t msr) const
+{
+	std::vector<uint32_t> msrs(1, msr);
+	std::vector<std::vector<Value> > values;
+	read(msrs, &values);
+
+	std::vector<Value> result(values.size());
+	for (size_t i = 0; i < values.size(); i++) {
+		result[i] = values[i][0];
+	}
+	return result;
+}
+
+}  // namespace hwpp
@@ -0,0 +1,136 @@
+#ifndef HWPP_DRIVERS_MSR_MSR_SAMPLER_H__
+#define HWPP_DRIVERS_MSR_MSR_SAMPLER_H__
+
+#include "hwpp.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#include "msr_binding.h"
+
+namespace hwpp {
+
+/*
+ * MsrSampler - read the same MSRs on many CPUs at once.
+ *
+ * The msr device of each CPU is opened once, and a pool of threads is
+ * started, when the sampler is made.  Each read then wakes the pool and
+ * hands the CPUs out to it, and each CPU is read with one pread(2) per
+ * MSR.  Since the kernel runs every MSR read on its own CPU, reading all
+ * CPUs in parallel takes about as long as reading the slowest one, rather
+ * than all of them in turn.
+ *
+ * Reads from different threads are done one at a time.
+ */
+class MsrSampler
+{
+    public:
+	/*
+	 * MsrSampler::MsrSampler(cpus, devdir)
+	 *
+	 * Open the msr device of each CPU, and start one thread per
+	 * online CPU, less the calling thread, but no more than there are
+	 * CPUs to read.
+	 *
+	 * Throws: syserr::ErrnoError
+	 */
+	explicit
+	MsrSampler(const std::vector<unsigned> &cpus,
+	           const string &devdir = "");
+	// Stops the pool threads.
+	~MsrSampler();
+
+	/*
+	 * MsrSampler::enumerate(cpus, devdir)
+	 *
+	 * Find the CPUs which have msr devices, in CPU order.
+	 *
+	 * Throws: syserr::ErrnoError
+	 */
+	static void
+	enumerate(std::vector<unsigned> *cpus, const string &devdir = "");
+
+	/*
+	 * MsrSampler::set_threads(n_threads)
+	 *
+	 * Set the most threads a read may use, including the calling
+	 * thread.  0, the default, means all of the pool.  This can not
+	 * grow the pool past the size it was started with.
+	 */
+	void
+	set_threads(unsigned n_threads)
+	{
+		m_threads = n_threads;
+	}
+
+	size_t
+	n_cpus() const
+	{
+		return m_ios.size();
+	}
+	unsigned
+	cpu(size_t index) const
+	{
+		return m_ios[index].address().cpu;
+	}
+
+	/*
+	 * MsrSampler::read(msr)
+	 * MsrSampler::read(msrs, values)
+	 *
+	 * Read one MSR, or a list of MSRs, on every CPU.  The first form
+	 * returns one value per CPU, in the order the CPUs were given.  The
+	 * second sets (*values)[cpu][i] to the value of msrs[i] on that
+	 * CPU.
+	 *
+	 * Throws: Driver::IoError
+	 */
+	std::vector<Value>
+	read(uint32_t msr) const;
+	void
+	read(const std::vector<uint32_t> &msrs,
+	     std::vector<std::vector<Value> > *values) const;
+
+    private:
+	static void *
+	run_thread(void *arg);
+
+	void
+	run(unsigned id);
+	void
+	work() const;
+
+	std::vector<MsrIo> m_ios;
+	unsigned m_threads;
+	std::vector<pthread_t> m_pool;
+	// m_lock protects everything below.  read() is const, so they are
+	// all mutable.
+	mutable pthread_mutex_t m_lock;
+	mutable pthread_cond_t m_wake;
+	mutable pthread_cond_t m_done;
+	bool m_stopping;
+	// set while a read is in progress
+	mutable bool m_reading;
+	// bumped for each read, to wake the pool
+	mutable uint64_t m_generation;
+	// pool threads which have taken an id
+	unsigned m_started;
+	// pool threads with an id below this take part in the current read
+	mutable unsigned m_wanted;
+	// pool threads still working on the current read
+	mutable unsigned m_busy;
+	// the current read
+	mutable const std::vector<uint32_t> *m_msrs;
+	mutable std::vector<std::vector<Value> > *m_values;
+	mutable bool m_failed;
+	mutable string m_error;
+	// the next CPU to read, which is claimed atomically
+	mutable size_t m_next;
+
+	// not copyable
+	MsrSampler(const MsrSampler &);
+	MsrSampler &operator=(const MsrSampler &);
+};
+
+}  // namespace hwpp
+
+#endif // HWPP_DRIVERS_MSR_MSR_SAMPLER_H__
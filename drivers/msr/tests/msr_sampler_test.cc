@@ -0,0 +1,80 @@
+#include "hwpp.h"
+#include "drivers/msr/msr_sampler.h"
+#include "driver.h"
+#include "util/test.h"
+
+namespace hwpp {
+
+// Make a fake msr device for each CPU, with 16 bytes of data: "cN" then
+// six 'a's, then "CN" then six 'b's.
+static void
+make_test_data()
+{
+	system("mkdir -p test_data/0 test_data/1 test_data/7 test_data/x");
+	system("printf 'c0aaaaaaC0bbbbbb' > test_data/0/msr");
+	system("printf 'c1aaaaaaC1bbbbbb' > test_data/1/msr");
+	system("printf 'c7aaaaaaC7bbbbbb' > test_data/7/msr");
+}
+
+TEST(test_msr_sampler)
+{
+	make_test_data();
+
+	try {
+		std::vector<unsigned> cpus;
+		MsrSampler::enumerate(&cpus, "test_data");
+		TEST_ASSERT(cpus.size() == 3
+		         && cpus[0] == 0 && cpus[1] == 1 && cpus[2] == 7,
+		    "MsrSampler::enumerate()") << cpus.size();
+
+		MsrSampler sampler(cpus, "test_data");
+		TEST_ASSERT(sampler.n_cpus() == 3 && sampler.cpu(2) == 7,
+		    "MsrSampler::MsrSampler()");
+
+		unsigned threads[] = { 1, 2, 0 };
+		for (size_t t = 0; t < sizeof(threads)/sizeof(*threads); t++) {
+			sampler.set_threads(threads[t]);
+			std::vector<Value> values = sampler.read(0);
+			TEST_ASSERT(values.size() == 3
+			 && values[0] == Value("0x6161616161613063")
+			 && values[1] == Value("0x6161616161613163")
+			 && values[2] == Value("0x6161616161613763"),
+			    "MsrSampler::read(msr)") << threads[t];
+		}
+
+		std::vector<uint32_t> msrs;
+		msrs.push_back(8);
+		msrs.push_back(0);
+		std::vector<std::vector<Value> > values;
+		sampler.read(msrs, &values);
+		TEST_ASSERT(values.size() == 3 && values[1].size() == 2
+		 && values[1][0] == Value("0x6262626262623143")
+		 && values[1][1] == Value("0x6161616161613163"),
+		    "MsrSampler::read(msrs)");
+
+		// past the end of the fake device
+		try {
+			sampler.read(16);
+			TEST_FAIL("MsrSampler::read(): short read");
+		} catch (Driver::IoError &e) {
+			TEST_ASSERT(string(e.what()).find("short read")
+			            != string::npos,
+			    "MsrSampler::read(): short read") << e.what();
+		}
+
+		// the pool is still usable after a failed read
+		for (int i = 0; i < 100; i++) {
+			std::vector<Value> values = sampler.read(8);
+			TEST_ASSERT(values.size() == 3
+			 && values[2] == Value("0x6262626262623743"),
+			    "MsrSampler::read(): after failure") << i;
+		}
+	} catch (std::exception &e) {
+		system("rm -rf test_data");
+		throw;
+	}
+
+	system("rm -rf test_data");
+}
+
+}  // namespace hwpp
@@ -9,6 +9,8 @@
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <fstream>
+#include <cstdlib>
 
 #include "pci_binding.h"
 #include "driver.h"
@@ -104,6 +106,85 @@ PciIo::enumerate(std::vector<PciAddress> *addresses)
 	std::sort(addresses->begin(), addresses->end());
 }
 
+// Read a sysfs attribute file that holds one hex number, like "0x8086".
+static bool
+read_sysfs_hex(const string &filename, unsigned *result)
+{
+	char buf[32];
+	size_t n;
+	try {
+		filesystem::FilePtr file = filesystem::File::open(filename,
+		                                                  O_RDONLY);
+		n = file->read(buf, sizeof(buf) - 1);
+	} catch (std::exception &e) {
+		return false;
+	}
+	buf[n] = '\0';
+
+	char *end;
+	unsigned long val = strtoul(buf, &end, 16);
+	if (end == buf) {
+		return false;
+	}
+	*result = val;
+	return true;
+}
+
+bool
+PciIo::read_ids(const PciAddress &address, PciIds *ids, string devdir)
+{
+	if (devdir == "") {
+		devdir = PCI_SYSFS_DIR;
+	}
+
+	string dirname = sprintfxx("%s/%04x:%02x:%02x.%d", devdir,
+	                           address.segment, address.bus,
+	                           address.device, address.function);
+	unsigned vendor, device;
+	if (!read_sysfs_hex(dirname + "/vendor", &vendor)
+	 || !read_sysfs_hex(dirname + "/device", &device)) {
+		return false;
+	}
+	ids->vendor = vendor;
+	ids->device = device;
+	return true;
+}
+
+bool
+PciIo::read_all_ids(std::map<PciAddress, PciIds> *ids, string devdir)
+{
+	if (devdir == "") {
+		devdir = PCI_PROCFS_DIR;
+	}
+
+	std::ifstream in((devdir + "/devices").c_str());
+	if (!in) {
+		return false;
+	}
+
+	// Each line starts with "bbdf vvvvdddd", in hex.  There is no PCI
+	// domain, so if a bus/devfn shows up twice we can not tell which
+	// line belongs to domain 0, and we give up on all of them.
+	std::map<PciAddress, PciIds> found;
+	string line;
+	while (std::getline(in, line)) {
+		std::istringstream iss(line);
+		unsigned bdf, vd;
+		if (!(iss >> std::hex >> bdf >> vd)) {
+			continue;
+		}
+		PciAddress addr(bdf >> 8, (bdf >> 3) & 0x1f, bdf & 0x7);
+		PciIds id;
+		id.vendor = vd >> 16;
+		id.device = vd & 0xffff;
+		if (!found.insert(std::make_pair(addr, id)).second) {
+			return false;
+		}
+	}
+	ids->insert(found.begin(), found.end());
+	return true;
+}
+
 void
 PciIo::do_io_error(const string &str) const
 {
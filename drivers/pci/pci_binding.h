@@ -7,6 +7,7 @@
 #include "driver.h"
 #include "util/filesystem.h"
 #include <iostream>
+#include <map>
 
 namespace hwpp { 
 
@@ -57,6 +58,18 @@ operator<<(std::ostream& out, const PciAddress &addr)
 	return out;
 }
 
+/*
+ * PciIds - the identity of a PCI device
+ */
+struct PciIds
+{
+	PciIds(): vendor(0), device(0)
+	{
+	}
+	uint16_t vendor;
+	uint16_t device;
+};
+
 /*
  * PciIo - Linux-specific PCI IO
  */
@@ -79,6 +92,24 @@ class PciIo
 	static void
 	enumerate(std::vector<PciAddress> *addresses);
 
+	/*
+	 * Read the IDs of a single device from its sysfs attribute files,
+	 * without opening config space.  Returns false if sysfs does not
+	 * have them.
+	 */
+	static bool
+	read_ids(const PciAddress &address, PciIds *ids,
+	    string devdir = "");
+
+	/*
+	 * Read the IDs of every device in domain 0 in one pass over
+	 * procfs.  Returns false if procfs does not have them, or if it
+	 * lists devices from more than one domain.
+	 */
+	static bool
+	read_all_ids(std::map<PciAddress, PciIds> *ids,
+	    string devdir = "");
+
     private:
 	PciAddress m_address;
 	filesystem::FilePtr m_file;
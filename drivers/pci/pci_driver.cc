@@ -3,6 +3,10 @@
 #include "datatype_types.h"
 #include "pci_driver.h"
 #include "pci_binding.h"
+#include "drivers.h"
+#include "util/parallel.h"
+#include <stdio.h>
+#include <map>
 
 namespace hwpp { 
 
@@ -28,8 +32,9 @@ PciDriver::name() const
 	return "pci";
 }
 
-BindingPtr
-PciDriver::new_binding(const std::vector<Value> &args) const
+/* validate the args of a pci<> binding */
+static PciAddress
+pci_address_from_args(const std::vector<Value> &args)
 {
 	if (args.size() < 3 || args.size() > 4) {
 		throw Driver::ArgsError(
@@ -59,33 +64,178 @@ PciDriver::new_binding(const std::vector<Value> &args) const
 	if (func < 0 || func >= 8) {
 		throw Driver::ArgsError("pci<>: invalid function");
 	}
-	return new_pci_binding(PciAddress(seg.as_uint(), bus.as_uint(),
-		dev.as_uint(), func.as_uint()));
+	return PciAddress(seg.as_uint(), bus.as_uint(),
+		dev.as_uint(), func.as_uint());
+}
+
+BindingPtr
+PciDriver::new_binding(const std::vector<Value> &args) const
+{
+	return new_pci_binding(pci_address_from_args(args));
+}
+
+string
+PciDriver::binding_name(const std::vector<Value> &args) const
+{
+	return to_string(pci_address_from_args(args));
+}
+
+/* the result of probing one PCI device */
+struct PciProbeResult {
+	PciProbeResult(): found(false)
+	{
+	}
+	PciIds ids;
+	bool found;
+};
+
+/*
+ * Read the vendor and device IDs of each PCI device from sysfs.  This is
+ * called in parallel, once per device, so each call only touches its
+ * own result.
+ */
+struct PciProber {
+	const std::vector<PciAddress> &addresses;
+	std::vector<PciProbeResult> &results;
+
+	PciProber(const std::vector<PciAddress> &a,
+	          std::vector<PciProbeResult> &r)
+	    : addresses(a), results(r)
+	{
+	}
+
+	void
+	operator()(size_t i) const
+	{
+		DTRACE_SPAN(TRACE_DISCOVERY, "pci probe");
+		results[i].found = PciIo::read_ids(addresses[i],
+		                                   &results[i].ids);
+	}
+};
+
+/*
+ * Fill in any IDs that sysfs did not have.  Procfs has them all in one
+ * file, so read that at most once.  Failing that, read config space.
+ */
+static void
+probe_fallback(const std::vector<PciAddress> &addresses,
+               std::vector<PciProbeResult> *results)
+{
+	std::map<PciAddress, PciIds> all_ids;
+	bool tried_procfs = false;
+	bool have_procfs = false;
+
+	for (size_t i = 0; i < addresses.size(); i++) {
+		PciProbeResult &r = (*results)[i];
+		if (r.found) {
+			continue;
+		}
+		if (!tried_procfs) {
+			have_procfs = PciIo::read_all_ids(&all_ids);
+			tried_procfs = true;
+		}
+		if (have_procfs) {
+			std::map<PciAddress, PciIds>::iterator it;
+			it = all_ids.find(addresses[i]);
+			if (it != all_ids.end()) {
+				r.ids = it->second;
+				r.found = true;
+				continue;
+			}
+		}
+		PciIo dev(addresses[i]);
+		r.ids.vendor = dev.read(0, BITS16).as_uint();
+		r.ids.device = dev.read(2, BITS16).as_uint();
+		r.found = true;
+	}
+}
+
+/*
+ * Find all PCI devices and their IDs in a snapshot.  Devices whose ID
+ * registers were not saved get IDs that nobody registers for, so they
+ * only reach the catchall.
+ */
+static void
+probe_snapshot(const ConstSnapshotPtr &snap,
+               std::vector<PciAddress> *addresses,
+               std::vector<PciProbeResult> *results)
+{
+	std::map<PciAddress, PciIds> found;
+	for (size_t i = 0; i < snap->n_bindings(); i++) {
+		string name = snap->binding_name(i);
+		unsigned seg, bus, dev, func;
+		int len = 0;
+		if (sscanf(name.c_str(), "pci<%u,%u,%u,%u>%n",
+		           &seg, &bus, &dev, &func, &len) != 4
+		 || size_t(len) != name.size()) {
+			continue;
+		}
+
+		PciIds &ids = found[PciAddress(seg, bus, dev, func)];
+		Value vid, did;
+		if (snap->read(i, 0, BITS16, &vid)
+		 && snap->read(i, 2, BITS16, &did)) {
+			ids.vendor = vid.as_uint();
+			ids.device = did.as_uint();
+		} else if (snap->read(i, 0, BITS32, &vid)) {
+			ids.vendor = vid.as_uint() & 0xffff;
+			ids.device = vid.as_uint() >> 16;
+		} else {
+			ids.vendor = 0xffff;
+			ids.device = 0xffff;
+		}
+	}
+
+	/* std::map keeps them sorted by address */
+	std::map<PciAddress, PciIds>::iterator it;
+	for (it = found.begin(); it != found.end(); it++) {
+		addresses->push_back(it->first);
+		PciProbeResult r;
+		r.ids = it->second;
+		r.found = true;
+		results->push_back(r);
+	}
 }
 
 void
 PciDriver::discover() const
 {
 	std::vector<PciAddress> addresses;
+	std::vector<PciProbeResult> probes;
+
+	if (current_snapshot()) {
+		/* find all PCI devices in the snapshot */
+		probe_snapshot(current_snapshot(), &addresses, &probes);
+	} else {
+		/* find all PCI addresses */
+		PciIo::enumerate(&addresses);
+
+		/* probe all devices at once, since that is where the
+		 * time goes */
+		probes.resize(addresses.size());
+		parallel::for_each_index(addresses.size(),
+		                         discovery_threads(),
+		                         PciProber(addresses, probes));
+		probe_fallback(addresses, &probes);
+	}
 
-	/* find all PCI addresses */
-	PciIo::enumerate(&addresses);
+	/* for each PCI device in the system, in order */
+	for (size_t i = 0; i < addresses.size(); i++) {
+		const PciAddress &addr = addresses[i];
 
-	/* for each PCI device in the system */
-	std::vector<PciAddress>::iterator it;
-	for (it = addresses.begin(); it != addresses.end(); it++) {
 		/* check if anyone registered for this vendor/device */
-		const DiscoveryRequest *dr = find_discovery_request(*it);
+		const DiscoveryRequest *dr = find_discovery_request(addr,
+		    probes[i].ids.vendor, probes[i].ids.device);
 		if (dr && dr->function == NULL) {
 			continue;
 		}
 
 		/* call the callback */
 		std::vector<Value> args;
-		args.push_back(it->segment);
-		args.push_back(it->bus);
-		args.push_back(it->device);
-		args.push_back(it->function);
+		args.push_back(addr.segment);
+		args.push_back(addr.bus);
+		args.push_back(addr.device);
+		args.push_back(addr.function);
 		if (dr) {
 			/* call the callback */
 			dr->function(args);
@@ -117,27 +267,24 @@ PciDriver::register_discovery(const std::vector<Value> &args,
 	dr.vendor = args[0].as_uint();
 	dr.device = args[1].as_uint();
 	dr.function = function;
-	m_callbacks.push_back(dr);
+	/* the first registration for a vendor/device wins */
+	m_callbacks.insert(std::make_pair(discovery_key(dr.vendor, dr.device),
+	                                  dr));
 }
 
 const PciDriver::DiscoveryRequest *
-PciDriver::find_discovery_request(const PciAddress &addr) const
+PciDriver::find_discovery_request(const PciAddress &addr,
+                                  uint16_t vid, uint16_t did) const
 {
-	PciIo dev(addr);
-	uint16_t vid = dev.read(0, BITS16).as_uint();
-	uint16_t did = dev.read(2, BITS16).as_uint();
-
 	DTRACE(TRACE_DISCOVERY, sprintfxx("discovery: pci 0x%04x 0x%04x",
 	                                  vid, did));
 
-	for (size_t i = 0; i < m_callbacks.size(); i++) {
-		if (m_callbacks[i].vendor == vid
-		 && m_callbacks[i].device == did) {
-			DTRACE(TRACE_DISCOVERY,
-			       sprintfxx("discovery: pci found match for %s",
-			                 addr));
-			return &m_callbacks[i];
-		}
+	DiscoveryMap::const_iterator it;
+	it = m_callbacks.find(discovery_key(vid, did));
+	if (it != m_callbacks.end()) {
+		DTRACE(TRACE_DISCOVERY,
+		       sprintfxx("discovery: pci found match for %s", addr));
+		return &it->second;
 	}
 
 	DTRACE(TRACE_DISCOVERY, sprintfxx("discovery: pci no match for %s",
@@ -5,6 +5,7 @@
 #include "hwpp.h"
 #include "driver.h"
 #include "pci_binding.h"
+#include <boost/unordered_map.hpp>
 
 namespace hwpp { 
 
@@ -35,6 +36,16 @@ class PciDriver: public Driver
 	virtual BindingPtr
 	new_binding(const std::vector<Value> &args) const;
 
+	/*
+	 * PciDriver::binding_name(args)
+	 *
+	 * Get the name of the Binding that new_binding(args) would create.
+	 *
+	 * Throws: Driver::ArgsError
+	 */
+	virtual string
+	binding_name(const std::vector<Value> &args) const;
+
 	/*
 	 * PciDriver::discover()
 	 *
@@ -63,9 +74,18 @@ class PciDriver: public Driver
 	};
 
 	const DiscoveryRequest *
-	find_discovery_request(const PciAddress &addr) const;
+	find_discovery_request(const PciAddress &addr,
+			uint16_t vid, uint16_t did) const;
+
+	/* callbacks are indexed by (vendor << 16 | device) */
+	typedef boost::unordered_map<uint32_t, DiscoveryRequest> DiscoveryMap;
+	static uint32_t
+	discovery_key(uint16_t vendor, uint16_t device)
+	{
+		return (uint32_t(vendor) << 16) | device;
+	}
 
-	std::vector<DiscoveryRequest> m_callbacks;
+	DiscoveryMap m_callbacks;
 	DiscoveryCallback m_catchall;
 };
 
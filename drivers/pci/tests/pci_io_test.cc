@@ -89,4 +89,59 @@ TEST(test_pci_io)
 	system("rm -rf test_data");
 }
 
+TEST(test_pci_ids)
+{
+	system("mkdir -p test_data/0000:01:02.3");
+	system("echo 0x8086 > test_data/0000:01:02.3/vendor");
+	system("echo 0x1234 > test_data/0000:01:02.3/device");
+	system("mkdir -p test_data/0000:01:02.4");
+	system("printf '0000\t10de0041\t0\n"
+	       "0209\t14e41639\t0\n' > test_data/devices");
+
+	try {
+		/* test read_ids() */
+		PciIds ids;
+		if (!PciIo::read_ids(PciAddress(0, 1, 2, 3), &ids, "test_data")
+		 || ids.vendor != 0x8086 || ids.device != 0x1234) {
+			TEST_FAIL("PciIo::read_ids()");
+		}
+		if (PciIo::read_ids(PciAddress(0, 1, 2, 4), &ids, "test_data")) {
+			TEST_FAIL("PciIo::read_ids()");
+		}
+
+		/* test read_all_ids() */
+		std::map<PciAddress, PciIds> all_ids;
+		if (!PciIo::read_all_ids(&all_ids, "test_data")
+		 || all_ids.size() != 2) {
+			TEST_FAIL("PciIo::read_all_ids()");
+		}
+		ids = all_ids[PciAddress(0, 0, 0)];
+		if (ids.vendor != 0x10de || ids.device != 0x0041) {
+			TEST_FAIL("PciIo::read_all_ids()");
+		}
+		ids = all_ids[PciAddress(2, 1, 1)];
+		if (ids.vendor != 0x14e4 || ids.device != 0x1639) {
+			TEST_FAIL("PciIo::read_all_ids()");
+		}
+		all_ids.clear();
+		if (PciIo::read_all_ids(&all_ids, "test_data.not")) {
+			TEST_FAIL("PciIo::read_all_ids()");
+		}
+
+		/* without domains, a repeated bus/devfn is ambiguous */
+		system("printf '0000\t10de0041\t0\n"
+		       "0209\t14e41639\t0\n"
+		       "0000\t80861234\t0\n' > test_data/devices");
+		if (PciIo::read_all_ids(&all_ids, "test_data")
+		 || all_ids.size() != 0) {
+			TEST_FAIL("PciIo::read_all_ids()");
+		}
+	} catch (std::exception &e) {
+		system("rm -rf test_data");
+		throw;
+	}
+
+	system("rm -rf test_data");
+}
+
 }  // namespace hwpp
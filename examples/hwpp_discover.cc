@@ -7,6 +7,10 @@
 #include "field_types.h"
 #include "array.h"
 #include "alias.h"
+#include "tree_writer.h"
+#include "util/output_buffer.h"
+#include <unistd.h>
+#include <stdexcept>
 #include "cmdline.h"
 
 using namespace std;
@@ -15,6 +19,7 @@ cmdline_bool skip_regs = false;
 cmdline_bool skip_fields = false;
 cmdline_bool skip_scopes = false;
 cmdline_bool skip_aliases = false;
+cmdline_string format = NULL;
 
 static void
 dump_field(const string &name, const hwpp::ConstFieldPtr &field);
@@ -139,6 +144,11 @@ static struct cmdline_opt hwpp_opts[] = {
 		CMDLINE_OPT_BOOL, &skip_aliases,
 		"", "don't print aliases"
 	},
+	{
+		"f", "format",
+		CMDLINE_OPT_STRING, &format,
+		"FORMAT", "print as text (default), json, csv or tsv"
+	},
 	{
 		"h", "help",
 		CMDLINE_OPT_CALLBACK, (void *)do_help,
@@ -175,6 +185,29 @@ do_help(...)
 	exit(EXIT_SUCCESS);
 }
 
+// Write the whole tree in a machine-readable format.
+static void
+write_tree(const hwpp::ConstScopePtr &root, const string &format)
+{
+	unsigned flags = 0;
+	if (skip_regs) {
+		flags |= hwpp::TREE_SKIP_REGISTERS;
+	}
+	if (skip_fields) {
+		flags |= hwpp::TREE_SKIP_FIELDS;
+	}
+	if (skip_aliases) {
+		flags |= hwpp::TREE_SKIP_ALIASES;
+	}
+
+	util::OutputBuffer out(STDOUT_FILENO);
+	hwpp::TreeWriterPtr writer = hwpp::new_tree_writer(format, &out);
+	writer->begin_output();
+	hwpp::write_tree(root, "", writer.get(), flags);
+	writer->end_output();
+	out.flush();
+}
+
 int
 main(int argc, const char *argv[])
 {
@@ -186,7 +219,16 @@ main(int argc, const char *argv[])
 
 	hwpp::ScopePtr root = hwpp::initialize_device_tree();
 	hwpp::do_discovery();
-	dump_scope("", root);
+	if (format && string(format) != "text") {
+		try {
+			write_tree(root, format);
+		} catch (std::invalid_argument &e) {
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+	} else {
+		dump_scope("", root);
+	}
 
 	return 0;
 }
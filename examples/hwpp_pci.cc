@@ -6,9 +6,16 @@
 #include "datatype_types.h"
 #include "field_types.h"
 #include "array.h"
+#include "tree_writer.h"
+#include "util/output_buffer.h"
+#include <unistd.h>
+#include <stdexcept>
+#include "cmdline.h"
 
 using namespace std;
 
+cmdline_string format = NULL;
+
 static void
 dump_field(const string &name, const hwpp::ConstFieldPtr &field,
            const string &indent="");
@@ -100,11 +107,81 @@ dump_scope(const string &name, const hwpp::ConstScopePtr &scope,
 	cout << indent << "}" << endl;
 }
 
+static void do_help(...);
+static struct cmdline_opt hwpp_opts[] = {
+	{
+		"f", "format",
+		CMDLINE_OPT_STRING, &format,
+		"FORMAT", "print as text (default), json, csv or tsv"
+	},
+	{
+		"h", "help",
+		CMDLINE_OPT_CALLBACK, (void *)do_help,
+		"", "produce this help message"
+	},
+	CMDLINE_OPT_END_OF_LIST
+};
+
+static void
+usage(const char *bad_opt)
+{
+	ostream *out;
+
+	if (bad_opt == NULL) {
+		out = &cout;
+	} else {
+		out = &cerr;
+		*out << "unknown argument: '" << bad_opt << "'" << std::endl;
+	}
+
+	*out << "usage: " << cmdline_progname << " [OPTIONS]" << std::endl;
+	*out << std::endl;
+	*out << "OPTIONS:" << std::endl;
+	while (const char *help_str = cmdline_help(hwpp_opts)) {
+		*out << "  " << help_str << std::endl;
+	}
+	*out << std::endl;
+}
+
+static void
+do_help(...)
+{
+	usage(NULL);
+	exit(EXIT_SUCCESS);
+}
+
+// Write the whole tree in a machine-readable format.
+static void
+write_tree(const hwpp::ConstScopePtr &root, const string &format)
+{
+	util::OutputBuffer out(STDOUT_FILENO);
+	hwpp::TreeWriterPtr writer = hwpp::new_tree_writer(format, &out);
+	writer->begin_output();
+	hwpp::write_tree(root, "", writer.get());
+	writer->end_output();
+	out.flush();
+}
+
 int
-main()
+main(int argc, const char *argv[])
 {
+	cmdline_parse(&argc, &argv, hwpp_opts);
+	if (argc != 1) {
+		usage(argv[1]);
+		exit(EXIT_FAILURE);
+	}
+
 	hwpp::ScopePtr root = hwpp::initialize_device_tree();
 	hwpp::do_discovery("pci");
-	dump_scope("", root);
+	if (format && string(format) != "text") {
+		try {
+			write_tree(root, format);
+		} catch (std::invalid_argument &e) {
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+	} else {
+		dump_scope("", root);
+	}
 	return 0;
 }
@@ -1,5 +1,7 @@
 // This tool takes a list of HWPP paths (on the commandline or stdin) and
-// reads them.  If a path is a scope or array, it will recurse.
+// reads them.  If a path is a scope or array, it will recurse.  A path with
+// glob syntax, such as "pci.*/capability[*]/link", is run as a query, and
+// only the dirents which match it are read.
 #include "hwpp.h"
 #include "util/printfxx.h"
 #include "drivers.h"
@@ -9,6 +11,17 @@
 #include "scope.h"
 #include "array.h"
 #include "alias.h"
+#include "snapshot.h"
+#include "diff.h"
+#include "binding_stats.h"
+#include "trace.h"
+#include "tree_writer.h"
+#include "query.h"
+#include "drivers/msr/msr_sampler.h"
+#include "util/output_buffer.h"
+#include <unistd.h>
+#include <fstream>
+#include <stdexcept>
 #include "cmdline.h"
 
 using namespace std;
@@ -17,142 +30,333 @@ cmdline_bool skip_regs = false;
 cmdline_bool skip_fields = false;
 cmdline_bool skip_scopes = false;
 cmdline_bool skip_aliases = false;
+cmdline_string snapshot_in = NULL;
+cmdline_string snapshot_out = NULL;
+cmdline_string diff_in = NULL;
+cmdline_bool print_stats = false;
+cmdline_string trace_out = NULL;
+cmdline_string trace_categories = NULL;
+cmdline_string format = NULL;
+cmdline_string query_types = NULL;
+cmdline_string query_datatype = NULL;
+cmdline_string msr_list = NULL;
+
+// Dumps print a lot of lines, so they are built in one reused path buffer
+// and written through one big output buffer, rather than through cout.
+static util::OutputBuffer out(STDOUT_FILENO);
+static util::PathBuffer cur_path;
+
+// Set for any format but text.
+static hwpp::TreeWriterPtr writer;
+
+// Report an error, after anything already dumped.
+static std::ostream &
+dump_error()
+{
+	out.flush();
+	return cerr << cur_path.str() << ": ";
+}
 
 static void
-dump_field(const string &name, const hwpp::ConstFieldPtr &field);
+dump_field(const hwpp::ConstFieldPtr &field);
 static void
-dump_register(const string &name, const hwpp::ConstRegisterPtr &reg);
+dump_register(const hwpp::ConstRegisterPtr &reg);
 static void
-dump_scope(const string &name, const hwpp::ConstScopePtr &scope);
+dump_scope(const hwpp::ConstScopePtr &scope);
 static void
-dump_array(const string &name, const hwpp::ConstArrayPtr &array);
+dump_array(const hwpp::ConstArrayPtr &array);
 static void
-dump_alias(const string &name, const hwpp::ConstAliasPtr &alias);
+dump_alias(const hwpp::ConstAliasPtr &alias);
 
 static void
-dump_field(const string &name, const hwpp::ConstFieldPtr &field)
+dump_field(const hwpp::ConstFieldPtr &field)
 {
 	if (!skip_fields) {
-		cout << name << ": "
-		     << field->evaluate()
-		     << std::hex
-		     << " (0x" << field->read() << ")"
-		     << endl;
+		out.write(cur_path.str());
+		out.write(": ");
+		out.write(field->evaluate());
+		out.write(" (0x");
+		out.write_hex(field->read());
+		out.write(")\n");
 	}
 }
 
 static void
-dump_register(const string &name, const hwpp::ConstRegisterPtr &reg)
+dump_register(const hwpp::ConstRegisterPtr &reg)
 {
 	if (!skip_regs) {
-		cout << name << ": "
-		     << std::hex
-		     << "0x" << reg->read()
-		     << endl;
+		out.write(cur_path.str());
+		out.write(": 0x");
+		out.write_hex(reg->read());
+		out.write('\n');
 	}
 }
 
 static void
-dump_scope(const string &name, const hwpp::ConstScopePtr &scope)
+dump_scope(const hwpp::ConstScopePtr &scope)
 {
 	if (!skip_scopes) {
-		cout << name << "/";
+		out.write(cur_path.str());
+		out.write('/');
 		if (scope->is_bound()) {
-			cout << " (@" << *scope->binding() << ")";
+			out.write(" (@");
+			out.write(scope->binding()->to_string());
+			out.write(')');
 		}
-		cout << endl;
+		out.write('\n');
 	}
 
 	for (size_t i = 0; i < scope->n_dirents(); i++) {
-		string subname = sprintfxx("%s/%s",name,scope->dirent_name(i));
-		if (scope->dirent(i)->is_field()) {
-			dump_field(subname,
-			    hwpp::field_from_dirent(scope->dirent(i)));
-		} else if (scope->dirent(i)->is_register()) {
-			dump_register(subname,
-			    hwpp::register_from_dirent(scope->dirent(i)));
-		} else if (scope->dirent(i)->is_scope()) {
-			dump_scope(subname,
-			    hwpp::scope_from_dirent(scope->dirent(i)));
-		} else if (scope->dirent(i)->is_array()) {
-			dump_array(subname,
-			    hwpp::array_from_dirent(scope->dirent(i)));
-		} else if (scope->dirent(i)->is_alias()) {
-			dump_alias(subname,
-			    hwpp::alias_from_dirent(scope->dirent(i)));
+		size_t mark = cur_path.push("/", scope->dirent_name(i));
+		const hwpp::ConstDirentPtr &de = scope->dirent(i);
+		if (de->is_field()) {
+			dump_field(hwpp::field_from_dirent(de));
+		} else if (de->is_register()) {
+			dump_register(hwpp::register_from_dirent(de));
+		} else if (de->is_scope()) {
+			dump_scope(hwpp::scope_from_dirent(de));
+		} else if (de->is_array()) {
+			dump_array(hwpp::array_from_dirent(de));
+		} else if (de->is_alias()) {
+			dump_alias(hwpp::alias_from_dirent(de));
 		} else {
-			cerr << subname << ": unknown dirent type: "
-			     << scope->dirent(i)->dirent_type() << endl;
+			dump_error() << "unknown dirent type: "
+			             << de->dirent_type() << endl;
 		}
+		cur_path.pop(mark);
 	}
 }
 
 static void
-dump_array(const string &name, const hwpp::ConstArrayPtr &array)
+dump_array(const hwpp::ConstArrayPtr &array)
 {
 	for (size_t i = 0; i < array->size(); i++) {
-		string subname = sprintfxx("%s[%d]", name, i);
+		size_t mark = cur_path.push_index(i);
 		if (array->array_type() == hwpp::DIRENT_TYPE_FIELD) {
-			dump_field(subname,
-			    hwpp::field_from_dirent(array->at(i)));
+			dump_field(hwpp::field_from_dirent(array->at(i)));
 		} else if (array->array_type() == hwpp::DIRENT_TYPE_REGISTER) {
-			dump_register(subname,
-			    hwpp::register_from_dirent(array->at(i)));
+			dump_register(hwpp::register_from_dirent(array->at(i)));
 		} else if (array->array_type() == hwpp::DIRENT_TYPE_SCOPE) {
-			dump_scope(subname,
-			    hwpp::scope_from_dirent(array->at(i)));
+			dump_scope(hwpp::scope_from_dirent(array->at(i)));
 		} else if (array->array_type() == hwpp::DIRENT_TYPE_ARRAY) {
-			dump_array(subname,
-			    hwpp::array_from_dirent(array->at(i)));
+			dump_array(hwpp::array_from_dirent(array->at(i)));
 		} else if (array->array_type() == hwpp::DIRENT_TYPE_ALIAS) {
-			dump_alias(subname,
-			    hwpp::alias_from_dirent(array->at(i)));
+			dump_alias(hwpp::alias_from_dirent(array->at(i)));
 		} else {
-			cerr << name << ": unknown array type: "
-			     << array->array_type() << endl;
+			cur_path.pop(mark);
+			dump_error() << "unknown array type: "
+			             << array->array_type() << endl;
 			return;
 		}
+		cur_path.pop(mark);
 	}
 }
 
 static void
-dump_alias(const string &name, const hwpp::ConstAliasPtr &alias)
+dump_alias(const hwpp::ConstAliasPtr &alias)
 {
 	if (!skip_aliases) {
-		cout << name << ": ->"
-		     << std::hex
-		     << alias->link_path()
-		     << endl;
+		out.write(cur_path.str());
+		out.write(": ->");
+		out.write(alias->link_path().to_string());
+		out.write('\n');
 	}
 }
 
-static void
-dump_dirent(hwpp::ScopePtr &root, string path)
+// The tree_writer flags for the --no-* options.  Scopes are always
+// written, since they hold everything else.
+static unsigned
+tree_flags()
 {
-	// special-case for "/"
-	if (path == "/") {
-		path = "";
+	unsigned flags = 0;
+	if (skip_regs) {
+		flags |= hwpp::TREE_SKIP_REGISTERS;
 	}
+	if (skip_fields) {
+		flags |= hwpp::TREE_SKIP_FIELDS;
+	}
+	if (skip_aliases) {
+		flags |= hwpp::TREE_SKIP_ALIASES;
+	}
+	return flags;
+}
 
-	const hwpp::ConstDirentPtr &de = root->lookup_dirent(path);
-	if (de == NULL) {
-		cerr << path << ": path not found" << endl;
+// Dump 'de', which is at 'path'.  cur_path must already be 'path'.
+static void
+dump_match(const hwpp::ConstDirentPtr &de, const string &path)
+{
+	if (writer) {
+		hwpp::write_tree(de, path, writer.get(), tree_flags());
 	} else if (de->is_field()) {
-		dump_field(path, hwpp::field_from_dirent(de));
+		dump_field(hwpp::field_from_dirent(de));
 	} else if (de->is_register()) {
-		dump_register(path, hwpp::register_from_dirent(de));
+		dump_register(hwpp::register_from_dirent(de));
 	} else if (de->is_scope()) {
-		dump_scope(path, hwpp::scope_from_dirent(de));
+		dump_scope(hwpp::scope_from_dirent(de));
 	} else if (de->is_array()) {
-		dump_array(path, hwpp::array_from_dirent(de));
+		dump_array(hwpp::array_from_dirent(de));
 	} else if (de->is_alias()) {
-		dump_alias(path, hwpp::alias_from_dirent(de));
+		dump_alias(hwpp::alias_from_dirent(de));
 	} else {
-		cerr << path << ": unknown dirent type: "
-		     << de->dirent_type() << endl;
+		dump_error() << "unknown dirent type: "
+		             << de->dirent_type() << endl;
+	}
+}
+
+// A Query callback.
+static void
+dump_query_match(const string &path, const hwpp::ConstDirentPtr &de)
+{
+	size_t mark = cur_path.push("", path);
+	dump_match(de, path);
+	cur_path.pop(mark);
+}
+
+static void
+dump_query(hwpp::ScopePtr &root, const string &pattern)
+{
+	try {
+		hwpp::Query query(pattern);
+		if (query_types) {
+			query.set_types(query_types);
+		}
+		if (query_datatype) {
+			query.set_datatype(query_datatype);
+		}
+		query.run(root, dump_query_match);
+	} catch (std::invalid_argument &e) {
+		out.flush();
+		cerr << e.what() << endl;
+	} catch (...) {
+		// don't lose what was dumped before the failure
+		out.flush();
+		throw;
 	}
 }
 
+static void
+dump_dirent(hwpp::ScopePtr &root, string path)
+{
+	// Filters only make sense for a query, so they make any path one.
+	if (hwpp::Query::is_query(path) || query_types || query_datatype) {
+		dump_query(root, path);
+		return;
+	}
+
+	// special-case for "/"
+	if (path == "/") {
+		path = "";
+	}
+
+	size_t mark = cur_path.push("", path);
+	try {
+		const hwpp::ConstDirentPtr &de = root->lookup_dirent(path);
+		if (de == NULL) {
+			dump_error() << "path not found" << endl;
+		} else {
+			dump_match(de, path);
+		}
+	} catch (...) {
+		// don't lose what was dumped before the failure
+		out.flush();
+		throw;
+	}
+	cur_path.pop(mark);
+}
+
+static void
+dump_diff(const hwpp::ConstScopePtr &root, const string &filename)
+{
+	hwpp::FieldIndex index(root);
+	hwpp::SnapshotDiffSource before(hwpp::Snapshot::open(filename));
+	hwpp::LiveDiffSource after(index);
+	hwpp::TreeDiff diff;
+	hwpp::diff_tree(index, before, after, &diff);
+
+	if (!skip_regs) {
+		for (size_t i = 0; i < diff.registers.size(); i++) {
+			const hwpp::RegisterChange &rc = diff.registers[i];
+			cout << rc.key.binding << std::hex
+			     << " 0x" << rc.key.address
+			     << std::dec << " (" << rc.key.width << " bits): ";
+			cout << std::hex;
+			if (rc.old_valid) {
+				cout << "0x" << rc.old_value;
+			} else {
+				cout << "<unreadable>";
+			}
+			cout << " -> ";
+			if (rc.new_valid) {
+				cout << "0x" << rc.new_value;
+			} else {
+				cout << "<unreadable>";
+			}
+			cout << endl;
+		}
+	}
+	if (!skip_fields) {
+		for (size_t i = 0; i < diff.fields.size(); i++) {
+			const hwpp::FieldChange &fc = diff.fields[i];
+			cout << fc.path << ": "
+			     << (fc.old_valid ? fc.old_string : "<unreadable>")
+			     << " -> "
+			     << (fc.new_valid ? fc.new_string : "<unreadable>")
+			     << endl;
+		}
+	}
+}
+
+// Read a list of MSRs, like "0x10,0x19c", on every CPU at once, and
+// print one line per CPU and MSR.
+static int
+dump_msrs(const string &list)
+{
+	std::vector<uint32_t> msrs;
+	size_t pos = 0;
+	while (pos <= list.size()) {
+		size_t end = list.find(',', pos);
+		if (end == string::npos) {
+			end = list.size();
+		}
+		string str = list.substr(pos, end - pos);
+		pos = end + 1;
+		char *p;
+		unsigned long msr = strtoul(str.c_str(), &p, 0);
+		if (str.empty() || *p != '\0' || msr > 0xffffffffUL) {
+			cerr << "invalid MSR: " << str << endl;
+			return EXIT_FAILURE;
+		}
+		msrs.push_back(msr);
+	}
+
+	std::vector<std::vector<hwpp::Value> > values;
+	std::vector<unsigned> cpus;
+	try {
+		// this loads the msr kernel module
+		hwpp::find_driver("msr");
+		hwpp::MsrSampler::enumerate(&cpus);
+		hwpp::MsrSampler sampler(cpus);
+		sampler.read(msrs, &values);
+	} catch (std::exception &e) {
+		cerr << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+
+	for (size_t c = 0; c < cpus.size(); c++) {
+		for (size_t i = 0; i < msrs.size(); i++) {
+			out.write("msr<");
+			out.write_dec(cpus[c]);
+			out.write("> 0x");
+			out.write_hex(msrs[i]);
+			out.write(": 0x");
+			out.write_hex(values[c][i]);
+			out.write('\n');
+		}
+	}
+	out.flush();
+	return 0;
+}
+
 static void do_help(...);
 static struct cmdline_opt hwpp_opts[] = {
 	{
@@ -175,6 +379,56 @@ static struct cmdline_opt hwpp_opts[] = {
 		CMDLINE_OPT_BOOL, &skip_aliases,
 		"", "don't print aliases"
 	},
+	{
+		"f", "format",
+		CMDLINE_OPT_STRING, &format,
+		"FORMAT", "print as text (default), json, csv or tsv"
+	},
+	{
+		"y", "type",
+		CMDLINE_OPT_STRING, &query_types,
+		"LIST", "only print these dirent types, as \"field,register\""
+	},
+	{
+		"D", "datatype",
+		CMDLINE_OPT_STRING, &query_datatype,
+		"GLOB", "only print fields of datatypes named GLOB"
+	},
+	{
+		"m", "msr",
+		CMDLINE_OPT_STRING, &msr_list,
+		"LIST", "read these MSRs on every CPU at once and exit"
+	},
+	{
+		"s", "snapshot",
+		CMDLINE_OPT_STRING, &snapshot_in,
+		"FILE", "read from a snapshot, rather than hardware"
+	},
+	{
+		"w", "write-snapshot",
+		CMDLINE_OPT_STRING, &snapshot_out,
+		"FILE", "save a snapshot of all registers and exit"
+	},
+	{
+		"d", "diff",
+		CMDLINE_OPT_STRING, &diff_in,
+		"FILE", "print what changed since a snapshot and exit"
+	},
+	{
+		"S", "stats",
+		CMDLINE_OPT_BOOL, &print_stats,
+		"", "print I/O statistics per binding to stderr when done"
+	},
+	{
+		"t", "trace",
+		CMDLINE_OPT_STRING, &trace_out,
+		"FILE", "write a Chrome trace to FILE when done"
+	},
+	{
+		"T", "trace-categories",
+		CMDLINE_OPT_STRING, &trace_categories,
+		"LIST", "trace only these categories (default: all)"
+	},
 	{
 		"h", "help",
 		CMDLINE_OPT_CALLBACK, (void *)do_help,
@@ -207,19 +461,71 @@ main(int argc, const char *argv[])
 {
 	cmdline_parse(&argc, &argv, hwpp_opts);
 
+	if (trace_out) {
+		try {
+			hwpp::trace::enable(hwpp::trace::parse_categories(
+			    trace_categories ? trace_categories : "all"));
+		} catch (std::invalid_argument &e) {
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (format && string(format) != "text") {
+		try {
+			writer = hwpp::new_tree_writer(format, &out);
+		} catch (std::invalid_argument &e) {
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (msr_list) {
+		// this reads hardware directly, without a device tree
+		return dump_msrs(msr_list);
+	}
+	if (snapshot_in) {
+		hwpp::set_snapshot(hwpp::Snapshot::open(snapshot_in));
+	}
+	// This must be set before discovery creates the bindings.
+	hwpp::set_binding_stats(print_stats);
+
 	hwpp::ScopePtr root = hwpp::initialize_device_tree();
 	hwpp::do_discovery();
 
-	if (argc == 1) {
-		string path;
-		while (cin >> path) {
-			dump_dirent(root, path);
-		}
+	if (snapshot_out) {
+		hwpp::write_snapshot(root, snapshot_out);
+	} else if (diff_in) {
+		dump_diff(root, diff_in);
 	} else {
-		for (int i = 1; i < argc; i++) {
-			dump_dirent(root, argv[i]);
+		if (writer) {
+			writer->begin_output();
+		}
+		if (argc == 1) {
+			string path;
+			while (cin >> path) {
+				dump_dirent(root, path);
+			}
+		} else {
+			for (int i = 1; i < argc; i++) {
+				dump_dirent(root, argv[i]);
+			}
+		}
+		if (writer) {
+			writer->end_output();
 		}
 	}
 
+	out.flush();
+
+	if (print_stats) {
+		hwpp::dump_binding_stats(cerr);
+	}
+	if (trace_out) {
+		std::ofstream out(trace_out);
+		hwpp::trace::write_chrome_trace(out);
+		if (!out) {
+			cerr << trace_out << ": can't write trace" << endl;
+			return EXIT_FAILURE;
+		}
+	}
 	return 0;
 }
@@ -7,10 +7,14 @@
 #include "register.h"
 #include "scope.h"
 #include "array.h"
+#include "binding_stats.h"
 #include "util/sockets.h"
 
 using namespace std;
 
+// Paths never start with ':', so this can't collide with one.
+static const string STATS_REQUEST = ":stats";
+
 string
 dump_field(const string &name, const hwpp::ConstFieldPtr &field);
 string
@@ -129,7 +133,10 @@ dump_dirent(hwpp::ScopePtr &root, const string &path)
 void
 usage(ostream &out, const char *progname)
 {
-	out << "usage: " << progname << " socketpath" << endl;
+	out << "usage: " << progname << " [--stats] socketpath" << endl;
+	out << endl;
+	out << "With --stats, a request for \"" << STATS_REQUEST << "\""
+	    << " returns I/O statistics per binding." << endl;
 }
 
 void exit_handler(int sig) {
@@ -145,6 +152,15 @@ main(int argc, const char *argv[])
 		usage(cout, argv[0]);
 		return EXIT_SUCCESS;
 	}
+	bool stats = false;
+	if (argc > 1 && string(argv[1]) == "--stats") {
+		stats = true;
+		argv[1] = argv[0];
+		argc--;
+		argv++;
+	}
+	// This must be set before discovery creates the bindings.
+	hwpp::set_binding_stats(stats);
 
 	signal(SIGINT, exit_handler);
 	signal(SIGTERM, exit_handler);
@@ -164,7 +180,13 @@ main(int argc, const char *argv[])
 				if (!s.is_connected()) {
 					break;
 				}
-				s.send(dump_dirent(root, path));
+				if (stats && path == STATS_REQUEST) {
+					stringstream out;
+					hwpp::dump_binding_stats(out);
+					s.send(out.str());
+				} else {
+					s.send(dump_dirent(root, path));
+				}
 				s.send("\n");
 			}
 		}
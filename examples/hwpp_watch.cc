@@ -0,0 +1,177 @@
+// This tool takes a list of HWPP paths or queries (on the commandline or
+// stdin) and reads them at a fixed interval, printing only what changed.
+// Fields of counter datatypes (see --counters) are printed with a rate.
+#include "hwpp.h"
+#include "drivers.h"
+#include "device_init.h"
+#include "watch.h"
+#include "util/interval_timer.h"
+#include "util/output_buffer.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <stdexcept>
+#include "cmdline.h"
+
+using namespace std;
+
+cmdline_uint interval_ms = 1000;
+cmdline_uint poll_count = 0;
+cmdline_string counters = NULL;
+
+static util::OutputBuffer out(STDOUT_FILENO);
+
+static void
+print_value(const hwpp::WatchChange &change, bool valid, const string &str,
+            const hwpp::Value &value)
+{
+	if (!valid) {
+		out.write("<unreadable>");
+	} else if (change.is_field) {
+		out.write(str);
+		out.write(" (0x");
+		out.write_hex(value);
+		out.write(')');
+	} else {
+		out.write("0x");
+		out.write_hex(value);
+	}
+}
+
+// Print one change, as "seconds path: [old -> ]new[ (rate/s)]".
+static void
+print_change(uint64_t elapsed_ns, const hwpp::WatchChange &change,
+             bool first)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%llu.%03llu ",
+	         (unsigned long long)(elapsed_ns / 1000000000ULL),
+	         (unsigned long long)(elapsed_ns / 1000000ULL % 1000));
+	out.write(buf);
+	out.write(change.path);
+	out.write(": ");
+	if (!first) {
+		print_value(change, change.old_valid, change.old_string,
+		            change.old_value);
+		out.write(" -> ");
+	}
+	print_value(change, change.new_valid, change.new_string,
+	            change.new_value);
+	if (change.has_rate) {
+		snprintf(buf, sizeof(buf), " (%.1f/s)", change.rate);
+		out.write(buf);
+	}
+	out.write('\n');
+}
+
+static void do_help(...);
+static struct cmdline_opt hwpp_opts[] = {
+	{
+		"i", "interval",
+		CMDLINE_OPT_UINT, &interval_ms,
+		"MS", "poll every MS milliseconds (default: 1000)"
+	},
+	{
+		"n", "count",
+		CMDLINE_OPT_UINT, &poll_count,
+		"N", "stop after N polls (default: run forever)"
+	},
+	{
+		"c", "counters",
+		CMDLINE_OPT_STRING, &counters,
+		"GLOB", "print rates for fields of datatypes named GLOB"
+	},
+	{
+		"h", "help",
+		CMDLINE_OPT_CALLBACK, (void *)do_help,
+		"", "produce this help message"
+	},
+	CMDLINE_OPT_END_OF_LIST
+};
+
+static void
+usage()
+{
+	cout << "usage: " << cmdline_progname << " [OPTIONS] [PATH ...]"
+	     << std::endl;
+	cout << std::endl;
+	cout << "OPTIONS:" << std::endl;
+	while (const char *help_str = cmdline_help(hwpp_opts)) {
+		cout << "  " << help_str << std::endl;
+	}
+	cout << std::endl;
+}
+
+static void
+do_help(...)
+{
+	usage();
+	exit(EXIT_SUCCESS);
+}
+
+int
+main(int argc, const char *argv[])
+{
+	cmdline_parse(&argc, &argv, hwpp_opts);
+
+	hwpp::ScopePtr root = hwpp::initialize_device_tree();
+	hwpp::do_discovery();
+
+	hwpp::Watch watch(root);
+	if (counters) {
+		watch.set_counters(counters);
+	}
+	vector<string> paths;
+	if (argc == 1) {
+		string path;
+		while (cin >> path) {
+			paths.push_back(path);
+		}
+	} else {
+		for (int i = 1; i < argc; i++) {
+			paths.push_back(argv[i]);
+		}
+	}
+	for (size_t i = 0; i < paths.size(); i++) {
+		try {
+			if (watch.add(paths[i]) == 0) {
+				cerr << paths[i] << ": path not found" << endl;
+			}
+		} catch (std::invalid_argument &e) {
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (watch.size() == 0) {
+		cerr << "nothing to watch" << endl;
+		return EXIT_FAILURE;
+	}
+
+	try {
+		util::IntervalTimer timer(interval_ms * 1000000ULL);
+		std::vector<hwpp::WatchChange> changes;
+		for (uint64_t n = 0; poll_count == 0 || n < poll_count; n++) {
+			if (n > 0) {
+				uint64_t ticks = timer.wait();
+				if (ticks > 1) {
+					out.flush();
+					cerr << "missed " << ticks - 1
+					     << " polls" << endl;
+				}
+			}
+			uint64_t now = util::monotonic_ns();
+			changes.clear();
+			watch.poll(now, &changes);
+			uint64_t elapsed = (now > timer.start_ns())
+			    ? now - timer.start_ns() : 0;
+			for (size_t i = 0; i < changes.size(); i++) {
+				print_change(elapsed, changes[i], n == 0);
+			}
+			out.flush();
+		}
+	} catch (std::exception &e) {
+		out.flush();
+		cerr << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
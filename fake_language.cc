@@ -14,9 +14,11 @@
 #include "register.h"
 #include "register_types.h"
 #include "scope.h"
+#include "scope_template.h"
 #include "datatype_types.h"
 #include "alias.h"
 
+#include <map>
 #include <stdexcept>
 
 namespace hwpp {
@@ -247,6 +249,128 @@ fkl_close_scope(const ParseLocation &loc)
 	global_runtime()->context_pop();
 }
 
+// This is the Scope::Builder for lazy scopes.
+struct FklLazyScopeBuilder {
+	Path::Element elem;
+	FklScopeBody body;
+
+	FklLazyScopeBuilder(const Path::Element &e, const FklScopeBody &b)
+	    : elem(e), body(b)
+	{
+	}
+
+	void
+	operator()(const ScopePtr &scope) const
+	{
+		DTRACE(TRACE_SCOPES, "build lazy scope: " + elem.to_string());
+
+		global_runtime()->context_push(new_hwpp_context(elem, scope));
+		try {
+			body();
+		} catch (...) {
+			global_runtime()->context_pop();
+			throw;
+		}
+		global_runtime()->context_pop();
+	}
+};
+
+//
+// Start a new lazy scope.
+//
+void
+fkl_lazy_scope(const ParseLocation &loc, const string &name,
+               const BindingPtr &binding, const FklScopeBody &body)
+{
+	DTRACE(TRACE_SCOPES, "lazy scope: " + name);
+
+	DASSERT_MSG(!global_runtime()->current_context()->is_readonly(),
+		"current_context is read-only");
+
+	try {
+		Path::Element elem(name);
+
+		// make sure the name is valid
+		fkl_validate_scope_name(elem, loc);
+
+		// note: this is not a debug-only test
+		if (fkl_defined(loc, Path(elem))) {
+			WARN(sprintfxx("%s: '%s' redefined", loc, name));
+		}
+
+		// make a new scope and link it into the tree
+		ScopePtr scope_ptr = new_hwpp_scope(binding);
+		scope_ptr->set_parent(global_runtime()->current_context()->scope());
+		scope_ptr->set_builder(FklLazyScopeBuilder(elem, body));
+
+		// add the new scope to the parent, but do not enter it
+		global_runtime()->current_context()->add_dirent(elem, scope_ptr);
+	} catch (Path::InvalidError &e) {
+		throw ParseError(e.what(), loc);
+	}
+}
+
+// Compiled templates, by key.  A NULL template means the key's body could
+// not be made into one.
+typedef std::map<string, ConstScopeTemplatePtr> FklTemplateMap;
+static FklTemplateMap fkl_templates;
+
+// Run a template body in a scratch scope on the placeholder binding, and
+// compile the result.
+static ConstScopeTemplatePtr
+fkl_compile_template(const string &key, const FklScopeBody &body)
+{
+	DTRACE(TRACE_SCOPES, "compile template: " + key);
+
+	ScopePtr scratch = new_hwpp_scope(ScopeTemplate::placeholder());
+	scratch->set_parent(global_runtime()->current_context()->scope());
+	global_runtime()->context_push(
+	    new_hwpp_context(global_runtime()->current_context()->name(),
+	                     scratch));
+	try {
+		body();
+	} catch (std::exception &e) {
+		// the body will run again on the real scope, and any
+		// real error will show up then
+		global_runtime()->context_pop();
+		DTRACE(TRACE_SCOPES, "template " + key
+		                     + " failed: " + e.what());
+		return ConstScopeTemplatePtr();
+	}
+	global_runtime()->context_pop();
+
+	return ScopeTemplate::compile(scratch);
+}
+
+//
+// Build part of the current scope from a shared template.
+//
+void
+fkl_template(const ParseLocation &loc, const string &key,
+             const FklScopeBody &body)
+{
+	(void)loc;
+	DASSERT_MSG(!global_runtime()->current_context()->is_readonly(),
+		"current_context is read-only");
+
+	ScopePtr scope = global_runtime()->current_context()->scope();
+	if (scope->n_dirents() == 0) {
+		FklTemplateMap::iterator it = fkl_templates.find(key);
+		if (it == fkl_templates.end()) {
+			ConstScopeTemplatePtr tmpl =
+			    fkl_compile_template(key, body);
+			it = fkl_templates.insert(
+			    std::make_pair(key, tmpl)).first;
+		}
+		if (it->second) {
+			DTRACE(TRACE_SCOPES, "use template: " + key);
+			scope->set_template(it->second);
+			return;
+		}
+	}
+	body();
+}
+
 //
 // Define a bookmark
 //
@@ -19,6 +19,7 @@
 #include <vector>
 #include <iostream>
 #include <unistd.h>
+#include <boost/function.hpp>
 
 #include "field_types.h"
 
@@ -44,13 +45,18 @@ operator,(const FklFormattedArglist &lhs, const Trhs &rhs)
 	return lhs;
 }
 inline void
-WARNF(const FklFormattedArglist &arglist)
+WARNF(const char *file, int line, const char *func,
+      const FklFormattedArglist &arglist)
 {
-	WARN(to_string(arglist.result));
+	// This goes to the log sink, so apps can redirect it.
+	log_warning(file, line, func, to_string(arglist.result));
 }
 // WARN() operates like printf(), but can take C++ objects (such as string
-// and Value) and has a newline added automatically.
-#define WARN(fmt, ...) WARNF((FklFormattedArglist(fmt), ##__VA_ARGS__))
+// and Value) and has a newline added automatically.  It is logged as
+// coming from the caller.
+#define WARN(fmt, ...) \
+	::hwpp::WARNF(__FILE__, __LINE__, __func__, \
+	              (::hwpp::FklFormattedArglist(fmt), ##__VA_ARGS__))
 
 //
 // Pause
@@ -135,6 +141,42 @@ extern void
 fkl_close_scope(const ParseLocation &loc);
 #define CLOSE_SCOPE(...)  ::hwpp::fkl_close_scope(THIS_LOCATION, ##__VA_ARGS__)
 
+//
+// Create a new lazy scope.  The scope is linked into the tree right
+// away, but its contents are not built until something looks inside it.
+// At that point the body is called with the new scope as the current
+// scope, just as if it had been run between OPEN_SCOPE() and
+// CLOSE_SCOPE().  The current scope is not changed by this call.
+//
+typedef boost::function<void ()> FklScopeBody;
+extern void
+fkl_lazy_scope(const ParseLocation &loc, const string &name,
+		const BindingPtr &binding, const FklScopeBody &body);
+inline void
+fkl_lazy_scope(const ParseLocation &loc, const string &name,
+		const FklScopeBody &body)
+{
+	fkl_lazy_scope(loc, name, BindingPtr(), body);
+}
+#define LAZY_SCOPE(...)  ::hwpp::fkl_lazy_scope(THIS_LOCATION, ##__VA_ARGS__)
+
+//
+// Build part of the current scope from a shared template.  The first time
+// a key is used, the body is run once against a placeholder binding and
+// compiled into a ScopeTemplate (see scope_template.h).  After that, any
+// scope which uses the same key just points at the template, rather than
+// holding its own copy of every register and field.
+//
+// The body must build the same thing for every device that uses the key,
+// and must not read the device.  If it can not be made into a template
+// (it reads a register, defines procedures, etc.), or the current scope
+// already has dirents, the body is just run in the current scope.
+//
+extern void
+fkl_template(const ParseLocation &loc, const string &key,
+		const FklScopeBody &body);
+#define TEMPLATE(...)  ::hwpp::fkl_template(THIS_LOCATION, ##__VA_ARGS__)
+
 //
 // Bookmark the current scope.
 //
@@ -173,7 +215,7 @@ operator,(FklValArgList lhs, const Value &rhs)
 inline BindingPtr
 BIND(const string &driver, const FklValArgList &args)
 {
-	return find_driver(driver)->new_binding(args);
+	return new_binding(driver, args);
 }
 inline BindingPtr
 BIND(const string &driver, const FklValArg &arg)
@@ -116,6 +116,17 @@ class Field: public Dirent
 		return m_datatype->test(read(), comparator);
 	}
 
+	/*
+	 * Field::datatype()
+	 *
+	 * Get the datatype of this field.
+	 */
+	const ConstDatatypePtr &
+	datatype() const
+	{
+		return m_datatype;
+	}
+
     private:
 	ConstDatatypePtr m_datatype;
 };
@@ -0,0 +1,184 @@
+//
+// Map registers back to the fields that are built on them.
+//
+#include "hwpp.h"
+#include "field_index.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "scope.h"
+#include "array.h"
+#include "field.h"
+#include "field_types.h"
+#include "register_types.h"
+
+namespace hwpp {
+
+bool
+register_key(const ConstRegisterPtr &reg, RegisterKey *key)
+{
+	boost::shared_ptr<const BoundRegister> bound =
+	    boost::dynamic_pointer_cast<const BoundRegister>(reg);
+	if (!bound || !bound->binding()) {
+		return false;
+	}
+	const Value &address = bound->address();
+	if (address < 0 || address > MASK(64)) {
+		return false;
+	}
+	*key = RegisterKey(bound->binding()->to_string(), address.as_uint(),
+	                   reg->width());
+	return true;
+}
+
+void
+FieldIndex::add_tree(const ConstScopePtr &root)
+{
+	add_scope(root, "");
+}
+
+void
+FieldIndex::add_scope(const ConstScopePtr &scope, const string &path)
+{
+	// this populates lazy scopes
+	for (size_t i = 0; i < scope->n_dirents(); i++) {
+		add_dirent(scope->dirent(i), path + "/" + scope->dirent_name(i));
+	}
+}
+
+void
+FieldIndex::add_dirent(const ConstDirentPtr &de, const string &path)
+{
+	if (de->is_scope()) {
+		add_scope(scope_from_dirent(de), path);
+	} else if (de->is_array()) {
+		ConstArrayPtr ar = array_from_dirent(de);
+		for (size_t i = 0; i < ar->size(); i++) {
+			add_dirent(ar->at(i), sprintfxx("%s[%d]", path, i));
+		}
+	} else if (de->is_register()) {
+		add_register(register_from_dirent(de));
+	} else if (de->is_field()) {
+		add_field(path, field_from_dirent(de));
+	}
+	// aliases point at things we will find anyway
+}
+
+bool
+FieldIndex::add_register(const ConstRegisterPtr &reg)
+{
+	RegisterKey key;
+	if (!register_key(reg, &key)
+	 || m_registers.find(key) != m_registers.end()) {
+		return false;
+	}
+	m_registers[key] = reg;
+	return true;
+}
+
+bool
+FieldIndex::add_field(const string &path, const ConstFieldPtr &field)
+{
+	boost::shared_ptr<const DirectField> direct =
+	    boost::dynamic_pointer_cast<const DirectField>(field);
+	if (!direct) {
+		return false;
+	}
+
+	Entry entry;
+	entry.path = path;
+	entry.field = field;
+	direct->regbits().ranges(&entry.ranges);
+	if (entry.ranges.empty()) {
+		return false;
+	}
+	for (size_t i = 0; i < entry.ranges.size(); i++) {
+		RegisterKey key;
+		if (!register_key(entry.ranges[i].reg, &key)) {
+			// can't be decoded from raw register values
+			return false;
+		}
+		entry.keys.push_back(key);
+	}
+
+	size_t index = m_fields.size();
+	m_fields.push_back(entry);
+	for (size_t i = 0; i < entry.keys.size(); i++) {
+		m_uses[entry.keys[i]].push_back(Use(index,
+		    entry.ranges[i].hi_bit, entry.ranges[i].lo_bit));
+	}
+	return true;
+}
+
+const std::vector<FieldIndex::Use> *
+FieldIndex::uses(const RegisterKey &key) const
+{
+	std::map<RegisterKey, std::vector<Use> >::const_iterator it =
+	    m_uses.find(key);
+	if (it == m_uses.end()) {
+		return NULL;
+	}
+	return &it->second;
+}
+
+// Add the fields using any changed bits of one register, unsorted.
+static void
+field_index_collect(const std::vector<FieldIndex::Use> *uses,
+                    const Value &changed_bits, std::vector<size_t> *out)
+{
+	if (uses == NULL || changed_bits == 0) {
+		return;
+	}
+	for (size_t i = 0; i < uses->size(); i++) {
+		const FieldIndex::Use &use = (*uses)[i];
+		Value mask = MASK(use.hi_bit - use.lo_bit + 1);
+		mask <<= use.lo_bit;
+		if ((changed_bits & mask) != 0) {
+			out->push_back(use.field);
+		}
+	}
+}
+
+// Sort and de-dup the fields added to 'out' since 'start'.
+static void
+field_index_finish(std::vector<size_t> *out, size_t start)
+{
+	std::sort(out->begin() + start, out->end());
+	out->erase(std::unique(out->begin() + start, out->end()), out->end());
+}
+
+void
+FieldIndex::affected_fields(const RegisterKey &key,
+    const Value &changed_bits, std::vector<size_t> *out) const
+{
+	size_t start = out->size();
+	field_index_collect(uses(key), changed_bits, out);
+	field_index_finish(out, start);
+}
+
+void
+FieldIndex::affected_fields(const std::map<RegisterKey, Value> &changes,
+    std::vector<size_t> *out) const
+{
+	size_t start = out->size();
+	std::map<RegisterKey, Value>::const_iterator it;
+	for (it = changes.begin(); it != changes.end(); it++) {
+		field_index_collect(uses(it->first), it->second, out);
+	}
+	field_index_finish(out, start);
+}
+
+void
+FieldIndex::affected_fields(const std::vector<RegisterKey> &keys,
+    std::vector<size_t> *out) const
+{
+	size_t start = out->size();
+	for (size_t i = 0; i < keys.size(); i++) {
+		field_index_collect(uses(keys[i]), MASK(keys[i].width), out);
+	}
+	field_index_finish(out, start);
+}
+
+}  // namespace hwpp
@@ -0,0 +1,222 @@
+#ifndef HWPP_FIELD_INDEX_H__
+#define HWPP_FIELD_INDEX_H__
+
+#include "hwpp.h"
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "scope.h"
+#include "register.h"
+#include "field.h"
+#include "regbits.h"
+
+namespace hwpp {
+
+/*
+ * RegisterKey - identifies one raw register, independent of any tree.
+ *
+ * This is the same key that snapshots are saved under: the binding's
+ * to_string(), the register address, and the register width.
+ */
+struct RegisterKey
+{
+	RegisterKey(): binding(), address(0), width(0)
+	{
+	}
+	RegisterKey(const string &b, uint64_t a, BitWidth w)
+	    : binding(b), address(a), width(w)
+	{
+	}
+
+	bool
+	operator<(const RegisterKey &that) const
+	{
+		if (binding != that.binding) {
+			return (binding < that.binding);
+		}
+		if (address != that.address) {
+			return (address < that.address);
+		}
+		return (width < that.width);
+	}
+	bool
+	operator==(const RegisterKey &that) const
+	{
+		return (binding == that.binding && address == that.address
+		     && width == that.width);
+	}
+
+	string binding;
+	uint64_t address;
+	BitWidth width;
+};
+
+/*
+ * register_key(reg, key)
+ *
+ * Get the key of a register, if it has one.  Only registers which talk
+ * straight to a binding (BoundRegisters) have keys.
+ *
+ * Returns: false if the register has no key.
+ */
+extern bool
+register_key(const ConstRegisterPtr &reg, RegisterKey *key);
+
+/*
+ * FieldIndex - a reverse map from registers to the fields built on them.
+ *
+ * The index holds every keyed register in a tree, and every DirectField
+ * whose bits all come from keyed registers, broken down into register bit
+ * ranges.  Given a set of changed registers, or changed bits, it can say
+ * exactly which fields need to be re-evaluated, without touching the
+ * rest of the tree.
+ *
+ * Fields are numbered in the order they were added, which for add_tree()
+ * is tree order.
+ */
+class FieldIndex
+{
+    public:
+	/*
+	 * FieldIndex::Entry - one indexed field.
+	 *
+	 * 'keys' and 'ranges' run in parallel, most significant bits
+	 * first, as from RegBits::ranges().
+	 */
+	struct Entry {
+		string path;
+		ConstFieldPtr field;
+		std::vector<RegisterKey> keys;
+		std::vector<RegBits::Range> ranges;
+	};
+
+	/*
+	 * FieldIndex::Use - one range of bits of a register used by one
+	 * field.
+	 */
+	struct Use {
+		Use(size_t f, unsigned hi, unsigned lo)
+		    : field(f), hi_bit(hi), lo_bit(lo)
+		{
+		}
+		size_t field;
+		unsigned hi_bit;
+		unsigned lo_bit;
+	};
+
+	FieldIndex()
+	{
+	}
+	explicit FieldIndex(const ConstScopePtr &root)
+	{
+		add_tree(root);
+	}
+
+	/*
+	 * FieldIndex::add_tree(root)
+	 *
+	 * Walk a tree and index all of its registers and fields.  Lazy
+	 * scopes are populated along the way.  Aliases are not followed.
+	 */
+	void
+	add_tree(const ConstScopePtr &root);
+
+	/*
+	 * FieldIndex::add_register(reg)
+	 *
+	 * Index one register.  Registers without keys, and registers with
+	 * a key already in the index, are ignored.
+	 *
+	 * Returns: true if the register was added.
+	 */
+	bool
+	add_register(const ConstRegisterPtr &reg);
+
+	/*
+	 * FieldIndex::add_field(path, field)
+	 *
+	 * Index one field.  Only DirectFields built entirely on keyed
+	 * registers can be indexed.
+	 *
+	 * Returns: true if the field was added.
+	 */
+	bool
+	add_field(const string &path, const ConstFieldPtr &field);
+
+	/*
+	 * FieldIndex::n_registers()
+	 * FieldIndex::registers()
+	 *
+	 * Get the indexed registers.
+	 */
+	size_t
+	n_registers() const
+	{
+		return m_registers.size();
+	}
+	const std::map<RegisterKey, ConstRegisterPtr> &
+	registers() const
+	{
+		return m_registers;
+	}
+
+	/*
+	 * FieldIndex::n_fields()
+	 * FieldIndex::field(index)
+	 *
+	 * Get the indexed fields.
+	 */
+	size_t
+	n_fields() const
+	{
+		return m_fields.size();
+	}
+	const Entry &
+	field(size_t index) const
+	{
+		return m_fields[index];
+	}
+
+	/*
+	 * FieldIndex::uses(key)
+	 *
+	 * Get every bit range of a register that a field uses, in field
+	 * order.  This may return NULL if nothing uses the register.
+	 */
+	const std::vector<Use> *
+	uses(const RegisterKey &key) const;
+
+	/*
+	 * FieldIndex::affected_fields(key, changed_bits, out)
+	 * FieldIndex::affected_fields(changes, out)
+	 * FieldIndex::affected_fields(keys, out)
+	 *
+	 * Find the fields which use any of the changed bits of one or more
+	 * registers.  The results are added to 'out' in field order, with
+	 * no duplicates.  The last form treats every bit of each register
+	 * as changed.
+	 */
+	void
+	affected_fields(const RegisterKey &key, const Value &changed_bits,
+	    std::vector<size_t> *out) const;
+	void
+	affected_fields(const std::map<RegisterKey, Value> &changes,
+	    std::vector<size_t> *out) const;
+	void
+	affected_fields(const std::vector<RegisterKey> &keys,
+	    std::vector<size_t> *out) const;
+
+    private:
+	void
+	add_dirent(const ConstDirentPtr &de, const string &path);
+	void
+	add_scope(const ConstScopePtr &scope, const string &path);
+
+	std::map<RegisterKey, ConstRegisterPtr> m_registers;
+	std::vector<Entry> m_fields;
+	std::map<RegisterKey, std::vector<Use> > m_uses;
+};
+
+}  // namespace hwpp
+
+#endif // HWPP_FIELD_INDEX_H__
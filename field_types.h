@@ -62,6 +62,17 @@ class DirectField: public Field
 		m_regbits.write(value);
 	}
 
+	/*
+	 * DirectField::regbits()
+	 *
+	 * Get the register bits which back this field.
+	 */
+	const RegBits &
+	regbits() const
+	{
+		return m_regbits;
+	}
+
     private:
 	RegBits m_regbits;
 };
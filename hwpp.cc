@@ -13,4 +13,11 @@ hwpp_init(bool enable_logging, uint8_t log_verbosity)
 	LOG(INFO, "libhwpp version: %s", version_string);
 }
 
+void
+log_warning(const char *file, int line, const char *func,
+            const string &message)
+{
+	log::internal::WARN(file, line, func, message);
+}
+
 }  // namespace hwpp
@@ -66,6 +66,12 @@ MASK(BitWidth nbits)
 void
 hwpp_init(bool enable_logging, uint8_t log_verbosity);
 
+// Log a warning through the log sink.  This is for code which can not
+// include util/log.h, whose namespace collides with ::log() from <cmath>.
+void
+log_warning(const char *file, int line, const char *func,
+            const string &message);
+
 }  // namespace hwpp
 
 #endif // HWPP_HWPP_H__
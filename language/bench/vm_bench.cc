@@ -0,0 +1,118 @@
+#include "hwpp.h"
+#include "language/vm.h"
+#include "language/bytecode.h"
+#include "language/compiler.h"
+#include "language/environment.h"
+#include "language/parsed_file.h"
+#include "language/syntax_tree.h"
+#include "util/bench.h"
+
+using namespace hwpp::language;
+using namespace hwpp::language::syntax;
+
+// These build syntax trees by hand, like language/tests/vm_test.cc, so the
+// benchmarks do not need the parser.  Each one runs a loop BENCH_N times,
+// so the time is per trip around the loop.  Validation and compilation
+// are not timed.
+
+static Parser::Position
+here()
+{
+	Parser::Position pos;
+	pos.file = "vm_bench";
+	pos.line = 1;
+	return pos;
+}
+
+static Expression *
+num(uint64_t value)
+{
+	return new IntLiteralExpression(here(), hwpp::Value(value));
+}
+
+static Expression *
+ref(const string &name)
+{
+	return new IdentifierExpression(here(), new Identifier(here(), name));
+}
+
+static Expression *
+binop(BinaryExpression::Operator op, Expression *lhs, Expression *rhs)
+{
+	return new BinaryExpression(here(), op, lhs, rhs);
+}
+
+static Statement *
+define(const Type &type, const string &name, Expression *init)
+{
+	InitializedIdentifierList *vars = new InitializedIdentifierList();
+	vars->push_back(new InitializedIdentifier(here(),
+	    new Identifier(here(), name), init));
+	return new DefinitionStatement(here(), new Type(type), vars);
+}
+
+static Statement *
+eval(Expression *expr)
+{
+	return new ExpressionStatement(here(), expr);
+}
+
+static Statement *
+block(Statement *s1, Statement *s2)
+{
+	StatementList *body = new StatementList();
+	body->push_back(s1);
+	body->push_back(s2);
+	return new CompoundStatement(here(), body);
+}
+
+// int i = 0;
+// while (i < n) { <body>; i++; }
+static void
+run_loop(uint64_t n, Statement *init, Statement *body)
+{
+	Environment env;
+	ParsedFile file;
+	file.add_statement(init);
+	file.add_statement(define(Type::INT, "i", num(0)));
+	file.add_statement(new WhileLoopStatement(here(),
+	    binop(BinaryExpression::OP_LT, ref("i"), num(n)), block(body,
+	    eval(new UnaryExpression(here(), UnaryExpression::OP_POSTINC,
+	        ref("i"))))));
+
+	ValidateOptions flags = env.default_validate_options();
+	for (size_t i = 0; i < file.n_statements(); i++) {
+		file.statement(i)->validate_once(flags, &env);
+	}
+	Compiler compiler;
+	compiler.add_file(&file);
+	Vm vm(compiler.finish());
+
+	BENCH_RESET_TIMER();
+	vm.run();
+}
+
+BENCH(bench_vm_arithmetic)
+{
+	// int t = 0;
+	// ... t = t + i * 3 - 1;
+	run_loop(BENCH_N, define(Type::INT, "t", num(0)),
+	    eval(binop(BinaryExpression::OP_ASSIGN, ref("t"),
+	        binop(BinaryExpression::OP_SUB,
+	            binop(BinaryExpression::OP_ADD, ref("t"),
+	                binop(BinaryExpression::OP_MUL, ref("i"), num(3))),
+	            num(1)))));
+}
+
+BENCH(bench_vm_compare)
+{
+	// int c = 0;
+	// ... c += (i % 7 == 0) ? 1 : 0;
+	run_loop(BENCH_N, define(Type::INT, "c", num(0)),
+	    eval(binop(BinaryExpression::OP_ADD_ASSIGN, ref("c"),
+	        new ConditionalExpression(here(),
+	            binop(BinaryExpression::OP_EQ,
+	                binop(BinaryExpression::OP_MOD, ref("i"), num(7)),
+	                num(0)),
+	            num(1), num(0)))));
+}
@@ -0,0 +1,115 @@
+#include "language/bytecode.h"
+
+#include "hwpp.h"
+#include <string>
+#include <vector>
+
+namespace hwpp {
+namespace language {
+namespace bytecode {
+
+const uint16_t Instruction::NONE;
+
+static const char *opcode_names[] = {
+	"nop",
+	"loadk",
+	"move",
+	"copy",
+	"getglobal",
+	"define",
+	"defglobal",
+	"assign",
+	"pos",
+	"neg",
+	"not",
+	"bitnot",
+	"inc",
+	"dec",
+	"mul",
+	"div",
+	"mod",
+	"add",
+	"sub",
+	"shl",
+	"shr",
+	"and",
+	"or",
+	"xor",
+	"eq",
+	"neq",
+	"lt",
+	"gt",
+	"le",
+	"ge",
+	"jump",
+	"jump_if_false",
+	"jump_if_true",
+	"subscript",
+	"subscript_ref",
+	"tuple",
+	"func",
+	"call",
+	"return",
+};
+
+const char *
+opcode_name(Opcode op)
+{
+	if (op >= OP_MAX) {
+		return "???";
+	}
+	return opcode_names[op];
+}
+
+static string
+operand_to_string(uint16_t operand)
+{
+	if (operand == Instruction::NONE) {
+		return "-";
+	}
+	return sprintfxx("%d", operand);
+}
+
+string
+Program::to_string() const
+{
+	string ret;
+	for (size_t f = 0; f < functions.size(); f++) {
+		const Function *fn = functions[f];
+		ret += sprintfxx("function %d %s (%d registers)\n",
+		                 f, fn->name, fn->n_registers);
+		for (size_t pc = 0; pc < fn->code.size(); pc++) {
+			const Instruction &in = fn->code[pc];
+			Opcode op = Opcode(in.op);
+			ret += sprintfxx("  %4d  %-14s", pc, opcode_name(op));
+			if (op == OP_JUMP) {
+				ret += sprintfxx("-> %d", in.target());
+			} else if (op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE) {
+				ret += sprintfxx("%s -> %d",
+				                 operand_to_string(in.a), in.target());
+			} else {
+				ret += operand_to_string(in.a) + " "
+				     + operand_to_string(in.b) + " "
+				     + operand_to_string(in.c);
+			}
+			ret += "\n";
+		}
+	}
+	return ret;
+}
+
+size_t
+Program::n_instructions() const
+{
+	size_t n = 0;
+	for (size_t f = 0; f < functions.size(); f++) {
+		n += functions[f]->code.size();
+	}
+	return n;
+}
+
+}  // namespace bytecode
+}  // namespace language
+}  // namespace hwpp
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
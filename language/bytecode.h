@@ -0,0 +1,158 @@
+// Bytecode for the HWPP language virtual machine.
+
+#ifndef HWPP_LANGUAGE_BYTECODE_H__
+#define HWPP_LANGUAGE_BYTECODE_H__
+
+#include "hwpp.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "language/language.h"
+#include "language/type.h"
+#include "language/variable.h"
+
+namespace hwpp {
+namespace language {
+namespace bytecode {
+
+// Every value the VM works with is a reference to a Variable.
+typedef boost::shared_ptr<Variable> VarPtr;
+
+// The operations.  Operands are register numbers, unless noted.  "R[n]" is
+// register n of the current frame, "K[n]" is constant n, "T[n]" is type n,
+// and "G[n]" is global n.  NONE means an operand is not used.
+enum Opcode {
+	OP_NOP,
+	OP_LOADK,          // R[a] = K[b]
+	OP_MOVE,           // R[a] = R[b]  (the same variable)
+	OP_COPY,           // R[a] = a non-const copy of R[b]
+	OP_GETGLOBAL,      // R[a] = G[b]
+	OP_DEFINE,         // R[a] = new variable of type T[b], init from R[c]
+	OP_DEFGLOBAL,      // G[a] = new variable of type T[b], init from R[c]
+	OP_ASSIGN,         // *R[a] = *R[b], checked against T[c]
+	OP_POS,            // R[a] = +R[b]
+	OP_NEG,            // R[a] = -R[b]
+	OP_NOT,            // R[a] = !R[b]
+	OP_BITNOT,         // R[a] = ~R[b]
+	OP_INC,            // ++*R[a]
+	OP_DEC,            // --*R[a]
+	OP_MUL,            // R[a] = R[b] * R[c]
+	OP_DIV,            // R[a] = R[b] / R[c]
+	OP_MOD,            // R[a] = R[b] % R[c]
+	OP_ADD,            // R[a] = R[b] + R[c]
+	OP_SUB,            // R[a] = R[b] - R[c]
+	OP_SHL,            // R[a] = R[b] << R[c]
+	OP_SHR,            // R[a] = R[b] >> R[c]
+	OP_AND,            // R[a] = R[b] & R[c]
+	OP_OR,             // R[a] = R[b] | R[c]
+	OP_XOR,            // R[a] = R[b] ^ R[c]
+	OP_EQ,             // R[a] = R[b] == R[c]
+	OP_NEQ,            // R[a] = R[b] != R[c]
+	OP_LT,             // R[a] = R[b] < R[c]
+	OP_GT,             // R[a] = R[b] > R[c]
+	OP_LE,             // R[a] = R[b] <= R[c]
+	OP_GE,             // R[a] = R[b] >= R[c]
+	OP_JUMP,           // goto target
+	OP_JUMP_IF_FALSE,  // if (!R[a]) goto target
+	OP_JUMP_IF_TRUE,   // if (R[a]) goto target
+	OP_SUBSCRIPT,      // R[a] = R[b][R[c]]  (the same variable)
+	OP_SUBSCRIPT_REF,  // R[a] = R[b][R[c]]  (unshared, to be written)
+	OP_TUPLE,          // R[a] = [ R[b], ... R[b+c-1] ]
+	OP_FUNC,           // R[a] = function number b
+	OP_CALL,           // R[a] = R[b](R[b+1], ... R[b+c])
+	OP_RETURN,         // return R[a]
+	OP_MAX,
+};
+
+// The name of an opcode, for disassembly.
+extern const char *
+opcode_name(Opcode op);
+
+// One instruction.  Jumps keep a 32 bit target in b and c.
+struct Instruction {
+	static const uint16_t NONE = 0xffff;
+
+	Instruction(Opcode o, uint16_t a_ = NONE, uint16_t b_ = NONE,
+	            uint16_t c_ = NONE)
+	    : op(o), a(a_), b(b_), c(c_)
+	{
+	}
+
+	uint32_t
+	target() const
+	{
+		return (uint32_t(c) << 16) | b;
+	}
+	void
+	set_target(uint32_t pc)
+	{
+		b = pc & 0xffff;
+		c = pc >> 16;
+	}
+
+	uint16_t op;
+	uint16_t a;
+	uint16_t b;
+	uint16_t c;
+};
+
+// One compiled function.  Function 0 of a program is the top-level code.
+// In every other function, R[0] holds the 'args' list.
+struct Function {
+	Function(const string &n, const Parser::Position &pos)
+	    : name(n), position(pos), n_registers(1)
+	{
+	}
+
+	string name;
+	Parser::Position position;
+	size_t n_registers;
+	std::vector<Instruction> code;
+	// Parallel to 'code': an index into Program::positions.
+	std::vector<uint32_t> positions;
+};
+
+// A compiled program.
+struct Program {
+	Program()
+	{
+	}
+	~Program()
+	{
+		for (size_t i = 0; i < functions.size(); i++) {
+			delete functions[i];
+		}
+	}
+
+	// Produce a human-readable listing.
+	string
+	to_string() const;
+
+	// Count the instructions in all functions.
+	size_t
+	n_instructions() const;
+
+	std::vector<Function*> functions;  // Owns the Function pointers.
+	std::vector<VarPtr> constants;
+	std::vector<Type> types;
+	// Globals which are not NULL here start out with these values.
+	std::vector<VarPtr> global_init;
+	std::vector<string> global_names;
+	std::vector<Parser::Position> positions;
+
+ private:
+	// Not copyable.
+	Program(const Program &);
+	void operator=(const Program &);
+};
+typedef boost::shared_ptr<Program> ProgramPtr;
+typedef boost::shared_ptr<const Program> ConstProgramPtr;
+
+}  // namespace bytecode
+}  // namespace language
+}  // namespace hwpp
+
+#endif  // HWPP_LANGUAGE_BYTECODE_H__
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
@@ -0,0 +1,1143 @@
+#include "language/compiler.h"
+
+#include "hwpp.h"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "language/bytecode.h"
+#include "language/errors.h"
+#include "language/parsed_file.h"
+#include "language/syntax_tree.h"
+#include "language/type.h"
+#include "language/variable.h"
+
+namespace hwpp {
+namespace language {
+
+using bytecode::Instruction;
+using bytecode::VarPtr;
+using namespace syntax;
+
+static const uint16_t NONE = Instruction::NONE;
+
+// A jump target within one function.  Until it is bound, jumps to it are
+// remembered so they can be patched.
+struct Compiler::Label {
+	Label() : pc(-1)
+	{
+	}
+	long pc;
+	std::vector<size_t> patches;
+};
+
+// The labels that a goto can see from one nesting level.  'direct' holds
+// labels on the statements of this level, 'deep' holds labels anywhere
+// below this level, and 'fixed' holds labels that the compiler made up,
+// such as the end of a switch.
+struct Compiler::LabelScope {
+	std::map<string, const Statement*> direct;
+	std::map<string, const Statement*> deep;
+	std::map<string, size_t> fixed;
+};
+
+// Everything about the function currently being compiled.
+struct Compiler::FunctionState {
+	FunctionState() : function(NULL), index(0), next_reg(0)
+	{
+	}
+	bytecode::Function *function;
+	size_t index;
+	size_t next_reg;
+	std::map<const Definition*, uint16_t> locals;
+	// Definitions in each open block, to drop when the block ends.
+	std::vector<std::vector<const Definition*> > blocks;
+	std::vector<Label> labels;
+	std::map<std::pair<const Statement*, string>, size_t> statement_labels;
+	std::vector<LabelScope> label_scopes;
+};
+
+Compiler::Compiler()
+    : m_program(new bytecode::Program()), m_position(NULL),
+      m_finished(false)
+{
+}
+
+Compiler::~Compiler()
+{
+	for (size_t i = 0; i < m_functions.size(); i++) {
+		delete m_functions[i];
+	}
+}
+
+void
+Compiler::add_builtin(const Definition *def, const VarPtr &value)
+{
+	DASSERT(!m_finished);
+	uint16_t g = m_program->global_init.size();
+	m_program->global_init.push_back(value);
+	m_program->global_names.push_back(def->identifier()->symbol());
+	m_globals[def] = g;
+	m_builtins[def->identifier()->symbol()] = g;
+}
+
+void
+Compiler::add_file(const ParsedFile *file)
+{
+	DASSERT(!m_finished);
+	Unit unit;
+	for (size_t i = 0; i < file->n_statements(); i++) {
+		unit.push_back(file->statement(i));
+	}
+	m_units.push_back(unit);
+}
+
+void
+Compiler::add_statement(Statement *statement)
+{
+	DASSERT(!m_finished);
+	m_units.push_back(Unit(1, statement));
+}
+
+bytecode::ProgramPtr
+Compiler::finish()
+{
+	DASSERT(!m_finished);
+	m_finished = true;
+
+	// Globals are known up front, so functions can use globals that are
+	// defined after them.
+	for (size_t i = 0; i < m_units.size(); i++) {
+		declare_globals(m_units[i]);
+	}
+
+	Parser::Position pos;
+	pos.line = 0;
+	if (!m_units.empty() && !m_units[0].empty()) {
+		pos = m_units[0][0]->parse_position();
+	}
+	begin_function("<top>", pos);
+	for (size_t i = 0; i < m_units.size(); i++) {
+		compile_unit(m_units[i]);
+	}
+	emit(bytecode::OP_RETURN);
+	end_function();
+
+	return m_program;
+}
+
+bytecode::ProgramPtr
+Compiler::compile_expression(Expression *expr)
+{
+	Compiler compiler;
+	compiler.m_finished = true;
+	compiler.begin_function("<expression>", expr->parse_position());
+	uint16_t r = compiler.compile_expr(expr);
+	compiler.emit(bytecode::OP_RETURN, r);
+	compiler.end_function();
+	return compiler.m_program;
+}
+
+//
+// Declarations.
+//
+
+void
+Compiler::declare_globals(const Unit &unit)
+{
+	for (size_t i = 0; i < unit.size(); i++) {
+		DefinitionStatement *defs =
+		    dynamic_cast<DefinitionStatement*>(unit[i]);
+		if (defs == NULL) {
+			continue;
+		}
+		for (size_t j = 0; j < defs->vars().size(); j++) {
+			const Definition *def = defs->vars()[j];
+			size_t g = m_program->global_init.size();
+			if (g >= NONE) {
+				throw LanguageError(def->parse_position(),
+				    "too many global variables");
+			}
+			m_program->global_init.push_back(VarPtr());
+			m_program->global_names.push_back(
+			    def->identifier()->symbol());
+			m_globals[def] = g;
+		}
+	}
+}
+
+uint16_t
+Compiler::add_constant(const VarPtr &value)
+{
+	size_t k = m_program->constants.size();
+	if (k >= NONE) {
+		throw LanguageError(error_position(),
+		    "too many constants");
+	}
+	m_program->constants.push_back(value);
+	return k;
+}
+
+uint16_t
+Compiler::add_type(const Type &type)
+{
+	std::vector<Type> &types = m_program->types;
+	for (size_t i = 0; i < types.size(); i++) {
+		if (types[i] == type && types[i].is_const() == type.is_const()) {
+			return i;
+		}
+	}
+	if (types.size() >= NONE) {
+		throw LanguageError(error_position(),
+		    "too many types");
+	}
+	types.push_back(type);
+	return types.size() - 1;
+}
+
+//
+// Functions and registers.
+//
+
+Compiler::FunctionState *
+Compiler::begin_function(const string &name, const Parser::Position &pos)
+{
+	if (m_program->functions.size() >= NONE) {
+		throw LanguageError(pos, "too many functions");
+	}
+	FunctionState *fs = new FunctionState();
+	fs->index = m_program->functions.size();
+	fs->function = new bytecode::Function(name, pos);
+	m_program->functions.push_back(fs->function);
+	m_functions.push_back(fs);
+	// R[0] is 'args' in functions, and unused at the top level.
+	fs->next_reg = 1;
+	return fs;
+}
+
+void
+Compiler::end_function()
+{
+	FunctionState *fs = current();
+	for (size_t i = 0; i < fs->labels.size(); i++) {
+		DASSERT(fs->labels[i].patches.empty() || fs->labels[i].pc >= 0);
+	}
+	m_functions.pop_back();
+	delete fs;
+}
+
+uint16_t
+Compiler::alloc_reg()
+{
+	FunctionState *fs = current();
+	size_t r = fs->next_reg++;
+	if (r >= NONE) {
+		throw LanguageError(error_position(),
+		    "function needs too many registers");
+	}
+	if (fs->next_reg > fs->function->n_registers) {
+		fs->function->n_registers = fs->next_reg;
+	}
+	return r;
+}
+
+size_t
+Compiler::reg_mark() const
+{
+	return current()->next_reg;
+}
+
+void
+Compiler::release_regs(size_t mark)
+{
+	DASSERT(mark <= current()->next_reg);
+	current()->next_reg = mark;
+}
+
+//
+// Emitting code.
+//
+
+size_t
+Compiler::emit(bytecode::Opcode op, uint16_t a, uint16_t b, uint16_t c)
+{
+	bytecode::Function *fn = current()->function;
+	std::vector<Parser::Position> &positions = m_program->positions;
+
+	// Consecutive instructions usually share a position.
+	const Parser::Position &pos = error_position();
+	if (positions.empty() || positions.back().line != pos.line
+	 || positions.back().file != pos.file) {
+		positions.push_back(pos);
+	}
+
+	fn->code.push_back(Instruction(op, a, b, c));
+	fn->positions.push_back(positions.size() - 1);
+	return fn->code.size() - 1;
+}
+
+const Parser::Position &
+Compiler::error_position() const
+{
+	if (m_position) {
+		return m_position->parse_position();
+	}
+	return current()->function->position;
+}
+
+void
+Compiler::emit_move(uint16_t dst, uint16_t src)
+{
+	if (dst != src) {
+		emit(bytecode::OP_MOVE, dst, src);
+	}
+}
+
+void
+Compiler::set_position(const SyntaxNode *node)
+{
+	m_position = node;
+}
+
+//
+// Labels.
+//
+
+size_t
+Compiler::new_label()
+{
+	current()->labels.push_back(Label());
+	return current()->labels.size() - 1;
+}
+
+size_t
+Compiler::statement_label(const Statement *stmt, const string &name)
+{
+	FunctionState *fs = current();
+	std::pair<const Statement*, string> key(stmt, name);
+	std::map<std::pair<const Statement*, string>, size_t>::iterator it =
+	    fs->statement_labels.find(key);
+	if (it != fs->statement_labels.end()) {
+		return it->second;
+	}
+	size_t label = new_label();
+	fs->statement_labels[key] = label;
+	return label;
+}
+
+void
+Compiler::bind_label(size_t label)
+{
+	FunctionState *fs = current();
+	Label &l = fs->labels[label];
+	DASSERT(l.pc < 0);
+	l.pc = fs->function->code.size();
+	for (size_t i = 0; i < l.patches.size(); i++) {
+		fs->function->code[l.patches[i]].set_target(l.pc);
+	}
+	l.patches.clear();
+}
+
+void
+Compiler::emit_jump(bytecode::Opcode op, size_t label, uint16_t a)
+{
+	FunctionState *fs = current();
+	size_t pc = emit(op, a);
+	Label &l = fs->labels[label];
+	if (l.pc >= 0) {
+		fs->function->code[pc].set_target(l.pc);
+	} else {
+		l.patches.push_back(pc);
+	}
+}
+
+void
+Compiler::push_label_scope(const std::vector<Statement*> &body)
+{
+	LabelScope scope;
+	for (size_t i = 0; i < body.size(); i++) {
+		const std::vector<Identifier*> &labels = body[i]->labels();
+		for (size_t j = 0; j < labels.size(); j++) {
+			scope.direct[labels[j]->symbol()] = body[i];
+		}
+		collect_labels(body[i], &scope.deep);
+	}
+	current()->label_scopes.push_back(scope);
+}
+
+void
+Compiler::pop_label_scope()
+{
+	current()->label_scopes.pop_back();
+}
+
+// Find every label in a statement and the statements below it, but not
+// in functions defined there.
+void
+Compiler::collect_labels(Statement *stmt,
+                         std::map<string, const Statement*> *out)
+{
+	const std::vector<Identifier*> &labels = stmt->labels();
+	for (size_t i = 0; i < labels.size(); i++) {
+		out->insert(std::make_pair(labels[i]->symbol(), stmt));
+	}
+
+	if (CompoundStatement *s = dynamic_cast<CompoundStatement*>(stmt)) {
+		for (size_t i = 0; i < s->body()->size(); i++) {
+			collect_labels(s->body()->at(i), out);
+		}
+	} else if (ConditionalStatement *s =
+	           dynamic_cast<ConditionalStatement*>(stmt)) {
+		collect_labels(s->true_case(), out);
+		if (s->false_case()) {
+			collect_labels(s->false_case(), out);
+		}
+	} else if (SwitchStatement *s = dynamic_cast<SwitchStatement*>(stmt)) {
+		collect_labels(s->body(), out);
+	} else if (LoopStatement *s = dynamic_cast<LoopStatement*>(stmt)) {
+		collect_labels(s->body(), out);
+	} else if (CaseStatement *s = dynamic_cast<CaseStatement*>(stmt)) {
+		collect_labels(s->statement(), out);
+	}
+}
+
+// A goto finds the nearest enclosing level which has the label on one of
+// its own statements.  Failing that, it finds the label anywhere below an
+// enclosing level, which is how a do-while loop enters its body.
+size_t
+Compiler::resolve_goto(const GotoStatement *stmt)
+{
+	const string &name = stmt->target()->symbol();
+	std::vector<LabelScope> &scopes = current()->label_scopes;
+
+	for (size_t i = scopes.size(); i > 0; i--) {
+		LabelScope &scope = scopes[i-1];
+		std::map<string, size_t>::iterator fixed = scope.fixed.find(name);
+		if (fixed != scope.fixed.end()) {
+			return fixed->second;
+		}
+		std::map<string, const Statement*>::iterator it =
+		    scope.direct.find(name);
+		if (it != scope.direct.end()) {
+			return statement_label(it->second, name);
+		}
+	}
+	for (size_t i = scopes.size(); i > 0; i--) {
+		LabelScope &scope = scopes[i-1];
+		std::map<string, const Statement*>::iterator it =
+		    scope.deep.find(name);
+		if (it != scope.deep.end()) {
+			return statement_label(it->second, name);
+		}
+	}
+	throw LanguageError(stmt->parse_position(),
+	    sprintfxx("label '%s' not found", name));
+}
+
+//
+// Statements.
+//
+
+void
+Compiler::compile_unit(const Unit &unit)
+{
+	push_label_scope(unit);
+	for (size_t i = 0; i < unit.size(); i++) {
+		compile_statement(unit[i]);
+	}
+	pop_label_scope();
+}
+
+void
+Compiler::compile_statement(Statement *stmt)
+{
+	set_position(stmt);
+
+	// Do-while loops bind their labels at the condition.
+	LoopStatement *loop = dynamic_cast<LoopStatement*>(stmt);
+	if (loop == NULL || loop->loop_type() != LoopStatement::LOOP_DO_WHILE) {
+		const std::vector<Identifier*> &labels = stmt->labels();
+		for (size_t i = 0; i < labels.size(); i++) {
+			bind_label(statement_label(stmt, labels[i]->symbol()));
+		}
+	}
+
+	size_t mark = reg_mark();
+	if (dynamic_cast<EmptyStatement*>(stmt)
+	 || dynamic_cast<ImportStatement*>(stmt)
+	 || dynamic_cast<ModuleStatement*>(stmt)) {
+		// Nothing to do at runtime.
+	} else if (CompoundStatement *s = dynamic_cast<CompoundStatement*>(stmt)) {
+		compile_compound(s);
+	} else if (ExpressionStatement *s =
+	           dynamic_cast<ExpressionStatement*>(stmt)) {
+		compile_expr(s->expression());
+	} else if (DefinitionStatement *s =
+	           dynamic_cast<DefinitionStatement*>(stmt)) {
+		compile_definitions(s);
+		// Locals stay allocated until the end of the block.
+		mark = reg_mark();
+	} else if (ConditionalStatement *s =
+	           dynamic_cast<ConditionalStatement*>(stmt)) {
+		compile_conditional(s);
+	} else if (SwitchStatement *s = dynamic_cast<SwitchStatement*>(stmt)) {
+		compile_switch(s);
+	} else if (loop) {
+		compile_loop(loop);
+	} else if (GotoStatement *s = dynamic_cast<GotoStatement*>(stmt)) {
+		emit_jump(bytecode::OP_JUMP, resolve_goto(s));
+	} else if (CaseStatement *s = dynamic_cast<CaseStatement*>(stmt)) {
+		// The switch already tested the expression.
+		bind_label(statement_label(s, ""));
+		compile_statement(s->statement());
+	} else if (ReturnStatement *s = dynamic_cast<ReturnStatement*>(stmt)) {
+		if (s->expression()) {
+			emit(bytecode::OP_RETURN, compile_expr(s->expression()));
+		} else {
+			emit(bytecode::OP_RETURN);
+		}
+	} else if (DiscoverStatement *s = dynamic_cast<DiscoverStatement*>(stmt)) {
+		compile_discover(s);
+	} else {
+		throw LanguageError(stmt->parse_position(),
+		    "can't compile statement: " + stmt->to_string());
+	}
+	release_regs(mark);
+}
+
+void
+Compiler::compile_compound(CompoundStatement *stmt)
+{
+	FunctionState *fs = current();
+	size_t mark = reg_mark();
+	fs->blocks.push_back(std::vector<const Definition*>());
+	push_label_scope(*stmt->body());
+
+	for (size_t i = 0; i < stmt->body()->size(); i++) {
+		compile_statement(stmt->body()->at(i));
+	}
+
+	pop_label_scope();
+	const std::vector<const Definition*> &defs = fs->blocks.back();
+	for (size_t i = 0; i < defs.size(); i++) {
+		fs->locals.erase(defs[i]);
+	}
+	fs->blocks.pop_back();
+	release_regs(mark);
+}
+
+void
+Compiler::compile_definitions(DefinitionStatement *stmt)
+{
+	FunctionState *fs = current();
+	for (size_t i = 0; i < stmt->vars().size(); i++) {
+		Definition *def = stmt->vars()[i];
+		set_position(def);
+		uint16_t type = add_type(def->type());
+
+		std::map<const Definition*, uint16_t>::iterator global =
+		    m_globals.find(def);
+		bool is_global = (fs->index == 0 && fs->blocks.empty()
+		                  && global != m_globals.end());
+		uint16_t local = is_global ? NONE : alloc_reg();
+
+		// The new variable is not visible in its own initializer.
+		size_t mark = reg_mark();
+		uint16_t init = NONE;
+		if (def->initializer()) {
+			init = compile_expr(def->initializer());
+		}
+		if (is_global) {
+			emit(bytecode::OP_DEFGLOBAL, global->second, type, init);
+		} else {
+			emit(bytecode::OP_DEFINE, local, type, init);
+			fs->locals[def] = local;
+			if (!fs->blocks.empty()) {
+				fs->blocks.back().push_back(def);
+			}
+		}
+		release_regs(mark);
+	}
+}
+
+// Get the value of a condition which folded to a literal.  Returns false
+// if it is not constant.
+static bool
+constant_condition(const Expression *cond, bool *out_value)
+{
+	const ValueExpression *literal =
+	    dynamic_cast<const ValueExpression*>(cond);
+	if (literal == NULL
+	 || literal->value()->type().primitive() != Type::BOOL) {
+		return false;
+	}
+	*out_value = literal->value()->bool_value();
+	return true;
+}
+
+void
+Compiler::compile_conditional(ConditionalStatement *stmt)
+{
+	// Only the branch which can run is compiled, unless the other one
+	// can be entered by a goto or case label.  Then both are compiled,
+	// and the condition is replaced by a plain jump.
+	bool value;
+	bool constant = constant_condition(stmt->condition(), &value);
+	if (constant) {
+		Statement *dead = value ? stmt->false_case()
+		                        : stmt->true_case();
+		if (dead == NULL || !dead->has_entry_points()) {
+			if (value) {
+				compile_statement(stmt->true_case());
+			} else if (stmt->false_case()) {
+				compile_statement(stmt->false_case());
+			}
+			return;
+		}
+	}
+
+	size_t else_label = new_label();
+	size_t end_label = new_label();
+
+	if (constant) {
+		if (!value) {
+			emit_jump(bytecode::OP_JUMP, else_label);
+		}
+	} else {
+		size_t mark = reg_mark();
+		uint16_t cond = compile_expr(stmt->condition());
+		emit_jump(bytecode::OP_JUMP_IF_FALSE, else_label, cond);
+		release_regs(mark);
+	}
+
+	compile_statement(stmt->true_case());
+	if (stmt->false_case()) {
+		emit_jump(bytecode::OP_JUMP, end_label);
+	}
+	bind_label(else_label);
+	if (stmt->false_case()) {
+		compile_statement(stmt->false_case());
+	}
+	bind_label(end_label);
+}
+
+// Find the cases and the default of a switch, looking through the blocks
+// and case chains ("case 1: case 2: foo;") that make up its body.
+static void
+find_cases(Statement *stmt, std::vector<CaseStatement*> *cases,
+           Statement **default_case)
+{
+	if (CompoundStatement *s = dynamic_cast<CompoundStatement*>(stmt)) {
+		for (size_t i = 0; i < s->body()->size(); i++) {
+			find_cases(s->body()->at(i), cases, default_case);
+		}
+		return;
+	}
+	while (stmt) {
+		const std::vector<Identifier*> &labels = stmt->labels();
+		for (size_t i = 0; i < labels.size(); i++) {
+			if (labels[i]->symbol() == "@switch_default"
+			 && *default_case == NULL) {
+				*default_case = stmt;
+			}
+		}
+		CaseStatement *c = dynamic_cast<CaseStatement*>(stmt);
+		if (c == NULL) {
+			break;
+		}
+		cases->push_back(c);
+		stmt = c->statement();
+	}
+}
+
+void
+Compiler::compile_switch(SwitchStatement *stmt)
+{
+	std::vector<CaseStatement*> cases;
+	Statement *default_case = NULL;
+	find_cases(stmt->body(), &cases, &default_case);
+
+	size_t mark = reg_mark();
+	uint16_t cond = compile_expr(stmt->condition());
+	uint16_t test = alloc_reg();
+
+	for (size_t i = 0; i < cases.size(); i++) {
+		set_position(cases[i]);
+		size_t case_mark = reg_mark();
+		uint16_t value = compile_expr(cases[i]->expression());
+		emit(bytecode::OP_EQ, test, cond, value);
+		emit_jump(bytecode::OP_JUMP_IF_TRUE,
+		          statement_label(cases[i], ""), test);
+		release_regs(case_mark);
+	}
+	size_t end_label = new_label();
+	if (default_case) {
+		emit_jump(bytecode::OP_JUMP,
+		          statement_label(default_case, "@switch_default"));
+	} else {
+		emit_jump(bytecode::OP_JUMP, end_label);
+	}
+	release_regs(mark);
+
+	// A 'break' in the body leaves the switch.
+	current()->label_scopes.push_back(LabelScope());
+	current()->label_scopes.back().fixed["@loop_break"] = end_label;
+	compile_statement(stmt->body());
+	pop_label_scope();
+	bind_label(end_label);
+}
+
+void
+Compiler::compile_loop(LoopStatement *stmt)
+{
+	size_t top_label = new_label();
+	size_t end_label = new_label();
+
+	if (stmt->loop_type() == LoopStatement::LOOP_WHILE) {
+		bind_label(top_label);
+		size_t mark = reg_mark();
+		uint16_t cond = compile_expr(stmt->expression());
+		emit_jump(bytecode::OP_JUMP_IF_FALSE, end_label, cond);
+		release_regs(mark);
+		compile_statement(stmt->body());
+		emit_jump(bytecode::OP_JUMP, top_label);
+	} else {
+		bind_label(top_label);
+		compile_statement(stmt->body());
+		// Labels on a do-while loop ('continue') go to the condition.
+		set_position(stmt);
+		const std::vector<Identifier*> &labels = stmt->labels();
+		for (size_t i = 0; i < labels.size(); i++) {
+			bind_label(statement_label(stmt, labels[i]->symbol()));
+		}
+		size_t mark = reg_mark();
+		uint16_t cond = compile_expr(stmt->expression());
+		emit_jump(bytecode::OP_JUMP_IF_TRUE, top_label, cond);
+		release_regs(mark);
+	}
+	bind_label(end_label);
+}
+
+void
+Compiler::compile_discover(DiscoverStatement *stmt)
+{
+	std::map<string, uint16_t>::iterator it = m_builtins.find("discover");
+	if (it == m_builtins.end()) {
+		throw LanguageError(stmt->parse_position(),
+		    "discover is not available in this environment");
+	}
+	size_t mark = reg_mark();
+	uint16_t callee = alloc_reg();
+	emit(bytecode::OP_GETGLOBAL, callee, it->second);
+	ArgumentList *args = stmt->args();
+	for (size_t i = 0; i < args->size(); i++) {
+		uint16_t slot = alloc_reg();
+		uint16_t r = compile_expr(args->at(i)->expression());
+		emit_move(slot, r);
+		release_regs(slot + 1);
+	}
+	emit(bytecode::OP_CALL, callee, callee, args->size());
+	release_regs(mark);
+}
+
+//
+// Expressions.
+//
+
+uint16_t
+Compiler::compile_expr(Expression *expr)
+{
+	const SyntaxNode *saved_position = m_position;
+	set_position(expr);
+	uint16_t result;
+
+	if (ValueExpression *e = dynamic_cast<ValueExpression*>(expr)) {
+		// Literals have literal types, but the values the VM
+		// hands out should look like any other value.
+		const Variable::Datum *datum = e->value();
+		Variable *value;
+		switch (datum->type().primitive()) {
+		 case Type::BOOL:
+			value = new Variable(Type::BOOL, Type::CONST,
+			                     datum->bool_value());
+			break;
+		 case Type::INT:
+			value = new Variable(Type::INT, Type::CONST,
+			                     datum->int_value());
+			break;
+		 case Type::STRING:
+			value = new Variable(Type::STRING, Type::CONST,
+			                     datum->string_value());
+			break;
+		 default:
+			throw LanguageError(expr->parse_position(),
+			    "can't compile literal: " + expr->to_string());
+		}
+		result = alloc_reg();
+		emit(bytecode::OP_LOADK, result, add_constant(VarPtr(value)));
+	} else if (IdentifierExpression *e =
+	           dynamic_cast<IdentifierExpression*>(expr)) {
+		result = compile_identifier(e);
+	} else if (SubscriptExpression *e =
+	           dynamic_cast<SubscriptExpression*>(expr)) {
+		uint16_t container = compile_expr(e->expression());
+		uint16_t index = compile_expr(e->index());
+		result = alloc_reg();
+		emit(bytecode::OP_SUBSCRIPT, result, container, index);
+	} else if (FunctionCallExpression *e =
+	           dynamic_cast<FunctionCallExpression*>(expr)) {
+		result = compile_call(e->callee(), e->args());
+	} else if (UnaryExpression *e = dynamic_cast<UnaryExpression*>(expr)) {
+		result = compile_unary(e);
+	} else if (BinaryExpression *e = dynamic_cast<BinaryExpression*>(expr)) {
+		result = compile_binary(e);
+	} else if (ConditionalExpression *e =
+	           dynamic_cast<ConditionalExpression*>(expr)) {
+		result = compile_conditional_expr(e);
+	} else if (TupleLiteralExpression *e =
+	           dynamic_cast<TupleLiteralExpression*>(expr)) {
+		result = compile_tuple(e);
+	} else if (FunctionLiteralExpression *e =
+	           dynamic_cast<FunctionLiteralExpression*>(expr)) {
+		result = compile_function(e);
+	} else {
+		throw LanguageError(expr->parse_position(),
+		    "can't compile expression: " + expr->to_string());
+	}
+
+	set_position(saved_position);
+	return result;
+}
+
+uint16_t
+Compiler::compile_identifier(IdentifierExpression *expr)
+{
+	Definition *def = expr->definition();
+	if (def == NULL) {
+		throw LanguageError(expr->parse_position(),
+		    sprintfxx("symbol '%s' was not resolved", expr->to_string()));
+	}
+
+	// A local of this function.
+	FunctionState *fs = current();
+	std::map<const Definition*, uint16_t>::iterator it =
+	    fs->locals.find(def);
+	if (it != fs->locals.end()) {
+		return it->second;
+	}
+
+	// A global.
+	it = m_globals.find(def);
+	if (it != m_globals.end()) {
+		uint16_t r = alloc_reg();
+		emit(bytecode::OP_GETGLOBAL, r, it->second);
+		return r;
+	}
+
+	// The implicit 'args' of a function.
+	if (fs->index != 0 && def->identifier()->symbol() == "args") {
+		return 0;
+	}
+
+	// A local of an enclosing function.
+	for (size_t i = 0; i + 1 < m_functions.size(); i++) {
+		if (m_functions[i]->locals.count(def)) {
+			throw LanguageError(expr->parse_position(),
+			    sprintfxx("can't use '%s' from an enclosing function",
+			              expr->to_string()));
+		}
+	}
+
+	// A constant which is not part of this program, such as when
+	// evaluating a single expression.  It can just be computed here.
+	if (def->type().is_const() && def->initializer()) {
+		for (size_t i = 0; i < m_inlining.size(); i++) {
+			if (m_inlining[i] == def) {
+				throw LanguageError(expr->parse_position(),
+				    sprintfxx("'%s' is defined in terms of itself",
+				              expr->to_string()));
+			}
+		}
+		m_inlining.push_back(def);
+		uint16_t r = compile_expr(def->initializer());
+		m_inlining.pop_back();
+		return r;
+	}
+
+	throw LanguageError(expr->parse_position(),
+	    sprintfxx("'%s' is not defined in this program", expr->to_string()));
+}
+
+// Compile an expression which is about to be written.  Subscripts are
+// made unshared, so the write does not show through other copies of the
+// container.  Anything else is compiled as usual.
+uint16_t
+Compiler::compile_lvalue(Expression *expr)
+{
+	SubscriptExpression *e = dynamic_cast<SubscriptExpression*>(expr);
+	if (e == NULL) {
+		return compile_expr(expr);
+	}
+	const SyntaxNode *saved_position = m_position;
+	set_position(expr);
+	uint16_t container = compile_lvalue(e->expression());
+	uint16_t index = compile_expr(e->index());
+	uint16_t result = alloc_reg();
+	emit(bytecode::OP_SUBSCRIPT_REF, result, container, index);
+	set_position(saved_position);
+	return result;
+}
+
+uint16_t
+Compiler::compile_unary(UnaryExpression *expr)
+{
+	uint16_t operand;
+	switch (expr->op()) {
+	 case UnaryExpression::OP_PREINC:
+	 case UnaryExpression::OP_PREDEC:
+	 case UnaryExpression::OP_POSTINC:
+	 case UnaryExpression::OP_POSTDEC:
+		operand = compile_lvalue(expr->expression());
+		break;
+	 default:
+		operand = compile_expr(expr->expression());
+		break;
+	}
+	uint16_t result;
+
+	switch (expr->op()) {
+	 case UnaryExpression::OP_POS:
+		result = alloc_reg();
+		emit(bytecode::OP_POS, result, operand);
+		break;
+	 case UnaryExpression::OP_NEG:
+		result = alloc_reg();
+		emit(bytecode::OP_NEG, result, operand);
+		break;
+	 case UnaryExpression::OP_NOT:
+		result = alloc_reg();
+		emit(bytecode::OP_NOT, result, operand);
+		break;
+	 case UnaryExpression::OP_BITNOT:
+		result = alloc_reg();
+		emit(bytecode::OP_BITNOT, result, operand);
+		break;
+	 case UnaryExpression::OP_PREINC:
+		emit(bytecode::OP_INC, operand);
+		result = operand;
+		break;
+	 case UnaryExpression::OP_PREDEC:
+		emit(bytecode::OP_DEC, operand);
+		result = operand;
+		break;
+	 case UnaryExpression::OP_POSTINC:
+		result = alloc_reg();
+		emit(bytecode::OP_COPY, result, operand);
+		emit(bytecode::OP_INC, operand);
+		break;
+	 case UnaryExpression::OP_POSTDEC:
+		result = alloc_reg();
+		emit(bytecode::OP_COPY, result, operand);
+		emit(bytecode::OP_DEC, operand);
+		break;
+	 default:
+		throw LanguageError(expr->parse_position(),
+		    "can't compile expression: " + expr->to_string());
+	}
+	return result;
+}
+
+// Map the arithmetic operators, including the compound assignments, to
+// opcodes.  Returns OP_NOP for anything else.
+static bytecode::Opcode
+binary_opcode(BinaryExpression::Operator op)
+{
+	switch (op) {
+	 case BinaryExpression::OP_EQ:         return bytecode::OP_EQ;
+	 case BinaryExpression::OP_NEQ:        return bytecode::OP_NEQ;
+	 case BinaryExpression::OP_LT:         return bytecode::OP_LT;
+	 case BinaryExpression::OP_GT:         return bytecode::OP_GT;
+	 case BinaryExpression::OP_LE:         return bytecode::OP_LE;
+	 case BinaryExpression::OP_GE:         return bytecode::OP_GE;
+	 case BinaryExpression::OP_MUL:
+	 case BinaryExpression::OP_MUL_ASSIGN: return bytecode::OP_MUL;
+	 case BinaryExpression::OP_DIV:
+	 case BinaryExpression::OP_DIV_ASSIGN: return bytecode::OP_DIV;
+	 case BinaryExpression::OP_MOD:
+	 case BinaryExpression::OP_MOD_ASSIGN: return bytecode::OP_MOD;
+	 case BinaryExpression::OP_ADD:
+	 case BinaryExpression::OP_ADD_ASSIGN: return bytecode::OP_ADD;
+	 case BinaryExpression::OP_SUB:
+	 case BinaryExpression::OP_SUB_ASSIGN: return bytecode::OP_SUB;
+	 case BinaryExpression::OP_SHL:
+	 case BinaryExpression::OP_SHL_ASSIGN: return bytecode::OP_SHL;
+	 case BinaryExpression::OP_SHR:
+	 case BinaryExpression::OP_SHR_ASSIGN: return bytecode::OP_SHR;
+	 case BinaryExpression::OP_AND:
+	 case BinaryExpression::OP_AND_ASSIGN: return bytecode::OP_AND;
+	 case BinaryExpression::OP_OR:
+	 case BinaryExpression::OP_OR_ASSIGN:  return bytecode::OP_OR;
+	 case BinaryExpression::OP_XOR:
+	 case BinaryExpression::OP_XOR_ASSIGN: return bytecode::OP_XOR;
+	 default:
+		break;
+	}
+	return bytecode::OP_NOP;
+}
+
+uint16_t
+Compiler::compile_binary(BinaryExpression *expr)
+{
+	BinaryExpression::Operator op = expr->op();
+
+	if (op == BinaryExpression::OP_COMMA) {
+		size_t mark = reg_mark();
+		compile_expr(expr->lhs());
+		release_regs(mark);
+		uint16_t rhs = compile_expr(expr->rhs());
+		if (rhs < mark) {
+			return rhs;
+		}
+		// Keep the result at the bottom of the released temporaries.
+		uint16_t result = alloc_reg();
+		emit_move(result, rhs);
+		return result;
+	}
+
+	if (op == BinaryExpression::OP_ASSIGN) {
+		uint16_t lhs = compile_lvalue(expr->lhs());
+		uint16_t rhs = compile_expr(expr->rhs());
+		emit(bytecode::OP_ASSIGN, lhs, rhs,
+		     add_type(expr->lhs()->result_type()));
+		return lhs;
+	}
+
+	bytecode::Opcode opcode = binary_opcode(op);
+	if (opcode == bytecode::OP_NOP) {
+		throw LanguageError(expr->parse_position(),
+		    "can't compile expression: " + expr->to_string());
+	}
+	bool assigns;
+	switch (op) {
+	 case BinaryExpression::OP_MUL_ASSIGN:
+	 case BinaryExpression::OP_DIV_ASSIGN:
+	 case BinaryExpression::OP_MOD_ASSIGN:
+	 case BinaryExpression::OP_ADD_ASSIGN:
+	 case BinaryExpression::OP_SUB_ASSIGN:
+	 case BinaryExpression::OP_SHL_ASSIGN:
+	 case BinaryExpression::OP_SHR_ASSIGN:
+	 case BinaryExpression::OP_AND_ASSIGN:
+	 case BinaryExpression::OP_OR_ASSIGN:
+	 case BinaryExpression::OP_XOR_ASSIGN:
+		assigns = true;
+		break;
+	 default:
+		assigns = false;
+		break;
+	}
+
+	uint16_t lhs = assigns ? compile_lvalue(expr->lhs())
+	                       : compile_expr(expr->lhs());
+	uint16_t rhs = compile_expr(expr->rhs());
+	uint16_t result = alloc_reg();
+	emit(opcode, result, lhs, rhs);
+
+	if (assigns) {
+		emit(bytecode::OP_ASSIGN, lhs, result,
+		     add_type(expr->lhs()->result_type()));
+		return lhs;
+	}
+	return result;
+}
+
+uint16_t
+Compiler::compile_conditional_expr(ConditionalExpression *expr)
+{
+	uint16_t result = alloc_reg();
+	size_t mark = reg_mark();
+
+	bool value;
+	if (constant_condition(expr->condition(), &value)) {
+		emit_move(result, compile_expr(value ? expr->true_case()
+		                                     : expr->false_case()));
+		release_regs(mark);
+		return result;
+	}
+
+	size_t false_label = new_label();
+	size_t end_label = new_label();
+	uint16_t cond = compile_expr(expr->condition());
+	emit_jump(bytecode::OP_JUMP_IF_FALSE, false_label, cond);
+	release_regs(mark);
+
+	emit_move(result, compile_expr(expr->true_case()));
+	release_regs(mark);
+	emit_jump(bytecode::OP_JUMP, end_label);
+
+	bind_label(false_label);
+	emit_move(result, compile_expr(expr->false_case()));
+	release_regs(mark);
+	bind_label(end_label);
+	return result;
+}
+
+// Arguments and tuple members are evaluated into consecutive registers,
+// starting at 'base'.
+uint16_t
+Compiler::compile_call(Expression *callee, const ArgumentList *args)
+{
+	uint16_t base = alloc_reg();
+	emit_move(base, compile_expr(callee));
+	release_regs(base + 1);
+
+	size_t n_args = args ? args->size() : 0;
+	for (size_t i = 0; i < n_args; i++) {
+		uint16_t slot = alloc_reg();
+		emit_move(slot, compile_expr(args->at(i)->expression()));
+		release_regs(slot + 1);
+	}
+	emit(bytecode::OP_CALL, base, base, n_args);
+	release_regs(base + 1);
+	return base;
+}
+
+uint16_t
+Compiler::compile_tuple(TupleLiteralExpression *expr)
+{
+	uint16_t result = alloc_reg();
+	ArgumentList *contents = expr->contents();
+	uint16_t base = result + 1;
+	for (size_t i = 0; i < contents->size(); i++) {
+		uint16_t slot = alloc_reg();
+		emit_move(slot, compile_expr(contents->at(i)->expression()));
+		release_regs(slot + 1);
+	}
+	emit(bytecode::OP_TUPLE, result, base, contents->size());
+	release_regs(result + 1);
+	return result;
+}
+
+uint16_t
+Compiler::compile_function(FunctionLiteralExpression *expr)
+{
+	const Parser::Position &pos = expr->parse_position();
+	FunctionState *fs = begin_function(
+	    sprintfxx("<function at %s:%d>", pos.file, pos.line), pos);
+	size_t index = fs->index;
+
+	fs->label_scopes.push_back(LabelScope());
+	compile_statement(expr->body());
+	emit(bytecode::OP_RETURN);
+	pop_label_scope();
+	end_function();
+
+	set_position(expr);
+	uint16_t result = alloc_reg();
+	emit(bytecode::OP_FUNC, result, index);
+	return result;
+}
+
+}  // namespace language
+}  // namespace hwpp
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
@@ -0,0 +1,183 @@
+// Compile validated syntax trees into bytecode.
+
+#ifndef HWPP_LANGUAGE_COMPILER_H__
+#define HWPP_LANGUAGE_COMPILER_H__
+
+#include "hwpp.h"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "language/bytecode.h"
+#include "language/parsed_file.h"
+#include "language/syntax_tree.h"
+
+namespace hwpp {
+namespace language {
+
+// This turns syntax trees into a bytecode::Program.  All trees must be
+// validated first, so that identifiers are resolved to their Definitions.
+//
+// Top-level definitions become globals, and every other definition gets a
+// register in its function's frame.  Functions can reference globals and
+// their own locals, but not locals of an enclosing function.
+//
+// Usage:
+//   Compiler compiler;
+//   compiler.add_file(file);
+//   bytecode::ProgramPtr program = compiler.finish();
+class Compiler {
+ public:
+	Compiler();
+	~Compiler();
+
+	// Make a global for 'def' which starts out holding 'value'.  This is
+	// how the environment provides built-in symbols.  A built-in named
+	// "discover" is called by discover statements.
+	void
+	add_builtin(const syntax::Definition *def, const bytecode::VarPtr &value);
+
+	// Queue the top-level statements of a file.  Files run in the order
+	// they are added.
+	void
+	add_file(const ParsedFile *file);
+
+	// Queue a single statement as top-level code.
+	void
+	add_statement(syntax::Statement *statement);
+
+	// Compile everything that was queued.  Throws LanguageError if
+	// something can not be compiled.  The Compiler can not be used after
+	// this.
+	bytecode::ProgramPtr
+	finish();
+
+	// Compile an expression into a program whose top-level code returns
+	// the value of the expression.
+	static bytecode::ProgramPtr
+	compile_expression(syntax::Expression *expr);
+
+ private:
+	struct Label;
+	struct LabelScope;
+	struct FunctionState;
+	typedef std::vector<syntax::Statement*> Unit;
+
+	// Declarations.
+	void
+	declare_globals(const Unit &unit);
+	uint16_t
+	add_constant(const bytecode::VarPtr &value);
+	uint16_t
+	add_type(const Type &type);
+
+	// Functions and registers.
+	FunctionState *
+	begin_function(const string &name, const Parser::Position &pos);
+	void
+	end_function();
+	FunctionState *
+	current() const
+	{
+		return m_functions.back();
+	}
+	uint16_t
+	alloc_reg();
+	size_t
+	reg_mark() const;
+	void
+	release_regs(size_t mark);
+
+	// Emitting code.
+	size_t
+	emit(bytecode::Opcode op, uint16_t a = bytecode::Instruction::NONE,
+	     uint16_t b = bytecode::Instruction::NONE,
+	     uint16_t c = bytecode::Instruction::NONE);
+	void
+	emit_move(uint16_t dst, uint16_t src);
+	void
+	set_position(const syntax::SyntaxNode *node);
+	const Parser::Position &
+	error_position() const;
+
+	// Labels.
+	size_t
+	new_label();
+	size_t
+	statement_label(const syntax::Statement *stmt, const string &name);
+	void
+	bind_label(size_t label);
+	void
+	emit_jump(bytecode::Opcode op, size_t label,
+	          uint16_t a = bytecode::Instruction::NONE);
+	void
+	push_label_scope(const std::vector<syntax::Statement*> &body);
+	void
+	pop_label_scope();
+	size_t
+	resolve_goto(const syntax::GotoStatement *stmt);
+	void
+	collect_labels(syntax::Statement *stmt,
+	               std::map<string, const syntax::Statement*> *out);
+
+	// Statements.
+	void
+	compile_unit(const Unit &unit);
+	void
+	compile_statement(syntax::Statement *stmt);
+	void
+	compile_compound(syntax::CompoundStatement *stmt);
+	void
+	compile_definitions(syntax::DefinitionStatement *stmt);
+	void
+	compile_conditional(syntax::ConditionalStatement *stmt);
+	void
+	compile_switch(syntax::SwitchStatement *stmt);
+	void
+	compile_loop(syntax::LoopStatement *stmt);
+	void
+	compile_discover(syntax::DiscoverStatement *stmt);
+
+	// Expressions.  These return the register holding the result, which
+	// may belong to a variable rather than be a temporary.
+	uint16_t
+	compile_expr(syntax::Expression *expr);
+	uint16_t
+	compile_lvalue(syntax::Expression *expr);
+	uint16_t
+	compile_identifier(syntax::IdentifierExpression *expr);
+	uint16_t
+	compile_unary(syntax::UnaryExpression *expr);
+	uint16_t
+	compile_binary(syntax::BinaryExpression *expr);
+	uint16_t
+	compile_conditional_expr(syntax::ConditionalExpression *expr);
+	uint16_t
+	compile_call(syntax::Expression *callee,
+	             const syntax::ArgumentList *args);
+	uint16_t
+	compile_tuple(syntax::TupleLiteralExpression *expr);
+	uint16_t
+	compile_function(syntax::FunctionLiteralExpression *expr);
+
+	bytecode::ProgramPtr m_program;
+	std::vector<Unit> m_units;
+	std::vector<FunctionState*> m_functions;
+	std::map<const syntax::Definition*, uint16_t> m_globals;
+	std::map<string, uint16_t> m_builtins;
+	// Constant identifiers currently being inlined, to catch loops.
+	std::vector<const syntax::Definition*> m_inlining;
+	const syntax::SyntaxNode *m_position;
+	bool m_finished;
+
+	// Not copyable.
+	Compiler(const Compiler &);
+	void operator=(const Compiler &);
+};
+
+}  // namespace language
+}  // namespace hwpp
+
+#endif  // HWPP_LANGUAGE_COMPILER_H__
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
@@ -1,18 +1,29 @@
 #include "language/environment.h"
 #include <stdio.h>
 #include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "language/compiler.h"
+#include "language/errors.h"
 #include "language/language.h"
+#include "language/module_cache.h"
 #include "language/parsed_file.h"
-#include "util/string_file.h"
+#include "language/variable.h"
+#include "language/vm.h"
 
 namespace hwpp {
 namespace language {
 
 Environment::~Environment()
 {
-	ParsedFileMap::iterator it;
-	for (it = m_parsed_files.begin(); it != m_parsed_files.end(); ++it) {
-		delete it->second;
+	FileStateMap::iterator it;
+	for (it = m_files.begin(); it != m_files.end(); ++it) {
+		delete it->second.file;
+	}
+	for (size_t i = 0; i < m_builtins.size(); i++) {
+		delete m_builtins[i].definition;
 	}
 }
 
@@ -32,52 +43,244 @@ Environment::parse_file(const string &name)
 const ParsedFile *
 Environment::parse_file(const string &name, FILE *file)
 {
-	// Parse the file.
-	std::auto_ptr<ParsedFile> parsed_file_ptr(new ParsedFile());
-	ParsedFile *current_file = parsed_file_ptr.get();
-	m_parser.parse_file(name, file, current_file);
+	// Keep the contents, so dependent files can be parsed again without
+	// going back to disk, and so the cache can be keyed by them.
+	string contents;
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+		contents.append(buf, n);
+	}
+	if (ferror(file)) {
+		return NULL;
+	}
+	return parse_contents(name, contents);
+}
 
-	// Save the results.
-	m_parsed_files[name] = parsed_file_ptr.release();
+const ParsedFile *
+Environment::reload_file(const string &name)
+{
+	if (m_files.find(name) == m_files.end()) {
+		return NULL;
+	}
+	return parse_file(name);
+}
+
+const ParsedFile *
+Environment::parse_contents(const string &name, const string &contents)
+{
+	// Parse before touching anything, so a failure changes nothing.
+	std::auto_ptr<ParsedFile> parsed_file_ptr(parse_uncommitted(name,
+	                                                            contents));
+	if (parsed_file_ptr.get() == NULL) {
+		return NULL;
+	}
+
+	// Replacing a file drops everything which depends on it.  Those are
+	// parsed again below, from the contents they had.
+	std::map<string, string> stale;
+	if (m_files.find(name) != m_files.end()) {
+		std::set<string> deps = dependents(name);
+		std::set<string>::iterator it;
+		for (it = deps.begin(); it != deps.end(); ++it) {
+			stale[*it] = m_files[*it].contents;
+			drop_file(*it);
+		}
+		drop_file(name);
+	}
+
+	ParsedFile *current_file = parsed_file_ptr.release();
+	FileState &state = m_files[name];
+	state.file = current_file;
+	state.contents = contents;
 
 	// Add it to the module map if it has a module name.
 	string module = current_file->module();
 	if (module != "") {
-		m_modules[module] = current_file;
+		m_modules[module] = name;
+	}
+
+	std::map<string, string>::iterator it;
+	for (it = stale.begin(); it != stale.end(); ++it) {
+		parse_contents(it->first, it->second);
 	}
 
-	return m_parsed_files[name];
+	return current_file;
 }
 
-const ParsedFile *
-Environment::parse_string(const string &name, const string &data)
+ParsedFile *
+Environment::parse_uncommitted(const string &name, const string &contents)
 {
-	util::StringFile sf;
+	if (m_module_cache) {
+		ParsedFile *cached = m_module_cache->load(name, contents);
+		if (cached) {
+			return cached;
+		}
+	}
+
+	// An empty file has nothing to parse, and fmemopen() can't open an
+	// empty buffer.
+	std::auto_ptr<ParsedFile> parsed_file_ptr(new ParsedFile());
+	if (contents.empty()) {
+		return parsed_file_ptr.release();
+	}
 
-	if (!sf.open(data)) {
-		WARN("could not create StringFile for data");
+	FILE *mem = fmemopen(const_cast<char *>(contents.data()),
+	                     contents.size(), "r");
+	if (!mem) {
 		return NULL;
 	}
+	// RAII for mem.
+	boost::shared_ptr<FILE> mem_ptr(mem, fclose);
+	int ret = m_parser.parse_file(name, mem, parsed_file_ptr.get());
+	if (ret == 0 && m_module_cache) {
+		m_module_cache->store(name, contents, *parsed_file_ptr);
+	}
+	return parsed_file_ptr.release();
+}
 
-	return parse_file(name, sf.get_read_file());
+void
+Environment::drop_file(const string &name)
+{
+	FileStateMap::iterator it = m_files.find(name);
+	if (it == m_files.end()) {
+		return;
+	}
+	FileState &state = it->second;
+
+	// Top-level symbols live in the root scope.
+	DASSERT(m_symtab.depth() == 1);
+	for (size_t i = 0; i < state.symbols.size(); i++) {
+		syntax::Definition * const *def = m_symtab.lookup(state.symbols[i]);
+		if (def) {
+			m_symbol_owners.erase(*def);
+		}
+		m_symtab.remove(state.symbols[i]);
+	}
+
+	ModuleMap::iterator mod = m_modules.find(state.file->module());
+	if (mod != m_modules.end() && mod->second == name) {
+		m_modules.erase(mod);
+	}
+
+	delete state.file;
+	m_files.erase(it);
+}
+
+std::set<string>
+Environment::dependents(const string &name) const
+{
+	std::set<string> found;
+	std::vector<string> todo(1, name);
+	while (!todo.empty()) {
+		string dep = todo.back();
+		todo.pop_back();
+		FileStateMap::const_iterator it;
+		for (it = m_files.begin(); it != m_files.end(); ++it) {
+			if (it->first != name && !found.count(it->first)
+			 && it->second.depends_on.count(dep)) {
+				found.insert(it->first);
+				todo.push_back(it->first);
+			}
+		}
+	}
+	return found;
+}
+
+void
+Environment::set_module_cache(const string &directory)
+{
+	m_module_cache.reset(new ModuleCache(directory));
+}
+
+const ParsedFile *
+Environment::parse_string(const string &name, const string &data)
+{
+	return parse_contents(name, data);
 }
 
 int
 Environment::validate(const ValidateOptions &flags)
 {
 	int warns = 0;
+	std::vector<string> validated;
+
+	FileStateMap::iterator it;
+	for (it = m_files.begin(); it != m_files.end(); ++it) {
+		warns += validate_file(it->first, flags, &validated);
+	}
+
+	// Folding needs every symbol resolved, so it waits for all files.
+	if (flags.fold_constants()) {
+		for (size_t i = 0; i < validated.size(); i++) {
+			ParsedFile *file = m_files[validated[i]].file;
+			for (size_t j = 0; j < file->n_statements(); j++) {
+				file->statement(j)->fold_constants();
+			}
+		}
+	}
 
-	ParsedFileMap::iterator it;
-	for (it = m_parsed_files.begin(); it != m_parsed_files.end(); ++it) {
-		ParsedFile *file = it->second;
+	return warns;
+}
+
+int
+Environment::validate_file(const string &name, const ValidateOptions &flags,
+                           std::vector<string> *validated)
+{
+	FileState &state = m_files[name];
+	if (state.validated) {
+		return 0;
+	}
+	// Mark it first, so that import cycles end.
+	state.validated = true;
+	ParsedFile *file = state.file;
+	int warns = 0;
+
+	// Validate imported modules first, so their symbols can be found.
+	for (size_t i = 0; i < file->n_statements(); i++) {
+		const syntax::ImportStatement *import =
+		    dynamic_cast<const syntax::ImportStatement*>(file->statement(i));
+		if (import == NULL) {
+			continue;
+		}
+		ModuleMap::iterator mod = m_modules.find(import->argument());
+		if (mod != m_modules.end() && mod->second != name) {
+			state.depends_on.insert(mod->second);
+			warns += validate_file(mod->second, flags, validated);
+		}
+	}
+
+	string saved_file = m_current_file;
+	m_current_file = name;
+	try {
 		for (size_t i = 0; i < file->n_statements(); i++) {
 			warns += file->statement(i)->validate_once(flags, this);
 		}
+	} catch (...) {
+		m_current_file = saved_file;
+		throw;
 	}
+	m_current_file = saved_file;
 
+	validated->push_back(name);
 	return warns;
 }
 
+bool
+Environment::add_symbol(const string &name, syntax::Definition *definition)
+{
+	if (!m_symtab.add_unique(name, definition)) {
+		return false;
+	}
+	// Remember where top-level symbols come from, to track which files
+	// depend on which.
+	if (m_current_file != "" && m_symtab.depth() == 1) {
+		m_symbol_owners[definition] = m_current_file;
+		m_files[m_current_file].symbols.push_back(name);
+	}
+	return true;
+}
+
 syntax::Definition *
 Environment::lookup_symbol(const string &name)
 {
@@ -85,17 +288,97 @@ Environment::lookup_symbol(const string &name)
 	if (p == NULL) {
 		return NULL;
 	}
+	if (m_current_file != "") {
+		std::map<const syntax::Definition*, string>::iterator owner =
+		    m_symbol_owners.find(*p);
+		if (owner != m_symbol_owners.end()
+		 && owner->second != m_current_file) {
+			m_files[m_current_file].depends_on.insert(owner->second);
+		}
+	}
 	return *p;
 }
 
+bool
+Environment::add_builtin(const string &name, const Type &type,
+                         Variable *value)
+{
+	boost::shared_ptr<Variable> value_ptr(value);
+	Parser::Position pos;
+	pos.file = "<builtin>";
+	pos.line = 0;
+	syntax::Definition *def = new syntax::Definition(pos, type,
+	    new syntax::InitializedIdentifier(pos,
+	        new syntax::Identifier(pos, name)));
+
+	// Validating the definition adds the symbol.
+	try {
+		def->validate_once(default_validate_options(), this);
+	} catch (SyntaxError &) {
+		delete def;
+		return false;
+	}
+	Builtin builtin = { def, value_ptr };
+	m_builtins.push_back(builtin);
+	return true;
+}
+
+void
+Environment::add_file_and_imports(const ParsedFile *file, Compiler *compiler,
+                                  std::set<const ParsedFile*> *done)
+{
+	if (done->count(file)) {
+		return;
+	}
+	done->insert(file);
+	for (size_t i = 0; i < file->n_statements(); i++) {
+		const syntax::ImportStatement *import =
+		    dynamic_cast<const syntax::ImportStatement*>(file->statement(i));
+		if (import == NULL) {
+			continue;
+		}
+		const ParsedFile *module = lookup_module(import->argument());
+		if (module) {
+			add_file_and_imports(module, compiler, done);
+		}
+	}
+	compiler->add_file(file);
+}
+
+void
+Environment::execute()
+{
+	Compiler compiler;
+	for (size_t i = 0; i < m_builtins.size(); i++) {
+		compiler.add_builtin(m_builtins[i].definition, m_builtins[i].value);
+	}
+	std::set<const ParsedFile*> done;
+	FileStateMap::iterator it;
+	for (it = m_files.begin(); it != m_files.end(); ++it) {
+		add_file_and_imports(it->second.file, &compiler, &done);
+	}
+
+	m_vm.reset(new Vm(compiler.finish()));
+	m_vm->run();
+}
+
+const Variable *
+Environment::lookup_global(const string &name) const
+{
+	if (!m_vm) {
+		return NULL;
+	}
+	return m_vm->global(name);
+}
+
 const ParsedFile *
 Environment::lookup_module(const string &name)
 {
 	ModuleMap::iterator it = m_modules.find(name);
-	if (it != m_modules.end()) {
-		return it->second;
+	if (it == m_modules.end()) {
+		return NULL;
 	}
-	return NULL;
+	return m_files[it->second].file;
 }
 
 }  // namespace language
@@ -7,15 +7,23 @@
 #include <stdio.h>
 #include <ostream>
 #include <map>
+#include <set>
+#include <vector>
+#include <boost/shared_ptr.hpp>
 #include "language/environment.h"
 #include "language/language.h"
+#include "language/type.h"
 #include "util/symbol_table.h"
 
 namespace hwpp {
 namespace language {
 
 // Forward declarations.
+class Compiler;
+class ModuleCache;
 class ParsedFile;
+class Variable;
+class Vm;
 namespace syntax {
 	class Definition;
 	class Identifier;
@@ -32,7 +40,8 @@ class ValidateOptions {
  public:
 	ValidateOptions()
 	    : m_warnings_stream(&std::cerr),
-	      m_unresolved_symbols(SEVERITY_ERROR)
+	      m_unresolved_symbols(SEVERITY_ERROR),
+	      m_fold_constants(true)
 	{
 	}
 
@@ -71,14 +80,44 @@ class ValidateOptions {
 		return m_unresolved_symbols == SEVERITY_ERROR;
 	}
 
+	// Constant folding simplifies the trees after they are validated.
+	// It is on by default.
+	ValidateOptions &
+	set_fold_constants(bool fold)
+	{
+		m_fold_constants = fold;
+		return *this;
+	}
+	bool
+	fold_constants() const
+	{
+		return m_fold_constants;
+	}
+
  private:
 	std::ostream *m_warnings_stream;
 	Severity m_unresolved_symbols;
+	bool m_fold_constants;
 };
 
 class Environment {
-	typedef std::map<string, ParsedFile*> ParsedFileMap;
-	typedef std::map<string, ParsedFile*> ModuleMap;
+	// What the environment knows about each parsed file.
+	struct FileState {
+		FileState()
+		    : file(NULL), validated(false)
+		{
+		}
+		ParsedFile *file;
+		bool validated;
+		// The top-level symbols this file added while it was validated.
+		std::vector<string> symbols;
+		// The files this file imports or uses symbols from.
+		std::set<string> depends_on;
+		// The source, so the file can be parsed again.
+		string contents;
+	};
+	typedef std::map<string, FileState> FileStateMap;
+	typedef std::map<string, string> ModuleMap;  // module -> file name
  public:
 	Environment()
 	{
@@ -86,7 +125,8 @@ class Environment {
 	~Environment();
 
 	// Open and parse a file name.  This object owns the returned pointer.
-	// Returns NULL on failure.
+	// Returns NULL on failure.  Parsing a name which was already parsed
+	// replaces it, as reload_file() does.
 	const ParsedFile *
 	parse_file(const string &name);
 	// Parse an already opened file.  This object owns the returned pointer.
@@ -95,16 +135,51 @@ class Environment {
 	const ParsedFile *
 	parse_file(const string &name, FILE *file);
 
+	// Parse a file again after it changed on disk.  The old parse is
+	// dropped, along with its symbols and the files which depend on it,
+	// which are parsed again from the contents they had.  Call validate()
+	// and execute() afterwards; only the replaced files are validated
+	// again.  Returns NULL on failure, in which case nothing is changed.
+	// Throws SyntaxError on parse errors, also leaving things unchanged.
+	const ParsedFile *
+	reload_file(const string &name);
+
+	// Cache parsed files in 'directory'.  After this, files whose name and
+	// contents have been seen before are loaded from the cache instead of
+	// being parsed.  They are still validated as usual.
+	void
+	set_module_cache(const string &directory);
+
 	// Parse a string.  This object owns the returned pointer.  Returns NULL
 	// on failure.
 	const ParsedFile *
 	parse_string(const string &name, const string &data);
 
-	// Validate all parsed files.  Returns the number of warnings
-	// generated.
+	// Validate all parsed files which have not been validated yet, then
+	// fold their constants unless the options say not to.  Files are
+	// validated after the modules they import.  Returns the number of
+	// warnings generated.
 	int
 	validate(const ValidateOptions &flags);
 
+	// Add a built-in symbol, which code can use like any other global.
+	// Call this before validate().  This takes ownership of 'value'.
+	// Returns false if the symbol already exists.  A built-in function
+	// named "discover" handles discover statements.
+	bool
+	add_builtin(const string &name, const Type &type, Variable *value);
+
+	// Compile all validated files to bytecode and run them.  Files run
+	// after the modules they import, and otherwise in name order.  Throws
+	// LanguageError on failure.
+	void
+	execute();
+
+	// Look up a global by name, after execute().  Returns NULL if it does
+	// not exist.
+	const Variable *
+	lookup_global(const string &name) const;
+
 	// Get the default validate options.
 	ValidateOptions
 	default_validate_options()
@@ -123,10 +198,7 @@ class Environment {
 	// Add a symbol to the current nested scope.  This is used while
 	// validating parsed files to do symbol resolution.
 	bool
-	add_symbol(const string &name, syntax::Definition *definition)
-	{
-		return m_symtab.add_unique(name,definition);
-	}
+	add_symbol(const string &name, syntax::Definition *definition);
 
 	// Terminate the current nested scope for symbols.  This is used while
 	// validating parsed files to do symbol resolution.
@@ -144,11 +216,46 @@ class Environment {
 	const ParsedFile *
 	lookup_module(const string &name);
 
+	// Get the names of the files which depend on a file, directly or
+	// not, by importing it or using its symbols.
+	std::set<string>
+	dependents(const string &name) const;
+
  private:
+	const ParsedFile *
+	parse_contents(const string &name, const string &contents);
+
+	ParsedFile *
+	parse_uncommitted(const string &name, const string &contents);
+
+	void
+	drop_file(const string &name);
+
+	int
+	validate_file(const string &name, const ValidateOptions &flags,
+	              std::vector<string> *validated);
+
+	void
+	add_file_and_imports(const ParsedFile *file, Compiler *compiler,
+	                     std::set<const ParsedFile*> *done);
+
+	struct Builtin {
+		syntax::Definition *definition;
+		boost::shared_ptr<Variable> value;
+	};
+
 	Parser m_parser;
 	util::SymbolTable<string, syntax::Definition*> m_symtab;
-	ParsedFileMap m_parsed_files;  // Owns the ParsedFile pointers.
+	FileStateMap m_files;  // Owns the ParsedFile pointers.
 	ModuleMap m_modules;
+	// Which file added each top-level Definition.
+	std::map<const syntax::Definition*, string> m_symbol_owners;
+	// The file being validated, if any.
+	string m_current_file;
+	std::vector<Builtin> m_builtins;  // Owns the Definition pointers.
+	boost::shared_ptr<ModuleCache> m_module_cache;
+	// The VM which ran the files, which holds their globals.
+	boost::shared_ptr<Vm> m_vm;
 };
 
 }  // namespace language
@@ -30,6 +30,16 @@ struct SyntaxError: public LanguageError
 	}
 };
 
+// An error while running code, such as a type mismatch that could not be
+// caught by validation.
+struct RuntimeError: public LanguageError
+{
+	RuntimeError(const Parser::Position &pos, const std::string &str)
+	    : LanguageError(pos, str)
+	{
+	}
+};
+
 }  // namespace language
 }  // namespace hwpp
 
@@ -98,6 +98,8 @@ hwpp__language__internal__pop_lexer_state(yyscan_t scanner);
 
 // To make position tracking less "in your face".
 #define curpos() parser->current_position()
+// Syntax nodes live as long as the file they came from.
+#define arena() out_parsed_file->arena()
 
 %}
 
@@ -179,7 +181,7 @@ identifier
 simple_identifier
 	: TOK_IDENTIFIER {
 		SYNTRACE("simple_identifier", "IDENTIFIER");
-		$$ = new Identifier(curpos(), *$1);
+		$$ = new (arena()) Identifier(curpos(), *$1);
 		delete $1;
 	}
 	;
@@ -187,7 +189,7 @@ simple_identifier
 absolute_identifier
 	: TOK_IDENTIFIER '.' TOK_IDENTIFIER {
 		SYNTRACE("absolute_identifier", "IDENTIFIER '.' IDENTIFIER");
-		$$ = new Identifier(curpos(), *$1, *$3);
+		$$ = new (arena()) Identifier(curpos(), *$1, *$3);
 		delete $1;
 		delete $3;
 	}
@@ -196,20 +198,20 @@ absolute_identifier
 primary_expression
 	: identifier {
 		SYNTRACE("primary_expression", "identifier");
-		$$ = new IdentifierExpression(curpos(), $1);
+		$$ = new (arena()) IdentifierExpression(curpos(), $1);
 	}
 	| TOK_BOOL_LITERAL {
 		SYNTRACE("primary_expression", "BOOL_LITERAL");
-		$$ = new BoolLiteralExpression(curpos(), $1);
+		$$ = new (arena()) BoolLiteralExpression(curpos(), $1);
 	}
 	| TOK_INT_LITERAL {
 		SYNTRACE("primary_expression", "INT_LITERAL");
-		$$ = new IntLiteralExpression(curpos(), *$1);
+		$$ = new (arena()) IntLiteralExpression(curpos(), *$1);
 		delete $1;
 	}
 	| string_literal {
 		SYNTRACE("primary_expression", "string_literal");
-		$$ = new StringLiteralExpression(curpos(), *$1);
+		$$ = new (arena()) StringLiteralExpression(curpos(), *$1);
 		delete $1;
 	}
 	| tuple_literal {
@@ -241,11 +243,11 @@ string_literal
 tuple_literal
 	: '[' ']' {
 		SYNTRACE("tuple_literal", "'[' ']'");
-		$$ = new TupleLiteralExpression(curpos(), new ArgumentList());
+		$$ = new (arena()) TupleLiteralExpression(curpos(), new ArgumentList());
 	}
 	| '[' argument_list ']' {
 		SYNTRACE("tuple_literal", "'[' argument_list ']'");
-		$$ = new TupleLiteralExpression(curpos(), $2);
+		$$ = new (arena()) TupleLiteralExpression(curpos(), $2);
 	}
 	;
 
@@ -253,21 +255,21 @@ function_literal
 	: TOK_FUNC_LITERAL compound_statement {
 		SYNTRACE("function_literal",
 		         "FUNC_LITERAL compound_statement");
-		$$ = new FunctionLiteralExpression(curpos(),
-		                                   new ParameterDeclarationList(), $2);
+		$$ = new (arena()) FunctionLiteralExpression(curpos(),
+		    new ParameterDeclarationList(), $2);
 	}
 	| TOK_FUNC_LITERAL '(' ')'compound_statement {
 		SYNTRACE("function_literal",
 		         "FUNC_LITERAL '(' ')' compound_statement");
-		$$ = new FunctionLiteralExpression(curpos(),
-		                                   new ParameterDeclarationList(), $4);
+		$$ = new (arena()) FunctionLiteralExpression(curpos(),
+		    new ParameterDeclarationList(), $4);
 	}
 	| TOK_FUNC_LITERAL '(' parameter_declaration_list ')'
 	  compound_statement {
 		SYNTRACE("function_literal",
 		         "FUNC_LITERAL '(' " "parameter_declaration_list ')'"
 		         " compound_statement");
-		$$ = new FunctionLiteralExpression(curpos(), $3, $5);
+		$$ = new (arena()) FunctionLiteralExpression(curpos(), $3, $5);
 	}
 	;
 
@@ -281,12 +283,12 @@ function_call_expression
 	| subscript_expression '(' ')' {
 		SYNTRACE("function_call_expression",
 		         "function_call_expression '(' ')'");
-		$$ = new FunctionCallExpression(curpos(), $1);
+		$$ = new (arena()) FunctionCallExpression(curpos(), $1);
 	}
 	| subscript_expression '(' argument_list ')' {
 		SYNTRACE("function_call_expression",
 		         "function_call_expression '(' argument_list ')'");
-		$$ = new FunctionCallExpression(curpos(), $1, $3);
+		$$ = new (arena()) FunctionCallExpression(curpos(), $1, $3);
 	}
 	;
 
@@ -310,12 +312,12 @@ argument_list
 argument
 	: assignment_expression {
 		SYNTRACE("argument", "assignment_expression");
-		$$ = new Argument(curpos(), $1);
+		$$ = new (arena()) Argument(curpos(), $1);
 	}
 	| simple_identifier ':' assignment_expression {
 		SYNTRACE("argument",
 		         "simple_identifier ':' assignment_expression");
-		$$ = new Argument(curpos(), $1, $3);
+		$$ = new (arena()) Argument(curpos(), $1, $3);
 	}
 	;
 
@@ -329,7 +331,7 @@ subscript_expression
 	| subscript_expression '[' expression ']' {
 		SYNTRACE("subscript_expression",
 		         "subscript_expression '[' expression ']'");
-		$$ = new SubscriptExpression(curpos(), $1, $3);
+		$$ = new (arena()) SubscriptExpression(curpos(), $1, $3);
 	}
 	;
 
@@ -340,13 +342,13 @@ postfix_expression
 	}
 	| postfix_expression TOK_INC {
 		SYNTRACE("postfix_expression", "postfix_expression INC");
-		$$ = new UnaryExpression(curpos(),
-		                         UnaryExpression::OP_POSTINC, $1);
+		$$ = new (arena()) UnaryExpression(curpos(),
+		                                   UnaryExpression::OP_POSTINC, $1);
 	}
 	| postfix_expression TOK_DEC {
 		SYNTRACE("postfix_expression", "postfix_expression DEC");
-		$$ = new UnaryExpression(curpos(),
-		                         UnaryExpression::OP_POSTDEC, $1);
+		$$ = new (arena()) UnaryExpression(curpos(),
+		                                   UnaryExpression::OP_POSTDEC, $1);
 	}
 	;
 
@@ -357,7 +359,7 @@ unary_expression
 	}
 	| unary_operator unary_expression {
 		SYNTRACE("unary_expression", "unary_operator unary_expression");
-		$$ = new UnaryExpression(curpos(), $1, $2);
+		$$ = new (arena()) UnaryExpression(curpos(), $1, $2);
 	}
 	;
 
@@ -396,20 +398,20 @@ multiplicative_expression
 	| multiplicative_expression '*' unary_expression {
 		SYNTRACE("multiplicative_expression",
 		         "multiplicative_expression '*' unary_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_MUL, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_MUL, $1, $3);
 	}
 	| multiplicative_expression '/' unary_expression {
 		SYNTRACE("multiplicative_expression",
 		         "multiplicative_expression '/' unary_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_DIV, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_DIV, $1, $3);
 	}
 	| multiplicative_expression '%' unary_expression {
 		SYNTRACE("multiplicative_expression",
 		         "multiplicative_expression '%' unary_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_MOD, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_MOD, $1, $3);
 	}
 	;
 
@@ -421,14 +423,14 @@ additive_expression
 	| additive_expression '+' multiplicative_expression {
 		SYNTRACE("additive_expression",
 		         "additive_expression '+' multiplicative_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_ADD, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_ADD, $1, $3);
 	}
 	| additive_expression '-' multiplicative_expression {
 		SYNTRACE("additive_expression",
 		         "additive_expression '-' multiplicative_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_SUB, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_SUB, $1, $3);
 	}
 	;
 
@@ -440,14 +442,14 @@ shift_expression
 	| shift_expression TOK_SHL additive_expression {
 		SYNTRACE("shift_expression",
 		         "shift_expression SHL additive_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_SHL, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_SHL, $1, $3);
 	}
 	| shift_expression TOK_SHR additive_expression {
 		SYNTRACE("shift_expression",
 		         "shift_expression SHR additive_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_SHR, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_SHR, $1, $3);
 	}
 	;
 
@@ -459,26 +461,26 @@ relational_expression
 	| relational_expression '<' shift_expression {
 		SYNTRACE("relational_expression",
 		         "relational_expression '<' shift_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_LT, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_LT, $1, $3);
 	}
 	| relational_expression '>' shift_expression {
 		SYNTRACE("relational_expression",
 		         "relational_expression '>' shift_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_GT, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_GT, $1, $3);
 	}
 	| relational_expression TOK_LE shift_expression {
 		SYNTRACE("relational_expression",
 		         "relational_expression LE shift_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_LE, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_LE, $1, $3);
 	}
 	| relational_expression TOK_GE shift_expression {
 		SYNTRACE("relational_expression",
 		         "relational_expression GE shift_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_GE, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_GE, $1, $3);
 	}
 	;
 
@@ -491,15 +493,15 @@ equality_expression
 	{
 		SYNTRACE("equality_expression",
 		         "equality_expression EQ relational_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_EQ, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_EQ, $1, $3);
 	}
 	| equality_expression TOK_NE relational_expression
 	{
 		SYNTRACE("equality_expression",
 		         "equality_expression NE relational_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_NEQ, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_NEQ, $1, $3);
 	}
 	;
 
@@ -511,8 +513,8 @@ and_expression
 	| and_expression '&' equality_expression {
 		SYNTRACE("and_expression",
 		         "and_expression '&' equality_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_AND, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_AND, $1, $3);
 	}
 	;
 
@@ -524,8 +526,8 @@ xor_expression
 	| xor_expression '^' and_expression {
 		SYNTRACE("xor_expression",
 		         "xor_expression '^' and_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_XOR, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_XOR, $1, $3);
 	}
 	;
 
@@ -536,8 +538,8 @@ or_expression
 	}
 	| or_expression '|' xor_expression {
 		SYNTRACE("or_expression", "or_expression '|' xor_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_OR, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_OR, $1, $3);
 	}
 	;
 
@@ -550,11 +552,11 @@ and_and_expression
 		SYNTRACE("and_and_expression",
 		         "and_and_expression AND_AND or_expression");
 		// (A && B)  =>  (A == true) ? B : false
-		Expression *cond = new BinaryExpression(curpos(),
+		Expression *cond = new (arena()) BinaryExpression(curpos(),
 		    BinaryExpression::OP_EQ, $1,
-		    new BoolLiteralExpression(curpos(), true));
-		$$ = new ConditionalExpression(curpos(), cond, $3,
-		    new BoolLiteralExpression(curpos(), false));
+		    new (arena()) BoolLiteralExpression(curpos(), true));
+		$$ = new (arena()) ConditionalExpression(curpos(), cond, $3,
+		    new (arena()) BoolLiteralExpression(curpos(), false));
 	}
 	;
 
@@ -567,11 +569,11 @@ or_or_expression
 		SYNTRACE("or_or_expression",
 		         "or_or_expression OR_OR and_and_expression");
 		// (A || B)  =>  (A == true) ? true : B
-		Expression *cond = new BinaryExpression(curpos(),
+		Expression *cond = new (arena()) BinaryExpression(curpos(),
 		    BinaryExpression::OP_EQ, $1,
-		    new BoolLiteralExpression(curpos(), true));
-		$$ = new ConditionalExpression(curpos(), cond,
-		    new BoolLiteralExpression(curpos(), true), $3);
+		    new (arena()) BoolLiteralExpression(curpos(), true));
+		$$ = new (arena()) ConditionalExpression(curpos(), cond,
+		    new (arena()) BoolLiteralExpression(curpos(), true), $3);
 	}
 	;
 
@@ -585,7 +587,7 @@ conditional_expression
 		SYNTRACE("conditional_expression",
 		         "or_or_expression '?' expression"
 		         " ':' conditional_expression");
-		$$ = new ConditionalExpression(curpos(), $1, $3, $5);
+		$$ = new (arena()) ConditionalExpression(curpos(), $1, $3, $5);
 	}
 	;
 
@@ -597,7 +599,7 @@ assignment_expression
 	| unary_expression assignment_operator assignment_expression {
 		SYNTRACE("assignment_expression",
 		"unary_expression assignment_operator assignment_expression");
-		$$ = new BinaryExpression(curpos(), $2, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(), $2, $1, $3);
 	}
 	;
 
@@ -655,8 +657,8 @@ expression
 	}
 	| expression ',' assignment_expression {
 		SYNTRACE("expression", "expression ',' assignment_expression");
-		$$ = new BinaryExpression(curpos(),
-		                          BinaryExpression::OP_COMMA, $1, $3);
+		$$ = new (arena()) BinaryExpression(curpos(),
+		                                    BinaryExpression::OP_COMMA, $1, $3);
 	}
 	;
 
@@ -799,11 +801,11 @@ labeled_statement
 	| TOK_CASE constant_expression ':' statement {
 		SYNTRACE("labeled_statement",
 		         "CASE constant_expression ':' statement");
-		$$ = new CaseStatement(curpos(), $2, $4);
+		$$ = new (arena()) CaseStatement(curpos(), $2, $4);
 	}
 	| TOK_DEFAULT ':' statement {
 		SYNTRACE("labeled_statement", "DEFAULT ':' statement");
-		$3->add_label(new Identifier(curpos(), "@switch_default"));
+		$3->add_label(new (arena()) Identifier(curpos(), "@switch_default"));
 		$$ = $3;
 	}
 	;
@@ -811,18 +813,18 @@ labeled_statement
 empty_statement
 	: ';' {
 		SYNTRACE("empty_statement", "';'");
-		$$ = new EmptyStatement(curpos());
+		$$ = new (arena()) EmptyStatement(curpos());
 	}
 	;
 
 compound_statement
 	: '{' '}' {
 		SYNTRACE("compound_statement", "'{' '}'");
-		$$ = new CompoundStatement(curpos(), new StatementList());
+		$$ = new (arena()) CompoundStatement(curpos(), new StatementList());
 	}
 	| '{' statement_list '}' {
 		SYNTRACE("compound_statement", "'{' statement_list '}'");
-		$$ = new CompoundStatement(curpos(), $2);
+		$$ = new (arena()) CompoundStatement(curpos(), $2);
 	}
 	;
 
@@ -842,7 +844,7 @@ statement_list
 expression_statement
 	: expression ';' {
 		SYNTRACE("expression_statement", "expression ';'");
-		$$ = new ExpressionStatement(curpos(), $1);
+		$$ = new (arena()) ExpressionStatement(curpos(), $1);
 	}
 	;
 
@@ -850,26 +852,26 @@ branch_statement
 	: TOK_IF '(' expression ')' compound_statement {
 		SYNTRACE("branch_statement",
 		         "IF '(' expression ')' compound_statement");
-		$$ = new ConditionalStatement(curpos(), $3, $5);
+		$$ = new (arena()) ConditionalStatement(curpos(), $3, $5);
 	}
 	| TOK_IF '(' expression ')' compound_statement
 	  TOK_ELSE compound_statement {
 		SYNTRACE("branch_statement",
 		         "IF '(' expression ')' compound_statement"
 		         " ELSE compound_statement");
-		$$ = new ConditionalStatement(curpos(), $3, $5, $7);
+		$$ = new (arena()) ConditionalStatement(curpos(), $3, $5, $7);
 	}
 	| TOK_IF '(' expression ')' compound_statement
 	  TOK_ELSE branch_statement {
 		SYNTRACE("branch_statement",
 		         "IF '(' expression ')' compound_statement"
 		         " ELSE branch_statement");
-		$$ = new ConditionalStatement(curpos(), $3, $5, $7);
+		$$ = new (arena()) ConditionalStatement(curpos(), $3, $5, $7);
 	}
 	| TOK_SWITCH '(' expression ')' compound_statement {
 		SYNTRACE("branch_statement",
 		         "SWITCH '(' expression ')' compound_statement");
-		$$ = new SwitchStatement(curpos(), $3, $5);
+		$$ = new (arena()) SwitchStatement(curpos(), $3, $5);
 	}
 	;
 
@@ -878,7 +880,7 @@ expression_or_nothing
 		$$ = $1;
 	}
 	| {
-		$$ = new BoolLiteralExpression(curpos(), true);
+		$$ = new (arena()) BoolLiteralExpression(curpos(), true);
 	}
 	;
 
@@ -892,13 +894,13 @@ loop_statement
 		//    becomes
 		// { @loop_continue: while(A) {B;} @loop_break: <nop> }
 		StatementList *stmts = new StatementList();
-		Statement *loop = new WhileLoopStatement(curpos(), $3, $5);
-		loop->add_label(new Identifier(curpos(), "@loop_continue"));
+		Statement *loop = new (arena()) WhileLoopStatement(curpos(), $3, $5);
+		loop->add_label(new (arena()) Identifier(curpos(), "@loop_continue"));
 		stmts->push_back(loop);
-		Statement *nop = new EmptyStatement(curpos());
-		nop->add_label(new Identifier(curpos(), "@loop_break"));
+		Statement *nop = new (arena()) EmptyStatement(curpos());
+		nop->add_label(new (arena()) Identifier(curpos(), "@loop_break"));
 		stmts->push_back(nop);
-		$$ = new CompoundStatement(curpos(), stmts);
+		$$ = new (arena()) CompoundStatement(curpos(), stmts);
 	}
 	| TOK_DO compound_statement TOK_WHILE '(' expression ')' ';' {
 		SYNTRACE("loop_statement",
@@ -913,16 +915,17 @@ loop_statement
 		//   @loop_break: <nop>
 		// }
 		StatementList *stmts = new StatementList();
-		Statement *goto_inner = new GotoStatement(curpos(),
-		    new Identifier(curpos(), "@do_while_inner"));
+		Statement *goto_inner = new (arena()) GotoStatement(curpos(),
+		    new (arena()) Identifier(curpos(), "@do_while_inner"));
 		stmts->push_back(goto_inner);
-		Statement *loop = new WhileLoopStatement(curpos(), $5, $2);
-		loop->add_label(new Identifier(curpos(), "@loop_continue"));
+		$2->add_label(new (arena()) Identifier(curpos(), "@do_while_inner"));
+		Statement *loop = new (arena()) WhileLoopStatement(curpos(), $5, $2);
+		loop->add_label(new (arena()) Identifier(curpos(), "@loop_continue"));
 		stmts->push_back(loop);
-		Statement *nop = new EmptyStatement(curpos());
-		nop->add_label(new Identifier(curpos(), "@loop_break"));
+		Statement *nop = new (arena()) EmptyStatement(curpos());
+		nop->add_label(new (arena()) Identifier(curpos(), "@loop_break"));
 		stmts->push_back(nop);
-		$$ = new CompoundStatement(curpos(), stmts);
+		$$ = new (arena()) CompoundStatement(curpos(), stmts);
 	}
 	| TOK_FOR '(' expression_or_nothing ';'
 	              expression_or_nothing ';'
@@ -942,18 +945,19 @@ loop_statement
 		//   @loop_break: <nop>
 		// }
 		StatementList *stmts = new StatementList();
-		stmts->push_back(new ExpressionStatement(curpos(), $3));
+		stmts->push_back(new (arena()) ExpressionStatement(curpos(), $3));
 		StatementList *body_stmts = new StatementList();
 		body_stmts->push_back($9);
-		body_stmts->push_back(new ExpressionStatement(curpos(), $7));
-		CompoundStatement *body = new CompoundStatement(curpos(), body_stmts);
-		Statement *loop = new WhileLoopStatement(curpos(), $5, body);
-		loop->add_label(new Identifier(curpos(), "@loop_continue"));
+		body_stmts->push_back(new (arena()) ExpressionStatement(curpos(), $7));
+		CompoundStatement *body
+		    = new (arena()) CompoundStatement(curpos(), body_stmts);
+		Statement *loop = new (arena()) WhileLoopStatement(curpos(), $5, body);
+		loop->add_label(new (arena()) Identifier(curpos(), "@loop_continue"));
 		stmts->push_back(loop);
-		Statement *nop = new EmptyStatement(curpos());
-		nop->add_label(new Identifier(curpos(), "@loop_break"));
+		Statement *nop = new (arena()) EmptyStatement(curpos());
+		nop->add_label(new (arena()) Identifier(curpos(), "@loop_break"));
 		stmts->push_back(nop);
-		$$ = new CompoundStatement(curpos(), stmts);
+		$$ = new (arena()) CompoundStatement(curpos(), stmts);
 	}
 	| TOK_FOR '(' variable_definition_statement
 	              expression_or_nothing ';'
@@ -976,40 +980,41 @@ loop_statement
 		stmts->push_back($3);
 		StatementList *body_stmts = new StatementList();
 		body_stmts->push_back($8);
-		body_stmts->push_back(new ExpressionStatement(curpos(), $6));
-		CompoundStatement *body = new CompoundStatement(curpos(), body_stmts);
-		Statement *loop = new WhileLoopStatement(curpos(), $4, body);
-		loop->add_label(new Identifier(curpos(), "@loop_continue"));
+		body_stmts->push_back(new (arena()) ExpressionStatement(curpos(), $6));
+		CompoundStatement *body
+		    = new (arena()) CompoundStatement(curpos(), body_stmts);
+		Statement *loop = new (arena()) WhileLoopStatement(curpos(), $4, body);
+		loop->add_label(new (arena()) Identifier(curpos(), "@loop_continue"));
 		stmts->push_back(loop);
-		Statement *nop = new EmptyStatement(curpos());
-		nop->add_label(new Identifier(curpos(), "@loop_break"));
+		Statement *nop = new (arena()) EmptyStatement(curpos());
+		nop->add_label(new (arena()) Identifier(curpos(), "@loop_break"));
 		stmts->push_back(nop);
-		$$ = new CompoundStatement(curpos(), stmts);
+		$$ = new (arena()) CompoundStatement(curpos(), stmts);
 	}
 	;
 
 jump_statement
 	: TOK_BREAK ';' {
 		SYNTRACE("jump_statement", "BREAK ';'");
-		$$ = new GotoStatement(curpos(),
-		    new Identifier(curpos(), "@loop_break"));
+		$$ = new (arena()) GotoStatement(curpos(),
+		    new (arena()) Identifier(curpos(), "@loop_break"));
 	}
 	| TOK_CONTINUE ';' {
 		SYNTRACE("jump_statement", "CONTINUE ';'");
-		$$ = new GotoStatement(curpos(),
-		    new Identifier(curpos(), "@loop_continue"));
+		$$ = new (arena()) GotoStatement(curpos(),
+		    new (arena()) Identifier(curpos(), "@loop_continue"));
 	}
 	| TOK_GOTO simple_identifier ';' {
 		SYNTRACE("jump_statement", "GOTO simple_identifier ';'");
-		$$ = new GotoStatement(curpos(), $2);
+		$$ = new (arena()) GotoStatement(curpos(), $2);
 	}
 	| TOK_RETURN ';' {
 		SYNTRACE("jump_statement", "RETURN ';'");
-		$$ = new ReturnStatement(curpos());
+		$$ = new (arena()) ReturnStatement(curpos());
 	}
 	| TOK_RETURN expression ';' {
 		SYNTRACE("jump_statement", "RETURN expression ';'");
-		$$ = new ReturnStatement(curpos(), $2);
+		$$ = new (arena()) ReturnStatement(curpos(), $2);
 	}
 	;
 
@@ -1089,7 +1094,7 @@ variable_definition_statement
 		SYNTRACE("variable_definition_statement",
 		         "qualified_type_specifier"
 		         " initialized_identifier_list");
-		$$ = new DefinitionStatement(curpos(), $1, $2);
+		$$ = new (arena()) DefinitionStatement(curpos(), $1, $2);
 	}
 	;
 
@@ -1112,13 +1117,13 @@ initialized_identifier_list
 initialized_identifier
 	: simple_identifier {
 		SYNTRACE("initialized_identifier", "simple_identifier");
-		$$ = new InitializedIdentifier(curpos(), $1);
+		$$ = new (arena()) InitializedIdentifier(curpos(), $1);
 	}
 	| simple_identifier '=' constant_expression {
 		//TODO: this allows function calls, which is bad at file-scope
 		SYNTRACE("initialized_identifier",
 		         "simple_identifier '=' constant_expression");
-		$$ = new InitializedIdentifier(curpos(), $1, $3);
+		$$ = new (arena()) InitializedIdentifier(curpos(), $1, $3);
 	}
 	;
 
@@ -1128,14 +1133,13 @@ function_definition_statement
 		         "simple_identifier '(' ')' compound_statement");
 		// A(){B}  =>  func A = ${B}
 		InitializedIdentifierList *var_list = new InitializedIdentifierList();
-		Expression *body
-		    = new FunctionLiteralExpression(curpos(),
-			                                new ParameterDeclarationList(), $4);
+		Expression *body = new (arena()) FunctionLiteralExpression(curpos(),
+		    new ParameterDeclarationList(), $4);
 		InitializedIdentifier *init_ident
-		    = new InitializedIdentifier(curpos(), $1, body);
+		    = new (arena()) InitializedIdentifier(curpos(), $1, body);
 		var_list->push_back(init_ident);
-		$$ = new DefinitionStatement(curpos(),
-		                             new Type(Type::FUNC), var_list);
+		$$ = new (arena()) DefinitionStatement(curpos(),
+		                                       new Type(Type::FUNC), var_list);
 	}
 	| simple_identifier '(' parameter_declaration_list ')'
 	  compound_statement {
@@ -1144,12 +1148,13 @@ function_definition_statement
 		         " compound_statement");
 		// Similar to above, but with named parameters.
 		InitializedIdentifierList *var_list = new InitializedIdentifierList();
-		Expression *body = new FunctionLiteralExpression(curpos(), $3, $5);
+		Expression *body
+		    = new (arena()) FunctionLiteralExpression(curpos(), $3, $5);
 		InitializedIdentifier *init_ident
-		    = new InitializedIdentifier(curpos(), $1, body);
+		    = new (arena()) InitializedIdentifier(curpos(), $1, body);
 		var_list->push_back(init_ident);
-		$$ = new DefinitionStatement(curpos(),
-		                             new Type(Type::FUNC), var_list);
+		$$ = new (arena()) DefinitionStatement(curpos(),
+		                                       new Type(Type::FUNC), var_list);
 	}
 	;
 
@@ -1172,14 +1177,14 @@ parameter_declaration
 	: qualified_type_specifier simple_identifier {
 		SYNTRACE("parameter_declaration",
 		         "qualified_type_specifier simple_identifier");
-		$$ = new ParameterDeclaration(curpos(), $1, $2);
+		$$ = new (arena()) ParameterDeclaration(curpos(), $1, $2);
 	}
 	;
 
 import_statement
 	: TOK_IMPORT simple_identifier ';' {
 		SYNTRACE("import_statement", "IMPORT simple_identifier");
-		$$ = new ImportStatement(curpos(), $2->symbol());
+		$$ = new (arena()) ImportStatement(curpos(), $2->symbol());
 		delete $2;
 	}
 	;
@@ -1188,7 +1193,7 @@ module_statement
 	: TOK_MODULE simple_identifier ';' {
 		SYNTRACE("module_statement", "MODULE simple_identifier");
 		out_parsed_file->set_module($2->symbol());
-		$$ = new ModuleStatement(curpos(), $2->symbol());
+		$$ = new (arena()) ModuleStatement(curpos(), $2->symbol());
 		delete $2;
 	}
 	;
@@ -1197,7 +1202,7 @@ discover_statement
 	: TOK_DISCOVER '(' argument_list ')' ';' {
 		SYNTRACE("discover_statement",
 		         "DISCOVER '(' argument_list ')' ';'");
-		$$ = new DiscoverStatement(curpos(), $3);
+		$$ = new (arena()) DiscoverStatement(curpos(), $3);
 	}
 	;
 
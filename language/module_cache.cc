@@ -0,0 +1,935 @@
+#include "language/module_cache.h"
+
+#include "hwpp.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "language/parsed_file.h"
+#include "language/syntax_tree.h"
+#include "language/type.h"
+#include "language/variable.h"
+#include "util/filesystem.h"
+
+namespace hwpp {
+namespace language {
+
+using namespace syntax;
+
+const uint32_t ModuleCache::VERSION;
+
+static const char CACHE_MAGIC[8] = { 'H','W','P','P','M','O','D','C' };
+
+// Entries built by a different compiler are not trusted, even if the format
+// version matches.
+#ifdef __VERSION__
+static const char CACHE_COMPILER[] = __VERSION__;
+#else
+static const char CACHE_COMPILER[] = "unknown";
+#endif
+
+// Every node in an entry starts with one of these.
+enum NodeTag {
+	TAG_NULL,
+	TAG_EMPTY_STATEMENT,
+	TAG_COMPOUND_STATEMENT,
+	TAG_EXPRESSION_STATEMENT,
+	TAG_CONDITIONAL_STATEMENT,
+	TAG_SWITCH_STATEMENT,
+	TAG_WHILE_STATEMENT,
+	TAG_DO_WHILE_STATEMENT,
+	TAG_GOTO_STATEMENT,
+	TAG_CASE_STATEMENT,
+	TAG_RETURN_STATEMENT,
+	TAG_DEFINITION_STATEMENT,
+	TAG_IMPORT_STATEMENT,
+	TAG_MODULE_STATEMENT,
+	TAG_DISCOVER_STATEMENT,
+	TAG_IDENTIFIER_EXPRESSION,
+	TAG_SUBSCRIPT_EXPRESSION,
+	TAG_CALL_EXPRESSION,
+	TAG_UNARY_EXPRESSION,
+	TAG_BINARY_EXPRESSION,
+	TAG_CONDITIONAL_EXPRESSION,
+	TAG_BOOL_LITERAL,
+	TAG_INT_LITERAL,
+	TAG_STRING_LITERAL,
+	TAG_FUNCTION_LITERAL,
+	TAG_TUPLE_LITERAL,
+};
+
+// How a top-level statement was declared.
+enum SymbolScope {
+	SCOPE_NONE,
+	SCOPE_PRIVATE,
+	SCOPE_PUBLIC,
+};
+
+// 64-bit FNV-1a.
+static uint64_t
+fnv_hash(const string &data, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+	for (size_t i = 0; i < data.size(); i++) {
+		hash ^= uint8_t(data[i]);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+// A second 64-bit hash, unrelated to FNV-1a, which is stored in each
+// entry.  The entry's name is only an FNV-1a hash, so a collision there
+// must not be enough to load the wrong file.  This runs each 8 bytes
+// through the splitmix64 finalizer.
+static uint64_t
+check_hash(const string &data)
+{
+	uint64_t hash = data.size();
+	for (size_t i = 0; i < data.size(); i += 8) {
+		uint64_t word = 0;
+		for (size_t j = 0; j < 8 && i + j < data.size(); j++) {
+			word |= uint64_t(uint8_t(data[i + j])) << (j * 8);
+		}
+		hash = (hash ^ word) + 0x9e3779b97f4a7c15ULL;
+		hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+		hash ^= hash >> 31;
+	}
+	return hash;
+}
+
+//
+// The writer side.
+//
+
+// This appends an encoded syntax tree to a string.  All integers are
+// little-endian, and strings are a length followed by the bytes.
+class CacheWriter {
+ public:
+	explicit
+	CacheWriter(string *out)
+	    : m_out(out)
+	{
+	}
+
+	void
+	put_u8(uint8_t value)
+	{
+		m_out->push_back(char(value));
+	}
+
+	void
+	put_u32(uint32_t value)
+	{
+		for (int i = 0; i < 4; i++) {
+			put_u8(value >> (i * 8));
+		}
+	}
+
+	void
+	put_u64(uint64_t value)
+	{
+		for (int i = 0; i < 8; i++) {
+			put_u8(value >> (i * 8));
+		}
+	}
+
+	void
+	put_string(const string &value)
+	{
+		put_u32(value.size());
+		m_out->append(value);
+	}
+
+	void
+	put_type(const Type &type)
+	{
+		put_u8(type.primitive());
+		put_u8(type.is_literal() ? Type::LITERAL
+		       : type.is_const() ? Type::CONST : 0);
+		put_u32(type.n_arguments());
+		for (size_t i = 0; i < type.n_arguments(); i++) {
+			put_type(type.argument(i));
+		}
+	}
+
+	void
+	put_node(NodeTag tag, const SyntaxNode *node)
+	{
+		put_u8(tag);
+		put_u32(node->parse_position().line);
+	}
+
+	void
+	put_identifier(const Identifier *ident)
+	{
+		if (ident == NULL) {
+			put_u8(TAG_NULL);
+			return;
+		}
+		put_u8(1);
+		put_u32(ident->parse_position().line);
+		put_string(ident->module());
+		put_string(ident->symbol());
+	}
+
+	void
+	put_init_ident(const InitializedIdentifier *init_ident)
+	{
+		put_u32(init_ident->parse_position().line);
+		put_identifier(init_ident->identifier());
+		put_expression(init_ident->initializer());
+	}
+
+	void
+	put_arguments(const ArgumentList *args)
+	{
+		if (args == NULL) {
+			put_u8(TAG_NULL);
+			return;
+		}
+		put_u8(1);
+		put_u32(args->size());
+		for (size_t i = 0; i < args->size(); i++) {
+			const Argument *arg = args->at(i);
+			put_u32(arg->parse_position().line);
+			put_identifier(arg->name());
+			put_expression(arg->expression());
+		}
+	}
+
+	void
+	put_statement(Statement *stmt);
+
+	void
+	put_expression(Expression *expr);
+
+ private:
+	string *m_out;
+};
+
+void
+CacheWriter::put_statement(Statement *stmt)
+{
+	if (stmt == NULL) {
+		put_u8(TAG_NULL);
+		return;
+	}
+
+	if (dynamic_cast<EmptyStatement*>(stmt)) {
+		put_node(TAG_EMPTY_STATEMENT, stmt);
+	} else if (CompoundStatement *s = dynamic_cast<CompoundStatement*>(stmt)) {
+		put_node(TAG_COMPOUND_STATEMENT, s);
+		put_u32(s->body()->size());
+		for (size_t i = 0; i < s->body()->size(); i++) {
+			put_statement(s->body()->at(i));
+		}
+	} else if (ExpressionStatement *s =
+	           dynamic_cast<ExpressionStatement*>(stmt)) {
+		put_node(TAG_EXPRESSION_STATEMENT, s);
+		put_expression(s->expression());
+	} else if (ConditionalStatement *s =
+	           dynamic_cast<ConditionalStatement*>(stmt)) {
+		put_node(TAG_CONDITIONAL_STATEMENT, s);
+		put_expression(s->condition());
+		put_statement(s->true_case());
+		put_statement(s->false_case());
+	} else if (SwitchStatement *s = dynamic_cast<SwitchStatement*>(stmt)) {
+		put_node(TAG_SWITCH_STATEMENT, s);
+		put_expression(s->condition());
+		put_statement(s->body());
+	} else if (LoopStatement *s = dynamic_cast<LoopStatement*>(stmt)) {
+		put_node(s->loop_type() == LoopStatement::LOOP_WHILE
+		         ? TAG_WHILE_STATEMENT : TAG_DO_WHILE_STATEMENT, s);
+		put_expression(s->expression());
+		put_statement(s->body());
+	} else if (GotoStatement *s = dynamic_cast<GotoStatement*>(stmt)) {
+		put_node(TAG_GOTO_STATEMENT, s);
+		put_identifier(s->target());
+	} else if (CaseStatement *s = dynamic_cast<CaseStatement*>(stmt)) {
+		put_node(TAG_CASE_STATEMENT, s);
+		put_expression(s->expression());
+		put_statement(s->statement());
+	} else if (ReturnStatement *s = dynamic_cast<ReturnStatement*>(stmt)) {
+		put_node(TAG_RETURN_STATEMENT, s);
+		put_expression(s->expression());
+	} else if (DefinitionStatement *s =
+	           dynamic_cast<DefinitionStatement*>(stmt)) {
+		// All of the definitions in one statement share a type, so
+		// this stores it once, as the parser saw it.
+		const DefinitionList &vars = s->vars();
+		put_node(TAG_DEFINITION_STATEMENT, s);
+		put_type(vars.size() ? vars[0]->type() : Type(Type::VAR));
+		put_u32(vars.size());
+		for (size_t i = 0; i < vars.size(); i++) {
+			put_init_ident(vars[i]->init_ident());
+		}
+	} else if (ImportStatement *s = dynamic_cast<ImportStatement*>(stmt)) {
+		put_node(TAG_IMPORT_STATEMENT, s);
+		put_string(s->argument());
+	} else if (ModuleStatement *s = dynamic_cast<ModuleStatement*>(stmt)) {
+		put_node(TAG_MODULE_STATEMENT, s);
+		put_string(s->name());
+	} else if (DiscoverStatement *s =
+	           dynamic_cast<DiscoverStatement*>(stmt)) {
+		put_node(TAG_DISCOVER_STATEMENT, s);
+		put_arguments(s->args());
+	} else {
+		throw ModuleCache::FormatError(
+		    "can't cache statement: " + stmt->to_string());
+	}
+
+	const std::vector<Identifier*> &labels = stmt->labels();
+	put_u32(labels.size());
+	for (size_t i = 0; i < labels.size(); i++) {
+		put_identifier(labels[i]);
+	}
+}
+
+void
+CacheWriter::put_expression(Expression *expr)
+{
+	if (expr == NULL) {
+		put_u8(TAG_NULL);
+		return;
+	}
+
+	if (IdentifierExpression *e = dynamic_cast<IdentifierExpression*>(expr)) {
+		put_node(TAG_IDENTIFIER_EXPRESSION, e);
+		put_identifier(e->identifier());
+	} else if (SubscriptExpression *e =
+	           dynamic_cast<SubscriptExpression*>(expr)) {
+		put_node(TAG_SUBSCRIPT_EXPRESSION, e);
+		put_expression(e->expression());
+		put_expression(e->index());
+	} else if (FunctionCallExpression *e =
+	           dynamic_cast<FunctionCallExpression*>(expr)) {
+		put_node(TAG_CALL_EXPRESSION, e);
+		put_expression(e->callee());
+		put_arguments(e->args());
+	} else if (UnaryExpression *e = dynamic_cast<UnaryExpression*>(expr)) {
+		put_node(TAG_UNARY_EXPRESSION, e);
+		put_u8(e->op());
+		put_expression(e->expression());
+	} else if (BinaryExpression *e = dynamic_cast<BinaryExpression*>(expr)) {
+		put_node(TAG_BINARY_EXPRESSION, e);
+		put_u8(e->op());
+		put_expression(e->lhs());
+		put_expression(e->rhs());
+	} else if (ConditionalExpression *e =
+	           dynamic_cast<ConditionalExpression*>(expr)) {
+		put_node(TAG_CONDITIONAL_EXPRESSION, e);
+		put_expression(e->condition());
+		put_expression(e->true_case());
+		put_expression(e->false_case());
+	} else if (ValueExpression *e = dynamic_cast<ValueExpression*>(expr)) {
+		const Variable::Datum *value = e->value();
+		switch (value->type().primitive()) {
+		 case Type::BOOL:
+			put_node(TAG_BOOL_LITERAL, e);
+			put_u8(value->bool_value());
+			break;
+		 case Type::INT:
+			put_node(TAG_INT_LITERAL, e);
+			put_string(value->int_value().get_str(16));
+			break;
+		 case Type::STRING:
+			put_node(TAG_STRING_LITERAL, e);
+			put_string(value->string_value());
+			break;
+		 default:
+			throw ModuleCache::FormatError(
+			    "can't cache literal: " + expr->to_string());
+		}
+	} else if (FunctionLiteralExpression *e =
+	           dynamic_cast<FunctionLiteralExpression*>(expr)) {
+		const ParameterDeclarationList *params = e->params();
+		put_node(TAG_FUNCTION_LITERAL, e);
+		put_u32(params->size());
+		for (size_t i = 0; i < params->size(); i++) {
+			put_u32(params->at(i)->parse_position().line);
+			put_type(params->at(i)->type());
+			put_identifier(params->at(i)->identifier());
+		}
+		put_statement(e->body());
+	} else if (TupleLiteralExpression *e =
+	           dynamic_cast<TupleLiteralExpression*>(expr)) {
+		put_node(TAG_TUPLE_LITERAL, e);
+		put_arguments(e->contents());
+	} else {
+		throw ModuleCache::FormatError(
+		    "can't cache expression: " + expr->to_string());
+	}
+}
+
+//
+// The reader side.
+//
+
+// This owns the pointers in a list until they are handed off, so that a
+// bad entry does not leak a partial tree.
+template<typename Tlist>
+class ListGuard {
+ public:
+	ListGuard()
+	    : m_list(new Tlist())
+	{
+	}
+	~ListGuard()
+	{
+		if (m_list) {
+			for (size_t i = 0; i < m_list->size(); i++) {
+				delete m_list->at(i);
+			}
+			delete m_list;
+		}
+	}
+
+	Tlist *
+	get() const
+	{
+		return m_list;
+	}
+
+	Tlist *
+	release()
+	{
+		Tlist *list = m_list;
+		m_list = NULL;
+		return list;
+	}
+
+ private:
+	Tlist *m_list;
+};
+
+// This decodes what CacheWriter wrote.  Every read is bounds-checked, and
+// any problem throws ModuleCache::FormatError.
+class CacheReader {
+ public:
+	// Nodes are allocated from 'arena'.
+	CacheReader(const string &name, const uint8_t *data, size_t size,
+	            util::Arena *arena)
+	    : m_name(name), m_data(data), m_size(size), m_offset(0),
+	      m_arena(arena)
+	{
+	}
+
+	bool
+	at_end() const
+	{
+		return m_offset == m_size;
+	}
+
+	void
+	need(size_t n)
+	{
+		if (n > m_size - m_offset) {
+			throw ModuleCache::FormatError("entry is truncated");
+		}
+	}
+
+	uint8_t
+	get_u8()
+	{
+		need(1);
+		return m_data[m_offset++];
+	}
+
+	uint32_t
+	get_u32()
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++) {
+			value |= uint32_t(get_u8()) << (i * 8);
+		}
+		return value;
+	}
+
+	uint64_t
+	get_u64()
+	{
+		uint64_t value = 0;
+		for (int i = 0; i < 8; i++) {
+			value |= uint64_t(get_u8()) << (i * 8);
+		}
+		return value;
+	}
+
+	string
+	get_string()
+	{
+		uint32_t len = get_u32();
+		need(len);
+		string value(reinterpret_cast<const char *>(m_data + m_offset), len);
+		m_offset += len;
+		return value;
+	}
+
+	// Get a count of things, each of which takes at least one byte.
+	size_t
+	get_count()
+	{
+		uint32_t count = get_u32();
+		need(count);
+		return count;
+	}
+
+	Parser::Position
+	get_position()
+	{
+		Parser::Position pos;
+		pos.file = m_name;
+		pos.line = int(get_u32());
+		return pos;
+	}
+
+	Type
+	get_type()
+	{
+		uint8_t prim = get_u8();
+		uint8_t constness = get_u8();
+		if (prim > Type::VAR || constness > Type::LITERAL) {
+			throw ModuleCache::FormatError("bad type");
+		}
+		Type::Primitive primitive = Type::Primitive(prim);
+		Type type = (constness == 0) ? Type(primitive)
+		          : Type(primitive, Type::Constness(constness));
+		size_t n_args = get_count();
+		for (size_t i = 0; i < n_args; i++) {
+			type.add_argument(get_type());
+		}
+		return type;
+	}
+
+	Identifier *
+	get_identifier()
+	{
+		if (get_u8() == TAG_NULL) {
+			return NULL;
+		}
+		Parser::Position pos = get_position();
+		string module = get_string();
+		string symbol = get_string();
+		return new (m_arena) Identifier(pos, module, symbol);
+	}
+
+	Identifier *
+	get_required_identifier()
+	{
+		Identifier *ident = get_identifier();
+		if (ident == NULL) {
+			throw ModuleCache::FormatError("missing identifier");
+		}
+		return ident;
+	}
+
+	InitializedIdentifier *
+	get_init_ident()
+	{
+		Parser::Position pos = get_position();
+		std::auto_ptr<Identifier> ident(get_required_identifier());
+		Expression *init = get_expression();
+		return new (m_arena) InitializedIdentifier(pos, ident.release(), init);
+	}
+
+	ArgumentList *
+	get_arguments()
+	{
+		if (get_u8() == TAG_NULL) {
+			return NULL;
+		}
+		ListGuard<ArgumentList> args;
+		size_t n = get_count();
+		for (size_t i = 0; i < n; i++) {
+			Parser::Position pos = get_position();
+			std::auto_ptr<Identifier> name(get_identifier());
+			std::auto_ptr<Expression> expr(get_required_expression());
+			args.get()->push_back(
+			    new (m_arena) Argument(pos, name.get(), expr.get()));
+			name.release();
+			expr.release();
+		}
+		return args.release();
+	}
+
+	ArgumentList *
+	get_required_arguments()
+	{
+		ArgumentList *args = get_arguments();
+		if (args == NULL) {
+			throw ModuleCache::FormatError("missing arguments");
+		}
+		return args;
+	}
+
+	Statement *
+	get_statement();
+
+	Statement *
+	get_required_statement()
+	{
+		Statement *stmt = get_statement();
+		if (stmt == NULL) {
+			throw ModuleCache::FormatError("missing statement");
+		}
+		return stmt;
+	}
+
+	Expression *
+	get_expression();
+
+	Expression *
+	get_required_expression()
+	{
+		Expression *expr = get_expression();
+		if (expr == NULL) {
+			throw ModuleCache::FormatError("missing expression");
+		}
+		return expr;
+	}
+
+ private:
+	Statement *
+	get_statement_body(NodeTag tag);
+
+	string m_name;
+	const uint8_t *m_data;
+	size_t m_size;
+	size_t m_offset;
+	util::Arena *m_arena;
+};
+
+Statement *
+CacheReader::get_statement()
+{
+	NodeTag tag = NodeTag(get_u8());
+	if (tag == TAG_NULL) {
+		return NULL;
+	}
+	std::auto_ptr<Statement> stmt(get_statement_body(tag));
+
+	size_t n_labels = get_count();
+	for (size_t i = 0; i < n_labels; i++) {
+		stmt->add_label(get_required_identifier());
+	}
+	return stmt.release();
+}
+
+Statement *
+CacheReader::get_statement_body(NodeTag tag)
+{
+	Parser::Position pos = get_position();
+
+	switch (tag) {
+	 case TAG_EMPTY_STATEMENT:
+		return new (m_arena) EmptyStatement(pos);
+	 case TAG_COMPOUND_STATEMENT: {
+		ListGuard<StatementList> body;
+		size_t n = get_count();
+		for (size_t i = 0; i < n; i++) {
+			body.get()->push_back(get_required_statement());
+		}
+		return new (m_arena) CompoundStatement(pos, body.release());
+	 }
+	 case TAG_EXPRESSION_STATEMENT:
+		return new (m_arena) ExpressionStatement(pos,
+		                                         get_required_expression());
+	 case TAG_CONDITIONAL_STATEMENT: {
+		std::auto_ptr<Expression> cond(get_required_expression());
+		std::auto_ptr<Statement> true_case(get_required_statement());
+		std::auto_ptr<Statement> false_case(get_statement());
+		return new (m_arena) ConditionalStatement(pos, cond.release(),
+		    true_case.release(), false_case.release());
+	 }
+	 case TAG_SWITCH_STATEMENT: {
+		std::auto_ptr<Expression> cond(get_required_expression());
+		std::auto_ptr<Statement> body(get_required_statement());
+		return new (m_arena) SwitchStatement(pos, cond.release(),
+		                                     body.release());
+	 }
+	 case TAG_WHILE_STATEMENT:
+	 case TAG_DO_WHILE_STATEMENT: {
+		std::auto_ptr<Expression> expr(get_required_expression());
+		std::auto_ptr<Statement> body(get_required_statement());
+		if (tag == TAG_WHILE_STATEMENT) {
+			return new (m_arena) WhileLoopStatement(pos, expr.release(),
+			                                        body.release());
+		}
+		return new (m_arena) DoWhileLoopStatement(pos, body.release(),
+		                                          expr.release());
+	 }
+	 case TAG_GOTO_STATEMENT:
+		return new (m_arena) GotoStatement(pos, get_required_identifier());
+	 case TAG_CASE_STATEMENT: {
+		std::auto_ptr<Expression> expr(get_required_expression());
+		std::auto_ptr<Statement> stmt(get_required_statement());
+		return new (m_arena) CaseStatement(pos, expr.release(), stmt.release());
+	 }
+	 case TAG_RETURN_STATEMENT: {
+		Expression *expr = get_expression();
+		if (expr == NULL) {
+			return new (m_arena) ReturnStatement(pos);
+		}
+		return new (m_arena) ReturnStatement(pos, expr);
+	 }
+	 case TAG_DEFINITION_STATEMENT: {
+		std::auto_ptr<Type> type(new Type(get_type()));
+		ListGuard<InitializedIdentifierList> vars;
+		size_t n = get_count();
+		for (size_t i = 0; i < n; i++) {
+			vars.get()->push_back(get_init_ident());
+		}
+		// The statement takes ownership of the type and the list.
+		InitializedIdentifierList *list = vars.release();
+		return new (m_arena) DefinitionStatement(pos, type.release(), list);
+	 }
+	 case TAG_IMPORT_STATEMENT:
+		return new (m_arena) ImportStatement(pos, get_string());
+	 case TAG_MODULE_STATEMENT:
+		return new (m_arena) ModuleStatement(pos, get_string());
+	 case TAG_DISCOVER_STATEMENT:
+		return new (m_arena) DiscoverStatement(pos, get_required_arguments());
+	 default:
+		break;
+	}
+	throw ModuleCache::FormatError(sprintfxx("bad statement tag %d", tag));
+}
+
+Expression *
+CacheReader::get_expression()
+{
+	NodeTag tag = NodeTag(get_u8());
+	if (tag == TAG_NULL) {
+		return NULL;
+	}
+	Parser::Position pos = get_position();
+
+	switch (tag) {
+	 case TAG_IDENTIFIER_EXPRESSION:
+		return new (m_arena) IdentifierExpression(pos,
+		                                          get_required_identifier());
+	 case TAG_SUBSCRIPT_EXPRESSION: {
+		std::auto_ptr<Expression> expr(get_required_expression());
+		std::auto_ptr<Expression> index(get_required_expression());
+		return new (m_arena) SubscriptExpression(pos, expr.release(),
+		                                         index.release());
+	 }
+	 case TAG_CALL_EXPRESSION: {
+		std::auto_ptr<Expression> callee(get_required_expression());
+		ArgumentList *args = get_arguments();
+		if (args == NULL) {
+			return new (m_arena) FunctionCallExpression(pos, callee.release());
+		}
+		return new (m_arena) FunctionCallExpression(pos, callee.release(),
+		                                            args);
+	 }
+	 case TAG_UNARY_EXPRESSION: {
+		uint8_t op = get_u8();
+		if (op > UnaryExpression::OP_POSTDEC) {
+			throw ModuleCache::FormatError("bad unary operator");
+		}
+		return new (m_arena) UnaryExpression(pos, UnaryExpression::Operator(op),
+		                                     get_required_expression());
+	 }
+	 case TAG_BINARY_EXPRESSION: {
+		uint8_t op = get_u8();
+		if (op > BinaryExpression::OP_XOR_ASSIGN) {
+			throw ModuleCache::FormatError("bad binary operator");
+		}
+		std::auto_ptr<Expression> lhs(get_required_expression());
+		std::auto_ptr<Expression> rhs(get_required_expression());
+		return new (m_arena) BinaryExpression(pos,
+		                                      BinaryExpression::Operator(op),
+		                                      lhs.release(), rhs.release());
+	 }
+	 case TAG_CONDITIONAL_EXPRESSION: {
+		std::auto_ptr<Expression> cond(get_required_expression());
+		std::auto_ptr<Expression> true_case(get_required_expression());
+		std::auto_ptr<Expression> false_case(get_required_expression());
+		return new (m_arena) ConditionalExpression(pos, cond.release(),
+		    true_case.release(), false_case.release());
+	 }
+	 case TAG_BOOL_LITERAL:
+		return new (m_arena) BoolLiteralExpression(pos, get_u8() != 0);
+	 case TAG_INT_LITERAL:
+		return new (m_arena) IntLiteralExpression(pos, Value(get_string(), 16));
+	 case TAG_STRING_LITERAL:
+		return new (m_arena) StringLiteralExpression(pos, get_string());
+	 case TAG_FUNCTION_LITERAL: {
+		ListGuard<ParameterDeclarationList> params;
+		size_t n = get_count();
+		for (size_t i = 0; i < n; i++) {
+			Parser::Position param_pos = get_position();
+			std::auto_ptr<Type> type(new Type(get_type()));
+			std::auto_ptr<Identifier> ident(get_required_identifier());
+			params.get()->push_back(new (m_arena) ParameterDeclaration(
+			    param_pos, type.get(), ident.get()));
+			type.release();
+			ident.release();
+		}
+		std::auto_ptr<Statement> body(get_required_statement());
+		return new (m_arena) FunctionLiteralExpression(pos, params.release(),
+		                                               body.release());
+	 }
+	 case TAG_TUPLE_LITERAL:
+		return new (m_arena) TupleLiteralExpression(pos,
+		                                            get_required_arguments());
+	 default:
+		break;
+	}
+	throw ModuleCache::FormatError(sprintfxx("bad expression tag %d", tag));
+}
+
+//
+// ModuleCache
+//
+
+string
+ModuleCache::entry_path(const string &name, const string &contents) const
+{
+	// The name is part of the key because it is in every parse position.
+	uint64_t key = fnv_hash(contents, fnv_hash(name + '\0'));
+	return sprintfxx("%s/%016x.ppc", m_directory, key);
+}
+
+bool
+ModuleCache::store(const string &name, const string &contents,
+                   const ParsedFile &file) const
+{
+	// Remember which top-level definitions were public or private, so
+	// that the symbol tables can be rebuilt.
+	std::set<const Definition*> publics;
+	std::set<const Definition*> privates;
+	ParsedFile::SymbolIterator it;
+	for (it = file.public_symbols_begin();
+	     it != file.public_symbols_end(); ++it) {
+		publics.insert(it->second);
+	}
+	for (it = file.private_symbols_begin();
+	     it != file.private_symbols_end(); ++it) {
+		privates.insert(it->second);
+	}
+
+	string image(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	CacheWriter writer(&image);
+	try {
+		writer.put_u32(VERSION);
+		writer.put_string(CACHE_COMPILER);
+		writer.put_string(name);
+		writer.put_u64(contents.size());
+		writer.put_u64(check_hash(contents));
+		writer.put_string(file.module());
+		writer.put_u32(file.n_statements());
+		for (size_t i = 0; i < file.n_statements(); i++) {
+			Statement *stmt = file.statement(i);
+			SymbolScope scope = SCOPE_NONE;
+			DefinitionStatement *defn =
+			    dynamic_cast<DefinitionStatement*>(stmt);
+			if (defn && defn->vars().size()) {
+				if (publics.count(defn->vars()[0])) {
+					scope = SCOPE_PUBLIC;
+				} else if (privates.count(defn->vars()[0])) {
+					scope = SCOPE_PRIVATE;
+				}
+			}
+			writer.put_u8(scope);
+			writer.put_statement(stmt);
+		}
+	} catch (FormatError &e) {
+		// Something the writer does not know about.
+		return false;
+	}
+
+	// Write it to a temp file and move it into place, so that readers
+	// never see a partial entry.
+	string path = entry_path(name, contents);
+	try {
+		mkdir(m_directory.c_str(), 0755);
+		filesystem::FilePtr tmp =
+		    filesystem::File::tempfile(path + ".XXXXXX");
+		size_t done = 0;
+		while (done < image.size()) {
+			done += tmp->write(&image[done], image.size() - done);
+		}
+		tmp->close();
+		if (rename(tmp->path().c_str(), path.c_str()) < 0) {
+			unlink(tmp->path().c_str());
+			return false;
+		}
+	} catch (std::exception &e) {
+		return false;
+	}
+	return true;
+}
+
+ParsedFile *
+ModuleCache::load(const string &name, const string &contents) const
+{
+	try {
+		filesystem::FilePtr file = filesystem::File::open(
+		    entry_path(name, contents), O_RDONLY);
+		size_t size = file->size();
+		if (size < sizeof(CACHE_MAGIC)) {
+			return NULL;
+		}
+		filesystem::FileMappingPtr mapping = file->mmap(0, size);
+		const uint8_t *base =
+		    static_cast<const uint8_t *>(mapping->address());
+		if (memcmp(base, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+			return NULL;
+		}
+
+		std::auto_ptr<ParsedFile> parsed_file(new ParsedFile());
+		CacheReader reader(name, base + sizeof(CACHE_MAGIC),
+		                   size - sizeof(CACHE_MAGIC), parsed_file->arena());
+		if (reader.get_u32() != VERSION
+		 || reader.get_string() != CACHE_COMPILER
+		 || reader.get_string() != name
+		 || reader.get_u64() != contents.size()
+		 || reader.get_u64() != check_hash(contents)) {
+			return NULL;
+		}
+
+		parsed_file->set_module(reader.get_string());
+		size_t n_statements = reader.get_count();
+		for (size_t i = 0; i < n_statements; i++) {
+			uint8_t scope = reader.get_u8();
+			Statement *stmt = reader.get_required_statement();
+			parsed_file->add_statement(stmt);
+
+			DefinitionStatement *defn =
+			    dynamic_cast<DefinitionStatement*>(stmt);
+			if (defn == NULL || scope == SCOPE_NONE) {
+				continue;
+			}
+			const DefinitionList &vars = defn->vars();
+			for (size_t j = 0; j < vars.size(); j++) {
+				const string &symbol = vars[j]->identifier()->symbol();
+				if (scope == SCOPE_PUBLIC) {
+					parsed_file->add_public_symbol(symbol, vars[j]);
+				} else {
+					parsed_file->add_private_symbol(symbol, vars[j]);
+				}
+			}
+		}
+		if (!reader.at_end()) {
+			return NULL;
+		}
+		return parsed_file.release();
+	} catch (std::exception &e) {
+		// A missing or bad entry is just a miss.
+		return NULL;
+	}
+}
+
+}  // namespace language
+}  // namespace hwpp
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
@@ -0,0 +1,86 @@
+// An on-disk cache of parsed files.
+
+#ifndef HWPP_LANGUAGE_MODULE_CACHE_H__
+#define HWPP_LANGUAGE_MODULE_CACHE_H__
+
+#include "hwpp.h"
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include "language/parsed_file.h"
+
+namespace hwpp {
+namespace language {
+
+// This saves parsed files to a directory, so that later runs can load them
+// instead of running the parser again.  Each entry is keyed by a hash of
+// the file name and contents, and records the cache format version, the
+// C++ compiler which built us, the file name, and the length and a second,
+// independent hash of the contents.  Any mismatch is treated as a miss.
+//
+// Only the parse is cached.  Validation resolves symbols across files, so
+// it still runs on every load.
+//
+// Usage:
+//   ModuleCache cache("/var/cache/hwpp");
+//   ParsedFile *file = cache.load(name, contents);
+//   if (file == NULL) {
+//       file = new ParsedFile();
+//       parser.parse_file(name, fp, file);
+//       cache.store(name, contents, *file);
+//   }
+class ModuleCache {
+ public:
+	// Bump this whenever the syntax tree or the file layout changes.
+	static const uint32_t VERSION = 2;
+
+	// Thrown internally when a cache entry can not be decoded.  Callers
+	// never see this, because a bad entry is just a miss.
+	struct FormatError: public std::runtime_error
+	{
+		explicit
+		FormatError(const string &str)
+		    : runtime_error(str)
+		{
+		}
+	};
+
+	explicit
+	ModuleCache(const string &directory)
+	    : m_directory(directory)
+	{
+	}
+
+	const string &
+	directory() const
+	{
+		return m_directory;
+	}
+
+	// Load the cached parse of a file whose name and contents are given.
+	// The caller owns the returned pointer.  Returns NULL if there is no
+	// usable entry.
+	ParsedFile *
+	load(const string &name, const string &contents) const;
+
+	// Save the parse of a file whose name and contents are given.  This
+	// must be called before the file is validated.  Returns false if the
+	// entry could not be written, which is not fatal.
+	bool
+	store(const string &name, const string &contents,
+	      const ParsedFile &file) const;
+
+	// Get the path of the entry for a file.
+	string
+	entry_path(const string &name, const string &contents) const;
+
+ private:
+	string m_directory;
+};
+
+}  // namespace language
+}  // namespace hwpp
+
+#endif  // HWPP_LANGUAGE_MODULE_CACHE_H__
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
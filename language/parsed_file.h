@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include "language/syntax_tree.h"
+#include "util/arena.h"
 #include "util/assert.h"
 
 namespace hwpp {
@@ -46,11 +47,21 @@ class ParsedFile {
 	}
 	~ParsedFile()
 	{
+		// This runs the destructors.  The memory of nodes from the arena
+		// goes when m_arena does.
 		for (size_t i = 0; i < m_statements.size(); i++) {
 			delete m_statements[i];
 		}
 	}
 
+	// Syntax nodes for this file should be allocated from here, and
+	// live as long as this file does.
+	util::Arena *
+	arena()
+	{
+		return &m_arena;
+	}
+
 	const string &
 	module() const
 	{
@@ -153,6 +164,8 @@ class ParsedFile {
 	}
 
  private:
+	// This must be destroyed after everything which lives in it.
+	util::Arena m_arena;
 	string m_module;
 	std::vector<syntax::Statement*> m_statements;
 	SymbolMap m_public_symbols;
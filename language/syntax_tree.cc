@@ -1,16 +1,80 @@
 #include "language/syntax_tree.h"
 
 #include "hwpp.h"
+#include <stdlib.h>
 #include <map>
+#include <new>
 #include <string>
 #include <vector>
+#include "language/bytecode.h"
+#include "language/compiler.h"
 #include "language/type.h"
 #include "language/variable.h"
+#include "language/vm.h"
 
 namespace hwpp {
 namespace language {
 namespace syntax {
 
+// Each node is preceded by a header which records the Arena it came from,
+// or NULL for the heap.
+static const size_t node_header_size = util::Arena::align(sizeof(void *));
+
+static void *
+node_header(void *pointer)
+{
+	return static_cast<char *>(pointer) - node_header_size;
+}
+
+void *
+SyntaxNode::operator new(size_t size)
+{
+	void *p = malloc(node_header_size + size);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	*static_cast<util::Arena **>(p) = NULL;
+	return static_cast<char *>(p) + node_header_size;
+}
+
+void *
+SyntaxNode::operator new(size_t size, util::Arena *arena)
+{
+	void *p = arena->allocate(node_header_size + size);
+	*static_cast<util::Arena **>(p) = arena;
+	return static_cast<char *>(p) + node_header_size;
+}
+
+void
+SyntaxNode::operator delete(void *pointer)
+{
+	if (pointer == NULL) {
+		return;
+	}
+	void *header = node_header(pointer);
+	if (*static_cast<util::Arena **>(header) == NULL) {
+		free(header);
+	}
+	// Arena memory is released with the Arena.
+}
+
+void
+SyntaxNode::operator delete(void *pointer, util::Arena *arena)
+{
+	// This is only called when a constructor throws.
+	(void)pointer;
+	(void)arena;
+}
+
+void
+Expression::evaluate(Variable *out_result)
+{
+	bytecode::ProgramPtr program = Compiler::compile_expression(this);
+	Vm vm(program);
+	bytecode::VarPtr result = vm.run();
+	out_result->assign_from(*result);
+}
+
 string
 Identifier::to_string() const
 {
@@ -27,6 +91,16 @@ InitializedIdentifier::to_string() const
 	return ret;
 }
 
+bool
+Statement::execute()
+{
+	Compiler compiler;
+	compiler.add_statement(this);
+	Vm vm(compiler.finish());
+	vm.run();
+	return true;
+}
+
 string
 Statement::to_string() const
 {
@@ -57,12 +131,6 @@ EmptyStatement::to_string() const
 	return ret + "(undef);";
 }
 
-bool
-EmptyStatement::execute()
-{
-	return true;
-}
-
 string
 CompoundStatement::to_string() const
 {
@@ -75,13 +143,6 @@ CompoundStatement::to_string() const
 	return ret;
 }
 
-bool
-CompoundStatement::execute()
-{
-	//FIXME:
-	return true;
-}
-
 string
 ExpressionStatement::to_string() const
 {
@@ -89,13 +150,6 @@ ExpressionStatement::to_string() const
 	return m_expr->to_string();
 }
 
-bool
-ExpressionStatement::execute()
-{
-	//FIXME:
-	return true;
-}
-
 string
 ConditionalStatement::to_string() const
 {
@@ -110,13 +164,6 @@ ConditionalStatement::to_string() const
 	return ret;
 }
 
-bool
-ConditionalStatement::execute()
-{
-	//FIXME:
-	return false;
-}
-
 string
 SwitchStatement::to_string() const
 {
@@ -127,20 +174,6 @@ SwitchStatement::to_string() const
 	return ret;
 }
 
-bool
-SwitchStatement::execute()
-{
-	//FIXME:
-	return false;
-}
-
-bool
-LoopStatement::execute()
-{
-	//FIXME:
-	return false;
-}
-
 string
 WhileLoopStatement::to_string() const
 {
@@ -169,13 +202,6 @@ GotoStatement::to_string() const
 	return ret;
 }
 
-bool
-GotoStatement::execute()
-{
-	//FIXME:
-	return false;
-}
-
 string
 CaseStatement::to_string() const
 {
@@ -184,28 +210,18 @@ CaseStatement::to_string() const
 	return ret;
 }
 
-bool
-CaseStatement::execute()
-{
-	//FIXME:
-	return false;
-}
-
 string
 ReturnStatement::to_string() const
 {
 	string ret = Statement::to_string();
-	ret += "return (" + m_expr->to_string() + ");\n";
+	if (m_expr) {
+		ret += "return (" + m_expr->to_string() + ");\n";
+	} else {
+		ret += "return;\n";
+	}
 	return ret;
 }
 
-bool
-ReturnStatement::execute()
-{
-	//FIXME:
-	return false;
-}
-
 string
 DefinitionStatement::to_string() const
 {
@@ -217,13 +233,6 @@ DefinitionStatement::to_string() const
 	return ret;
 }
 
-bool
-DefinitionStatement::execute()
-{
-	//FIXME:
-	return true;
-}
-
 string
 ImportStatement::to_string() const
 {
@@ -232,13 +241,6 @@ ImportStatement::to_string() const
 	return ret;
 }
 
-bool
-ImportStatement::execute()
-{
-	//FIXME:
-	return true;
-}
-
 string
 ModuleStatement::to_string() const
 {
@@ -247,13 +249,6 @@ ModuleStatement::to_string() const
 	return ret;
 }
 
-bool
-ModuleStatement::execute()
-{
-	//FIXME:
-	return true;
-}
-
 string
 DiscoverStatement::to_string() const
 {
@@ -269,25 +264,12 @@ DiscoverStatement::to_string() const
 	return ret;
 }
 
-bool
-DiscoverStatement::execute()
-{
-	//FIXME:
-	return true;
-}
-
 string
 IdentifierExpression::to_string() const
 {
 	return m_ident->to_string();
 }
 
-void
-IdentifierExpression::evaluate(Variable *out_result)
-{
-	(void)out_result;//FIXME:
-}
-
 string
 SubscriptExpression::to_string() const
 {
@@ -295,12 +277,6 @@ SubscriptExpression::to_string() const
 	     + "[" + m_index->to_string() + "]";
 }
 
-void
-SubscriptExpression::evaluate(Variable *out_result)
-{
-	(void)out_result;//FIXME:
-}
-
 string
 FunctionCallExpression::to_string() const
 {
@@ -317,12 +293,6 @@ FunctionCallExpression::to_string() const
 	return ret;
 }
 
-void
-FunctionCallExpression::evaluate(Variable *out_result)
-{
-	(void)out_result;//FIXME:
-}
-
 string
 UnaryExpression::to_string() const
 {
@@ -345,12 +315,6 @@ UnaryExpression::to_string() const
 	return ret;
 }
 
-void
-UnaryExpression::evaluate(Variable *out_result)
-{
-	(void)out_result;//FIXME:
-}
-
 string
 BinaryExpression::to_string() const
 {
@@ -389,12 +353,6 @@ BinaryExpression::to_string() const
 	return ret;
 }
 
-void
-BinaryExpression::evaluate(Variable *out_result)
-{
-	(void)out_result;//FIXME:
-}
-
 string
 ConditionalExpression::to_string() const
 {
@@ -403,12 +361,6 @@ ConditionalExpression::to_string() const
 	     + "(" + m_false->to_string() + ")";
 }
 
-void
-ConditionalExpression::evaluate(Variable *out_result)
-{
-	(void)out_result;//FIXME:
-}
-
 string
 ParameterDeclaration::to_string() const
 {
@@ -473,14 +425,6 @@ ValueExpression::to_string() const
 	return datum_to_string(m_value.get());
 }
 
-void
-ValueExpression::evaluate(Variable *out_result)
-{
-	//FIXME:
-	(void)out_result;
-	//*out_result = m_value;
-}
-
 string
 FunctionLiteralExpression::to_string() const
 {
@@ -497,12 +441,6 @@ FunctionLiteralExpression::to_string() const
 	return ret;
 }
 
-void
-FunctionLiteralExpression::evaluate(Variable *out_result)
-{
-	(void)out_result;//FIXME:
-}
-
 string
 TupleLiteralExpression::to_string() const
 {
@@ -519,10 +457,172 @@ TupleLiteralExpression::to_string() const
 	return ret;
 }
 
+//
+// Constant folding.
+//
+
+// Get an expression as a literal, or NULL if it is not one.
+static const ValueExpression *
+as_literal(const Expression *expr)
+{
+	return dynamic_cast<const ValueExpression*>(expr);
+}
+
+// Get an expression as a bool literal, or NULL if it is not one.
+static const ValueExpression *
+as_bool_literal(const Expression *expr)
+{
+	const ValueExpression *literal = as_literal(expr);
+	if (literal && literal->value()->type().primitive() == Type::BOOL) {
+		return literal;
+	}
+	return NULL;
+}
+
+// Make a copy of a literal, at a new position.
+static Expression *
+copy_literal(const Parser::Position &pos, const ValueExpression *literal)
+{
+	return new ValueExpression(pos, new Variable::Datum(*literal->value()));
+}
+
+Expression *
+Expression::fold_to_literal()
+{
+	Variable result(Type::VAR);
+	try {
+		evaluate(&result);
+	} catch (LanguageError &e) {
+		// Errors like division by zero are left for run time.
+		return NULL;
+	}
+
+	const Parser::Position &pos = parse_position();
+	switch (result.type().primitive()) {
+	 case Type::BOOL:
+		return new BoolLiteralExpression(pos, result.bool_value());
+	 case Type::INT:
+		return new IntLiteralExpression(pos, result.int_value());
+	 case Type::STRING:
+		return new StringLiteralExpression(pos, result.string_value());
+	 default:
+		break;
+	}
+	return NULL;
+}
+
+bool
+Statement::has_entry_points() const
+{
+	for (size_t i = 0; i < m_labels.size(); i++) {
+		const string &label = m_labels[i]->symbol();
+		if (label != "@loop_continue" && label != "@loop_break"
+		 && label != "@do_while_inner") {
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+ConditionalStatement::fold_constants()
+{
+	fold_expression(m_condition);
+	m_true->fold_constants();
+	if (m_false) {
+		m_false->fold_constants();
+	}
+
+	const ValueExpression *cond = as_bool_literal(m_condition.get());
+	if (cond == NULL) {
+		return;
+	}
+	if (cond->value()->bool_value()) {
+		if (m_false && !m_false->has_entry_points()) {
+			m_false.reset(NULL);
+		}
+	} else if (!m_true->has_entry_points()) {
+		Statement *empty = new EmptyStatement(m_true->parse_position());
+		m_true.reset(empty);
+	}
+}
+
 void
-TupleLiteralExpression::evaluate(Variable *out_result)
+LoopStatement::fold_constants()
 {
-	(void)out_result;//FIXME:
+	fold_expression(m_expr);
+	m_body->fold_constants();
+
+	// A do-while body always runs once, so only while loops are dropped.
+	const ValueExpression *cond = as_bool_literal(m_expr.get());
+	if (m_loop_type == LOOP_WHILE && cond && !cond->value()->bool_value()
+	 && !m_body->has_entry_points()) {
+		Statement *empty = new EmptyStatement(m_body->parse_position());
+		m_body.reset(empty);
+	}
+}
+
+Expression *
+IdentifierExpression::fold_constants()
+{
+	if (m_definition == NULL || !m_definition->type().is_const()) {
+		return NULL;
+	}
+	const ValueExpression *init = as_literal(m_definition->initializer());
+	if (init == NULL) {
+		return NULL;
+	}
+	return copy_literal(parse_position(), init);
+}
+
+Expression *
+UnaryExpression::fold_constants()
+{
+	fold_expression(m_expr);
+	if (is_constexpr() && as_literal(m_expr.get())) {
+		return fold_to_literal();
+	}
+	return NULL;
+}
+
+Expression *
+BinaryExpression::fold_constants()
+{
+	fold_expression(m_lhs);
+	fold_expression(m_rhs);
+	if (is_constexpr() && as_literal(m_lhs.get()) && as_literal(m_rhs.get())) {
+		return fold_to_literal();
+	}
+	return NULL;
+}
+
+Expression *
+ConditionalExpression::fold_constants()
+{
+	fold_expression(m_condition);
+	fold_expression(m_true);
+	fold_expression(m_false);
+
+	const ValueExpression *cond = as_bool_literal(m_condition.get());
+	if (cond == NULL) {
+		return NULL;
+	}
+	bool value = cond->value()->bool_value();
+	const ValueExpression *taken = as_literal(value ? m_true.get()
+	                                                : m_false.get());
+	if (taken) {
+		return copy_literal(parse_position(), taken);
+	}
+
+	// The compiler does not emit code for the other branch, so it is
+	// replaced with something small.
+	util::NeverNullScopedPtr<Expression> &dead = value ? m_false : m_true;
+	if (!as_literal(dead.get())) {
+		Expression *nothing =
+		    new BoolLiteralExpression(dead->parse_position(), false);
+		dead.reset(nothing);
+	}
+	return NULL;
 }
 
 }  // namespace syntax
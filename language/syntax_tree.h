@@ -15,6 +15,7 @@
 #include "language/language.h"
 #include "language/type.h"
 #include "language/variable.h"
+#include "util/arena.h"
 #include "util/pointer.h"
 
 namespace hwpp {
@@ -70,6 +71,22 @@ class SyntaxNode {
 		return validate(flags, env);
 	}
 
+	// Nodes can be allocated from the heap, as usual, or from an Arena,
+	// which is how the parser builds a ParsedFile:
+	//   Expression *expr = new (arena) IntLiteralExpression(pos, value);
+	// Either way they are freed with delete.  Deleting a node from an
+	// Arena runs its destructor, but the memory is only released when the
+	// Arena is.  This lets a file's tree come and go in a few big chunks
+	// while still allowing nodes to be replaced, e.g. by fold_constants().
+	static void *
+	operator new(size_t size);
+	static void *
+	operator new(size_t size, util::Arena *arena);
+	static void
+	operator delete(void *pointer);
+	static void
+	operator delete(void *pointer, util::Arena *arena);
+
  protected:
 	SyntaxNode(const Parser::Position &pos, NodeType node_type)
 	    : m_position(pos), m_node_type(node_type), m_validated(false)
@@ -101,9 +118,12 @@ class Expression : public SyntaxNode {
 	{
 	}
 
-	// Evaluate this expression, producing a result.
+	// Evaluate this expression, producing a result.  This compiles the
+	// expression to bytecode and runs it, so it is meant for one-off uses
+	// such as constant expressions during validation.  Throws
+	// LanguageError on failure.
 	virtual void
-	evaluate(Variable *out_result) = 0;
+	evaluate(Variable *out_result);
 
 	// Get the resulting type of this expression.
 	virtual const Type &
@@ -119,6 +139,16 @@ class Expression : public SyntaxNode {
 		return false;
 	}
 
+	// Fold constant subexpressions in place.  If this whole expression
+	// is constant, returns a new literal which the caller should use in
+	// its place, otherwise returns NULL.  This must be called after
+	// validation.
+	virtual Expression *
+	fold_constants()
+	{
+		return NULL;
+	}
+
  protected:
 	void
 	set_result_type(const Type &type)
@@ -126,23 +156,42 @@ class Expression : public SyntaxNode {
 		m_result_type = type;
 	}
 
+	// Evaluate this expression into a new literal.  Returns NULL if it
+	// can not be evaluated now, or if its type has no literal form.
+	Expression *
+	fold_to_literal();
+
  private:
 	// The resulting datatype of the Expression.
 	Type m_result_type;
 };
 typedef std::vector<Expression*> ExpressionList;
 
+// Fold the constants in an expression held by a smart pointer, replacing
+// the expression if it folded to a literal.
+template<typename Tptr>
+inline void
+fold_expression(Tptr &expr)
+{
+	if (expr) {
+		Expression *folded = expr->fold_constants();
+		if (folded) {
+			expr.reset(folded);
+		}
+	}
+}
+
 class Identifier : public SyntaxNode {
  public:
 	Identifier(const Parser::Position &pos, const string &symbol)
 	    : SyntaxNode(pos, NODE_TYPE_IDENTIFIER),
-	      m_module(""), m_symbol(symbol)
+	      m_module(""), m_symbol(symbol), m_definition(NULL)
 	{
 	}
 	Identifier(const Parser::Position &pos,
 	           const string &module, const string &symbol)
 	    : SyntaxNode(pos, NODE_TYPE_IDENTIFIER),
-	      m_module(module), m_symbol(symbol)
+	      m_module(module), m_symbol(symbol), m_definition(NULL)
 	{
 	}
 
@@ -212,6 +261,12 @@ class InitializedIdentifier : public SyntaxNode {
 		return warnings;
 	}
 
+	void
+	fold_constants()
+	{
+		fold_expression(m_init);
+	}
+
  private:
 	util::NeverNullScopedPtr<Identifier> m_ident;
 	util::MaybeNullScopedPtr<Expression> m_init;
@@ -234,9 +289,12 @@ class Statement : public SyntaxNode {
 		}
 	}
 
-	// Execute this statement.
+	// Execute this statement on its own, by compiling it to bytecode and
+	// running it.  Top-level definitions made this way only live while it
+	// runs.  Returns true when the statement completes, and throws
+	// LanguageError on failure.
 	virtual bool
-	execute() = 0;
+	execute();
 
 	// Get a string representation of this statement.
 	virtual string
@@ -261,6 +319,20 @@ class Statement : public SyntaxNode {
 		return 0;
 	}
 
+	// Fold constant expressions in this statement, and drop branches
+	// which can never run.  This must be called after validation.
+	virtual void
+	fold_constants()
+	{
+	}
+
+	// Test whether control can enter this statement other than at the
+	// top, through a label or a case.  Branches like that are never
+	// dropped.  The labels of loops only lead into their own loop, so
+	// they do not count.
+	virtual bool
+	has_entry_points() const;
+
  private:
 	std::vector<Identifier*> m_labels;
 };
@@ -276,7 +348,7 @@ class Definition : public SyntaxNode {
 	}
 
 	const Type &
-	type()
+	type() const
 	{
 		return m_type;
 	}
@@ -298,7 +370,13 @@ class Definition : public SyntaxNode {
 	{
 		return m_init_ident->initializer();
 	}
-	
+
+	void
+	fold_constants()
+	{
+		m_init_ident->fold_constants();
+	}
+
 	virtual string
 	to_string() const;
 
@@ -422,6 +500,12 @@ class Argument : public SyntaxNode {
 		return warnings;
 	}
 
+	void
+	fold_constants()
+	{
+		fold_expression(m_expr);
+	}
+
  private:
 	util::MaybeNullScopedPtr<Identifier> m_name;
 	util::NeverNullScopedPtr<Expression> m_expr;
@@ -438,8 +522,6 @@ class EmptyStatement : public Statement {
 	{
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int
@@ -461,8 +543,6 @@ class CompoundStatement : public Statement {
 		return m_body.get();
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -476,6 +556,28 @@ class CompoundStatement : public Statement {
 		return warnings;
 	}
 
+	virtual void
+	fold_constants()
+	{
+		for (size_t i = 0; i < m_body->size(); i++) {
+			m_body->at(i)->fold_constants();
+		}
+	}
+
+	virtual bool
+	has_entry_points() const
+	{
+		if (Statement::has_entry_points()) {
+			return true;
+		}
+		for (size_t i = 0; i < m_body->size(); i++) {
+			if (m_body->at(i)->has_entry_points()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
  private:
 	util::NeverNullScopedPtr<StatementList> m_body;
 };
@@ -492,8 +594,6 @@ class ExpressionStatement : public Statement {
 		return m_expr.get();
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -502,6 +602,12 @@ class ExpressionStatement : public Statement {
 		     + m_expr->validate_once(flags, env);
 	}
 
+	virtual void
+	fold_constants()
+	{
+		fold_expression(m_expr);
+	}
+
  private:
 	util::NeverNullScopedPtr<Expression> m_expr;
 };
@@ -537,8 +643,6 @@ class ConditionalStatement : public Statement {
 		return m_false.get();
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -552,6 +656,18 @@ class ConditionalStatement : public Statement {
 		return warnings;
 	}
 
+	// A constant condition drops the branch which can not run.
+	virtual void
+	fold_constants();
+
+	virtual bool
+	has_entry_points() const
+	{
+		return Statement::has_entry_points()
+		    || m_true->has_entry_points()
+		    || (m_false && m_false->has_entry_points());
+	}
+
  private:
 	util::NeverNullScopedPtr<Expression> m_condition;
 	util::NeverNullScopedPtr<Statement> m_true;
@@ -576,8 +692,6 @@ class SwitchStatement : public Statement {
 		return m_body.get();
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -588,6 +702,19 @@ class SwitchStatement : public Statement {
 		return warnings;
 	}
 
+	virtual void
+	fold_constants()
+	{
+		fold_expression(m_condition);
+		m_body->fold_constants();
+	}
+
+	virtual bool
+	has_entry_points() const
+	{
+		return Statement::has_entry_points() || m_body->has_entry_points();
+	}
+
  private:
 	util::NeverNullScopedPtr<Expression> m_condition;
 	util::NeverNullScopedPtr<Statement> m_body;
@@ -629,7 +756,15 @@ class LoopStatement : public Statement {
 		return warnings;
 	}
 
-	virtual bool execute();
+	// A while loop whose condition is constant false drops its body.
+	virtual void
+	fold_constants();
+
+	virtual bool
+	has_entry_points() const
+	{
+		return Statement::has_entry_points() || m_body->has_entry_points();
+	}
 
  private:
 	LoopType m_loop_type;
@@ -671,8 +806,6 @@ class GotoStatement : public Statement {
 		return m_target.get();
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -704,8 +837,6 @@ class CaseStatement : public Statement {
 		return m_statement.get();
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -716,6 +847,20 @@ class CaseStatement : public Statement {
 		return warnings;
 	}
 
+	virtual void
+	fold_constants()
+	{
+		fold_expression(m_expr);
+		m_statement->fold_constants();
+	}
+
+	// A switch can always jump to a case.
+	virtual bool
+	has_entry_points() const
+	{
+		return true;
+	}
+
  private:
 	util::NeverNullScopedPtr<Expression> m_expr;
 	util::NeverNullScopedPtr<Statement> m_statement;
@@ -738,8 +883,6 @@ class ReturnStatement : public Statement {
 		return m_expr.get();
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -751,6 +894,12 @@ class ReturnStatement : public Statement {
 		return warnings;
 	}
 
+	virtual void
+	fold_constants()
+	{
+		fold_expression(m_expr);
+	}
+
  private:
 	util::MaybeNullScopedPtr<Expression> m_expr;
 };
@@ -778,9 +927,6 @@ class DefinitionStatement : public Statement {
 		return m_vars;
 	}
 
-	virtual bool
-	execute();
-
 	virtual string
 	to_string() const;
 
@@ -794,6 +940,14 @@ class DefinitionStatement : public Statement {
 		return warnings;
 	}
 
+	virtual void
+	fold_constants()
+	{
+		for (size_t i = 0; i < m_vars.size(); i++) {
+			m_vars[i]->fold_constants();
+		}
+	}
+
  private:
 	DefinitionList m_vars;
 };
@@ -810,8 +964,6 @@ class ImportStatement : public Statement {
 		return m_argument;
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -836,8 +988,6 @@ class ModuleStatement : public Statement {
 		return m_name;
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -863,8 +1013,6 @@ class DiscoverStatement : public Statement {
 		return m_args.get();
 	}
 
-	virtual bool execute();
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -876,6 +1024,14 @@ class DiscoverStatement : public Statement {
 		return warnings;
 	}
 
+	virtual void
+	fold_constants()
+	{
+		for (size_t i = 0; i < m_args->size(); i++) {
+			m_args->at(i)->fold_constants();
+		}
+	}
+
  private:
 	util::NeverNullScopedPtr<ArgumentList> m_args;
 };
@@ -883,7 +1039,7 @@ class DiscoverStatement : public Statement {
 class IdentifierExpression : public Expression {
  public:
 	IdentifierExpression(const Parser::Position &pos, Identifier *ident)
-	    : Expression(pos), m_ident(ident)
+	    : Expression(pos), m_ident(ident), m_definition(NULL)
 	{
 	}
 
@@ -893,8 +1049,12 @@ class IdentifierExpression : public Expression {
 		return m_ident.get();
 	}
 
-	virtual void
-	evaluate(Variable *out_result);
+	// The Definition this resolved to, or NULL before validation.
+	Definition *
+	definition() const
+	{
+		return m_definition;
+	}
 
 	virtual string
 	to_string() const;
@@ -929,6 +1089,10 @@ class IdentifierExpression : public Expression {
 		return false;
 	}
 
+	// A const which is initialized to a literal folds to that literal.
+	virtual Expression *
+	fold_constants();
+
  private:
 	util::NeverNullScopedPtr<Identifier> m_ident;
 	Definition *m_definition;  // cached for easy access
@@ -952,8 +1116,6 @@ class SubscriptExpression : public Expression {
 		return m_index.get();
 	}
 
-	virtual void evaluate(Variable *out_result);
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -1030,6 +1192,14 @@ class SubscriptExpression : public Expression {
 		return (m_expr->is_constexpr() && m_index->is_constexpr());
 	}
 
+	virtual Expression *
+	fold_constants()
+	{
+		fold_expression(m_expr);
+		fold_expression(m_index);
+		return NULL;
+	}
+
  private:
 	util::NeverNullScopedPtr<Expression> m_expr;
 	util::NeverNullScopedPtr<Expression> m_index;
@@ -1064,8 +1234,6 @@ class FunctionCallExpression : public Expression {
 		return t; //FIXME:
 	}
 
-	virtual void evaluate(Variable *out_result);
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -1079,6 +1247,18 @@ class FunctionCallExpression : public Expression {
 		return warnings;
 	}
 
+	virtual Expression *
+	fold_constants()
+	{
+		fold_expression(m_callee);
+		if (m_args) {
+			for (size_t i = 0; i < m_args->size(); i++) {
+				m_args->at(i)->fold_constants();
+			}
+		}
+		return NULL;
+	}
+
  private:
 	util::NeverNullScopedPtr<Expression> m_callee;
 	util::MaybeNullScopedPtr<ArgumentList> m_args;
@@ -1113,8 +1293,6 @@ class UnaryExpression : public Expression {
 		return m_expr.get();
 	}
 
-	virtual void evaluate(Variable *out_result);
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -1178,6 +1356,9 @@ class UnaryExpression : public Expression {
 		return false;
 	}
 
+	virtual Expression *
+	fold_constants();
+
  private:
 	SyntaxError
 	syntax_error(const string &fmt, const Type &type) const
@@ -1245,8 +1426,6 @@ class BinaryExpression : public Expression {
 		return m_rhs.get();
 	}
 
-	virtual void evaluate(Variable *out_result);
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -1358,6 +1537,9 @@ class BinaryExpression : public Expression {
 		return false;
 	}
 
+	virtual Expression *
+	fold_constants();
+
  private:
 	SyntaxError
 	syntax_error(const string &fmt, const Type &type) const
@@ -1403,8 +1585,6 @@ class ConditionalExpression : public Expression {
 		return m_false.get();
 	}
 
-	virtual void evaluate(Variable *out_result);
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -1430,6 +1610,11 @@ class ConditionalExpression : public Expression {
 		    && m_true->is_constexpr() && m_false->is_constexpr());
 	}
 
+	// A constant condition folds to the branch it picks, if that is a
+	// literal.  Otherwise the other branch is dropped.
+	virtual Expression *
+	fold_constants();
+
  private:
 	util::NeverNullScopedPtr<Expression> m_condition;
 	util::NeverNullScopedPtr<Expression> m_true;
@@ -1444,6 +1629,16 @@ class ParameterDeclaration : public SyntaxNode {
 	{
 	}
 
+	const Type &type() const
+	{
+		return *m_type;
+	}
+
+	Identifier *identifier() const
+	{
+		return m_ident.get();
+	}
+
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -1473,8 +1668,6 @@ class ValueExpression : public Expression {
 		return m_value.get();
 	}
 
-	virtual void evaluate(Variable *out_result);
-
 	virtual string to_string() const;
 
 	virtual int
@@ -1529,13 +1722,16 @@ class FunctionLiteralExpression : public Expression {
 		set_result_type(Type(Type::FUNC, Type::LITERAL));
 	}
 
+	ParameterDeclarationList *params() const
+	{
+		return m_params.get();
+	}
+
 	Statement *body() const
 	{
 		return m_body.get();
 	}
 
-	virtual void evaluate(Variable *out_result);
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -1558,6 +1754,13 @@ class FunctionLiteralExpression : public Expression {
 		return true;
 	}
 
+	virtual Expression *
+	fold_constants()
+	{
+		m_body->fold_constants();
+		return NULL;
+	}
+
  private:
 	// Make a new Definition that is the built-in function args list.
 	Definition *
@@ -1588,8 +1791,6 @@ class TupleLiteralExpression : public Expression {
 		return m_contents.get();
 	}
 
-	virtual void evaluate(Variable *out_result);
-
 	virtual string to_string() const;
 
 	virtual int validate(const ValidateOptions &flags, Environment *env)
@@ -1617,6 +1818,15 @@ class TupleLiteralExpression : public Expression {
 		return true;
 	}
 
+	virtual Expression *
+	fold_constants()
+	{
+		for (size_t i = 0; i < m_contents->size(); i++) {
+			m_contents->at(i)->fold_constants();
+		}
+		return NULL;
+	}
+
  private:
 	util::NeverNullScopedPtr<ArgumentList> m_contents;
 };
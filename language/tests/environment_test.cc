@@ -0,0 +1,130 @@
+#include "language/environment.h"
+#include "hwpp.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <set>
+#include "language/module_cache.h"
+#include "language/parsed_file.h"
+#include "language/syntax_tree.h"
+#include "util/test.h"
+
+using namespace hwpp::language;
+using namespace hwpp::language::syntax;
+
+// These build syntax trees by hand and feed them to the Environment through
+// the module cache, so the tests do not need the parser.
+
+static Parser::Position
+here()
+{
+	Parser::Position pos;
+	pos.file = "environment_test";
+	pos.line = 1;
+	return pos;
+}
+
+static Expression *
+num(int value)
+{
+	return new IntLiteralExpression(here(), hwpp::Value(value));
+}
+
+static Expression *
+ref(const string &name)
+{
+	return new IdentifierExpression(here(), new Identifier(here(), name));
+}
+
+static Statement *
+define(const string &name, Expression *init)
+{
+	InitializedIdentifierList *vars = new InitializedIdentifierList();
+	vars->push_back(new InitializedIdentifier(here(),
+	    new Identifier(here(), name), init));
+	return new DefinitionStatement(here(), new Type(Type::INT), vars);
+}
+
+// Put a one-statement file in the cache, for the given contents.
+static void
+cache_file(const ModuleCache &cache, const string &name,
+           const string &contents, Statement *stmt)
+{
+	ParsedFile file;
+	file.add_statement(stmt);
+	cache.store(name, contents, file);
+}
+
+static string
+make_cache_dir()
+{
+	char dir[] = "/tmp/environment_test.XXXXXX";
+	if (mkdtemp(dir) == NULL) {
+		return "";
+	}
+	return dir;
+}
+
+static bool
+global_is(const Environment &env, const string &name, int value)
+{
+	const Variable *var = env.lookup_global(name);
+	return var && var->int_value() == value;
+}
+
+TEST(test_reload)
+{
+	string dir = make_cache_dir();
+	TEST_ASSERT(dir != "", "mkdtemp()");
+	ModuleCache cache(dir);
+	cache_file(cache, "a.pp", "x = 1", define("x", num(1)));
+	cache_file(cache, "a.pp", "x = 2", define("x", num(2)));
+	cache_file(cache, "b.pp", "y = x + 1", define("y",
+	    new BinaryExpression(here(), BinaryExpression::OP_ADD,
+	                         ref("x"), num(1))));
+	cache_file(cache, "c.pp", "z = 3", define("z", num(3)));
+
+	Environment env;
+	env.set_module_cache(dir);
+	TEST_ASSERT(env.parse_string("a.pp", "x = 1") != NULL,
+	    "Environment::parse_string()");
+	TEST_ASSERT(env.parse_string("b.pp", "y = x + 1") != NULL,
+	    "Environment::parse_string()");
+	TEST_ASSERT(env.parse_string("c.pp", "z = 3") != NULL,
+	    "Environment::parse_string()");
+	env.validate(env.default_validate_options());
+	env.execute();
+	TEST_ASSERT(global_is(env, "y", 2), "Environment::execute()");
+
+	// b.pp uses a symbol from a.pp, and c.pp stands alone.
+	std::set<string> deps = env.dependents("a.pp");
+	TEST_ASSERT(deps.size() == 1 && deps.count("b.pp"),
+	    "Environment::dependents()");
+	TEST_ASSERT(env.dependents("b.pp").empty(),
+	    "Environment::dependents()");
+	TEST_ASSERT(env.dependents("c.pp").empty(),
+	    "Environment::dependents()");
+
+	// Replacing a.pp must not redefine x, and must bring b.pp along.
+	TEST_ASSERT(env.parse_string("a.pp", "x = 2") != NULL,
+	    "Environment::parse_string()");
+	env.validate(env.default_validate_options());
+	env.execute();
+	TEST_ASSERT(global_is(env, "x", 2), "Environment::execute()");
+	TEST_ASSERT(global_is(env, "y", 3), "Environment::execute()");
+	TEST_ASSERT(global_is(env, "z", 3), "Environment::execute()");
+	deps = env.dependents("a.pp");
+	TEST_ASSERT(deps.size() == 1 && deps.count("b.pp"),
+	    "Environment::dependents()");
+
+	// Only names which were parsed can be reloaded.
+	TEST_ASSERT(env.reload_file("nonexistent.pp") == NULL,
+	    "Environment::reload_file()");
+
+	unlink(cache.entry_path("a.pp", "x = 1").c_str());
+	unlink(cache.entry_path("a.pp", "x = 2").c_str());
+	unlink(cache.entry_path("b.pp", "y = x + 1").c_str());
+	unlink(cache.entry_path("c.pp", "z = 3").c_str());
+	rmdir(dir.c_str());
+}
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
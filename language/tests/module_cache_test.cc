@@ -0,0 +1,219 @@
+#include "language/module_cache.h"
+#include "hwpp.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <memory>
+#include "language/environment.h"
+#include "language/parsed_file.h"
+#include "language/syntax_tree.h"
+#include "util/test.h"
+
+using namespace hwpp::language;
+using namespace hwpp::language::syntax;
+
+// These build syntax trees by hand, so the tests do not need the parser.
+
+static Parser::Position
+here(int line)
+{
+	Parser::Position pos;
+	pos.file = "test.pp";
+	pos.line = line;
+	return pos;
+}
+
+static Expression *
+num(int value)
+{
+	return new IntLiteralExpression(here(1), hwpp::Value(value));
+}
+
+static Expression *
+ref(const string &name)
+{
+	return new IdentifierExpression(here(2), new Identifier(here(2), name));
+}
+
+static Statement *
+define(const Type &type, const string &name, Expression *init)
+{
+	InitializedIdentifierList *vars = new InitializedIdentifierList();
+	vars->push_back(new InitializedIdentifier(here(3),
+	    new Identifier(here(3), name), init));
+	return new DefinitionStatement(here(3), new Type(type), vars);
+}
+
+// Build a file which uses most kinds of nodes.
+static void
+build_file(ParsedFile *file)
+{
+	file->set_module("test");
+	file->add_statement(new ModuleStatement(here(1), "test"));
+	file->add_statement(new ImportStatement(here(2), "pci"));
+
+	Statement *pub = define(Type::INT, "x", new BinaryExpression(here(4),
+	    BinaryExpression::OP_SHL, num(1), num(12)));
+	file->add_public_symbol("x",
+	    dynamic_cast<DefinitionStatement*>(pub)->vars()[0]);
+	file->add_statement(pub);
+
+	Type list_type(Type::LIST);
+	list_type.add_argument(Type(Type::STRING, Type::CONST));
+	ArgumentList *members = new ArgumentList();
+	members->push_back(new Argument(here(5),
+	    new StringLiteralExpression(here(5), string("a\0b", 3))));
+	members->push_back(new Argument(here(5), new Identifier(here(5), "n"),
+	    new BoolLiteralExpression(here(5), true)));
+	Statement *priv = define(list_type, "l",
+	    new TupleLiteralExpression(here(5), members));
+	file->add_private_symbol("l",
+	    dynamic_cast<DefinitionStatement*>(priv)->vars()[0]);
+	file->add_statement(priv);
+
+	ParameterDeclarationList *params = new ParameterDeclarationList();
+	params->push_back(new ParameterDeclaration(here(6), new Type(Type::INT),
+	    new Identifier(here(6), "i")));
+	StatementList *body = new StatementList();
+	body->push_back(new DoWhileLoopStatement(here(7),
+	    new ExpressionStatement(here(7), new UnaryExpression(here(7),
+	        UnaryExpression::OP_PREINC, ref("x"))),
+	    new BinaryExpression(here(7), BinaryExpression::OP_LT,
+	        ref("x"), num(100))));
+	body->back()->add_label(new Identifier(here(7), "top"));
+	body->push_back(new ConditionalStatement(here(8),
+	    new ConditionalExpression(here(8), ref("x"), ref("x"), num(0)),
+	    new GotoStatement(here(8), new Identifier(here(8), "top")),
+	    new ReturnStatement(here(8), new SubscriptExpression(here(8),
+	        ref("l"), num(0)))));
+	body->push_back(new ReturnStatement(here(9)));
+	file->add_statement(define(Type::FUNC, "f",
+	    new FunctionLiteralExpression(here(6), params,
+	        new CompoundStatement(here(6), body))));
+
+	ArgumentList *args = new ArgumentList();
+	args->push_back(new Argument(here(10), new FunctionCallExpression(
+	    here(10), ref("f"))));
+	file->add_statement(new DiscoverStatement(here(10), args));
+}
+
+static string
+make_cache_dir()
+{
+	char dir[] = "/tmp/module_cache_test.XXXXXX";
+	if (mkdtemp(dir) == NULL) {
+		return "";
+	}
+	return dir;
+}
+
+TEST(test_round_trip)
+{
+	string dir = make_cache_dir();
+	TEST_ASSERT(dir != "", "mkdtemp()");
+	ModuleCache cache(dir);
+	string contents = "the source text";
+
+	ParsedFile original;
+	build_file(&original);
+	TEST_ASSERT(cache.load("test.pp", contents) == NULL,
+	    "ModuleCache::load()");
+	TEST_ASSERT(cache.store("test.pp", contents, original),
+	    "ModuleCache::store()");
+
+	std::auto_ptr<ParsedFile> loaded(cache.load("test.pp", contents));
+	TEST_ASSERT(loaded.get() != NULL, "ModuleCache::load()");
+	if (loaded.get()) {
+		TEST_ASSERT(loaded->module() == "test", "ModuleCache::load()");
+		TEST_ASSERT(loaded->arena()->bytes_allocated() > 0,
+		    "ModuleCache::load()");
+		TEST_ASSERT(loaded->n_statements() == original.n_statements(),
+		    "ModuleCache::load()");
+		for (size_t i = 0; i < original.n_statements(); i++) {
+			TEST_ASSERT(loaded->statement(i)->to_string()
+			            == original.statement(i)->to_string())
+			    << "ModuleCache::load(): " << i << ": "
+			    << loaded->statement(i)->to_string();
+			TEST_ASSERT(loaded->statement(i)->parse_position().line
+			            == original.statement(i)->parse_position().line,
+			    "ModuleCache::load()");
+			TEST_ASSERT(loaded->statement(i)->parse_position().file
+			            == "test.pp", "ModuleCache::load()");
+		}
+		TEST_ASSERT(loaded->n_public_symbols() == 1
+		         && loaded->public_symbols_begin()->first.symbol == "x",
+		    "ModuleCache::load()");
+		TEST_ASSERT(loaded->n_private_symbols() == 1
+		         && loaded->private_symbols_begin()->first.symbol == "l",
+		    "ModuleCache::load()");
+	}
+
+	// A different name or different contents must miss.
+	TEST_ASSERT(cache.load("other.pp", contents) == NULL,
+	    "ModuleCache::load()");
+	TEST_ASSERT(cache.load("test.pp", contents + " ") == NULL,
+	    "ModuleCache::load()");
+
+	unlink(cache.entry_path("test.pp", contents).c_str());
+	rmdir(dir.c_str());
+}
+
+TEST(test_bad_entry)
+{
+	string dir = make_cache_dir();
+	TEST_ASSERT(dir != "", "mkdtemp()");
+	ModuleCache cache(dir);
+	string contents = "int x = 1;";
+	string path = cache.entry_path("test.pp", contents);
+
+	ParsedFile original;
+	build_file(&original);
+	TEST_ASSERT(cache.store("test.pp", contents, original),
+	    "ModuleCache::store()");
+
+	// Chop the entry in half.
+	FILE *f = fopen(path.c_str(), "r+");
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+	TEST_ASSERT(truncate(path.c_str(), size / 2) == 0, "truncate()");
+	TEST_ASSERT(cache.load("test.pp", contents) == NULL,
+	    "ModuleCache::load()");
+
+	// Garbage.
+	f = fopen(path.c_str(), "w");
+	fputs("HWPPMODCgarbage", f);
+	fclose(f);
+	TEST_ASSERT(cache.load("test.pp", contents) == NULL,
+	    "ModuleCache::load()");
+
+	unlink(path.c_str());
+	rmdir(dir.c_str());
+}
+
+TEST(test_key_collision)
+{
+	string dir = make_cache_dir();
+	TEST_ASSERT(dir != "", "mkdtemp()");
+	ModuleCache cache(dir);
+	string contents = "int x = 1;";
+	string other = "int x = 2;";
+
+	ParsedFile original;
+	build_file(&original);
+	TEST_ASSERT(cache.store("test.pp", contents, original),
+	    "ModuleCache::store()");
+
+	// Pretend that 'other', which is the same length, hashed to the same
+	// entry.  Loading it must still miss.
+	string path = cache.entry_path("test.pp", contents);
+	string other_path = cache.entry_path("test.pp", other);
+	TEST_ASSERT(rename(path.c_str(), other_path.c_str()) == 0, "rename()");
+	TEST_ASSERT(cache.load("test.pp", other) == NULL,
+	    "ModuleCache::load()");
+
+	unlink(other_path.c_str());
+	rmdir(dir.c_str());
+}
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
@@ -173,7 +173,8 @@ TEST(test_datum) {
 
 	{
 		struct TestFunc : public Variable::Func {
-			virtual Variable *call() {
+			virtual Variable *
+			call(const std::vector<Variable*> &) const {
 				return NULL;
 			}
 		};
@@ -219,6 +220,71 @@ TEST(test_datum) {
 	}
 }
 
+TEST(test_copy_on_write) {
+	using hwpp::language::Type;
+	using hwpp::language::Variable;
+
+	// Copies share the payload.
+	{
+		Variable::Datum d1(Type::STRING, string("a long string"));
+		Variable::Datum d2(d1);
+		TEST_ASSERT(&d1.string_value() == &d2.string_value());
+		TEST_ASSERT(d2.string_value() == "a long string");
+	}
+
+	// Lists are shared until a member is written.
+	{
+		Variable::List *list = new Variable::List();
+		list->append(new Variable(Type::INT, hwpp::Value(1)));
+		list->append(new Variable(Type::INT, hwpp::Value(2)));
+		Variable v1(Type::LIST, list);
+		Variable v2(Type::VAR);
+		v2.assign_from(v1);
+		TEST_ASSERT(&v1.list_value() == &v2.list_value());
+
+		v1.unshare_members();
+		TEST_ASSERT(&v1.list_value() != &v2.list_value());
+		v1.list_value().contents()[0]->assign_from(
+		    Variable(Type::INT, hwpp::Value(42)));
+		TEST_ASSERT(v1.list_value().contents()[0]->int_value() == 42);
+		TEST_ASSERT(v2.list_value().contents()[0]->int_value() == 1);
+
+		// Unsharing an unshared list does nothing.
+		const Variable::List *before = &v1.list_value();
+		v1.unshare_members();
+		TEST_ASSERT(&v1.list_value() == before);
+	}
+
+	// Nested lists don't share members after unsharing.
+	{
+		Variable::List *inner = new Variable::List();
+		inner->append(new Variable(Type::INT, hwpp::Value(1)));
+		Variable::List *outer = new Variable::List();
+		outer->append(new Variable(Type::LIST, inner));
+		Variable v1(Type::LIST, outer);
+		Variable v2(Type::VAR);
+		v2.assign_from(v1);
+
+		v1.unshare_members();
+		Variable *member = v1.list_value().contents()[0];
+		member->unshare_members();
+		member->list_value().contents()[0]->assign_from(
+		    Variable(Type::INT, hwpp::Value(42)));
+		const Variable *other = v2.list_value().contents()[0];
+		TEST_ASSERT(other->list_value().contents()[0]->int_value() == 1);
+	}
+
+	// Variable::copy() keeps the constness.
+	{
+		Variable v1(Type(Type::INT, Type::CONST), hwpp::Value(7));
+		Variable *v2 = v1.copy();
+		TEST_ASSERT(v2->is_const());
+		TEST_ASSERT(v2->int_value() == 7);
+		TEST_ASSERT(v2->value() != v1.value());
+		delete v2;
+	}
+}
+
 TEST(test_basics) {
 	using hwpp::language::Type;
 	using hwpp::language::Variable;
@@ -308,7 +374,8 @@ TEST(test_basics) {
 
 	{
 		struct TestFunc : public Variable::Func {
-			virtual Variable *call() {
+			virtual Variable *
+			call(const std::vector<Variable*> &) const {
 				return NULL;
 			}
 		};
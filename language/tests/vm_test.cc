@@ -0,0 +1,484 @@
+#include "language/vm.h"
+#include "hwpp.h"
+#include "language/bytecode.h"
+#include "language/compiler.h"
+#include "language/environment.h"
+#include "language/errors.h"
+#include "language/parsed_file.h"
+#include "language/syntax_tree.h"
+#include "util/test.h"
+
+using namespace hwpp::language;
+using namespace hwpp::language::syntax;
+
+// These build syntax trees by hand, so the tests do not need the parser.
+
+static Parser::Position
+here()
+{
+	Parser::Position pos;
+	pos.file = "vm_test";
+	pos.line = 1;
+	return pos;
+}
+
+static Expression *
+num(int value)
+{
+	return new IntLiteralExpression(here(), hwpp::Value(value));
+}
+
+static Expression *
+ref(const string &name)
+{
+	return new IdentifierExpression(here(), new Identifier(here(), name));
+}
+
+static Expression *
+binop(BinaryExpression::Operator op, Expression *lhs, Expression *rhs)
+{
+	return new BinaryExpression(here(), op, lhs, rhs);
+}
+
+static Expression *
+call(Expression *callee, Expression *arg)
+{
+	ArgumentList *args = new ArgumentList();
+	args->push_back(new Argument(here(), arg));
+	return new FunctionCallExpression(here(), callee, args);
+}
+
+static Expression *
+subscript(Expression *expr, int index)
+{
+	return new SubscriptExpression(here(), expr, num(index));
+}
+
+static Expression *
+function(Statement *body)
+{
+	return new FunctionLiteralExpression(here(),
+	    new ParameterDeclarationList(), body);
+}
+
+static Statement *
+define(const Type &type, const string &name, Expression *init)
+{
+	InitializedIdentifierList *vars = new InitializedIdentifierList();
+	vars->push_back(new InitializedIdentifier(here(),
+	    new Identifier(here(), name), init));
+	return new DefinitionStatement(here(), new Type(type), vars);
+}
+
+static Statement *
+eval(Expression *expr)
+{
+	return new ExpressionStatement(here(), expr);
+}
+
+static Statement *
+jump(const string &label)
+{
+	return new GotoStatement(here(), new Identifier(here(), label));
+}
+
+static Statement *
+labeled(const string &label, Statement *stmt)
+{
+	stmt->add_label(new Identifier(here(), label));
+	return stmt;
+}
+
+static Statement *
+block(Statement *s1, Statement *s2 = NULL, Statement *s3 = NULL,
+      Statement *s4 = NULL)
+{
+	StatementList *body = new StatementList();
+	Statement *all[] = { s1, s2, s3, s4 };
+	for (size_t i = 0; i < 4 && all[i]; i++) {
+		body->push_back(all[i]);
+	}
+	return new CompoundStatement(here(), body);
+}
+
+// Validate, compile and run a file, optionally folding constants first.
+static void
+run_file(Environment *env, ParsedFile *file, Vm **vm, bool fold = false)
+{
+	ValidateOptions flags = env->default_validate_options();
+	for (size_t i = 0; i < file->n_statements(); i++) {
+		file->statement(i)->validate_once(flags, env);
+	}
+	for (size_t i = 0; fold && i < file->n_statements(); i++) {
+		file->statement(i)->fold_constants();
+	}
+	Compiler compiler;
+	compiler.add_file(file);
+	*vm = new Vm(compiler.finish());
+	(*vm)->run();
+}
+
+static bool
+global_is(const Vm &vm, const string &name, int value)
+{
+	const Variable *var = vm.global(name);
+	return var && var->int_value() == value;
+}
+
+TEST(test_evaluate)
+{
+	// 2 + 3 * 4
+	Expression *expr = binop(BinaryExpression::OP_ADD, num(2),
+	    binop(BinaryExpression::OP_MUL, num(3), num(4)));
+	Environment env;
+	expr->validate_once(env.default_validate_options(), &env);
+	Variable result(Type::VAR);
+	expr->evaluate(&result);
+	TEST_ASSERT(result.int_value() == 14)
+	    << "Expression::evaluate(): " << result.int_value();
+
+	// a conditional, as && is compiled
+	Expression *cond = new ConditionalExpression(here(),
+	    binop(BinaryExpression::OP_LT, num(1), num(2)),
+	    binop(BinaryExpression::OP_EQ, num(5), num(5)),
+	    new BoolLiteralExpression(here(), false));
+	cond->validate_once(env.default_validate_options(), &env);
+	Variable flag(Type::VAR);
+	cond->evaluate(&flag);
+	TEST_ASSERT(flag.bool_value() == true, "Expression::evaluate()");
+
+	delete expr;
+	delete cond;
+}
+
+TEST(test_program)
+{
+	Environment env;
+	ParsedFile file;
+
+	// int total = 0;
+	// int i = 0;
+	// func twice = $() { return args[0] * 2; };
+	// while (i < 10) {
+	//     i++;
+	//     if (i == 3) continue;
+	//     if (i == 8) break;
+	//     total += twice(i);
+	// }
+	file.add_statement(define(Type::INT, "total", num(0)));
+	file.add_statement(define(Type::INT, "i", num(0)));
+	file.add_statement(define(Type::FUNC, "twice", function(block(
+	    new ReturnStatement(here(), binop(BinaryExpression::OP_MUL,
+	        subscript(ref("args"), 0), num(2)))))));
+	Statement *body = block(
+	    eval(new UnaryExpression(here(), UnaryExpression::OP_POSTINC,
+	        ref("i"))),
+	    new ConditionalStatement(here(),
+	        binop(BinaryExpression::OP_EQ, ref("i"), num(3)),
+	        jump("@loop_continue")),
+	    new ConditionalStatement(here(),
+	        binop(BinaryExpression::OP_EQ, ref("i"), num(8)),
+	        jump("@loop_break")),
+	    eval(binop(BinaryExpression::OP_ADD_ASSIGN, ref("total"),
+	        call(ref("twice"), ref("i")))));
+	file.add_statement(block(
+	    labeled("@loop_continue", new WhileLoopStatement(here(),
+	        binop(BinaryExpression::OP_LT, ref("i"), num(10)), body)),
+	    labeled("@loop_break", new EmptyStatement(here()))));
+
+	// func quad = $() { return twice(twice(args[0])); };
+	// int q = quad(5);
+	file.add_statement(define(Type::FUNC, "quad", function(block(
+	    new ReturnStatement(here(), call(ref("twice"),
+	        call(ref("twice"), subscript(ref("args"), 0))))))));
+	file.add_statement(define(Type::INT, "q", call(ref("quad"), num(5))));
+
+	// list<int> l = [1, 2, 3];
+	// l[1] = 7;
+	// int sum = l[0] + l[1] + l[2];
+	Type list_type(Type::LIST);
+	list_type.add_argument(Type::INT);
+	ArgumentList *members = new ArgumentList();
+	members->push_back(new Argument(here(), num(1)));
+	members->push_back(new Argument(here(), num(2)));
+	members->push_back(new Argument(here(), num(3)));
+	file.add_statement(define(list_type, "l",
+	    new TupleLiteralExpression(here(), members)));
+	file.add_statement(eval(binop(BinaryExpression::OP_ASSIGN,
+	    subscript(ref("l"), 1), num(7))));
+	file.add_statement(define(Type::INT, "sum",
+	    binop(BinaryExpression::OP_ADD,
+	        binop(BinaryExpression::OP_ADD, subscript(ref("l"), 0),
+	              subscript(ref("l"), 1)),
+	        subscript(ref("l"), 2))));
+
+	// list<int> m = l;
+	// l[2] = 9;
+	// int l2 = l[2];
+	// int m2 = m[2];
+	file.add_statement(define(list_type, "m", ref("l")));
+	file.add_statement(eval(binop(BinaryExpression::OP_ASSIGN,
+	    subscript(ref("l"), 2), num(9))));
+	file.add_statement(define(Type::INT, "l2", subscript(ref("l"), 2)));
+	file.add_statement(define(Type::INT, "m2", subscript(ref("m"), 2)));
+
+	// list<int> n = m;
+	// int n0 = n[0];
+	// list<int> p = m;
+	// p[0] += 5;
+	// int p0 = p[0];
+	// int m0 = m[0];
+	file.add_statement(define(list_type, "n", ref("m")));
+	file.add_statement(define(Type::INT, "n0", subscript(ref("n"), 0)));
+	file.add_statement(define(list_type, "p", ref("m")));
+	file.add_statement(eval(binop(BinaryExpression::OP_ADD_ASSIGN,
+	    subscript(ref("p"), 0), num(5))));
+	file.add_statement(define(Type::INT, "p0", subscript(ref("p"), 0)));
+	file.add_statement(define(Type::INT, "m0", subscript(ref("m"), 0)));
+
+	// switch (total) { case 50: total = 1; break; default: total = 2; }
+	file.add_statement(new SwitchStatement(here(), ref("total"), block(
+	    new CaseStatement(here(), num(50), eval(binop(
+	        BinaryExpression::OP_ASSIGN, ref("total"), num(1)))),
+	    jump("@loop_break"),
+	    labeled("@switch_default", eval(binop(
+	        BinaryExpression::OP_ASSIGN, ref("total"), num(2)))))));
+
+	Vm *vm = NULL;
+	run_file(&env, &file, &vm);
+	TEST_ASSERT(global_is(*vm, "i", 8), "Vm::run()");
+	TEST_ASSERT(global_is(*vm, "total", 1))
+	    << "Vm::run(): " << vm->global("total")->int_value();
+	TEST_ASSERT(global_is(*vm, "q", 20), "Vm::run()");
+	TEST_ASSERT(global_is(*vm, "sum", 11), "Vm::run()");
+	TEST_ASSERT(global_is(*vm, "l2", 9), "Vm::run()");
+	TEST_ASSERT(global_is(*vm, "m2", 3), "Vm::run()");
+	TEST_ASSERT(vm->global("l")->type().primitive() == Type::LIST,
+	    "Vm::run()");
+	// reading a member leaves the list shared, writing one does not
+	TEST_ASSERT(global_is(*vm, "n0", 1), "Vm::run()");
+	TEST_ASSERT(&vm->global("n")->list_value()
+	            == &vm->global("m")->list_value(), "Vm::run()");
+	TEST_ASSERT(global_is(*vm, "p0", 6) && global_is(*vm, "m0", 1),
+	    "Vm::run()");
+	TEST_ASSERT(&vm->global("p")->list_value()
+	            != &vm->global("m")->list_value(), "Vm::run()");
+	delete vm;
+}
+
+TEST(test_temporaries)
+{
+	Environment env;
+	ParsedFile file;
+
+	// int t = 0;
+	// int i = 0;
+	// while (i < 100) { t = t + i * 3 - 1; i++; }
+	file.add_statement(define(Type::INT, "t", num(0)));
+	file.add_statement(define(Type::INT, "i", num(0)));
+	file.add_statement(new WhileLoopStatement(here(),
+	    binop(BinaryExpression::OP_LT, ref("i"), num(100)), block(
+	    eval(binop(BinaryExpression::OP_ASSIGN, ref("t"),
+	        binop(BinaryExpression::OP_SUB,
+	            binop(BinaryExpression::OP_ADD, ref("t"),
+	                binop(BinaryExpression::OP_MUL, ref("i"), num(3))),
+	            num(1)))),
+	    eval(new UnaryExpression(here(), UnaryExpression::OP_POSTINC,
+	        ref("i"))))));
+
+	// A register which held a list member must not have the member
+	// overwritten when it is reused for a result.
+	// list<int> l = [1, 2];
+	// list<int> k = l;
+	// int a = l[0];
+	// int b = a * 3;
+	Type list_type(Type::LIST);
+	list_type.add_argument(Type::INT);
+	ArgumentList *members = new ArgumentList();
+	members->push_back(new Argument(here(), num(1)));
+	members->push_back(new Argument(here(), num(2)));
+	file.add_statement(define(list_type, "l",
+	    new TupleLiteralExpression(here(), members)));
+	file.add_statement(define(list_type, "k", ref("l")));
+	file.add_statement(define(Type::INT, "a", subscript(ref("l"), 0)));
+	file.add_statement(define(Type::INT, "b",
+	    binop(BinaryExpression::OP_MUL, ref("a"), num(3))));
+	file.add_statement(define(Type::INT, "l0", subscript(ref("l"), 0)));
+	file.add_statement(define(Type::INT, "k0", subscript(ref("k"), 0)));
+
+	Vm *vm = NULL;
+	run_file(&env, &file, &vm);
+	TEST_ASSERT(global_is(*vm, "i", 100) && global_is(*vm, "t", 14750))
+	    << "Vm::run(): " << vm->global("t")->int_value();
+	TEST_ASSERT(global_is(*vm, "b", 3), "Vm::run()");
+	TEST_ASSERT(global_is(*vm, "l0", 1) && global_is(*vm, "k0", 1))
+	    << "Vm::run(): " << vm->global("l0")->int_value();
+	delete vm;
+}
+
+TEST(test_errors)
+{
+	// int zero = 0;
+	// int bad = 1 / zero;
+	{
+		Environment env;
+		ParsedFile file;
+		file.add_statement(define(Type::INT, "zero", num(0)));
+		file.add_statement(define(Type::INT, "bad",
+		    binop(BinaryExpression::OP_DIV, num(1), ref("zero"))));
+		Vm *vm = NULL;
+		try {
+			run_file(&env, &file, &vm);
+			TEST_FAIL("Vm::run()");
+		} catch (RuntimeError &e) {
+			TEST_ASSERT(string(e.what()).find("division by zero")
+			            != string::npos)
+			    << "Vm::run(): " << e.what();
+		}
+		delete vm;
+	}
+
+	// var v = "string";
+	// int i = v;
+	{
+		Environment env;
+		ParsedFile file;
+		file.add_statement(define(Type::VAR, "v",
+		    new StringLiteralExpression(here(), "string")));
+		file.add_statement(define(Type::INT, "i", ref("v")));
+		Vm *vm = NULL;
+		try {
+			run_file(&env, &file, &vm);
+			TEST_FAIL("Vm::run()");
+		} catch (RuntimeError &e) {
+		}
+		delete vm;
+	}
+
+	// goto a label that does not exist
+	{
+		Environment env;
+		ParsedFile file;
+		file.add_statement(jump("nowhere"));
+		Vm *vm = NULL;
+		try {
+			run_file(&env, &file, &vm);
+			TEST_FAIL("Compiler::finish()");
+		} catch (LanguageError &e) {
+		}
+		delete vm;
+	}
+}
+
+// Get the initializer of the first definition in a statement.
+static Expression *
+initializer_of(Statement *stmt)
+{
+	return dynamic_cast<DefinitionStatement*>(stmt)->vars()[0]->initializer();
+}
+
+static bool
+is_int_literal(Expression *expr, int value)
+{
+	IntLiteralExpression *literal = dynamic_cast<IntLiteralExpression*>(expr);
+	return literal && literal->value()->int_value() == value;
+}
+
+TEST(test_fold_constants)
+{
+	// const int base = 0x100;
+	// int addr = base + (1 << 2);
+	// int x = 0;
+	// if (base > 0x200) x = 1; else x = 2;
+	// int y = (base == 0x100) ? x : 99;
+	// while (false) { x = 3; }
+	// if (false) { lbl: x = 4; }
+	{
+		Environment env;
+		ParsedFile file;
+		file.add_statement(define(Type(Type::INT, Type::CONST), "base",
+		    num(0x100)));
+		file.add_statement(define(Type::INT, "addr",
+		    binop(BinaryExpression::OP_ADD, ref("base"),
+		        binop(BinaryExpression::OP_SHL, num(1), num(2)))));
+		file.add_statement(define(Type::INT, "x", num(0)));
+		ConditionalStatement *dead_if = new ConditionalStatement(here(),
+		    binop(BinaryExpression::OP_GT, ref("base"), num(0x200)),
+		    eval(binop(BinaryExpression::OP_ASSIGN, ref("x"), num(1))),
+		    eval(binop(BinaryExpression::OP_ASSIGN, ref("x"), num(2))));
+		file.add_statement(dead_if);
+		file.add_statement(define(Type::INT, "y", new ConditionalExpression(
+		    here(), binop(BinaryExpression::OP_EQ, ref("base"), num(0x100)),
+		    ref("x"), num(99))));
+		WhileLoopStatement *dead_loop = new WhileLoopStatement(here(),
+		    new BoolLiteralExpression(here(), false),
+		    block(eval(binop(BinaryExpression::OP_ASSIGN, ref("x"), num(3)))));
+		file.add_statement(dead_loop);
+		ConditionalStatement *labeled_if = new ConditionalStatement(here(),
+		    new BoolLiteralExpression(here(), false),
+		    block(labeled("lbl", eval(binop(BinaryExpression::OP_ASSIGN,
+		        ref("x"), num(4))))));
+		file.add_statement(labeled_if);
+
+		Vm *vm = NULL;
+		run_file(&env, &file, &vm, true);
+		TEST_ASSERT(is_int_literal(initializer_of(file.statement(1)), 0x104),
+		    "Expression::fold_constants()");
+		TEST_ASSERT(dynamic_cast<EmptyStatement*>(dead_if->true_case()),
+		    "Statement::fold_constants()");
+		TEST_ASSERT(dynamic_cast<EmptyStatement*>(dead_loop->body()),
+		    "Statement::fold_constants()");
+		TEST_ASSERT(dynamic_cast<CompoundStatement*>(labeled_if->true_case()),
+		    "Statement::fold_constants()");
+		TEST_ASSERT(global_is(*vm, "addr", 0x104), "Vm::run()");
+		TEST_ASSERT(global_is(*vm, "x", 2), "Vm::run()");
+		TEST_ASSERT(global_is(*vm, "y", 2), "Vm::run()");
+		delete vm;
+	}
+
+	// int x = 0;
+	// goto lbl;
+	// x = 1;
+	// if (false) { lbl: x += 5; }
+	// x += 10;
+	{
+		Environment env;
+		ParsedFile file;
+		file.add_statement(define(Type::INT, "x", num(0)));
+		file.add_statement(jump("lbl"));
+		file.add_statement(eval(binop(BinaryExpression::OP_ASSIGN,
+		    ref("x"), num(1))));
+		file.add_statement(new ConditionalStatement(here(),
+		    new BoolLiteralExpression(here(), false),
+		    block(labeled("lbl", eval(binop(
+		        BinaryExpression::OP_ADD_ASSIGN, ref("x"), num(5)))))));
+		file.add_statement(eval(binop(BinaryExpression::OP_ADD_ASSIGN,
+		    ref("x"), num(10))));
+
+		// the branch is kept, compiled, and reached only by the goto
+		Vm *vm = NULL;
+		run_file(&env, &file, &vm, true);
+		TEST_ASSERT(global_is(*vm, "x", 15))
+		    << "Compiler::compile_conditional(): "
+		    << vm->global("x")->int_value();
+		delete vm;
+	}
+
+	// int bad = 1 / 0;
+	{
+		Environment env;
+		ParsedFile file;
+		file.add_statement(define(Type::INT, "bad",
+		    binop(BinaryExpression::OP_DIV, num(1), num(0))));
+		Vm *vm = NULL;
+		try {
+			run_file(&env, &file, &vm, true);
+			TEST_FAIL("Vm::run()");
+		} catch (RuntimeError &e) {
+			// Errors are not folded away.
+		}
+		delete vm;
+	}
+}
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
@@ -25,7 +25,7 @@ Variable::Datum::Datum(const Type &type) : m_type(type), m_type_locked(true)
 		m_list_value.reset(new List());
 		break;
 	  case Type::STRING:
-		m_string_value = "";
+		m_string_value.reset(new string());
 		break;
 	  case Type::TUPLE:
 		m_tuple_value.reset(new Tuple());
@@ -39,7 +39,7 @@ Variable::Datum::Datum(const Type &type) : m_type(type), m_type_locked(true)
 	}
 }
 
-// Make a deep-copy of another Datum.
+// Make a copy of another Datum, sharing any list, tuple or string.
 Variable::Datum::Datum(const Datum &other)
     : m_type(other.type()), m_type_locked(true)
 {
@@ -58,17 +58,16 @@ Variable::Datum::Datum(const Datum &other)
 		m_int_value = other.int_value();
 		break;
 	  case Type::LIST:
-		// deep copy
-		m_list_value.reset(
-		    new List(other.list_value()));
+		// copy on write
+		m_list_value = other.m_list_value;
 		break;
 	  case Type::STRING:
-		m_string_value = other.string_value();
+		// strings are immutable
+		m_string_value = other.m_string_value;
 		break;
 	  case Type::TUPLE:
-		// deep copy
-		m_tuple_value.reset(
-		    new Tuple(other.tuple_value()));
+		// copy on write
+		m_tuple_value = other.m_tuple_value;
 		break;
 	  case Type::VAR:
 		m_type_locked = false;
@@ -137,7 +136,11 @@ Variable::Datum::Datum(const Type &type, const List *value)
 		    "can't init value of type '%s' as list",
 		    m_type.to_string()));
 	}
-	// Validate that the new actual-types are OK for this list.
+	// Validate that the new actual-types are OK for this list.  A list
+	// with no type-arg is a list<var>.
+	if (m_type.n_arguments() == 0) {
+		m_type.add_argument(Type::VAR);
+	}
 	const Type &spec_type = m_type.argument(0);
 	const List::Contents &vars = value->contents();
 	for (size_t i = 0; i < vars.size(); i++) {
@@ -165,7 +168,7 @@ Variable::Datum::Datum(const Type &type, const string &value)
 		    "can't init value of type '%s' as string",
 		    m_type.to_string()));
 	}
-	m_string_value = value;
+	m_string_value.reset(new string(value));
 }
 
 // Initialize as tuple.
@@ -174,17 +177,19 @@ Variable::Datum::Datum(const Type &type, const Tuple *value)
 {
 	if (m_type.primitive() == Type::VAR) {
 		m_type_locked = false;
-		m_type.reinit(Type::LIST);
+		m_type.reinit(Type::TUPLE);
 	}
 	if (m_type.primitive() != Type::TUPLE) {
 		throw TypeError(sprintfxx(
-		    "can't init value of type '%s' as list",
+		    "can't init value of type '%s' as tuple",
 		    m_type.to_string()));
 	}
-	// Validate that the new actual-types are OK for this list.
-	const Type &spec_type = m_type.argument(0);
+	// Validate that the new actual-types are OK for this tuple.  Each
+	// member has its own type-arg.  A tuple with no type-args can hold
+	// anything.
 	const Tuple::Contents &vars = value->contents();
-	for (size_t i = 0; i < vars.size(); i++) {
+	for (size_t i = 0; i < vars.size() && i < m_type.n_arguments(); i++) {
+		const Type &spec_type = m_type.argument(i);
 		const Type &actual_type = vars[i]->type();
 		if (!spec_type.is_assignable_from(actual_type)) {
 			throw TypeError(sprintfxx(
@@ -196,6 +201,42 @@ Variable::Datum::Datum(const Type &type, const Tuple *value)
 	m_tuple_value.reset(value);
 }
 
+void
+Variable::Datum::unshare()
+{
+	// The Container copy constructor gives each member its own Datum.
+	if (m_type.primitive() == Type::LIST && !m_list_value.unique()) {
+		m_list_value.reset(new List(*m_list_value));
+	} else if (m_type.primitive() == Type::TUPLE
+	        && !m_tuple_value.unique()) {
+		m_tuple_value.reset(new Tuple(*m_tuple_value));
+	}
+}
+
+void
+Variable::Datum::reset(const Value &value)
+{
+	m_type.reinit(Type::INT);
+	m_type_locked = true;
+	m_func_value.reset();
+	m_list_value.reset();
+	m_tuple_value.reset();
+	m_string_value.reset();
+	m_int_value = value;
+}
+
+void
+Variable::Datum::reset(bool value)
+{
+	m_type.reinit(Type::BOOL);
+	m_type_locked = true;
+	m_func_value.reset();
+	m_list_value.reset();
+	m_tuple_value.reset();
+	m_string_value.reset();
+	m_bool_value = value;
+}
+
 void
 Variable::Datum::check_type_primitive(Type::Primitive primitive) const
 {
@@ -3,6 +3,7 @@
 
 #include "hwpp.h"
 #include <string>
+#include <vector>
 #include <boost/smart_ptr.hpp>
 #include "type.h"
 
@@ -30,8 +31,10 @@ class Variable {
 		{
 		}
 
-		//FIXME: need args;
-		virtual Variable *call() = 0;
+		// Call the function.  Returns a new Variable, which the caller
+		// owns, or NULL if there is no result.
+		virtual Variable *
+		call(const std::vector<Variable*> &args) const = 0;
 	};
 	class Container {
 	 public:
@@ -41,10 +44,13 @@ class Variable {
 		}
 		Container(const Container &other) : m_contents()
 		{
-			// Do a deep-copy.
+			// Each member gets its own Variable and Datum, so writing
+			// to a member of one copy can't show through in another.
+			// The members' own payloads are still shared until they
+			// are written.
 			const Contents &old = other.contents();
 			for (size_t i = 0; i < old.size(); i++) {
-				m_contents.push_back(new Variable(*(old[i])));
+				m_contents.push_back(old[i]->copy());
 			}
 		}
 		~Container()
@@ -84,13 +90,20 @@ class Variable {
 
 	// This represents the actual contents of a Variable.  This has no
 	// concept of type qualifiers like 'const'.
+	//
+	// Lists, tuples and strings are reference-counted, and copying a Datum
+	// shares them, so copies cost the same no matter how big the value is.
+	// The only way to change a shared payload is through the members of a
+	// list or tuple, so anyone who writes to a member must call unshare()
+	// on the Datum first.
 	class Datum {
 	 public:
 		// Initialize to the default value for a given type.  This
 		// takes ownership of the 'type' argument.
 		explicit
 		Datum(const Type &type);
-		// Make a deep-copy of another Datum.
+		// Make a copy of another Datum.  This shares the payload of
+		// lists, tuples and strings.
 		Datum(const Datum &other);
 		// Initialize a specific type with a given value.
 		Datum(const Type &type, bool value);
@@ -156,7 +169,7 @@ class Variable {
 		string_value() const
 		{
 			check_type_primitive(Type::STRING);
-			return m_string_value;
+			return *m_string_value;
 		}
 
 		// Access this value as a tuple.  Throws Variable::TypeError
@@ -177,6 +190,19 @@ class Variable {
 			return (m_type.primitive() == Type::VAR);
 		}
 
+		// Make sure the list or tuple in this Datum is not shared
+		// with any other Datum, copying it if needed, so its members
+		// can be written.  This does nothing for other types.
+		void
+		unshare();
+
+		// Make this an int or bool Datum with a new value, as if it
+		// had just been constructed.
+		void
+		reset(const Value &value);
+		void
+		reset(bool value);
+
 	 private:
 		void operator=(const Datum &)
 		{
@@ -186,7 +212,7 @@ class Variable {
 		class UndefFunc : public Func {
 		 public:
 			virtual Variable *
-			call() {
+			call(const std::vector<Variable*> &) const {
 				return new Variable(Type::VAR);
 			}
 		};
@@ -204,9 +230,10 @@ class Variable {
 		bool m_bool_value;
 		boost::shared_ptr<const Func> m_func_value;
 		Value m_int_value;
-		boost::scoped_ptr<const List> m_list_value;
-		boost::scoped_ptr<const Tuple> m_tuple_value;
-		string m_string_value;
+		// These are shared between copies.
+		boost::shared_ptr<const List> m_list_value;
+		boost::shared_ptr<const Tuple> m_tuple_value;
+		boost::shared_ptr<const string> m_string_value;
 	};
 
 	// Initialize to the default value for a given type.
@@ -290,6 +317,15 @@ class Variable {
 		return m_value.get();
 	}
 
+	// Make a new Variable with its own copy of this value, and the same
+	// constness.  The caller owns the result.  This is cheap, since lists,
+	// tuples and strings are shared until written.
+	Variable *
+	copy() const
+	{
+		return new Variable(new Datum(*m_value), m_is_const);
+	}
+
 	bool
 	is_const() const
 	{
@@ -363,7 +399,43 @@ class Variable {
 		return m_value->tuple_value();
 	}
 
+	// Make sure the members of this list or tuple are not shared with
+	// any other value.  Call this before writing to a member.  Variables
+	// which reference this one see the change too.
+	void
+	unshare_members()
+	{
+		m_value->unshare();
+	}
+
+	// Give this variable a new int or bool value and type in place,
+	// rather than allocating a new Variable.  This only works if nothing
+	// else refers to the value, and returns false if something does.
+	bool
+	overwrite(const Value &value)
+	{
+		if (m_is_const || !m_value.unique()) {
+			return false;
+		}
+		m_value->reset(value);
+		return true;
+	}
+	bool
+	overwrite(bool value)
+	{
+		if (m_is_const || !m_value.unique()) {
+			return false;
+		}
+		m_value->reset(value);
+		return true;
+	}
+
  private:
+	Variable(Datum *value, bool is_const)
+	    : m_value(value), m_is_const(is_const)
+	{
+	}
+
 	// This is shared_ptr rather than scoped_ptr for reference semantics.
 	boost::shared_ptr<Datum> m_value;
 	bool m_is_const;
@@ -0,0 +1,571 @@
+#include "language/vm.h"
+
+#include "hwpp.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "language/bytecode.h"
+#include "language/errors.h"
+#include "language/type.h"
+#include "language/variable.h"
+
+namespace hwpp {
+namespace language {
+
+using bytecode::Function;
+using bytecode::Instruction;
+using bytecode::VarPtr;
+
+// Something went wrong while running an instruction.  This gets turned
+// into a RuntimeError with the position of the instruction.
+struct Fault: public std::runtime_error
+{
+	explicit
+	Fault(const string &str) : runtime_error(str)
+	{
+	}
+};
+
+// A function value made by OP_FUNC.
+class Vm::CompiledFunc : public Variable::Func {
+ public:
+	CompiledFunc(Vm *vm, size_t index) : m_vm(vm), m_index(index)
+	{
+	}
+
+	virtual Variable *
+	call(const std::vector<Variable*> &args) const;
+
+	Vm *
+	vm() const
+	{
+		return m_vm;
+	}
+
+	size_t
+	index() const
+	{
+		return m_index;
+	}
+
+ private:
+	Vm *m_vm;
+	size_t m_index;
+};
+
+// Make a copy of the value in a variable, as a new non-const variable.
+static VarPtr
+copy_value(const Variable &src)
+{
+	VarPtr copy(new Variable(Type::VAR));
+	copy->assign_from(src);
+	return copy;
+}
+
+// Make the 'args' list for a call.  Arguments are passed by value.
+static VarPtr
+make_args(const std::vector<Variable*> &args)
+{
+	Type type(Type::LIST);
+	type.add_argument(Type::VAR);
+	Variable::List *list = new Variable::List();
+	for (size_t i = 0; i < args.size(); i++) {
+		list->append(new Variable(*copy_value(*args[i])));
+	}
+	return VarPtr(new Variable(type, list));
+}
+
+Variable *
+Vm::CompiledFunc::call(const std::vector<Variable*> &args) const
+{
+	VarPtr result = m_vm->execute(m_index, make_args(args));
+	return new Variable(*result);
+}
+
+// The same type without const, all the way down.  Literals give their
+// const-ness to the type-args of things like "list l = [ 1, 2 ];".
+static Type
+bare_type(const Type &type)
+{
+	Type bare(type.primitive());
+	for (size_t i = 0; i < type.n_arguments(); i++) {
+		bare.add_argument(bare_type(type.argument(i)));
+	}
+	return bare;
+}
+
+// Store a value into a variable which was defined with type 'spec'.  This
+// is where assignments from 'var' are checked, and where tuples become
+// lists.
+static void
+store(Variable *dst, const Type &spec, const Variable &src)
+{
+	if (dst->is_const()) {
+		throw Fault("can't write to a const variable");
+	}
+	if (spec.primitive() == Type::VAR) {
+		dst->assign_from(src);
+		return;
+	}
+	if (src.value()->is_undef()) {
+		throw Fault(sprintfxx("can't assign '%s' from an undefined value",
+		                      spec.to_string()));
+	}
+	if (!spec.is_initializable_from(src.type())) {
+		throw Fault(sprintfxx("can't assign '%s' from '%s'",
+		                      spec.to_string(), src.type().to_string()));
+	}
+
+	if (spec.primitive() == Type::LIST
+	 && src.type().primitive() == Type::TUPLE) {
+		Variable::List *list = new Variable::List();
+		const Variable::Tuple::Contents &members =
+		    src.tuple_value().contents();
+		for (size_t i = 0; i < members.size(); i++) {
+			list->append(new Variable(*copy_value(*members[i])));
+		}
+		Variable converted(bare_type(spec), list);
+		dst->assign_from(converted);
+		return;
+	}
+	dst->assign_from(src);
+}
+
+static const Variable::Container &
+container_value(const Variable &var)
+{
+	if (var.type().primitive() == Type::TUPLE) {
+		return var.tuple_value();
+	}
+	return var.list_value();
+}
+
+static bool
+is_container(const Variable &var)
+{
+	Type::Primitive prim = var.type().primitive();
+	return (prim == Type::LIST || prim == Type::TUPLE);
+}
+
+static bool
+values_equal(const Variable &lhs, const Variable &rhs)
+{
+	if (is_container(lhs) && is_container(rhs)) {
+		const Variable::Container::Contents &l =
+		    container_value(lhs).contents();
+		const Variable::Container::Contents &r =
+		    container_value(rhs).contents();
+		if (l.size() != r.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < l.size(); i++) {
+			if (!values_equal(*l[i], *r[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	Type::Primitive prim = lhs.type().primitive();
+	if (prim != rhs.type().primitive()) {
+		throw Fault(sprintfxx("can't compare '%s' to '%s'",
+		                      lhs.type().to_string(),
+		                      rhs.type().to_string()));
+	}
+	switch (prim) {
+	 case Type::BOOL:
+		return lhs.bool_value() == rhs.bool_value();
+	 case Type::FUNC:
+		return lhs.func_value() == rhs.func_value();
+	 case Type::INT:
+		return lhs.int_value() == rhs.int_value();
+	 case Type::STRING:
+		return lhs.string_value() == rhs.string_value();
+	 case Type::VAR:
+		// Both are undefined.
+		return true;
+	 default:
+		break;
+	}
+	throw Fault(sprintfxx("can't compare '%s'", lhs.type().to_string()));
+}
+
+// Registers hold NULL until they are written, which can only be seen when
+// a goto skips a definition.
+static inline Variable *
+defined(const VarPtr &reg)
+{
+	Variable *var = reg.get();
+	if (var == NULL) {
+		throw Fault("variable used before it was defined");
+	}
+	return var;
+}
+
+// Operators make their results with this deleter, which marks them as
+// temporaries.  Registers also hold members of lists and tuples (see
+// OP_SUBSCRIPT), which can look unshared but must never be overwritten.
+struct Temporary {
+	void
+	operator()(Variable *var) const
+	{
+		delete var;
+	}
+};
+
+// Write an operator's result to a register.  If the register holds the
+// only reference to an earlier temporary, that is overwritten in place,
+// which saves allocating a Variable, a Datum and a reference count.
+template<typename Tvalue>
+static inline void
+set_result(VarPtr *reg, Type::Primitive type, const Tvalue &value)
+{
+	if (reg->unique() && boost::get_deleter<Temporary>(*reg)
+	 && (*reg)->overwrite(value)) {
+		return;
+	}
+	reg->reset(new Variable(type, value), Temporary());
+}
+
+static inline void
+set_int(VarPtr *reg, const Value &value)
+{
+	set_result(reg, Type::INT, value);
+}
+
+static inline void
+set_bool(VarPtr *reg, bool value)
+{
+	set_result(reg, Type::BOOL, value);
+}
+
+const size_t Vm::MAX_CALL_DEPTH;
+
+Vm::Vm(const bytecode::ConstProgramPtr &program)
+    : m_program(program), m_globals(program->global_init), m_depth(0)
+{
+}
+
+VarPtr
+Vm::run()
+{
+	return execute(0, VarPtr());
+}
+
+VarPtr
+Vm::call(const Variable &func, const std::vector<Variable*> &args)
+{
+	const Variable::Func *f = func.func_value();
+	const CompiledFunc *compiled = dynamic_cast<const CompiledFunc*>(f);
+	if (compiled && compiled->vm() == this) {
+		return execute(compiled->index(), make_args(args));
+	}
+	Variable *result = f->call(args);
+	if (result == NULL) {
+		return VarPtr(new Variable(Type::VAR));
+	}
+	return VarPtr(result);
+}
+
+const Variable *
+Vm::global(const string &name) const
+{
+	const std::vector<string> &names = m_program->global_names;
+	for (size_t i = names.size(); i > 0; i--) {
+		if (names[i-1] == name) {
+			return m_globals[i-1].get();
+		}
+	}
+	return NULL;
+}
+
+// Release a frame, however execute() returns.
+class FrameGuard {
+ public:
+	FrameGuard(std::vector<VarPtr> *stack, size_t *depth)
+	    : m_stack(stack), m_base(stack->size()), m_depth(depth)
+	{
+		(*m_depth)++;
+	}
+	~FrameGuard()
+	{
+		m_stack->resize(m_base);
+		(*m_depth)--;
+	}
+
+	size_t
+	base() const
+	{
+		return m_base;
+	}
+
+ private:
+	std::vector<VarPtr> *m_stack;
+	size_t m_base;
+	size_t *m_depth;
+};
+
+VarPtr
+Vm::execute(size_t index, const VarPtr &args)
+{
+	const Function &fn = *m_program->functions[index];
+	if (m_depth >= MAX_CALL_DEPTH) {
+		throw RuntimeError(fn.position,
+		    sprintfxx("calls nested more than %d deep", MAX_CALL_DEPTH));
+	}
+
+	FrameGuard frame(&m_stack, &m_depth);
+	size_t base = frame.base();
+	m_stack.resize(base + fn.n_registers);
+	m_stack[base] = args;
+
+	// Frames live on a shared stack, which moves when a call grows it, so
+	// registers are always accessed by index.
+	#define REG(n)  m_stack[base + (n)]
+	#define GET(n)  defined(REG(n))
+
+	const std::vector<Instruction> &code = fn.code;
+	size_t pc = 0;
+	try {
+		while (pc < code.size()) {
+			const Instruction &in = code[pc];
+			pc++;
+
+			switch (in.op) {
+			 case bytecode::OP_NOP:
+				break;
+			 case bytecode::OP_LOADK:
+				REG(in.a) = m_program->constants[in.b];
+				break;
+			 case bytecode::OP_MOVE:
+				REG(in.a) = REG(in.b);
+				break;
+			 case bytecode::OP_COPY:
+				REG(in.a) = copy_value(*GET(in.b));
+				break;
+			 case bytecode::OP_GETGLOBAL:
+				if (!m_globals[in.b]) {
+					throw Fault(sprintfxx("'%s' used before it was defined",
+					    m_program->global_names[in.b]));
+				}
+				REG(in.a) = m_globals[in.b];
+				break;
+			 case bytecode::OP_DEFINE:
+			 case bytecode::OP_DEFGLOBAL: {
+				const Type &spec = m_program->types[in.b];
+				VarPtr var(new Variable(bare_type(spec)));
+				if (in.c != Instruction::NONE) {
+					store(var.get(), spec, *GET(in.c));
+				}
+				if (spec.is_const()) {
+					var.reset(new Variable(*var, Type::CONST));
+				}
+				if (in.op == bytecode::OP_DEFINE) {
+					REG(in.a) = var;
+				} else {
+					m_globals[in.a] = var;
+				}
+				break;
+			 }
+			 case bytecode::OP_ASSIGN:
+				store(GET(in.a), m_program->types[in.c], *GET(in.b));
+				break;
+			 case bytecode::OP_POS:
+				set_int(&REG(in.a), Value(GET(in.b)->int_value()));
+				break;
+			 case bytecode::OP_NEG:
+				set_int(&REG(in.a), Value(-GET(in.b)->int_value()));
+				break;
+			 case bytecode::OP_NOT:
+				set_bool(&REG(in.a), !GET(in.b)->bool_value());
+				break;
+			 case bytecode::OP_BITNOT:
+				set_int(&REG(in.a), Value(~GET(in.b)->int_value()));
+				break;
+			 case bytecode::OP_INC:
+			 case bytecode::OP_DEC: {
+				Variable *var = GET(in.a);
+				if (var->is_const()) {
+					throw Fault("can't write to a const variable");
+				}
+				Value v = var->int_value();
+				if (in.op == bytecode::OP_INC) {
+					v += 1;
+				} else {
+					v -= 1;
+				}
+				if (!var->overwrite(v)) {
+					var->assign_from(Variable(Type::INT, v));
+				}
+				break;
+			 }
+			 case bytecode::OP_MUL:
+				set_int(&REG(in.a), Value(GET(in.b)->int_value()
+				                        * GET(in.c)->int_value()));
+				break;
+			 case bytecode::OP_DIV:
+			 case bytecode::OP_MOD: {
+				const Value &lhs = GET(in.b)->int_value();
+				const Value &rhs = GET(in.c)->int_value();
+				if (rhs == 0) {
+					throw Fault("division by zero");
+				}
+				if (in.op == bytecode::OP_DIV) {
+					set_int(&REG(in.a), Value(lhs / rhs));
+				} else {
+					set_int(&REG(in.a), Value(lhs % rhs));
+				}
+				break;
+			 }
+			 case bytecode::OP_ADD:
+				set_int(&REG(in.a), Value(GET(in.b)->int_value()
+				                        + GET(in.c)->int_value()));
+				break;
+			 case bytecode::OP_SUB:
+				set_int(&REG(in.a), Value(GET(in.b)->int_value()
+				                        - GET(in.c)->int_value()));
+				break;
+			 case bytecode::OP_SHL:
+			 case bytecode::OP_SHR: {
+				const Value &lhs = GET(in.b)->int_value();
+				const Value &rhs = GET(in.c)->int_value();
+				if (rhs < 0) {
+					throw Fault("negative shift count");
+				}
+				if (in.op == bytecode::OP_SHL) {
+					set_int(&REG(in.a), Value(lhs << rhs));
+				} else {
+					set_int(&REG(in.a), Value(lhs >> rhs));
+				}
+				break;
+			 }
+			 case bytecode::OP_AND:
+				set_int(&REG(in.a), Value(GET(in.b)->int_value()
+				                        & GET(in.c)->int_value()));
+				break;
+			 case bytecode::OP_OR:
+				set_int(&REG(in.a), Value(GET(in.b)->int_value()
+				                        | GET(in.c)->int_value()));
+				break;
+			 case bytecode::OP_XOR:
+				set_int(&REG(in.a), Value(GET(in.b)->int_value()
+				                        ^ GET(in.c)->int_value()));
+				break;
+			 case bytecode::OP_EQ:
+				set_bool(&REG(in.a), values_equal(*GET(in.b), *GET(in.c)));
+				break;
+			 case bytecode::OP_NEQ:
+				set_bool(&REG(in.a), !values_equal(*GET(in.b), *GET(in.c)));
+				break;
+			 case bytecode::OP_LT:
+				set_bool(&REG(in.a), GET(in.b)->int_value()
+				                   < GET(in.c)->int_value());
+				break;
+			 case bytecode::OP_GT:
+				set_bool(&REG(in.a), GET(in.b)->int_value()
+				                   > GET(in.c)->int_value());
+				break;
+			 case bytecode::OP_LE:
+				set_bool(&REG(in.a), GET(in.b)->int_value()
+				                   <= GET(in.c)->int_value());
+				break;
+			 case bytecode::OP_GE:
+				set_bool(&REG(in.a), GET(in.b)->int_value()
+				                   >= GET(in.c)->int_value());
+				break;
+			 case bytecode::OP_JUMP:
+				pc = in.target();
+				break;
+			 case bytecode::OP_JUMP_IF_FALSE:
+				if (!GET(in.a)->bool_value()) {
+					pc = in.target();
+				}
+				break;
+			 case bytecode::OP_JUMP_IF_TRUE:
+				if (GET(in.a)->bool_value()) {
+					pc = in.target();
+				}
+				break;
+			 case bytecode::OP_SUBSCRIPT:
+			 case bytecode::OP_SUBSCRIPT_REF: {
+				Variable *container = GET(in.b);
+				if (!is_container(*container)) {
+					throw Fault(sprintfxx("can't subscript type '%s'",
+					                      container->type().to_string()));
+				}
+				// A member which is about to be written must not be
+				// shared with copies of the container.  This copies at
+				// most once per copy, however often it is written.
+				// Reads leave the members shared.
+				if (in.op == bytecode::OP_SUBSCRIPT_REF
+				 && !container->is_const()) {
+					container->unshare_members();
+				}
+				const Variable::Container::Contents &contents =
+				    container_value(*container).contents();
+				const Value &index = GET(in.c)->int_value();
+				if (index < 0 || index >= contents.size()) {
+					throw Fault(sprintfxx("index %s is out of range",
+					                      index.to_string()));
+				}
+				// The member belongs to the container's Datum, so
+				// hold a reference to that while the member is used.
+				VarPtr owner(new Variable(*container));
+				REG(in.a) = VarPtr(owner, contents[index.as_uint()]);
+				break;
+			 }
+			 case bytecode::OP_TUPLE: {
+				Type type(Type::TUPLE);
+				Variable::Tuple *tuple = new Variable::Tuple();
+				for (size_t i = 0; i < in.c; i++) {
+					const Variable &member = *GET(in.b + i);
+					tuple->append(new Variable(*copy_value(member)));
+					type.add_argument(member.type());
+				}
+				REG(in.a) = VarPtr(new Variable(type, tuple));
+				break;
+			 }
+			 case bytecode::OP_FUNC:
+				REG(in.a) = VarPtr(new Variable(Type::FUNC,
+				                   new CompiledFunc(this, in.b)));
+				break;
+			 case bytecode::OP_CALL: {
+				std::vector<Variable*> call_args;
+				for (size_t i = 0; i < in.c; i++) {
+					call_args.push_back(GET(in.b + 1 + i));
+				}
+				VarPtr result = call(*GET(in.b), call_args);
+				REG(in.a) = result;
+				break;
+			 }
+			 case bytecode::OP_RETURN:
+				if (in.a == Instruction::NONE) {
+					return VarPtr(new Variable(Type::VAR));
+				}
+				// Results are returned by value.
+				return copy_value(*GET(in.a));
+			 default:
+				throw Fault(sprintfxx("bad opcode %d", in.op));
+			}
+		}
+	} catch (Fault &e) {
+		throw RuntimeError(m_program->positions[fn.positions[pc-1]],
+		                   e.what());
+	} catch (Variable::TypeError &e) {
+		throw RuntimeError(m_program->positions[fn.positions[pc-1]],
+		                   e.what());
+	} catch (Type::Error &e) {
+		throw RuntimeError(m_program->positions[fn.positions[pc-1]],
+		                   e.what());
+	}
+
+	#undef GET
+	#undef REG
+
+	return VarPtr(new Variable(Type::VAR));
+}
+
+}  // namespace language
+}  // namespace hwpp
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
@@ -0,0 +1,65 @@
+// A register-based virtual machine which runs compiled bytecode.
+
+#ifndef HWPP_LANGUAGE_VM_H__
+#define HWPP_LANGUAGE_VM_H__
+
+#include "hwpp.h"
+#include <string>
+#include <vector>
+#include "language/bytecode.h"
+#include "language/variable.h"
+
+namespace hwpp {
+namespace language {
+
+// This runs a bytecode::Program.  Each call gets a frame of registers on
+// one shared stack, so calls do not allocate once the stack has grown.
+// Globals live as long as the Vm, and function values made by the program
+// refer back to it, so they must not be called after the Vm is destroyed.
+//
+// Errors while running throw RuntimeError, with the position of the code
+// that failed.
+class Vm {
+ public:
+	explicit
+	Vm(const bytecode::ConstProgramPtr &program);
+
+	// Run the top-level code of the program.  Returns the value it
+	// returned, or an undefined var.
+	bytecode::VarPtr
+	run();
+
+	// Call a function value, which may or may not come from this Vm.
+	bytecode::VarPtr
+	call(const Variable &func, const std::vector<Variable*> &args);
+
+	// Look up a global by name.  Returns NULL if there is no such global,
+	// or it has not been defined yet.
+	const Variable *
+	global(const string &name) const;
+
+	// The deepest that calls can nest.
+	static const size_t MAX_CALL_DEPTH = 1000;
+
+ private:
+	class CompiledFunc;
+
+	bytecode::VarPtr
+	execute(size_t function, const bytecode::VarPtr &args);
+
+	bytecode::ConstProgramPtr m_program;
+	std::vector<bytecode::VarPtr> m_globals;
+	std::vector<bytecode::VarPtr> m_stack;
+	size_t m_depth;
+
+	// Not copyable.
+	Vm(const Vm &);
+	void operator=(const Vm &);
+};
+
+}  // namespace language
+}  // namespace hwpp
+
+#endif  // HWPP_LANGUAGE_VM_H__
+
+// vim: set ai tabstop=4 shiftwidth=4 noexpandtab:
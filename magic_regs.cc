@@ -2,6 +2,8 @@
 #include "util/printfxx.h"
 #include "binding.h"
 #include "register_types.h"
+#include "driver.h"
+#include "snapshot.h"
 
 namespace hwpp {
 
@@ -47,6 +49,62 @@ class ConstantValueBinding: public Binding
 	Value m_value;
 };
 
+/*
+ * A binding which reads registers from a snapshot, rather than hardware.
+ */
+class SnapshotBinding: public Binding
+{
+    public:
+	SnapshotBinding(const ConstSnapshotPtr &snapshot, const string &name)
+	    : m_snapshot(snapshot), m_name(name),
+	      m_index(snapshot->find_binding(name))
+	{
+	}
+
+	virtual ~SnapshotBinding()
+	{
+	}
+
+	virtual Value
+	read(const Value &address, const BitWidth width) const
+	{
+		Value ret;
+		if (!m_snapshot->read(m_index, address, width, &ret)) {
+			throw Driver::IoError(sprintfxx(
+			    "%s: register 0x%x (%d bits) not in snapshot",
+			    m_name, address, width));
+		}
+		return ret;
+	}
+
+	virtual void
+	write(const Value &address, const BitWidth width,
+		const Value &value) const
+	{
+		(void)value;
+		throw Driver::IoError(sprintfxx(
+		    "%s: can not write register 0x%x (%d bits) in snapshot",
+		    m_name, address, width));
+	}
+
+	virtual string
+	to_string() const
+	{
+		return m_name;
+	}
+
+    private:
+	ConstSnapshotPtr m_snapshot;
+	string m_name;
+	int m_index;
+};
+
+BindingPtr
+new_snapshot_binding(const ConstSnapshotPtr &snapshot, const string &name)
+{
+	return BindingPtr(new SnapshotBinding(snapshot, name));
+}
+
 ConstRegisterPtr magic_zeros(new BoundRegister(
 		BindingPtr(new ConstantValueBinding(0)),
 		0x0, BIT_WIDTH_MAX));
@@ -0,0 +1,292 @@
+//
+// Find the dirents in a tree which match a glob pattern.
+//
+#include "hwpp.h"
+#include "query.h"
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "field.h"
+
+namespace hwpp {
+
+// Indexed by DirentType.
+static const char *type_names[] = {
+	"register",
+	"field",
+	"scope",
+	"array",
+	"alias",
+};
+
+static const unsigned all_types = (1U << DIRENT_TYPE_MAX) - 1;
+
+Query::Query(const string &pattern): m_types(all_types)
+{
+	size_t pos = 0;
+	// a leading '/' is allowed, but every pattern starts at the root
+	if (pattern.size() > 0 && pattern[0] == '/') {
+		pos = 1;
+	}
+	if (pattern.size() > 1 && pattern[pattern.size()-1] == '/') {
+		throw std::invalid_argument(
+		    "empty element in pattern: " + pattern);
+	}
+	while (pos < pattern.size()) {
+		size_t end = pattern.find('/', pos);
+		if (end == string::npos) {
+			end = pattern.size();
+		}
+		string str = pattern.substr(pos, end - pos);
+		pos = end + 1;
+		if (str.empty()) {
+			throw std::invalid_argument(
+			    "empty element in pattern: " + pattern);
+		}
+
+		Element elem;
+		elem.is_any_depth = false;
+		elem.index_mode = Element::INDEX_NONE;
+		elem.index = 0;
+		if (str == "**") {
+			// "**/**" is the same as "**"
+			if (!m_elements.empty()
+			 && m_elements.back().is_any_depth) {
+				continue;
+			}
+			elem.is_any_depth = true;
+			elem.is_glob = false;
+			m_elements.push_back(elem);
+			continue;
+		}
+
+		if (str[str.size()-1] == ']') {
+			size_t open = str.rfind('[');
+			string index = (open == string::npos) ? ""
+			    : str.substr(open + 1, str.size() - open - 2);
+			if (index == "*") {
+				elem.index_mode = Element::INDEX_ALL;
+			} else if (!index.empty() && isdigit(index[0])
+			        && index.find_first_not_of("0123456789")
+			           == string::npos) {
+				elem.index_mode = Element::INDEX_ONE;
+				elem.index = strtoul(index.c_str(), NULL, 10);
+			} else {
+				throw std::invalid_argument(
+				    "invalid array index in pattern: " + str);
+			}
+			str.erase(open);
+		}
+		if (str.empty()) {
+			throw std::invalid_argument(
+			    "missing name in pattern: " + pattern);
+		}
+		elem.name = str;
+		elem.is_glob = is_query(str) || str.find('[') != string::npos;
+		m_elements.push_back(elem);
+	}
+}
+
+void
+Query::set_types(const string &types)
+{
+	unsigned mask = 0;
+	size_t pos = 0;
+	while (pos < types.size()) {
+		size_t end = types.find_first_of(", ", pos);
+		if (end == string::npos) {
+			end = types.size();
+		}
+		string name = types.substr(pos, end - pos);
+		pos = end + 1;
+		if (name.empty()) {
+			continue;
+		}
+		unsigned i;
+		for (i = 0; i < DIRENT_TYPE_MAX; i++) {
+			if (strcasecmp(name.c_str(), type_names[i]) == 0) {
+				mask |= (1U << i);
+				break;
+			}
+		}
+		if (i == DIRENT_TYPE_MAX) {
+			throw std::invalid_argument(
+			    "unknown dirent type: " + name);
+		}
+	}
+	m_types = mask ? mask : all_types;
+}
+
+void
+Query::set_datatype(const string &name)
+{
+	m_datatype = name;
+}
+
+bool
+Query::is_query(const string &str)
+{
+	return (str.find_first_of("*?") != string::npos);
+}
+
+void
+Query::run(const ConstScopePtr &root, const Callback &callback) const
+{
+	util::PathBuffer path;
+	match(root, 0, &path, DatatypeSet(), callback);
+}
+
+// 'dirent' has matched the first 'elem' elements of the pattern.  Try to
+// match the rest.  'datatypes' are the datatypes which pass the datatype
+// filter, as seen from 'dirent'.
+void
+Query::match(const ConstDirentPtr &dirent, size_t elem,
+             util::PathBuffer *path, const DatatypeSet &datatypes,
+             const Callback &callback) const
+{
+	if (elem == m_elements.size()) {
+		if (wanted(dirent, datatypes)) {
+			callback(path->str(), dirent);
+		}
+		return;
+	}
+
+	const Element &element = m_elements[elem];
+	if (element.is_any_depth) {
+		match_any_depth(dirent, elem, path, datatypes, callback);
+		return;
+	}
+
+	// only scopes have named members
+	if (!dirent->is_scope()) {
+		return;
+	}
+	ConstScopePtr scope = scope_from_dirent(dirent);
+	DatatypeSet scope_datatypes(datatypes);
+	add_datatypes(scope, &scope_datatypes);
+
+	if (!element.is_glob) {
+		// look it up, rather than looking at every member
+		ConstDirentPtr member = scope->dirent(element.name);
+		if (member) {
+			size_t mark = path->push("/", element.name);
+			match_member(member, elem, path, scope_datatypes,
+			             callback);
+			path->pop(mark);
+		}
+		return;
+	}
+	for (size_t i = 0; i < scope->n_dirents(); i++) {
+		const string &name = scope->dirent_name(i);
+		if (fnmatch(element.name.c_str(), name.c_str(), 0) != 0) {
+			continue;
+		}
+		size_t mark = path->push("/", name);
+		match_member(scope->dirent(i), elem, path, scope_datatypes,
+		             callback);
+		path->pop(mark);
+	}
+}
+
+// 'member' is a scope member whose name matched element 'elem'.  Apply the
+// element's array index, if it has one, and match the rest.
+void
+Query::match_member(const ConstDirentPtr &member, size_t elem,
+                    util::PathBuffer *path, const DatatypeSet &datatypes,
+                    const Callback &callback) const
+{
+	const Element &element = m_elements[elem];
+	if (element.index_mode == Element::INDEX_NONE) {
+		match(member, elem + 1, path, datatypes, callback);
+		return;
+	}
+	if (!member->is_array()) {
+		return;
+	}
+
+	ConstArrayPtr array = array_from_dirent(member);
+	size_t begin = 0;
+	size_t end = array->size();
+	if (element.index_mode == Element::INDEX_ONE) {
+		if (element.index >= end) {
+			return;
+		}
+		begin = element.index;
+		end = begin + 1;
+	}
+	for (size_t i = begin; i < end; i++) {
+		size_t mark = path->push_index(i);
+		match(array->at(i), elem + 1, path, datatypes, callback);
+		path->pop(mark);
+	}
+}
+
+// Element 'elem' is "**": match the rest here, and at every depth below.
+void
+Query::match_any_depth(const ConstDirentPtr &dirent, size_t elem,
+                       util::PathBuffer *path, const DatatypeSet &datatypes,
+                       const Callback &callback) const
+{
+	match(dirent, elem + 1, path, datatypes, callback);
+
+	if (dirent->is_scope()) {
+		ConstScopePtr scope = scope_from_dirent(dirent);
+		DatatypeSet scope_datatypes(datatypes);
+		add_datatypes(scope, &scope_datatypes);
+		for (size_t i = 0; i < scope->n_dirents(); i++) {
+			size_t mark = path->push("/", scope->dirent_name(i));
+			match_any_depth(scope->dirent(i), elem, path,
+			                scope_datatypes, callback);
+			path->pop(mark);
+		}
+	} else if (dirent->is_array()) {
+		ConstArrayPtr array = array_from_dirent(dirent);
+		for (size_t i = 0; i < array->size(); i++) {
+			size_t mark = path->push_index(i);
+			match_any_depth(array->at(i), elem, path, datatypes,
+			                callback);
+			path->pop(mark);
+		}
+	}
+}
+
+bool
+Query::wanted(const ConstDirentPtr &dirent,
+              const DatatypeSet &datatypes) const
+{
+	if (!(m_types & (1U << dirent->dirent_type()))) {
+		return false;
+	}
+	if (m_datatype.empty()) {
+		return true;
+	}
+	if (!dirent->is_field()) {
+		return false;
+	}
+	const Datatype *dt = field_from_dirent(dirent)->datatype().get();
+	return (std::find(datatypes.begin(), datatypes.end(), dt)
+	        != datatypes.end());
+}
+
+// Add the datatypes named in 'scope' which pass the datatype filter.
+void
+Query::add_datatypes(const ConstScopePtr &scope,
+                     DatatypeSet *datatypes) const
+{
+	if (m_datatype.empty()) {
+		return;
+	}
+	for (size_t i = 0; i < scope->n_datatypes(); i++) {
+		if (fnmatch(m_datatype.c_str(),
+		            scope->datatype_name(i).c_str(), 0) == 0) {
+			datatypes->push_back(scope->datatype(i).get());
+		}
+	}
+}
+
+}  // namespace hwpp
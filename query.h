@@ -0,0 +1,137 @@
+#ifndef HWPP_QUERY_H__
+#define HWPP_QUERY_H__
+
+#include "hwpp.h"
+#include <vector>
+#include <boost/function.hpp>
+#include "dirent.h"
+#include "scope.h"
+#include "array.h"
+#include "util/output_buffer.h"
+
+namespace hwpp {
+
+//
+// Query - find the dirents in a tree which match a glob pattern.
+//
+// A pattern is a path, in which each element can be:
+//
+// 	name		a scope member, exactly as in a path
+// 	glob		scope members matching a shell glob, as in
+// 			fnmatch(3), such as "pci.*" or "%PCI.0?0"
+// 	name[N]		element N of an array member
+// 	glob[*]		every element of the matching array members
+// 	**		any number of scopes and array elements, including
+// 			none
+//
+// A pattern with more than one "**" can match a dirent more than once.
+//
+// For example, "pci.*/capability[*]/link" finds the link scope of every
+// capability of every PCI device.
+//
+// Matches can also be limited to some dirent types, and to fields of a
+// named datatype.  A datatype name is looked up from the field's scope
+// and the scopes above it, as the language does.  Fields with anonymous
+// datatypes never match a datatype filter.
+//
+// The walk only goes into scopes and arrays which can still match the
+// rest of the pattern, so lazy scopes elsewhere in the tree are never
+// built.  Nothing is read: that is left to the caller, for the dirents
+// which matched.  Aliases are matched, but not followed.
+//
+class Query
+{
+    public:
+	// called for each match, in tree order
+	typedef boost::function<void (const string &path,
+	                              const ConstDirentPtr &dirent)> Callback;
+
+	//
+	// Query::Query(pattern)
+	//
+	// Throws: std::invalid_argument
+	//
+	explicit
+	Query(const string &pattern);
+
+	//
+	// Query::set_types(types)
+	//
+	// Only match dirents of these types, as a list like
+	// "field,register".  The default is all types.
+	//
+	// Throws: std::invalid_argument
+	//
+	void
+	set_types(const string &types);
+
+	//
+	// Query::set_datatype(name)
+	//
+	// Only match fields of the named datatype.  The name is a glob.
+	//
+	void
+	set_datatype(const string &name);
+
+	//
+	// Query::run(root, callback)
+	//
+	// Walk the tree under 'root' and call 'callback' for each match.
+	// Paths are given as they are in hwpp_read.
+	//
+	void
+	run(const ConstScopePtr &root, const Callback &callback) const;
+
+	//
+	// is_query(str)
+	//
+	// Tell whether a string uses any glob syntax, and so must be run as
+	// a Query rather than looked up as a path.
+	//
+	static bool
+	is_query(const string &str);
+
+    private:
+	struct Element
+	{
+		enum index_mode {
+			INDEX_NONE = 0,	// a scope member
+			INDEX_ONE,	// one array element
+			INDEX_ALL,	// every array element
+		};
+
+		string name;
+		bool is_glob;
+		bool is_any_depth;
+		enum index_mode index_mode;
+		size_t index;
+	};
+	typedef std::vector<const Datatype *> DatatypeSet;
+
+	std::vector<Element> m_elements;
+	unsigned m_types;
+	string m_datatype;
+
+	void
+	match(const ConstDirentPtr &dirent, size_t elem,
+	      util::PathBuffer *path, const DatatypeSet &datatypes,
+	      const Callback &callback) const;
+	void
+	match_member(const ConstDirentPtr &member, size_t elem,
+	             util::PathBuffer *path, const DatatypeSet &datatypes,
+	             const Callback &callback) const;
+	void
+	match_any_depth(const ConstDirentPtr &dirent, size_t elem,
+	                util::PathBuffer *path, const DatatypeSet &datatypes,
+	                const Callback &callback) const;
+	bool
+	wanted(const ConstDirentPtr &dirent,
+	       const DatatypeSet &datatypes) const;
+	void
+	add_datatypes(const ConstScopePtr &scope,
+	              DatatypeSet *datatypes) const;
+};
+
+}  // namespace hwpp
+
+#endif // HWPP_QUERY_H__
@@ -5,6 +5,7 @@
 #include "hwpp.h"
 #include "util/printfxx.h"
 #include "register.h"
+#include <vector>
 
 namespace hwpp {
 
@@ -204,6 +205,40 @@ class RegBits
 		return result;
 	}
 
+	/*
+	 * RegBits::Range - one contiguous range of bits in one register.
+	 */
+	struct Range {
+		Range(const ConstRegisterPtr &r, unsigned hi, unsigned lo)
+		    : reg(r), hi_bit(hi), lo_bit(lo)
+		{
+		}
+		ConstRegisterPtr reg;
+		unsigned hi_bit;
+		unsigned lo_bit;
+	};
+
+	/*
+	 * RegBits::ranges(out)
+	 *
+	 * Append the register bit ranges that make up this regbits to
+	 * 'out', most significant bits first, so that concatenating them
+	 * in order gives the same result as read().
+	 */
+	void
+	ranges(std::vector<Range> *out) const
+	{
+		if (m_register) {
+			// simple
+			out->push_back(Range(m_register, m_hi_bit, m_lo_bit));
+		} else {
+			// complex (MSB first)
+			for (size_t i = 0; i < m_sub_bits.size(); i++) {
+				m_sub_bits[i].ranges(out);
+			}
+		}
+	}
+
     private:
 	// a simple regbits populates these
 	ConstRegisterPtr m_register;
@@ -38,6 +38,20 @@ class BoundRegister: public Register
 		return to_string(m_address);
 	}
 
+	/*
+	 * Get the binding and address of this register.
+	 */
+	const ConstBindingPtr &
+	binding() const
+	{
+		return m_binding;
+	}
+	const Value &
+	address() const
+	{
+		return m_address;
+	}
+
 	/*
 	 * Read the value of this register.
 	 *
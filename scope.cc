@@ -2,6 +2,7 @@
 #include "hwpp.h"
 #include "util/printfxx.h"
 #include "scope.h"
+#include "scope_template.h"
 #include <stdexcept>
 #include "path.h"
 #include "dirent.h"
@@ -71,12 +72,82 @@ Scope::is_bound() const
 	return m_binding ? true : false;
 }
 
+//
+// Make this a lazy scope.  The builder is called exactly once, the
+// first time the contents of this scope are looked up or iterated.
+//
+void
+Scope::set_builder(const Builder &builder)
+{
+	m_builder = builder;
+}
+
+//
+// Return a boolean indicating whether this scope's contents have
+// been built.
+//
+bool
+Scope::is_populated() const
+{
+	return m_builder.empty();
+}
+
+//
+// Give this scope the contents of a template.
+//
+void
+Scope::set_template(const ConstScopeTemplatePtr &tmpl)
+{
+	m_template = tmpl;
+	m_template_dirents.clear();
+	m_template_dirents.resize(tmpl->n_dirents());
+	m_template_scopes.clear();
+	for (size_t i = 0; i < tmpl->m_datatypes.size(); i++) {
+		m_datatypes.insert(tmpl->m_datatypes.key_at(i),
+		                   tmpl->m_datatypes.at(i));
+	}
+	for (size_t i = 0; i < tmpl->m_bookmarks.size(); i++) {
+		m_bookmarks.insert(std::make_pair(tmpl->m_bookmarks[i], 1));
+	}
+}
+
+// Run the builder, if there is one.  The builder is cleared before it
+// runs, so anything it does to this scope (add_dirent(), etc.) sees a
+// populated scope rather than recursing.  If the builder throws, whatever
+// it built is thrown away and the builder is put back, so the next lookup
+// tries again rather than seeing a partial scope.
+void
+Scope::populate() const
+{
+	if (m_builder.empty()) {
+		return;
+	}
+	DTRACE(TRACE_SCOPES, "populating lazy scope");
+	ScopePtr self = const_pointer_cast<Scope>(shared_from_this());
+	Builder builder;
+	builder.swap(m_builder);
+	try {
+		builder(self);
+	} catch (...) {
+		DTRACE(TRACE_SCOPES, "lazy scope builder failed");
+		self->m_dirents.clear();
+		self->m_datatypes.clear();
+		self->m_bookmarks.clear();
+		self->m_template.reset();
+		self->m_template_dirents.clear();
+		self->m_template_scopes.clear();
+		m_builder.swap(builder);
+		throw;
+	}
+}
+
 //
 // Add a named datatype to this scope.
 //
 void
 Scope::add_datatype(const string &name, const DatatypePtr &datatype)
 {
+	populate();
 	m_datatypes.insert(name, datatype);
 }
 
@@ -86,6 +157,7 @@ Scope::add_datatype(const string &name, const DatatypePtr &datatype)
 size_t
 Scope::n_datatypes() const
 {
+	populate();
 	return m_datatypes.size();
 }
 
@@ -95,6 +167,7 @@ Scope::n_datatypes() const
 ConstDatatypePtr
 Scope::datatype(int index) const
 {
+	populate();
 	ConstDatatypePtr dt;
 	util::KeyedVector<string, ConstDatatypePtr>::const_iterator it;
 	it = m_datatypes.find(index);
@@ -106,6 +179,7 @@ Scope::datatype(int index) const
 ConstDatatypePtr
 Scope::datatype(string index) const
 {
+	populate();
 	ConstDatatypePtr dt;
 	util::KeyedVector<string, ConstDatatypePtr>::const_iterator it;
 	it = m_datatypes.find(index);
@@ -121,6 +195,7 @@ Scope::datatype(string index) const
 string
 Scope::datatype_name(int index) const
 {
+	populate();
 	return m_datatypes.key_at(index);
 }
 
@@ -130,7 +205,7 @@ Scope::datatype_name(int index) const
 ConstDatatypePtr
 Scope::resolve_datatype(const string &name) const
 {
-	DTRACE(TRACE_TYPES && TRACE_SCOPES,
+	DTRACE(TRACE_TYPES | TRACE_SCOPES,
 		"trying to resolve type \"" + name + "\"");
 
 	// look for it in this scope
@@ -141,13 +216,13 @@ Scope::resolve_datatype(const string &name) const
 
 	// if not found in currrent scope fall through to parent scope
 	if (!is_root()) {
-		DTRACE(TRACE_TYPES && TRACE_SCOPES,
+		DTRACE(TRACE_TYPES | TRACE_SCOPES,
 			"type \"" + name
 			+ "\" not found, climbing scope");
 		return parent()->resolve_datatype(name);
 	}
 
-	DTRACE(TRACE_TYPES && TRACE_SCOPES,
+	DTRACE(TRACE_TYPES | TRACE_SCOPES,
 		"type \"" + name + "\" not found");
 	return ConstDatatypePtr();
 }
@@ -178,6 +253,13 @@ void
 Scope::add_dirent(const Path::Element &elem,
                      const DirentPtr &new_dirent)
 {
+	populate();
+	// the template's names can not be redefined
+	if (m_template && m_template->find(elem.name()) >= 0) {
+		throw Path::InvalidError(
+		    "dirent is defined by the scope's template: "
+		    + elem.to_string());
+	}
 	// is the element an array access?
 	if (elem.is_array()) {
 		// if so, we don't support direct indexed writes, just appends
@@ -210,15 +292,28 @@ Scope::add_dirent(const Path::Element &elem,
 size_t
 Scope::n_dirents() const
 {
-	return m_dirents.size();
+	populate();
+	size_t n = m_dirents.size();
+	if (m_template) {
+		n += m_template->n_dirents();
+	}
+	return n;
 }
 
 //
-// Provide access to the dirents vector.
+// Provide access to the dirents vector.  The dirents of a template come
+// before this scope's own.
 //
 DirentPtr
 Scope::dirent(int index)
 {
+	populate();
+	if (m_template && index >= 0) {
+		if (size_t(index) < m_template->n_dirents()) {
+			return template_dirent(index);
+		}
+		index -= m_template->n_dirents();
+	}
 	DirentPtr de;
 	util::KeyedVector<string, DirentPtr>::iterator it;
 	it = m_dirents.find(index);
@@ -230,6 +325,13 @@ Scope::dirent(int index)
 DirentPtr
 Scope::dirent(string index)
 {
+	populate();
+	if (m_template) {
+		int i = m_template->find(index);
+		if (i >= 0) {
+			return template_dirent(i);
+		}
+	}
 	DirentPtr de;
 	util::KeyedVector<string, DirentPtr>::iterator it;
 	it = m_dirents.find(index);
@@ -241,22 +343,28 @@ Scope::dirent(string index)
 ConstDirentPtr
 Scope::dirent(int index) const
 {
-	ConstDirentPtr de;
-	util::KeyedVector<string, DirentPtr>::const_iterator it
-	    = m_dirents.find(index);
-	if (it != m_dirents.end()) {
-		de = *it;
-	}
-	return de;
+	return const_cast<Scope *>(this)->dirent(index);
 }
 ConstDirentPtr
 Scope::dirent(string index) const
 {
-	ConstDirentPtr de;
-	util::KeyedVector<string, DirentPtr>::const_iterator it
-	    = m_dirents.find(index);
-	if (it != m_dirents.end()) {
-		de = *it;
+	return const_cast<Scope *>(this)->dirent(index);
+}
+
+// A templated dirent is made again if nothing holds the last one, so
+// lookups return the same object while it is in use, without this scope
+// keeping every register and field it has ever made.  Sub-scopes are made
+// once and kept, so they stay alive as long as their parent.
+DirentPtr
+Scope::template_dirent(size_t index)
+{
+	DirentPtr de = m_template_dirents[index].lock();
+	if (!de) {
+		de = m_template->instantiate(index, *this);
+		m_template_dirents[index] = de;
+		if (de->is_scope()) {
+			m_template_scopes.push_back(de);
+		}
 	}
 	return de;
 }
@@ -267,6 +375,13 @@ Scope::dirent(string index) const
 const string &
 Scope::dirent_name(int index) const
 {
+	populate();
+	if (m_template && index >= 0) {
+		if (size_t(index) < m_template->n_dirents()) {
+			return m_template->dirent_name(index);
+		}
+		index -= m_template->n_dirents();
+	}
 	return m_dirents.key_at(index);
 }
 
@@ -443,12 +558,14 @@ Scope::dirent_defined(const Path &path) const
 void
 Scope::add_bookmark(const string &name)
 {
+	populate();
 	m_bookmarks.insert(std::make_pair(name, 1));
 }
 
 bool
 Scope::has_bookmark(const string &name) const
 {
+	populate();
 	return (m_bookmarks.find(name) != m_bookmarks.end());
 }
 
@@ -5,6 +5,7 @@
 #include "hwpp.h"
 #include <stdexcept>
 #include <map>
+#include <vector>
 #include "path.h"
 #include "dirent.h"
 #include "binding.h"
@@ -14,6 +15,7 @@
 #include "field.h"
 #include "array.h"
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
 
 namespace hwpp {
 
@@ -25,18 +27,38 @@ typedef boost::shared_ptr<Scope> ScopePtr;
 typedef boost::shared_ptr<const Scope> ConstScopePtr;
 typedef boost::weak_ptr<const Scope> WeakConstScopePtr;
 
+class ScopeTemplate;
+typedef boost::shared_ptr<const ScopeTemplate> ConstScopeTemplatePtr;
+
 class Scope: public Dirent, public boost::enable_shared_from_this<Scope>
 {
+    public:
+	// A builder populates a lazy scope the first time it is needed.
+	typedef boost::function<void (const ScopePtr &)> Builder;
+
     private:
 	WeakConstScopePtr m_parent;
 	ConstBindingPtr m_binding;
 	util::KeyedVector<string, DirentPtr> m_dirents;
 	util::KeyedVector<string, ConstDatatypePtr> m_datatypes;
 	std::map<string, int> m_bookmarks;
+	mutable Builder m_builder;
+	ConstScopeTemplatePtr m_template;
+	// Dirents made from m_template, parallel to it, filled in as they
+	// are looked up.  Registers and fields are only held weakly, so they
+	// live as long as whoever looked them up.  Sub-scopes are also held
+	// in m_template_scopes, so the parent pointers of their own
+	// templated sub-scopes stay good.
+	std::vector<boost::weak_ptr<Dirent> > m_template_dirents;
+	std::vector<DirentPtr> m_template_scopes;
+
+	friend class ScopeTemplate;
 
     public:
 	explicit Scope(const BindingPtr &binding = BindingPtr())
-	    : Dirent(DIRENT_TYPE_SCOPE), m_parent(), m_binding(binding)
+	    : Dirent(DIRENT_TYPE_SCOPE), m_parent(), m_binding(binding),
+	      m_builder(), m_template(), m_template_dirents(),
+	      m_template_scopes()
 	{
 	}
 	virtual ~Scope()
@@ -76,6 +98,33 @@ class Scope: public Dirent, public boost::enable_shared_from_this<Scope>
 	bool
 	is_bound() const;
 
+	//
+	// Make this a lazy scope.  The builder is called exactly once, the
+	// first time the contents of this scope are looked up or iterated.
+	// Until then, the scope is just a named, bound stub.
+	//
+	void
+	set_builder(const Builder &builder);
+
+	//
+	// Return a boolean indicating whether this scope's contents have
+	// been built.  Scopes without a builder are always populated.
+	//
+	bool
+	is_populated() const;
+
+	//
+	// Give this scope the contents of a template (see scope_template.h).
+	// The template's dirents come first, bound to this scope's binding,
+	// followed by any dirents added to this scope itself, which can
+	// not reuse the template's names.  Templated dirents are made when
+	// they are looked up.  Sub-scopes are kept by this scope, but
+	// registers and fields are only kept while something else holds
+	// them.  This must be called before anything else is added.
+	//
+	void
+	set_template(const ConstScopeTemplatePtr &tmpl);
+
 	//
 	// Add a named datatype to this scope.
 	//
@@ -134,7 +183,8 @@ class Scope: public Dirent, public boost::enable_shared_from_this<Scope>
 	//
 	// Throws:
 	// 	Path::NotFoundError		- path not found
-	// 	Path::InvalidError		- invalid path element
+	// 	Path::InvalidError		- invalid path element, or a
+	// 					  name the template defines
 	// 	Dirent::ConversionError		- path element is not a scope
 	//
 	void
@@ -211,6 +261,14 @@ class Scope: public Dirent, public boost::enable_shared_from_this<Scope>
 	has_bookmark(const string &name) const;
 
     private:
+	// Run the builder, if there is one.
+	void
+	populate() const;
+
+	// Return the indexed templated dirent, making it if needed.
+	DirentPtr
+	template_dirent(size_t index);
+
 	// Walk a path.
 	int
 	walk_path(const Path &path, unsigned flags,
@@ -0,0 +1,217 @@
+// Copyright (c) Tim Hockin, 2007
+#include "hwpp.h"
+#include "scope_template.h"
+#include <map>
+#include <vector>
+#include "driver.h"
+#include "field_types.h"
+#include "register_types.h"
+#include "alias.h"
+
+namespace hwpp {
+
+//
+// The binding that template scopes are built against.  It has no device
+// behind it, so all I/O fails.
+//
+class TemplateBinding: public Binding
+{
+    public:
+	virtual ~TemplateBinding()
+	{
+	}
+
+	virtual Value
+	read(const Value &address, const BitWidth width) const
+	{
+		(void)address;
+		(void)width;
+		throw Driver::IoError("template scopes can not be read");
+	}
+
+	virtual void
+	write(const Value &address, const BitWidth width,
+	    const Value &value) const
+	{
+		(void)address;
+		(void)width;
+		(void)value;
+		throw Driver::IoError("template scopes can not be written");
+	}
+
+	virtual string
+	to_string() const
+	{
+		return "template";
+	}
+};
+
+const BindingPtr &
+ScopeTemplate::placeholder()
+{
+	static BindingPtr the_placeholder(new TemplateBinding());
+	return the_placeholder;
+}
+
+// Get the address and width of a register on the placeholder binding.
+static bool
+templated_register(const ConstRegisterPtr &reg, Value *address,
+                   BitWidth *width)
+{
+	boost::shared_ptr<const BoundRegister> bound =
+	    boost::dynamic_pointer_cast<const BoundRegister>(reg);
+	if (!bound || bound->binding() != ScopeTemplate::placeholder()) {
+		return false;
+	}
+	*address = bound->address();
+	*width = bound->width();
+	return true;
+}
+
+void
+ScopeTemplate::compile_range(const RegBits::Range &range, Range *result)
+{
+	result->hi_bit = range.hi_bit;
+	result->lo_bit = range.lo_bit;
+	result->width = BITS0;
+	if (!templated_register(range.reg, &result->address,
+	                        &result->width)) {
+		// registers on any other binding are shared
+		result->reg = range.reg;
+	}
+}
+
+ConstScopeTemplatePtr
+ScopeTemplate::compile(const ConstScopePtr &scope)
+{
+	if (!scope->is_populated()
+	 || (scope->is_bound() && scope->binding() != placeholder())) {
+		return ConstScopeTemplatePtr();
+	}
+	if (scope->m_template) {
+		// a template built from another template is the same one
+		if (scope->m_dirents.size() > 0) {
+			return ConstScopeTemplatePtr();
+		}
+		return scope->m_template;
+	}
+
+	boost::shared_ptr<ScopeTemplate> tmpl(new ScopeTemplate());
+	for (size_t i = 0; i < scope->m_dirents.size(); i++) {
+		const DirentPtr &de = scope->m_dirents.at(i);
+		Entry entry;
+		entry.kind = Entry::SHARED;
+		entry.width = BITS0;
+
+		if (de->is_register()) {
+			if (templated_register(register_from_dirent(de),
+			                       &entry.address, &entry.width)) {
+				entry.kind = Entry::REGISTER;
+			} else {
+				entry.shared = de;
+			}
+		} else if (de->is_field()) {
+			ConstFieldPtr field = field_from_dirent(de);
+			boost::shared_ptr<const DirectField> direct =
+			    boost::dynamic_pointer_cast<const DirectField>(
+			    field);
+			if (direct) {
+				entry.kind = Entry::FIELD;
+				entry.datatype = field->datatype();
+				std::vector<RegBits::Range> ranges;
+				direct->regbits().ranges(&ranges);
+				entry.ranges.resize(ranges.size());
+				for (size_t r = 0; r < ranges.size(); r++) {
+					compile_range(ranges[r],
+					              &entry.ranges[r]);
+				}
+			} else if (boost::dynamic_pointer_cast<
+			           const ConstantField>(field)) {
+				entry.shared = de;
+			} else {
+				// procedures hold their builder's context
+				return ConstScopeTemplatePtr();
+			}
+		} else if (de->is_scope()) {
+			ConstScopePtr sub = scope_from_dirent(de);
+			if (sub->is_bound()) {
+				return ConstScopeTemplatePtr();
+			}
+			entry.kind = Entry::SCOPE;
+			entry.scope = compile(sub);
+			if (!entry.scope) {
+				return ConstScopeTemplatePtr();
+			}
+		} else if (de->is_alias()) {
+			entry.shared = de;
+		} else {
+			// arrays of bound dirents can not be shared yet
+			return ConstScopeTemplatePtr();
+		}
+		tmpl->m_entries.insert(scope->m_dirents.key_at(i), entry);
+	}
+
+	for (size_t i = 0; i < scope->m_datatypes.size(); i++) {
+		tmpl->m_datatypes.insert(scope->m_datatypes.key_at(i),
+		                         scope->m_datatypes.at(i));
+	}
+	std::map<string, int>::const_iterator it;
+	for (it = scope->m_bookmarks.begin(); it != scope->m_bookmarks.end();
+	     it++) {
+		tmpl->m_bookmarks.push_back(it->first);
+	}
+	return tmpl;
+}
+
+int
+ScopeTemplate::find(const string &name) const
+{
+	util::KeyedVector<string, Entry>::const_iterator it;
+	it = m_entries.find(name);
+	if (it == m_entries.end()) {
+		return -1;
+	}
+	return it - m_entries.begin();
+}
+
+DirentPtr
+ScopeTemplate::instantiate(size_t index, const Scope &scope) const
+{
+	const Entry &entry = m_entries.at(index);
+
+	switch (entry.kind) {
+	    case Entry::SHARED:
+		return entry.shared;
+	    case Entry::REGISTER:
+		return new_hwpp_bound_register(scope.binding(),
+		                               entry.address, entry.width);
+	    case Entry::FIELD: {
+		const ConstBindingPtr &binding = scope.binding();
+		RegBits bits;
+		for (size_t i = 0; i < entry.ranges.size(); i++) {
+			const Range &range = entry.ranges[i];
+			ConstRegisterPtr reg = range.reg;
+			if (!reg) {
+				reg = new_hwpp_bound_register(binding,
+				    range.address, range.width);
+			}
+			RegBits piece(reg, range.hi_bit, range.lo_bit);
+			if (i == 0) {
+				bits = piece;
+			} else {
+				bits += piece;
+			}
+		}
+		return new_hwpp_direct_field(entry.datatype, bits);
+	    }
+	    case Entry::SCOPE: {
+		ScopePtr sub = new_hwpp_scope();
+		sub->set_parent(scope.shared_from_this());
+		sub->set_template(entry.scope);
+		return sub;
+	    }
+	}
+	return DirentPtr();
+}
+
+}  // namespace hwpp
@@ -0,0 +1,139 @@
+// Copyright (c) Tim Hockin, 2007
+#ifndef HWPP_SCOPE_TEMPLATE_H__
+#define HWPP_SCOPE_TEMPLATE_H__
+
+#include "hwpp.h"
+#include <vector>
+#include "dirent.h"
+#include "binding.h"
+#include "datatype.h"
+#include "register.h"
+#include "regbits.h"
+#include "scope.h"
+#include "util/keyed_vector.h"
+
+namespace hwpp {
+
+//
+// ScopeTemplate - the shared, immutable contents of a kind of scope.
+//
+// Many devices (every CPU, every PCI function) are built by the same
+// code, and differ only in their binding.  A template holds what they
+// have in common: the names of their dirents, the addresses and widths
+// of their registers, the bit layouts and datatypes of their fields, and
+// their sub-scopes.  A scope which uses a template (see
+// Scope::set_template()) stores a pointer to it, and makes each of
+// the template's dirents, bound to the scope's own binding, when it is
+// looked up.
+//
+// Templates are compiled from a scope which was built against the
+// placeholder binding.  Registers on the placeholder become templated
+// registers.  Constant fields, aliases and registers on other bindings
+// are shared as they are, so the code which builds a template must not
+// bind anything itself, or depend on the device it is built for.
+//
+class ScopeTemplate
+{
+    public:
+	//
+	// The binding to build template scopes against.  Any I/O through
+	// it throws Driver::IoError, so code which reads the device while
+	// building can not be made into a template.
+	//
+	static const BindingPtr &
+	placeholder();
+
+	//
+	// Compile the contents of a scope, which was built against the
+	// placeholder binding, into a template.
+	//
+	// Returns:
+	// 	NULL if the scope holds something a template can not
+	// 	represent, such as procedure fields, arrays, lazy or bound
+	// 	sub-scopes.
+	//
+	static boost::shared_ptr<const ScopeTemplate>
+	compile(const ConstScopePtr &scope);
+
+	//
+	// Return the number of dirents in this template.
+	//
+	size_t
+	n_dirents() const
+	{
+		return m_entries.size();
+	}
+
+	//
+	// Return the name of the indexed dirent.
+	//
+	const string &
+	dirent_name(size_t index) const
+	{
+		return m_entries.key_at(index);
+	}
+
+	//
+	// Find a dirent by name.
+	//
+	// Returns:
+	// 	the index of the dirent, or -1 if not found.
+	//
+	int
+	find(const string &name) const;
+
+	//
+	// Make the indexed dirent for an instance scope.  Registers and
+	// fields are bound to the scope's binding.  Sub-scopes are made
+	// with 'scope' as their parent.  Each call makes new objects,
+	// except for shared dirents.
+	//
+	DirentPtr
+	instantiate(size_t index, const Scope &scope) const;
+
+    private:
+	friend class Scope;
+
+	// One range of bits of a field.
+	struct Range {
+		// If 'reg' is set, the range is in that shared register.
+		// Otherwise it is in a templated register.
+		ConstRegisterPtr reg;
+		Value address;
+		BitWidth width;
+		unsigned hi_bit;
+		unsigned lo_bit;
+	};
+
+	struct Entry {
+		enum kind {
+			SHARED,		// 'shared' is used as is
+			REGISTER,	// a templated register
+			FIELD,		// a DirectField on 'ranges'
+			SCOPE,		// a sub-scope from 'scope'
+		};
+		enum kind kind;
+		DirentPtr shared;
+		Value address;
+		BitWidth width;
+		ConstDatatypePtr datatype;
+		std::vector<Range> ranges;
+		boost::shared_ptr<const ScopeTemplate> scope;
+	};
+
+	ScopeTemplate()
+	{
+	}
+
+	static void
+	compile_range(const RegBits::Range &range, Range *result);
+
+	util::KeyedVector<string, Entry> m_entries;
+	util::KeyedVector<string, ConstDatatypePtr> m_datatypes;
+	std::vector<string> m_bookmarks;
+};
+typedef boost::shared_ptr<const ScopeTemplate> ConstScopeTemplatePtr;
+
+}  // namespace hwpp
+
+#endif // HWPP_SCOPE_TEMPLATE_H__
@@ -0,0 +1,493 @@
+//
+// Save and load register snapshots.
+//
+#include "hwpp.h"
+#include "snapshot.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "scope.h"
+#include "array.h"
+#include "register_types.h"
+#include "driver.h"
+#include "util/bit_buffer.h"
+#include "util/filesystem.h"
+
+namespace hwpp {
+
+static const char SNAPSHOT_MAGIC[8] = { 'H','W','P','P','S','N','A','P' };
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+// Round up to the alignment of each section.
+static inline uint64_t
+snapshot_align(uint64_t n)
+{
+	return (n + 7) & ~uint64_t(7);
+}
+
+//
+// The writer side.
+//
+
+void
+SnapshotWriter::add_binding(const string &name, const string &path)
+{
+	BindingData &data = m_bindings[name];
+	if (data.path == "") {
+		data.path = path;
+	}
+}
+
+bool
+SnapshotWriter::has_register(const string &binding, const Value &address,
+                             BitWidth width) const
+{
+	if (address < 0 || address > MASK(64)) {
+		return false;
+	}
+	std::map<string, BindingData>::const_iterator it =
+	    m_bindings.find(binding);
+	if (it == m_bindings.end()) {
+		return false;
+	}
+	RegisterKey key(address.as_uint(), width);
+	return (it->second.registers.find(key) != it->second.registers.end());
+}
+
+SnapshotWriter::SavedValue *
+SnapshotWriter::new_register(const string &binding, const Value &address,
+                             BitWidth width)
+{
+	if (address < 0 || address > MASK(64)) {
+		throw std::out_of_range(sprintfxx(
+		    "snapshot address out of range: 0x%x", address));
+	}
+	BindingData &data = m_bindings[binding];
+	RegisterKey key(address.as_uint(), width);
+	if (data.registers.find(key) != data.registers.end()) {
+		return NULL;
+	}
+	return &data.registers[key];
+}
+
+void
+SnapshotWriter::add_register(const string &binding, const Value &address,
+                             BitWidth width, const Value &value)
+{
+	SavedValue *sv = new_register(binding, address, width);
+	if (sv) {
+		sv->valid = true;
+		sv->value = value;
+	}
+}
+
+void
+SnapshotWriter::add_unreadable(const string &binding, const Value &address,
+                               BitWidth width)
+{
+	SavedValue *sv = new_register(binding, address, width);
+	if (sv) {
+		sv->valid = false;
+	}
+}
+
+// Append raw bytes to the image, padding to the next section alignment.
+static void
+snapshot_append(string *image, const void *data, size_t len)
+{
+	image->append(static_cast<const char *>(data), len);
+	image->append(snapshot_align(image->size()) - image->size(), '\0');
+}
+
+void
+SnapshotWriter::write(const string &filename) const
+{
+	// lay out the tables
+	std::vector<Snapshot::FileBinding> bindings;
+	std::vector<Snapshot::FileRecord> records;
+	string strings;
+	string data;
+	std::map<string, BindingData>::const_iterator bit;
+	for (bit = m_bindings.begin(); bit != m_bindings.end(); bit++) {
+		Snapshot::FileBinding fb;
+		fb.name_offset = strings.size();
+		fb.name_len = bit->first.size();
+		strings += bit->first;
+		fb.path_offset = strings.size();
+		fb.path_len = bit->second.path.size();
+		strings += bit->second.path;
+		fb.first_record = records.size();
+		fb.n_records = bit->second.registers.size();
+		bindings.push_back(fb);
+
+		std::map<RegisterKey, SavedValue>::const_iterator rit;
+		for (rit = bit->second.registers.begin();
+		     rit != bit->second.registers.end(); rit++) {
+			Snapshot::FileRecord fr;
+			fr.address = rit->first.first;
+			fr.width = rit->first.second;
+			fr.flags = 0;
+			fr.data_offset = 0;
+			if (rit->second.valid) {
+				util::BitBuffer bb =
+				    rit->second.value.to_bitbuffer(fr.width);
+				fr.flags |= Snapshot::RECORD_VALID;
+				fr.data_offset = data.size();
+				snapshot_append(&data, bb.get(),
+				                bb.size_bytes());
+			}
+			records.push_back(fr);
+		}
+	}
+
+	// build the header
+	Snapshot::FileHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = Snapshot::VERSION;
+	hdr.byte_order = SNAPSHOT_BYTE_ORDER;
+	hdr.n_bindings = bindings.size();
+	hdr.n_records = records.size();
+	hdr.bindings_offset = snapshot_align(sizeof(hdr));
+	hdr.records_offset = hdr.bindings_offset
+	    + snapshot_align(bindings.size() * sizeof(Snapshot::FileBinding));
+	hdr.strings_offset = hdr.records_offset
+	    + snapshot_align(records.size() * sizeof(Snapshot::FileRecord));
+	hdr.data_offset = hdr.strings_offset + snapshot_align(strings.size());
+	hdr.file_size = hdr.data_offset + data.size();
+
+	// assemble the image
+	string image;
+	image.reserve(hdr.file_size);
+	snapshot_append(&image, &hdr, sizeof(hdr));
+	if (bindings.size()) {
+		snapshot_append(&image, &bindings[0],
+		    bindings.size() * sizeof(Snapshot::FileBinding));
+	}
+	if (records.size()) {
+		snapshot_append(&image, &records[0],
+		    records.size() * sizeof(Snapshot::FileRecord));
+	}
+	snapshot_append(&image, strings.data(), strings.size());
+	image += data;
+	DASSERT(image.size() == hdr.file_size);
+
+	// write it to a temp file and move it into place
+	filesystem::FilePtr file =
+	    filesystem::File::tempfile(filename + ".XXXXXX");
+	size_t done = 0;
+	while (done < image.size()) {
+		done += file->write(&image[done], image.size() - done);
+	}
+	file->close();
+	if (rename(file->path().c_str(), filename.c_str()) < 0) {
+		int err = errno;
+		unlink(file->path().c_str());
+		syserr::throw_errno_error(err,
+		    "hwpp::write_snapshot(" + filename + ")");
+	}
+}
+
+static void
+snapshot_dirent(const ConstDirentPtr &de, const string &path,
+                SnapshotWriter *writer);
+
+static void
+snapshot_scope(const ConstScopePtr &scope, const string &path,
+               SnapshotWriter *writer)
+{
+	// remember where each binding lives in the tree
+	if (scope->is_bound()) {
+		writer->add_binding(scope->binding()->to_string(),
+		                    (path == "") ? "/" : path);
+	}
+
+	// this populates lazy scopes
+	for (size_t i = 0; i < scope->n_dirents(); i++) {
+		snapshot_dirent(scope->dirent(i),
+		                path + "/" + scope->dirent_name(i), writer);
+	}
+}
+
+static void
+snapshot_register(const ConstRegisterPtr &reg, SnapshotWriter *writer)
+{
+	// only registers that talk straight to a binding are saved
+	boost::shared_ptr<const BoundRegister> bound =
+	    boost::dynamic_pointer_cast<const BoundRegister>(reg);
+	if (!bound || !bound->binding()) {
+		return;
+	}
+	const Value &address = bound->address();
+	if (address < 0 || address > MASK(64)) {
+		return;
+	}
+
+	string name = bound->binding()->to_string();
+	if (writer->has_register(name, address, reg->width())) {
+		return;
+	}
+	try {
+		writer->add_register(name, address, reg->width(), reg->read());
+	} catch (Driver::IoError &e) {
+		writer->add_unreadable(name, address, reg->width());
+	}
+}
+
+static void
+snapshot_dirent(const ConstDirentPtr &de, const string &path,
+                SnapshotWriter *writer)
+{
+	if (de->is_scope()) {
+		snapshot_scope(scope_from_dirent(de), path, writer);
+	} else if (de->is_array()) {
+		ConstArrayPtr ar = array_from_dirent(de);
+		for (size_t i = 0; i < ar->size(); i++) {
+			snapshot_dirent(ar->at(i), sprintfxx("%s[%d]", path, i),
+			                writer);
+		}
+	} else if (de->is_register()) {
+		snapshot_register(register_from_dirent(de), writer);
+	}
+	// fields are decoded from registers, and aliases point at
+	// things we will find anyway
+}
+
+void
+write_snapshot(const ConstScopePtr &root, const string &filename)
+{
+	SnapshotWriter writer;
+	snapshot_scope(root, "", &writer);
+	writer.write(filename);
+}
+
+//
+// The reader side.
+//
+
+SnapshotPtr
+Snapshot::open(const string &filename)
+{
+	filesystem::FilePtr file = filesystem::File::open(filename, O_RDONLY);
+	size_t size = file->size();
+	if (size < sizeof(FileHeader)) {
+		throw FormatError(filename + ": file is too short");
+	}
+
+	SnapshotPtr snap(new Snapshot());
+	snap->m_mapping = file->mmap(0, size);
+	snap->m_base = static_cast<const uint8_t *>(snap->m_mapping->address());
+	snap->m_header = reinterpret_cast<const FileHeader *>(snap->m_base);
+	try {
+		snap->validate(size);
+	} catch (FormatError &e) {
+		throw FormatError(filename + ": " + e.what());
+	}
+	snap->m_bindings = reinterpret_cast<const FileBinding *>(
+	    snap->m_base + snap->m_header->bindings_offset);
+	snap->m_records = reinterpret_cast<const FileRecord *>(
+	    snap->m_base + snap->m_header->records_offset);
+	return snap;
+}
+
+// Check everything once, up front, so that reads don't have to.
+void
+Snapshot::validate(size_t file_size) const
+{
+	const FileHeader *hdr = m_header;
+	if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0) {
+		throw FormatError("not a snapshot file");
+	}
+	if (hdr->version != VERSION) {
+		throw FormatError(sprintfxx("unsupported version %d",
+		                            hdr->version));
+	}
+	if (hdr->byte_order != SNAPSHOT_BYTE_ORDER) {
+		throw FormatError("wrong byte order");
+	}
+	if (hdr->file_size != file_size) {
+		throw FormatError("wrong file size");
+	}
+
+	// each section must fit before the next one; sizes are compared
+	// against the space left, so crafted offsets can not wrap around
+	uint64_t bindings_size =
+	    uint64_t(hdr->n_bindings) * sizeof(FileBinding);
+	uint64_t records_size =
+	    uint64_t(hdr->n_records) * sizeof(FileRecord);
+	if (hdr->bindings_offset < sizeof(FileHeader)
+	 || hdr->bindings_offset % 8 != 0
+	 || hdr->bindings_offset > file_size
+	 || bindings_size > file_size - hdr->bindings_offset
+	 || hdr->records_offset < hdr->bindings_offset
+	 || hdr->records_offset - hdr->bindings_offset < bindings_size
+	 || hdr->records_offset % 8 != 0
+	 || hdr->records_offset > file_size
+	 || records_size > file_size - hdr->records_offset
+	 || hdr->strings_offset < hdr->records_offset
+	 || hdr->strings_offset - hdr->records_offset < records_size
+	 || hdr->data_offset < hdr->strings_offset
+	 || hdr->file_size < hdr->data_offset) {
+		throw FormatError("bad section offsets");
+	}
+
+	const FileBinding *bindings = reinterpret_cast<const FileBinding *>(
+	    m_base + hdr->bindings_offset);
+	const FileRecord *records = reinterpret_cast<const FileRecord *>(
+	    m_base + hdr->records_offset);
+	uint64_t strings_size = hdr->data_offset - hdr->strings_offset;
+	uint64_t data_size = hdr->file_size - hdr->data_offset;
+
+	for (size_t i = 0; i < hdr->n_bindings; i++) {
+		const FileBinding &fb = bindings[i];
+		if (uint64_t(fb.name_offset) + fb.name_len > strings_size
+		 || uint64_t(fb.path_offset) + fb.path_len > strings_size
+		 || uint64_t(fb.first_record) + fb.n_records
+		    > hdr->n_records) {
+			throw FormatError(sprintfxx("bad binding %d", i));
+		}
+	}
+	for (size_t i = 0; i < hdr->n_records; i++) {
+		const FileRecord &fr = records[i];
+		if (fr.width == 0 || fr.width > BIT_WIDTH_MAX
+		 || fr.width % CHAR_BIT != 0) {
+			throw FormatError(sprintfxx("bad record %d width", i));
+		}
+		if ((fr.flags & RECORD_VALID)
+		 && (fr.data_offset > data_size
+		  || fr.width/CHAR_BIT > data_size - fr.data_offset)) {
+			throw FormatError(sprintfxx("bad record %d data", i));
+		}
+	}
+}
+
+string
+Snapshot::get_string(uint32_t offset, uint32_t len) const
+{
+	const char *p = reinterpret_cast<const char *>(m_base)
+	    + m_header->strings_offset + offset;
+	return string(p, len);
+}
+
+string
+Snapshot::binding_name(int index) const
+{
+	const FileBinding &fb = m_bindings[index];
+	return get_string(fb.name_offset, fb.name_len);
+}
+
+string
+Snapshot::binding_path(int index) const
+{
+	const FileBinding &fb = m_bindings[index];
+	return get_string(fb.path_offset, fb.path_len);
+}
+
+int
+Snapshot::find_binding(const string &name) const
+{
+	// the binding table is sorted by name
+	int lo = 0;
+	int hi = m_header->n_bindings;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		int cmp = binding_name(mid).compare(name);
+		if (cmp == 0) {
+			return mid;
+		}
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return -1;
+}
+
+size_t
+Snapshot::n_registers(int binding) const
+{
+	return m_bindings[binding].n_records;
+}
+
+const Snapshot::FileRecord *
+Snapshot::record(int binding, int index) const
+{
+	return &m_records[m_bindings[binding].first_record + index];
+}
+
+Value
+Snapshot::register_address(int binding, int index) const
+{
+	return Value(record(binding, index)->address);
+}
+
+BitWidth
+Snapshot::register_width(int binding, int index) const
+{
+	return record(binding, index)->width;
+}
+
+const Snapshot::FileRecord *
+Snapshot::find_record(int binding, const Value &address,
+                      BitWidth width) const
+{
+	if (binding < 0 || size_t(binding) >= m_header->n_bindings) {
+		return NULL;
+	}
+	if (address < 0 || address > MASK(64)) {
+		return NULL;
+	}
+	uint64_t addr = address.as_uint();
+
+	// records are sorted by (address, width) within a binding
+	const FileRecord *lo = record(binding, 0);
+	const FileRecord *hi = lo + m_bindings[binding].n_records;
+	while (lo < hi) {
+		const FileRecord *mid = lo + (hi - lo) / 2;
+		if (mid->address < addr
+		 || (mid->address == addr && mid->width < width)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo != record(binding, 0) + m_bindings[binding].n_records
+	 && lo->address == addr && lo->width == width) {
+		return lo;
+	}
+	return NULL;
+}
+
+bool
+Snapshot::decode(const FileRecord *rec, Value *result) const
+{
+	if (!rec || !(rec->flags & RECORD_VALID)) {
+		return false;
+	}
+	const uint8_t *p = m_base + m_header->data_offset + rec->data_offset;
+	*result = Value(util::BitBuffer(rec->width, p));
+	return true;
+}
+
+bool
+Snapshot::read(int binding, const Value &address, BitWidth width,
+               Value *result) const
+{
+	return decode(find_record(binding, address, width), result);
+}
+
+bool
+Snapshot::read(int binding, int index, Value *result) const
+{
+	return decode(record(binding, index), result);
+}
+
+}  // namespace hwpp
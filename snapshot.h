@@ -0,0 +1,273 @@
+#ifndef HWPP_SNAPSHOT_H__
+#define HWPP_SNAPSHOT_H__
+
+#include "hwpp.h"
+#include <stdexcept>
+#include <stdint.h>
+#include <map>
+#include <utility>
+#include "scope.h"
+#include "util/filesystem.h"
+
+namespace hwpp {
+
+/*
+ * Snapshot - a read-only, memory-mapped image of the registers of a tree.
+ *
+ * A snapshot file holds, for each binding (keyed by Binding::to_string()),
+ * the path of the scope it was found at and the raw value of every bound
+ * register read through it.  The file is mmap()ed, and values are decoded
+ * straight from the mapping on each read.
+ *
+ * File layout (all integers are in host byte order, which is recorded in
+ * the header, all sections are 8-byte aligned):
+ *
+ * 	header
+ * 	binding table		- sorted by name
+ * 	record table		- per binding, sorted by (address, width)
+ * 	string table		- binding names and paths
+ * 	data			- raw little-endian register values
+ */
+class Snapshot;
+typedef boost::shared_ptr<Snapshot> SnapshotPtr;
+typedef boost::shared_ptr<const Snapshot> ConstSnapshotPtr;
+
+class Snapshot
+{
+    public:
+	/* bump this when the file layout changes */
+	static const uint32_t VERSION = 1;
+
+	/* thrown when a snapshot file is malformed */
+	struct FormatError: public std::runtime_error
+	{
+		explicit FormatError(const string &str)
+		    : runtime_error(str)
+		{
+		}
+	};
+
+	/* on-disk structures */
+	struct FileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t n_bindings;
+		uint32_t n_records;
+		uint64_t bindings_offset;
+		uint64_t records_offset;
+		uint64_t strings_offset;
+		uint64_t data_offset;
+		uint64_t file_size;
+	};
+	struct FileBinding {
+		uint32_t name_offset;
+		uint32_t name_len;
+		uint32_t path_offset;
+		uint32_t path_len;
+		uint32_t first_record;
+		uint32_t n_records;
+	};
+	struct FileRecord {
+		uint64_t address;
+		uint32_t width;
+		uint32_t flags;
+		uint64_t data_offset;
+	};
+	/* FileRecord flags */
+	static const uint32_t RECORD_VALID = 0x01;
+
+	/*
+	 * Snapshot::open(filename)
+	 *
+	 * Map a snapshot file.
+	 *
+	 * Throws: Snapshot::FormatError, syserr::ErrnoError
+	 */
+	static SnapshotPtr
+	open(const string &filename);
+
+	/*
+	 * Snapshot::n_bindings()
+	 *
+	 * Get the number of bindings in this snapshot.
+	 */
+	size_t
+	n_bindings() const
+	{
+		return m_header->n_bindings;
+	}
+
+	/*
+	 * Snapshot::binding_name(index)
+	 * Snapshot::binding_path(index)
+	 *
+	 * Get the name (as from Binding::to_string()) of a binding, or the
+	 * path of the scope it was found at.
+	 */
+	string
+	binding_name(int index) const;
+	string
+	binding_path(int index) const;
+
+	/*
+	 * Snapshot::find_binding(name)
+	 *
+	 * Look up a binding by name.
+	 *
+	 * Returns: the index of the binding, or -1 if not found.
+	 */
+	int
+	find_binding(const string &name) const;
+
+	/*
+	 * Snapshot::n_registers(binding)
+	 * Snapshot::register_address(binding, index)
+	 * Snapshot::register_width(binding, index)
+	 *
+	 * Iterate the registers of a binding, in (address, width) order.
+	 */
+	size_t
+	n_registers(int binding) const;
+	Value
+	register_address(int binding, int index) const;
+	BitWidth
+	register_width(int binding, int index) const;
+
+	/*
+	 * Snapshot::read(binding, address, width, result)
+	 *
+	 * Read the saved value of a register.
+	 *
+	 * Returns: false if the register was not saved, or could not be
+	 * read when the snapshot was taken.
+	 */
+	bool
+	read(int binding, const Value &address, BitWidth width,
+	    Value *result) const;
+	bool
+	read(int binding, int index, Value *result) const;
+
+    private:
+	Snapshot()
+	{
+	}
+
+	const FileRecord *
+	find_record(int binding, const Value &address, BitWidth width) const;
+	const FileRecord *
+	record(int binding, int index) const;
+	string
+	get_string(uint32_t offset, uint32_t len) const;
+	bool
+	decode(const FileRecord *rec, Value *result) const;
+	void
+	validate(size_t file_size) const;
+
+	filesystem::FileMappingPtr m_mapping;
+	const uint8_t *m_base;
+	const FileHeader *m_header;
+	const FileBinding *m_bindings;
+	const FileRecord *m_records;
+};
+
+/*
+ * SnapshotWriter - build a snapshot file from raw register values.
+ *
+ * write_snapshot() uses this to save a tree.  It can also be fed
+ * directly, to make up a snapshot of a machine that is not at hand.
+ */
+class SnapshotWriter
+{
+    public:
+	/*
+	 * SnapshotWriter::add_binding(name, path)
+	 *
+	 * Record the path of the scope a binding was found at.  Only the
+	 * first path given for each binding is kept.
+	 */
+	void
+	add_binding(const string &name, const string &path);
+
+	/*
+	 * SnapshotWriter::has_register(binding, address, width)
+	 *
+	 * Test whether a register has been added.
+	 */
+	bool
+	has_register(const string &binding, const Value &address,
+	    BitWidth width) const;
+
+	/*
+	 * SnapshotWriter::add_register(binding, address, width, value)
+	 * SnapshotWriter::add_unreadable(binding, address, width)
+	 *
+	 * Save the value of a register, or save that it could not be
+	 * read.  A register which was already added is left alone.
+	 *
+	 * Throws: std::out_of_range
+	 */
+	void
+	add_register(const string &binding, const Value &address,
+	    BitWidth width, const Value &value);
+	void
+	add_unreadable(const string &binding, const Value &address,
+	    BitWidth width);
+
+	/*
+	 * SnapshotWriter::write(filename)
+	 *
+	 * Write everything added so far to a snapshot file.  The file is
+	 * written to a temporary name and renamed into place.
+	 *
+	 * Throws: syserr::ErrnoError
+	 */
+	void
+	write(const string &filename) const;
+
+    private:
+	struct SavedValue {
+		bool valid;
+		Value value;
+	};
+	typedef std::pair<uint64_t, uint32_t> RegisterKey;
+	struct BindingData {
+		string path;
+		std::map<RegisterKey, SavedValue> registers;
+	};
+
+	SavedValue *
+	new_register(const string &binding, const Value &address,
+	    BitWidth width);
+
+	// all bindings, keyed (and so sorted) by name
+	std::map<string, BindingData> m_bindings;
+};
+
+/*
+ * write_snapshot(root, filename)
+ *
+ * Walk a tree, read every bound register, and save the results to a
+ * snapshot file.  Lazy scopes are populated along the way.  Registers
+ * which can not be read are saved as such, rather than failing the whole
+ * snapshot.  The file is written to a temporary name and renamed into
+ * place.
+ *
+ * Throws: syserr::ErrnoError
+ */
+extern void
+write_snapshot(const ConstScopePtr &root, const string &filename);
+
+/*
+ * new_snapshot_binding(snapshot, name)
+ *
+ * Create a read-only Binding which serves the registers saved for the
+ * named binding.  Reads of registers which were not saved, and all
+ * writes, throw Driver::IoError.
+ */
+extern BindingPtr
+new_snapshot_binding(const ConstSnapshotPtr &snapshot, const string &name);
+
+}  // namespace hwpp
+
+#endif // HWPP_SNAPSHOT_H__
@@ -0,0 +1,180 @@
+#include "hwpp.h"
+#include "binding_stats.h"
+#include "driver.h"
+#include <sstream>
+#include "util/test.h"
+
+// A binding which counts what it is asked to do.
+class CountingBinding: public hwpp::Binding
+{
+    public:
+	explicit CountingBinding(const string &name)
+	    : m_name(name), reads(0), writes(0)
+	{
+	}
+
+	virtual hwpp::Value
+	read(const hwpp::Value &address, const hwpp::BitWidth width) const
+	{
+		reads++;
+		if (address == 0xbad)
+			throw hwpp::Driver::IoError("counting binding read");
+		return (address & hwpp::MASK(width));
+	}
+
+	virtual void
+	write(const hwpp::Value &address, const hwpp::BitWidth width,
+	    const hwpp::Value &value) const
+	{
+		(void)address; (void)width; (void)value;
+		writes++;
+	}
+
+	virtual string
+	to_string() const
+	{
+		return m_name;
+	}
+
+	string m_name;
+	mutable int reads;
+	mutable int writes;
+};
+
+TEST(test_histogram)
+{
+	typedef hwpp::LatencyHistogram Hist;
+
+	// Buckets are contiguous and cover every value.
+	TEST_ASSERT(Hist::bucket_min(0) == 0, "LatencyHistogram::bucket_min()");
+	for (unsigned i = 1; i < Hist::N_BUCKETS; i++) {
+		if (Hist::bucket_min(i) != Hist::bucket_max(i-1) + 1) {
+			TEST_FAIL("LatencyHistogram::bucket_min()") << i;
+		}
+	}
+	TEST_ASSERT(Hist::bucket_max(Hist::N_BUCKETS-1) == UINT64_MAX,
+	    "LatencyHistogram::bucket_max()");
+
+	// Values land in the bucket that covers them.
+	uint64_t values[] = { 0, 1, 3, 4, 7, 8, 1000, 123456789, UINT64_MAX };
+	for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); i++) {
+		unsigned b = Hist::bucket_of(values[i]);
+		if (values[i] < Hist::bucket_min(b)
+		 || values[i] > Hist::bucket_max(b)) {
+			TEST_FAIL("LatencyHistogram::bucket_of()") << values[i];
+		}
+	}
+
+	// Buckets are never wider than 1/SUB_BUCKETS of their values.
+	unsigned b = Hist::bucket_of(1000);
+	TEST_ASSERT(Hist::bucket_max(b) - Hist::bucket_min(b) + 1
+	            <= Hist::bucket_min(b) / Hist::SUB_BUCKETS,
+	    "LatencyHistogram::bucket_of()");
+
+	Hist h;
+	TEST_ASSERT(h.count() == 0, "LatencyHistogram::count()");
+	TEST_ASSERT(h.percentile(50) == 0, "LatencyHistogram::percentile()");
+	for (int i = 0; i < 99; i++) {
+		h.record(100);
+	}
+	h.record(1000000);
+	TEST_ASSERT(h.count() == 100, "LatencyHistogram::count()");
+	TEST_ASSERT(h.total_nsecs() == 99*100 + 1000000,
+	    "LatencyHistogram::total_nsecs()");
+	TEST_ASSERT(h.percentile(50) == Hist::bucket_max(Hist::bucket_of(100)),
+	    "LatencyHistogram::percentile()");
+	TEST_ASSERT(h.percentile(99) == Hist::bucket_max(Hist::bucket_of(100)),
+	    "LatencyHistogram::percentile()");
+	TEST_ASSERT(h.percentile(100)
+	            == Hist::bucket_max(Hist::bucket_of(1000000)),
+	    "LatencyHistogram::percentile()");
+	h.reset();
+	TEST_ASSERT(h.count() == 0, "LatencyHistogram::reset()");
+}
+
+TEST(test_stats_binding)
+{
+	typedef hwpp::BindingStats Stats;
+
+	CountingBinding *counting = new CountingBinding("counting");
+	hwpp::BindingPtr inner(counting);
+	hwpp::StatsBinding binding(inner);
+	TEST_ASSERT(binding.to_string() == "counting",
+	    "StatsBinding::to_string()");
+
+	TEST_ASSERT(binding.read(0x1234, hwpp::BITS8) == 0x34,
+	    "StatsBinding::read()");
+	binding.read(0x1234, hwpp::BITS32);
+	binding.read(0x1234, hwpp::BITS32);
+	binding.read(0x1234, hwpp::BITS12);
+	binding.write(0x1234, hwpp::BITS16, 0);
+	try {
+		binding.read(0xbad, hwpp::BITS32);
+		TEST_FAIL("StatsBinding::read()");
+	} catch (hwpp::Driver::IoError &e) {
+	}
+	TEST_ASSERT(counting->reads == 5, "StatsBinding::read()");
+	TEST_ASSERT(counting->writes == 1, "StatsBinding::write()");
+
+	const hwpp::ConstBindingStatsPtr &stats = binding.stats();
+	TEST_ASSERT(stats->name() == "counting", "BindingStats::name()");
+	TEST_ASSERT(stats->count(Stats::OP_READ) == 5, "BindingStats::count()");
+	TEST_ASSERT(stats->count(Stats::OP_READ, hwpp::BITS32) == 3,
+	    "BindingStats::count()");
+	TEST_ASSERT(stats->count(Stats::OP_READ, hwpp::BITS8) == 1,
+	    "BindingStats::count()");
+	TEST_ASSERT(stats->count(Stats::OP_READ, hwpp::BITS12) == 1,
+	    "BindingStats::count()");
+	TEST_ASSERT(stats->count(Stats::OP_WRITE) == 1, "BindingStats::count()");
+	TEST_ASSERT(stats->count(Stats::OP_WRITE, hwpp::BITS16) == 1,
+	    "BindingStats::count()");
+	TEST_ASSERT(stats->errors(Stats::OP_READ) == 1,
+	    "BindingStats::errors()");
+	TEST_ASSERT(stats->errors(Stats::OP_READ, hwpp::BITS32) == 1,
+	    "BindingStats::errors()");
+	TEST_ASSERT(stats->errors(Stats::OP_WRITE) == 0,
+	    "BindingStats::errors()");
+
+	std::ostringstream out;
+	stats->dump(out);
+	TEST_ASSERT(out.str().find("counting read32: count=3 errors=1")
+	            != string::npos, "BindingStats::dump()");
+	TEST_ASSERT(out.str().find("counting readother: count=1")
+	            != string::npos, "BindingStats::dump()");
+	TEST_ASSERT(out.str().find("counting write16: count=1 errors=0")
+	            != string::npos, "BindingStats::dump()");
+	TEST_ASSERT(out.str().find("write8") == string::npos,
+	    "BindingStats::dump()");
+}
+
+TEST(test_registry)
+{
+	hwpp::BindingPtr b1 = hwpp::new_stats_binding(
+	    hwpp::BindingPtr(new CountingBinding("dev1")));
+	hwpp::BindingPtr b2 = hwpp::new_stats_binding(
+	    hwpp::BindingPtr(new CountingBinding("dev2")));
+	// The same name shares stats.
+	hwpp::BindingPtr b3 = hwpp::new_stats_binding(
+	    hwpp::BindingPtr(new CountingBinding("dev2")));
+	b1->read(0, hwpp::BITS8);
+	b2->read(0, hwpp::BITS8);
+	b3->read(0, hwpp::BITS8);
+
+	std::vector<hwpp::ConstBindingStatsPtr> all = hwpp::all_binding_stats();
+	TEST_ASSERT(all.size() == 2, "all_binding_stats()");
+	if (all.size() == 2) {
+		TEST_ASSERT(all[0]->name() == "dev1"
+		         && all[0]->count(hwpp::BindingStats::OP_READ) == 1,
+		    "all_binding_stats()");
+		TEST_ASSERT(all[1]->name() == "dev2"
+		         && all[1]->count(hwpp::BindingStats::OP_READ) == 2,
+		    "all_binding_stats()");
+	}
+
+	std::ostringstream out;
+	hwpp::dump_binding_stats(out);
+	TEST_ASSERT(out.str().find("dev1 read8: count=1") != string::npos,
+	    "dump_binding_stats()");
+	TEST_ASSERT(out.str().find("dev2 read8: count=2") != string::npos,
+	    "dump_binding_stats()");
+}
@@ -0,0 +1,182 @@
+#include "hwpp.h"
+#include "diff.h"
+#include "snapshot.h"
+#include "scope.h"
+#include "register_types.h"
+#include "field_types.h"
+#include "datatype_types.h"
+#include "driver.h"
+#include "util/filesystem.h"
+#include <map>
+#include "util/test.h"
+
+// A binding whose registers are held in a table, so tests can change them.
+class TableBinding: public hwpp::Binding
+{
+    public:
+	explicit TableBinding(const string &name): m_name(name) {}
+
+	virtual hwpp::Value
+	read(const hwpp::Value &address, const hwpp::BitWidth width) const
+	{
+		std::map<uint64_t, hwpp::Value>::const_iterator it =
+		    m_data.find(address.as_uint());
+		if (it == m_data.end())
+			throw hwpp::Driver::IoError("table binding read");
+		return (it->second & hwpp::MASK(width));
+	}
+
+	virtual void
+	write(const hwpp::Value &address, const hwpp::BitWidth width,
+	    const hwpp::Value &value) const
+	{
+		m_data[address.as_uint()] = (value & hwpp::MASK(width));
+	}
+
+	void
+	remove(uint64_t address)
+	{
+		m_data.erase(address);
+	}
+
+	virtual string
+	to_string() const
+	{
+		return m_name;
+	}
+
+    private:
+	string m_name;
+	mutable std::map<uint64_t, hwpp::Value> m_data;
+};
+typedef boost::shared_ptr<TableBinding> TableBindingPtr;
+
+static hwpp::ScopePtr
+make_tree(const TableBindingPtr &binding)
+{
+	hwpp::ScopePtr root = new_hwpp_scope();
+	hwpp::ScopePtr dev = new_hwpp_scope(binding);
+	dev->set_parent(root);
+	root->add_dirent("dev", dev);
+
+	hwpp::RegisterPtr r0 = new_hwpp_bound_register(binding, 0x0,
+	                                               hwpp::BITS16);
+	hwpp::RegisterPtr r1 = new_hwpp_bound_register(binding, 0x4,
+	                                               hwpp::BITS8);
+	dev->add_dirent("%r0", r0);
+	dev->add_dirent("%r1", r1);
+
+	hwpp::DatatypePtr hex4 = new_hwpp_hex_datatype(hwpp::BITS4);
+	hwpp::DatatypePtr hex8 = new_hwpp_hex_datatype(hwpp::BITS8);
+	dev->add_dirent("lo", new_hwpp_direct_field(hex8,
+	                hwpp::RegBits(r0, 7, 0)));
+	dev->add_dirent("hi", new_hwpp_direct_field(hex8,
+	                hwpp::RegBits(r0, 15, 8)));
+	dev->add_dirent("nib", new_hwpp_direct_field(hex4,
+	                hwpp::RegBits(r1, 3, 0)));
+	dev->add_dirent("join", new_hwpp_direct_field(hex8,
+	                hwpp::RegBits(r1, 3, 0) + hwpp::RegBits(r0, 15, 12)));
+	return root;
+}
+
+TEST(test_diff_snapshots)
+{
+	TableBindingPtr binding(new TableBinding("dev0"));
+	binding->write(0x0, hwpp::BITS16, 0x1234);
+	binding->write(0x4, hwpp::BITS8, 0x56);
+	hwpp::ScopePtr root = make_tree(binding);
+
+	string before_file = filesystem::File::tempname(
+	    string(TEST_TMP_DIR()) + "/diff.XXXXXX");
+	string after_file = filesystem::File::tempname(
+	    string(TEST_TMP_DIR()) + "/diff.XXXXXX");
+	hwpp::write_snapshot(root, before_file);
+	// change only the high byte of r0
+	binding->write(0x0, hwpp::BITS16, 0x9934);
+	hwpp::write_snapshot(root, after_file);
+
+	hwpp::SnapshotDiffSource before(hwpp::Snapshot::open(before_file));
+	hwpp::SnapshotDiffSource after(hwpp::Snapshot::open(after_file));
+
+	// same vs. same
+	hwpp::TreeDiff same;
+	hwpp::diff_tree(root, before, before, &same);
+	TEST_ASSERT(same.registers.empty() && same.fields.empty(),
+	    "hwpp::diff_tree()");
+
+	hwpp::TreeDiff diff;
+	hwpp::diff_tree(root, before, after, &diff);
+	TEST_ASSERT(diff.registers.size() == 1)
+	    << "hwpp::diff_tree(): " << diff.registers.size() << " registers";
+	const hwpp::RegisterChange &rc = diff.registers[0];
+	TEST_ASSERT(rc.key == hwpp::RegisterKey("dev0", 0x0, hwpp::BITS16)
+	         && rc.old_valid && rc.new_valid
+	         && rc.old_value == 0x1234 && rc.new_value == 0x9934
+	         && rc.changed_bits == 0x8b00,
+	    "hwpp::diff_tree()");
+
+	// "lo" and "nib" sit on unchanged bits
+	TEST_ASSERT(diff.fields.size() == 2)
+	    << "hwpp::diff_tree(): " << diff.fields.size() << " fields";
+	TEST_ASSERT(diff.fields[0].path == "/dev/hi"
+	         && diff.fields[0].old_value == 0x12
+	         && diff.fields[0].new_value == 0x99
+	         && diff.fields[0].old_string == "0x12"
+	         && diff.fields[0].new_string == "0x99",
+	    "hwpp::diff_tree()");
+	TEST_ASSERT(diff.fields[1].path == "/dev/join"
+	         && diff.fields[1].old_value == 0x61
+	         && diff.fields[1].new_value == 0x69,
+	    "hwpp::diff_tree()");
+
+	filesystem::File::unlink(before_file);
+	filesystem::File::unlink(after_file);
+}
+
+TEST(test_diff_live)
+{
+	TableBindingPtr binding(new TableBinding("dev0"));
+	binding->write(0x0, hwpp::BITS16, 0x1234);
+	binding->write(0x4, hwpp::BITS8, 0x56);
+	hwpp::ScopePtr root = make_tree(binding);
+
+	string filename = filesystem::File::tempname(
+	    string(TEST_TMP_DIR()) + "/diff.XXXXXX");
+	hwpp::write_snapshot(root, filename);
+	hwpp::SnapshotDiffSource golden(hwpp::Snapshot::open(filename));
+
+	// a change in bits no field uses
+	binding->write(0x4, hwpp::BITS8, 0x76);
+	{
+		hwpp::LiveDiffSource live(root);
+		hwpp::TreeDiff diff;
+		hwpp::diff_tree(root, golden, live, &diff);
+		TEST_ASSERT(diff.registers.size() == 1
+		         && diff.registers[0].changed_bits == 0x20
+		         && diff.fields.empty(),
+		    "hwpp::diff_tree()");
+	}
+
+	// a register that can no longer be read
+	binding->remove(0x4);
+	{
+		hwpp::FieldIndex index(root);
+		hwpp::LiveDiffSource live(index);
+		hwpp::TreeDiff diff;
+		hwpp::diff_tree(index, golden, live, &diff);
+		TEST_ASSERT(diff.registers.size() == 1
+		         && diff.registers[0].old_valid
+		         && !diff.registers[0].new_valid
+		         && diff.registers[0].changed_bits == 0xff,
+		    "hwpp::diff_tree()");
+		TEST_ASSERT(diff.fields.size() == 2
+		         && diff.fields[0].path == "/dev/nib"
+		         && diff.fields[0].old_string == "0x6"
+		         && !diff.fields[0].new_valid
+		         && diff.fields[0].new_string == ""
+		         && diff.fields[1].path == "/dev/join",
+		    "hwpp::diff_tree()");
+	}
+
+	filesystem::File::unlink(filename);
+}
@@ -0,0 +1,124 @@
+#include "hwpp.h"
+#include "field_index.h"
+#include "scope.h"
+#include "array.h"
+#include "register_types.h"
+#include "field_types.h"
+#include "datatype_types.h"
+#include "test_binding.h"
+#include "util/test.h"
+
+TEST(test_register_key)
+{
+	hwpp::BindingPtr binding = new_test_binding();
+	hwpp::RegisterKey key;
+	TEST_ASSERT(hwpp::register_key(
+	    new_hwpp_bound_register(binding, 0x4, hwpp::BITS8), &key),
+	    "hwpp::register_key()");
+	TEST_ASSERT(key == hwpp::RegisterKey("test", 0x4, hwpp::BITS8),
+	    "hwpp::register_key()");
+	TEST_ASSERT(!hwpp::register_key(
+	    new_hwpp_bound_register(hwpp::BindingPtr(), 0x4, hwpp::BITS8),
+	    &key), "hwpp::register_key()");
+
+	TEST_ASSERT(hwpp::RegisterKey("a", 4, 8) < hwpp::RegisterKey("b", 0, 8)
+	         && hwpp::RegisterKey("a", 0, 8) < hwpp::RegisterKey("a", 4, 8)
+	         && hwpp::RegisterKey("a", 4, 8) < hwpp::RegisterKey("a", 4, 16)
+	         && !(hwpp::RegisterKey("a", 4, 8)
+	              < hwpp::RegisterKey("a", 4, 8)),
+	    "hwpp::RegisterKey::operator<()");
+}
+
+TEST(test_field_index)
+{
+	hwpp::BindingPtr binding = new_test_binding();
+	hwpp::ScopePtr root = new_hwpp_scope();
+	hwpp::ScopePtr dev = new_hwpp_scope(binding);
+	dev->set_parent(root);
+	root->add_dirent("dev", dev);
+
+	hwpp::RegisterPtr r0 = new_hwpp_bound_register(binding, 0x0,
+	                                               hwpp::BITS16);
+	hwpp::RegisterPtr r1 = new_hwpp_bound_register(binding, 0x4,
+	                                               hwpp::BITS8);
+	hwpp::RegisterPtr unbound = new_hwpp_bound_register(
+	    hwpp::BindingPtr(), 0x8, hwpp::BITS8);
+	dev->add_dirent("%r0", r0);
+	dev->add_dirent("%r1", r1);
+	dev->add_dirent("%unbound", unbound);
+
+	hwpp::DatatypePtr hex = new_hwpp_hex_datatype(hwpp::BITS8);
+	dev->add_dirent("lo", new_hwpp_direct_field(hex,
+	                hwpp::RegBits(r0, 7, 0)));
+	dev->add_dirent("hi", new_hwpp_direct_field(hex,
+	                hwpp::RegBits(r0, 15, 8)));
+	dev->add_dirent("join", new_hwpp_direct_field(hex,
+	                hwpp::RegBits(r1, 3, 0) + hwpp::RegBits(r0, 15, 12)));
+	// not indexable
+	dev->add_dirent("const", new_hwpp_constant_field(hex, 1));
+	dev->add_dirent("mixed", new_hwpp_direct_field(hex,
+	                hwpp::RegBits(r1, 3, 0) + hwpp::RegBits(unbound)));
+	// an array of fields
+	hwpp::ArrayPtr bits = new_hwpp_array(hwpp::DIRENT_TYPE_FIELD);
+	dev->add_dirent("bit", bits);
+	bits->append(new_hwpp_direct_field(hex, hwpp::RegBits(r1, 6)));
+	bits->append(new_hwpp_direct_field(hex, hwpp::RegBits(r1, 7)));
+
+	hwpp::FieldIndex index(root);
+	TEST_ASSERT(index.n_registers() == 2)
+	    << "hwpp::FieldIndex::n_registers(): " << index.n_registers();
+	TEST_ASSERT(index.n_fields() == 5)
+	    << "hwpp::FieldIndex::n_fields(): " << index.n_fields();
+	TEST_ASSERT(index.field(0).path == "/dev/lo"
+	         && index.field(2).path == "/dev/join"
+	         && index.field(3).path == "/dev/bit[0]"
+	         && index.field(4).path == "/dev/bit[1]",
+	    "hwpp::FieldIndex::field()");
+	const hwpp::FieldIndex::Entry &join = index.field(2);
+	TEST_ASSERT(join.ranges.size() == 2
+	         && join.keys[0] == hwpp::RegisterKey("test", 0x4, 8)
+	         && join.ranges[0].hi_bit == 3 && join.ranges[0].lo_bit == 0
+	         && join.keys[1] == hwpp::RegisterKey("test", 0x0, 16)
+	         && join.ranges[1].hi_bit == 15 && join.ranges[1].lo_bit == 12,
+	    "hwpp::FieldIndex::field()");
+
+	hwpp::RegisterKey k0("test", 0x0, hwpp::BITS16);
+	hwpp::RegisterKey k1("test", 0x4, hwpp::BITS8);
+	TEST_ASSERT(index.uses(k0) && index.uses(k0)->size() == 3,
+	    "hwpp::FieldIndex::uses()");
+	TEST_ASSERT(index.uses(hwpp::RegisterKey("test", 0x8, 8)) == NULL,
+	    "hwpp::FieldIndex::uses()");
+
+	// changed bits
+	std::vector<size_t> out;
+	index.affected_fields(k0, 0x0100, &out);
+	TEST_ASSERT(out.size() == 1 && out[0] == 1,
+	    "hwpp::FieldIndex::affected_fields()");
+	out.clear();
+	index.affected_fields(k0, 0x8001, &out);
+	TEST_ASSERT(out.size() == 3 && out[0] == 0 && out[1] == 1
+	         && out[2] == 2,
+	    "hwpp::FieldIndex::affected_fields()");
+	out.clear();
+	index.affected_fields(k1, 0x30, &out);
+	TEST_ASSERT(out.empty(), "hwpp::FieldIndex::affected_fields()");
+
+	// several registers, with overlap
+	std::map<hwpp::RegisterKey, hwpp::Value> changes;
+	changes[k0] = 0x1000;
+	changes[k1] = 0x81;
+	out.clear();
+	index.affected_fields(changes, &out);
+	TEST_ASSERT(out.size() == 3 && out[0] == 1 && out[1] == 2
+	         && out[2] == 4,
+	    "hwpp::FieldIndex::affected_fields()");
+
+	// whole registers
+	std::vector<hwpp::RegisterKey> keys;
+	keys.push_back(k1);
+	out.clear();
+	index.affected_fields(keys, &out);
+	TEST_ASSERT(out.size() == 3 && out[0] == 2 && out[1] == 3
+	         && out[2] == 4,
+	    "hwpp::FieldIndex::affected_fields()");
+}
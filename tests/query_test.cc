@@ -0,0 +1,219 @@
+#include "hwpp.h"
+#include "query.h"
+#include "scope.h"
+#include "array.h"
+#include "alias.h"
+#include "register_types.h"
+#include "field_types.h"
+#include "datatype_types.h"
+#include "test_binding.h"
+#include "util/test.h"
+
+#include <stdexcept>
+
+static int n_built;
+
+static void
+build_lazy(const hwpp::ScopePtr &scope)
+{
+	n_built++;
+	scope->add_dirent("x", new_hwpp_constant_field(
+	    new_hwpp_hex_datatype(hwpp::BITS8), 1));
+}
+
+// Build a tree:
+// 	/dev.N/%r0		a register
+// 	/dev.N/lo		a field of the named type "hex8_t"
+// 	/dev.N/anon		a field of an anonymous type
+// 	/dev.N/link		an alias to lo
+// 	/dev.N/cap[M]/link	a field of type "hex8_t"
+// 	/dev.N/lazy		a lazy scope
+// 	/other/lo		a field
+static hwpp::ScopePtr
+new_test_tree()
+{
+	hwpp::ScopePtr root = new_hwpp_scope();
+	hwpp::DatatypePtr hex = new_hwpp_hex_datatype(hwpp::BITS8);
+	root->add_datatype("hex8_t", hex);
+
+	for (int n = 0; n < 2; n++) {
+		hwpp::BindingPtr binding = new_test_binding();
+		hwpp::ScopePtr dev = new_hwpp_scope(binding);
+		dev->set_parent(root);
+		root->add_dirent("dev." + to_string(n), dev);
+
+		hwpp::RegisterPtr r0 = new_hwpp_bound_register(binding, 0x0,
+		                                               hwpp::BITS16);
+		dev->add_dirent("%r0", r0);
+		dev->add_dirent("lo", new_hwpp_direct_field(hex,
+		                hwpp::RegBits(r0, 7, 0)));
+		dev->add_dirent("anon", new_hwpp_direct_field(
+		                new_hwpp_hex_datatype(hwpp::BITS8),
+		                hwpp::RegBits(r0, 15, 8)));
+		dev->add_dirent("link", new_hwpp_alias("lo"));
+
+		hwpp::ArrayPtr caps = new_hwpp_array(hwpp::DIRENT_TYPE_SCOPE);
+		dev->add_dirent("cap", caps);
+		for (int m = 0; m < 2; m++) {
+			hwpp::ScopePtr cap = new_hwpp_scope();
+			cap->set_parent(dev);
+			cap->add_dirent("link", new_hwpp_direct_field(hex,
+			                hwpp::RegBits(r0, m)));
+			caps->append(cap);
+		}
+
+		hwpp::ScopePtr lazy = new_hwpp_scope();
+		lazy->set_parent(dev);
+		lazy->set_builder(build_lazy);
+		dev->add_dirent("lazy", lazy);
+	}
+
+	hwpp::ScopePtr other = new_hwpp_scope();
+	other->set_parent(root);
+	root->add_dirent("other", other);
+	other->add_dirent("lo", new_hwpp_constant_field(hex, 1));
+	return root;
+}
+
+// Collect the matched paths, separated by spaces.  The root is "/".
+struct Collector
+{
+	explicit Collector(string *out): paths(out)
+	{
+	}
+	void
+	operator()(const string &path, const hwpp::ConstDirentPtr &dirent)
+	{
+		(void)dirent;
+		if (!paths->empty()) {
+			*paths += " ";
+		}
+		*paths += path.empty() ? "/" : path;
+	}
+	string *paths;
+};
+
+static string
+run_query(const hwpp::ConstScopePtr &root, const string &pattern,
+          const string &types = "", const string &datatype = "")
+{
+	hwpp::Query query(pattern);
+	query.set_types(types);
+	query.set_datatype(datatype);
+	string paths;
+	query.run(root, Collector(&paths));
+	return paths;
+}
+
+TEST(test_patterns)
+{
+	hwpp::ScopePtr root = new_test_tree();
+	string s;
+
+	s = run_query(root, "/dev.0/lo");
+	TEST_ASSERT(s == "/dev.0/lo", "hwpp::Query: exact") << s;
+	s = run_query(root, "dev.*/lo");
+	TEST_ASSERT(s == "/dev.0/lo /dev.1/lo", "hwpp::Query: glob") << s;
+	s = run_query(root, "dev.1/%r?");
+	TEST_ASSERT(s == "/dev.1/%r0", "hwpp::Query: glob") << s;
+	s = run_query(root, "dev.0/cap");
+	TEST_ASSERT(s == "/dev.0/cap", "hwpp::Query: array") << s;
+	s = run_query(root, "dev.0/cap[*]/link");
+	TEST_ASSERT(s == "/dev.0/cap[0]/link /dev.0/cap[1]/link",
+	            "hwpp::Query: [*]") << s;
+	s = run_query(root, "dev.*/cap[1]/link");
+	TEST_ASSERT(s == "/dev.0/cap[1]/link /dev.1/cap[1]/link",
+	            "hwpp::Query: [N]") << s;
+	s = run_query(root, "dev.0/cap[2]/link");
+	TEST_ASSERT(s == "", "hwpp::Query: [N] out of range") << s;
+	s = run_query(root, "dev.0/lo[*]");
+	TEST_ASSERT(s == "", "hwpp::Query: [*] of a non-array") << s;
+	s = run_query(root, "dev.0/link/*");
+	TEST_ASSERT(s == "", "hwpp::Query: aliases are not followed") << s;
+	s = run_query(root, "nothing/*");
+	TEST_ASSERT(s == "", "hwpp::Query: no match") << s;
+	s = run_query(root, "/");
+	TEST_ASSERT(s == "/", "hwpp::Query: root") << s;
+}
+
+TEST(test_any_depth)
+{
+	hwpp::ScopePtr root = new_test_tree();
+	string s;
+
+	s = run_query(root, "**/lo");
+	TEST_ASSERT(s == "/dev.0/lo /dev.1/lo /other/lo",
+	            "hwpp::Query: **") << s;
+	s = run_query(root, "dev.1/**/link");
+	TEST_ASSERT(s == "/dev.1/link /dev.1/cap[0]/link /dev.1/cap[1]/link",
+	            "hwpp::Query: **") << s;
+	s = run_query(root, "dev.1/**/**/link", "field");
+	TEST_ASSERT(s == "/dev.1/cap[0]/link /dev.1/cap[1]/link",
+	            "hwpp::Query: **/**") << s;
+}
+
+TEST(test_filters)
+{
+	hwpp::ScopePtr root = new_test_tree();
+	string s;
+
+	s = run_query(root, "dev.0/*", "register,alias");
+	TEST_ASSERT(s == "/dev.0/%r0 /dev.0/link",
+	            "hwpp::Query::set_types()") << s;
+	s = run_query(root, "dev.0/*", "Scope Array");
+	TEST_ASSERT(s == "/dev.0/cap /dev.0/lazy",
+	            "hwpp::Query::set_types()") << s;
+	s = run_query(root, "dev.0/**", "", "hex8_t");
+	TEST_ASSERT(s == "/dev.0/lo /dev.0/cap[0]/link /dev.0/cap[1]/link",
+	            "hwpp::Query::set_datatype()") << s;
+	s = run_query(root, "**", "", "hex*");
+	TEST_ASSERT(s == "/dev.0/lo /dev.0/cap[0]/link /dev.0/cap[1]/link"
+	                 " /dev.1/lo /dev.1/cap[0]/link /dev.1/cap[1]/link"
+	                 " /other/lo",
+	            "hwpp::Query::set_datatype()") << s;
+	s = run_query(root, "**", "", "int*");
+	TEST_ASSERT(s == "", "hwpp::Query::set_datatype()") << s;
+}
+
+TEST(test_pruning)
+{
+	hwpp::ScopePtr root = new_test_tree();
+	n_built = 0;
+
+	string s = run_query(root, "dev.*/lo");
+	TEST_ASSERT(n_built == 0, "hwpp::Query: pruning") << n_built;
+	s = run_query(root, "dev.*/lazy");
+	TEST_ASSERT(s == "/dev.0/lazy /dev.1/lazy", "hwpp::Query") << s;
+	TEST_ASSERT(n_built == 0, "hwpp::Query: pruning") << n_built;
+	s = run_query(root, "dev.1/lazy/*");
+	TEST_ASSERT(s == "/dev.1/lazy/x", "hwpp::Query: lazy scope") << s;
+	TEST_ASSERT(n_built == 1, "hwpp::Query: pruning") << n_built;
+}
+
+TEST(test_errors)
+{
+	const char *bad_patterns[] = {
+		"a//b", "a/", "[3]", "a[x]", "a[-1]", "a[]",
+	};
+	for (size_t i = 0; i < sizeof(bad_patterns)/sizeof(*bad_patterns);
+	     i++) {
+		try {
+			hwpp::Query query(bad_patterns[i]);
+			TEST_FAIL("hwpp::Query::Query()") << bad_patterns[i];
+		} catch (std::invalid_argument &e) {
+		}
+	}
+
+	hwpp::Query query("*");
+	try {
+		query.set_types("field,widget");
+		TEST_FAIL("hwpp::Query::set_types()");
+	} catch (std::invalid_argument &e) {
+	}
+
+	TEST_ASSERT(hwpp::Query::is_query("dev.*/lo")
+	         && hwpp::Query::is_query("cap[*]")
+	         && hwpp::Query::is_query("%r?")
+	         && !hwpp::Query::is_query("/dev.0/cap[1]/link"),
+	    "hwpp::Query::is_query()");
+}
@@ -0,0 +1,169 @@
+#include "hwpp.h"
+#include "scope_template.h"
+#include "scope.h"
+#include "register_types.h"
+#include "field_types.h"
+#include "datatype_types.h"
+#include "alias.h"
+#include "test_binding.h"
+#include "util/test.h"
+
+// Build a scope like a template body would, against the placeholder.
+static hwpp::ScopePtr
+make_template_scope(const hwpp::RegisterPtr &shared)
+{
+	hwpp::ScopePtr scope = new_hwpp_scope(
+	    hwpp::ScopeTemplate::placeholder());
+	hwpp::RegisterPtr r0 = new_hwpp_bound_register(
+	    hwpp::ScopeTemplate::placeholder(), 0x10, hwpp::BITS16);
+	scope->add_dirent("%r0", r0);
+
+	hwpp::DatatypePtr hex = new_hwpp_hex_datatype(hwpp::BITS16);
+	scope->add_datatype("hex_t", hex);
+	scope->add_bookmark("tmpl");
+	scope->add_dirent("lo", new_hwpp_direct_field(hex,
+	                  hwpp::RegBits(r0, 7, 0)));
+	scope->add_dirent("mixed", new_hwpp_direct_field(hex,
+	                  hwpp::RegBits(r0, 3, 0)
+	                  + hwpp::RegBits(shared, 3, 0)));
+	scope->add_dirent("const", new_hwpp_constant_field(hex, 5));
+	scope->add_dirent("alias", new_hwpp_alias("lo"));
+
+	hwpp::ScopePtr sub = new_hwpp_scope();
+	sub->set_parent(scope);
+	sub->add_dirent("%r1", new_hwpp_bound_register(
+	    hwpp::ScopeTemplate::placeholder(), 0x20, hwpp::BITS8));
+	hwpp::ScopePtr inner = new_hwpp_scope();
+	inner->set_parent(sub);
+	inner->add_dirent("%r2", new_hwpp_bound_register(
+	    hwpp::ScopeTemplate::placeholder(), 0x28, hwpp::BITS8));
+	sub->add_dirent("inner", inner);
+	scope->add_dirent("sub", sub);
+	return scope;
+}
+
+TEST(test_scope_template)
+{
+	hwpp::BindingPtr binding = new_test_binding();
+	hwpp::RegisterPtr shared = new_hwpp_bound_register(binding, 0x30,
+	                                                   hwpp::BITS8);
+	hwpp::ConstScopeTemplatePtr tmpl = hwpp::ScopeTemplate::compile(
+	    make_template_scope(shared));
+	TEST_ASSERT(tmpl != NULL, "ScopeTemplate::compile()");
+	TEST_ASSERT(tmpl->n_dirents() == 6, "ScopeTemplate::n_dirents()");
+	TEST_ASSERT(tmpl->dirent_name(1) == "lo" && tmpl->find("lo") == 1,
+	    "ScopeTemplate::find()");
+	TEST_ASSERT(tmpl->find("nope") == -1, "ScopeTemplate::find()");
+
+	// two devices share one template
+	hwpp::ScopePtr root = new_hwpp_scope();
+	hwpp::ScopePtr dev0 = new_hwpp_scope(binding);
+	dev0->set_parent(root);
+	dev0->set_template(tmpl);
+	hwpp::ScopePtr dev1 = new_hwpp_scope(new_test_binding());
+	dev1->set_parent(root);
+	dev1->set_template(tmpl);
+	dev1->add_dirent("extra", new_hwpp_constant_field(
+	    new_hwpp_hex_datatype(hwpp::BITS8), 1));
+
+	TEST_ASSERT(dev0->n_dirents() == 6 && dev1->n_dirents() == 7,
+	    "Scope::set_template()");
+	TEST_ASSERT(dev1->dirent_name(6) == "extra"
+	         && dev1->dirent(6) == dev1->dirent("extra"),
+	    "Scope::set_template()");
+	TEST_ASSERT(dev0->datatype("hex_t") != NULL
+	         && dev0->has_bookmark("tmpl"), "Scope::set_template()");
+
+	// registers are bound to each device's own binding
+	hwpp::ConstRegisterPtr r0 = hwpp::register_from_dirent(
+	    dev0->dirent("%r0"));
+	boost::shared_ptr<const hwpp::BoundRegister> bound =
+	    boost::dynamic_pointer_cast<const hwpp::BoundRegister>(r0);
+	TEST_ASSERT(bound && bound->binding() == binding
+	         && bound->address() == 0x10 && r0->width() == hwpp::BITS16,
+	    "ScopeTemplate::instantiate()");
+	r0->write(0x1234);
+	TEST_ASSERT(r0->read() == 0x1234, "ScopeTemplate::instantiate()");
+	TEST_ASSERT(hwpp::field_from_dirent(dev0->dirent("lo"))->read()
+	            == 0x34, "ScopeTemplate::instantiate()");
+	TEST_ASSERT(hwpp::field_from_dirent(dev1->dirent("lo"))->read()
+	            != 0x34, "ScopeTemplate::instantiate()");
+
+	// shared dirents are the same object everywhere
+	TEST_ASSERT(dev0->dirent("const") == dev1->dirent("const")
+	         && dev0->dirent("alias") == dev1->dirent("alias"),
+	    "ScopeTemplate::instantiate()");
+	TEST_ASSERT(dev0->lookup_dirent("alias", hwpp::Scope::RESOLVE_ALIAS)
+	            ->is_field(), "ScopeTemplate::instantiate()");
+
+	// sub-scopes find their registers through their new parent
+	hwpp::ConstDirentPtr r1 = dev1->lookup_dirent("sub/%r1");
+	TEST_ASSERT(r1 && r1->is_register(), "ScopeTemplate::instantiate()");
+	bound = boost::dynamic_pointer_cast<const hwpp::BoundRegister>(
+	    hwpp::register_from_dirent(r1));
+	TEST_ASSERT(bound && bound->binding() == dev1->binding()
+	         && bound->address() == 0x20, "ScopeTemplate::instantiate()");
+	hwpp::ConstDirentPtr r2 = dev1->lookup_dirent("sub/inner/%r2");
+	TEST_ASSERT(r2 && r2->is_register(), "ScopeTemplate::instantiate()");
+	bound = boost::dynamic_pointer_cast<const hwpp::BoundRegister>(
+	    hwpp::register_from_dirent(r2));
+	TEST_ASSERT(bound && bound->binding() == dev1->binding()
+	         && bound->address() == 0x28, "ScopeTemplate::instantiate()");
+
+	// each dirent is made once per scope, while it is in use
+	TEST_ASSERT(dev0->dirent("lo") == dev0->dirent("lo")
+	         && dev0->dirent("lo") == dev0->dirent(1)
+	         && dev0->dirent("sub") == dev0->dirent("sub")
+	         && dev0->dirent("lo") != dev1->dirent("lo"),
+	    "Scope::dirent()");
+	TEST_ASSERT(dev1->lookup_dirent("sub/inner/%r2") == r2,
+	    "Scope::lookup_dirent()");
+
+	// registers and fields go once nothing holds them, sub-scopes don't
+	boost::weak_ptr<const hwpp::Dirent> lo = dev0->dirent("lo");
+	boost::weak_ptr<const hwpp::Dirent> sub = dev0->dirent("sub");
+	TEST_ASSERT(lo.expired() && !sub.expired(), "Scope::dirent()");
+	TEST_ASSERT(dev0->dirent("lo") && dev0->dirent("sub") == sub.lock(),
+	    "Scope::dirent()");
+
+	// the template's names can not be added again
+	try {
+		dev1->add_dirent("lo", new_hwpp_constant_field(
+		    new_hwpp_hex_datatype(hwpp::BITS8), 2));
+		TEST_FAIL("Scope::add_dirent()");
+	} catch (hwpp::Path::InvalidError &e) {
+	}
+	TEST_ASSERT(dev1->n_dirents() == 7, "Scope::add_dirent()");
+
+	// the template's own binding does no I/O
+	try {
+		hwpp::ScopeTemplate::placeholder()->read(0, hwpp::BITS8);
+		TEST_FAIL("ScopeTemplate::placeholder()");
+	} catch (hwpp::Driver::IoError &e) {
+	}
+}
+
+TEST(test_scope_template_errors)
+{
+	hwpp::BindingPtr binding = new_test_binding();
+	hwpp::DatatypePtr hex = new_hwpp_hex_datatype(hwpp::BITS16);
+
+	// scopes bound to real devices are not templates
+	hwpp::ScopePtr scope = new_hwpp_scope(binding);
+	TEST_ASSERT(!hwpp::ScopeTemplate::compile(scope),
+	    "ScopeTemplate::compile()");
+
+	// arrays can not be templated
+	scope = new_hwpp_scope(hwpp::ScopeTemplate::placeholder());
+	scope->add_dirent("a[]", new_hwpp_constant_field(hex, 1));
+	TEST_ASSERT(!hwpp::ScopeTemplate::compile(scope),
+	    "ScopeTemplate::compile()");
+
+	// nor can bound sub-scopes
+	scope = new_hwpp_scope(hwpp::ScopeTemplate::placeholder());
+	hwpp::ScopePtr sub = new_hwpp_scope(binding);
+	sub->set_parent(scope);
+	scope->add_dirent("sub", sub);
+	TEST_ASSERT(!hwpp::ScopeTemplate::compile(scope),
+	    "ScopeTemplate::compile()");
+}
@@ -404,3 +404,89 @@ TEST(test_dirents)
 		    << "hwpp::Scope::resolve_path(): got '" << final << "'";
 	}
 }
+
+// A builder for test_lazy.
+static int lazy_builds;
+static void
+lazy_builder(const hwpp::ScopePtr &scope)
+{
+	lazy_builds++;
+	hwpp::DatatypePtr dt = new_hwpp_int_datatype();
+	scope->add_dirent("field", new_hwpp_constant_field(dt, 0));
+	scope->add_bookmark("lazy");
+}
+
+TEST(test_lazy)
+{
+	hwpp::ScopePtr root = new_hwpp_scope();
+	hwpp::ScopePtr lazy = new_hwpp_scope(new_test_binding());
+	lazy->set_parent(root);
+	lazy->set_builder(lazy_builder);
+	root->add_dirent("lazy", lazy);
+
+	// adding and finding the stub must not build it
+	lazy_builds = 0;
+	TEST_ASSERT(!lazy->is_populated(), "hwpp::Scope::is_populated()");
+	TEST_ASSERT(root->n_dirents() == 1, "hwpp::Scope::n_dirents()");
+	TEST_ASSERT(root->dirent_defined("lazy"),
+	    "hwpp::Scope::dirent_defined()");
+	TEST_ASSERT(lazy_builds == 0, "hwpp::Scope::set_builder()");
+
+	// looking inside it builds it, once
+	TEST_ASSERT(root->dirent_defined("lazy/field"),
+	    "hwpp::Scope::dirent_defined()");
+	TEST_ASSERT(lazy_builds == 1, "hwpp::Scope::set_builder()");
+	TEST_ASSERT(lazy->is_populated(), "hwpp::Scope::is_populated()");
+	TEST_ASSERT(lazy->n_dirents() == 1, "hwpp::Scope::n_dirents()");
+	TEST_ASSERT(lazy->has_bookmark("lazy"), "hwpp::Scope::has_bookmark()");
+	TEST_ASSERT(lazy_builds == 1, "hwpp::Scope::set_builder()");
+
+	// iterating a lazy scope builds it
+	hwpp::ScopePtr lazy2 = new_hwpp_scope();
+	lazy2->set_builder(lazy_builder);
+	TEST_ASSERT(lazy2->n_dirents() == 1, "hwpp::Scope::n_dirents()");
+	TEST_ASSERT(lazy2->dirent_name(0) == "field",
+	    "hwpp::Scope::dirent_name()");
+	TEST_ASSERT(lazy_builds == 2, "hwpp::Scope::set_builder()");
+}
+
+// A builder for test_lazy_error, which fails part way through the first
+// time it runs.
+static void
+failing_builder(const hwpp::ScopePtr &scope)
+{
+	lazy_builds++;
+	hwpp::DatatypePtr dt = new_hwpp_int_datatype();
+	scope->add_dirent("first", new_hwpp_constant_field(dt, 0));
+	scope->add_bookmark("failing");
+	if (lazy_builds == 1) {
+		throw hwpp::Driver::IoError("failing builder");
+	}
+	scope->add_dirent("second", new_hwpp_constant_field(dt, 1));
+}
+
+TEST(test_lazy_error)
+{
+	hwpp::ScopePtr lazy = new_hwpp_scope(new_test_binding());
+	lazy->set_builder(failing_builder);
+
+	// a failed build leaves the scope unbuilt
+	lazy_builds = 0;
+	try {
+		lazy->n_dirents();
+		TEST_FAIL("hwpp::Scope::set_builder()");
+	} catch (hwpp::Driver::IoError &e) {
+	}
+	TEST_ASSERT(lazy_builds == 1, "hwpp::Scope::set_builder()");
+	TEST_ASSERT(!lazy->is_populated(), "hwpp::Scope::is_populated()");
+
+	// the next lookup builds it again, from scratch
+	TEST_ASSERT(lazy->n_dirents() == 2, "hwpp::Scope::n_dirents()");
+	TEST_ASSERT(lazy_builds == 2, "hwpp::Scope::set_builder()");
+	TEST_ASSERT(lazy->is_populated(), "hwpp::Scope::is_populated()");
+	TEST_ASSERT(lazy->dirent_name(0) == "first"
+	         && lazy->dirent_name(1) == "second",
+	    "hwpp::Scope::dirent_name()");
+	TEST_ASSERT(lazy->has_bookmark("failing"),
+	    "hwpp::Scope::has_bookmark()");
+}
@@ -0,0 +1,357 @@
+#include "hwpp.h"
+#include "snapshot.h"
+#include "scope.h"
+#include "register_types.h"
+#include "driver.h"
+#include "drivers/mem/mem_driver.h"
+#include "drivers/io/io_driver.h"
+#include "util/filesystem.h"
+#include <fstream>
+#include <stdexcept>
+#include "util/test.h"
+
+// A binding whose registers read back as a function of their address.
+class AddressBinding: public hwpp::Binding
+{
+    public:
+	explicit AddressBinding(const string &name): m_name(name) {}
+
+	virtual hwpp::Value
+	read(const hwpp::Value &address, const hwpp::BitWidth width) const
+	{
+		if (address == 0xbad)
+			throw hwpp::Driver::IoError("address binding read");
+		return ((address * 0x01010101) & hwpp::MASK(width));
+	}
+
+	virtual void
+	write(const hwpp::Value &address, const hwpp::BitWidth width,
+	    const hwpp::Value &value) const
+	{
+		(void)address; (void)width; (void)value;
+	}
+
+	virtual string
+	to_string() const
+	{
+		return m_name;
+	}
+
+    private:
+	string m_name;
+};
+
+static hwpp::ScopePtr
+make_tree()
+{
+	hwpp::ScopePtr root = new_hwpp_scope();
+
+	hwpp::BindingPtr b0(new AddressBinding("dev0"));
+	hwpp::ScopePtr s0 = new_hwpp_scope(b0);
+	s0->set_parent(root);
+	root->add_dirent("s0", s0);
+	s0->add_dirent("%r0", new_hwpp_bound_register(b0, 0x10, hwpp::BITS8));
+	s0->add_dirent("%r1", new_hwpp_bound_register(b0, 0x10, hwpp::BITS32));
+	s0->add_dirent("%r2", new_hwpp_bound_register(b0, 0x4, hwpp::BITS16));
+	s0->add_dirent("%bad", new_hwpp_bound_register(b0, 0xbad, hwpp::BITS8));
+	// a duplicate, in a sub-scope
+	hwpp::ScopePtr sub = new_hwpp_scope();
+	sub->set_parent(s0);
+	s0->add_dirent("sub", sub);
+	sub->add_dirent("%r0", new_hwpp_bound_register(b0, 0x10, hwpp::BITS8));
+
+	hwpp::BindingPtr b1(new AddressBinding("dev1"));
+	hwpp::ScopePtr s1 = new_hwpp_scope(b1);
+	s1->set_parent(root);
+	root->add_dirent("s1[]", s1);
+	s1->add_dirent("%r[]", new_hwpp_bound_register(b1, 0x100, hwpp::BITS64));
+
+	return root;
+}
+
+TEST(test_snapshot)
+{
+	string filename = filesystem::File::tempname(
+	    string(TEST_TMP_DIR()) + "/snapshot.XXXXXX");
+	hwpp::write_snapshot(make_tree(), filename);
+
+	hwpp::SnapshotPtr snap = hwpp::Snapshot::open(filename);
+
+	// bindings
+	TEST_ASSERT(snap->n_bindings() == 2, "hwpp::Snapshot::n_bindings()");
+	TEST_ASSERT(snap->find_binding("nope") == -1,
+	    "hwpp::Snapshot::find_binding()");
+	int b0 = snap->find_binding("dev0");
+	int b1 = snap->find_binding("dev1");
+	TEST_ASSERT(b0 >= 0 && b1 >= 0, "hwpp::Snapshot::find_binding()");
+	TEST_ASSERT(snap->binding_name(b0) == "dev0",
+	    "hwpp::Snapshot::binding_name()");
+	TEST_ASSERT(snap->binding_path(b0) == "/s0")
+	    << "hwpp::Snapshot::binding_path(): " << snap->binding_path(b0);
+	TEST_ASSERT(snap->binding_path(b1) == "/s1[0]")
+	    << "hwpp::Snapshot::binding_path(): " << snap->binding_path(b1);
+
+	// registers, sorted by (address, width) and de-duplicated
+	TEST_ASSERT(snap->n_registers(b0) == 4,
+	    "hwpp::Snapshot::n_registers()");
+	TEST_ASSERT(snap->register_address(b0, 0) == 0x4
+	         && snap->register_address(b0, 1) == 0x10
+	         && snap->register_width(b0, 1) == hwpp::BITS8
+	         && snap->register_width(b0, 2) == hwpp::BITS32
+	         && snap->register_address(b0, 3) == 0xbad,
+	    "hwpp::Snapshot::register_address()");
+
+	// values
+	hwpp::Value v;
+	TEST_ASSERT(snap->read(b0, 0x10, hwpp::BITS8, &v) && v == 0x10,
+	    "hwpp::Snapshot::read()");
+	TEST_ASSERT(snap->read(b0, 0x10, hwpp::BITS32, &v) && v == 0x10101010,
+	    "hwpp::Snapshot::read()");
+	TEST_ASSERT(snap->read(b0, 0x4, hwpp::BITS16, &v) && v == 0x0404,
+	    "hwpp::Snapshot::read()");
+	TEST_ASSERT(snap->read(b1, 0x100, hwpp::BITS64, &v)
+	         && v == hwpp::Value("0x101010100"),
+	    "hwpp::Snapshot::read()");
+	TEST_ASSERT(snap->read(b0, 0, &v) && v == 0x0404,
+	    "hwpp::Snapshot::read()");
+
+	// things that are not there, or failed
+	TEST_ASSERT(!snap->read(b0, 0xbad, hwpp::BITS8, &v),
+	    "hwpp::Snapshot::read()");
+	TEST_ASSERT(!snap->read(b0, 0x10, hwpp::BITS16, &v),
+	    "hwpp::Snapshot::read()");
+	TEST_ASSERT(!snap->read(b0, 0x11, hwpp::BITS8, &v),
+	    "hwpp::Snapshot::read()");
+	TEST_ASSERT(!snap->read(-1, 0x10, hwpp::BITS8, &v),
+	    "hwpp::Snapshot::read()");
+
+	filesystem::File::unlink(filename);
+}
+
+TEST(test_snapshot_writer)
+{
+	string filename = filesystem::File::tempname(
+	    string(TEST_TMP_DIR()) + "/snapshot.XXXXXX");
+
+	hwpp::SnapshotWriter writer;
+	writer.add_binding("dev1", "/one");
+	writer.add_binding("dev1", "/two");
+	writer.add_register("dev1", 0x8, hwpp::BITS32, 0x12345678);
+	writer.add_register("dev1", 0x8, hwpp::BITS32, 0);
+	writer.add_unreadable("dev1", 0x0, hwpp::BITS8);
+	writer.add_register("dev0", 0x0, hwpp::BITS128,
+	    hwpp::Value("0x112233445566778899aabbccddeeff00"));
+	TEST_ASSERT(writer.has_register("dev1", 0x8, hwpp::BITS32),
+	    "hwpp::SnapshotWriter::has_register()");
+	TEST_ASSERT(!writer.has_register("dev1", 0x8, hwpp::BITS16),
+	    "hwpp::SnapshotWriter::has_register()");
+	TEST_ASSERT(!writer.has_register("dev2", 0x8, hwpp::BITS32),
+	    "hwpp::SnapshotWriter::has_register()");
+	try {
+		writer.add_register("dev1", -1, hwpp::BITS8, 0);
+		TEST_FAIL("hwpp::SnapshotWriter::add_register()");
+	} catch (std::out_of_range &e) {
+	}
+	writer.write(filename);
+
+	hwpp::SnapshotPtr snap = hwpp::Snapshot::open(filename);
+	TEST_ASSERT(snap->n_bindings() == 2, "hwpp::SnapshotWriter::write()");
+	int b0 = snap->find_binding("dev0");
+	int b1 = snap->find_binding("dev1");
+	TEST_ASSERT(b0 == 0 && b1 == 1, "hwpp::SnapshotWriter::write()");
+	TEST_ASSERT(snap->binding_path(b0) == "",
+	    "hwpp::SnapshotWriter::add_binding()");
+	TEST_ASSERT(snap->binding_path(b1) == "/one",
+	    "hwpp::SnapshotWriter::add_binding()");
+
+	// the first value added is the one that is kept
+	hwpp::Value v;
+	TEST_ASSERT(snap->read(b1, 0x8, hwpp::BITS32, &v) && v == 0x12345678,
+	    "hwpp::SnapshotWriter::add_register()");
+	TEST_ASSERT(snap->n_registers(b1) == 2,
+	    "hwpp::SnapshotWriter::add_unreadable()");
+	TEST_ASSERT(!snap->read(b1, 0x0, hwpp::BITS8, &v),
+	    "hwpp::SnapshotWriter::add_unreadable()");
+	TEST_ASSERT(snap->read(b0, 0x0, hwpp::BITS128, &v)
+	         && v == hwpp::Value("0x112233445566778899aabbccddeeff00"),
+	    "hwpp::SnapshotWriter::add_register()");
+
+	filesystem::File::unlink(filename);
+}
+
+// Overwrite part of a file in place.
+static void
+patch_file(const string &filename, uint64_t offset, const void *data,
+           size_t size)
+{
+	std::fstream file(filename.c_str(),
+	                  std::ios::in | std::ios::out | std::ios::binary);
+	file.seekp(offset);
+	file.write(reinterpret_cast<const char *>(data), size);
+}
+
+TEST(test_bad_files)
+{
+	string filename = filesystem::File::tempname(
+	    string(TEST_TMP_DIR()) + "/snapshot.XXXXXX");
+
+	// not found
+	try {
+		hwpp::Snapshot::open(filename);
+		TEST_FAIL("hwpp::Snapshot::open()");
+	} catch (syserr::NotFound &e) {
+	}
+
+	// not a snapshot
+	{
+		std::ofstream out(filename.c_str());
+		out << string(256, 'x');
+	}
+	try {
+		hwpp::Snapshot::open(filename);
+		TEST_FAIL("hwpp::Snapshot::open()");
+	} catch (hwpp::Snapshot::FormatError &e) {
+	}
+
+	// truncated
+	hwpp::write_snapshot(make_tree(), filename);
+	truncate(filename.c_str(), 100);
+	try {
+		hwpp::Snapshot::open(filename);
+		TEST_FAIL("hwpp::Snapshot::open()");
+	} catch (hwpp::Snapshot::FormatError &e) {
+	}
+
+	// offsets which wrap around when sizes are added to them
+	hwpp::write_snapshot(make_tree(), filename);
+	hwpp::Snapshot::FileHeader hdr;
+	{
+		std::ifstream in(filename.c_str());
+		in.read(reinterpret_cast<char *>(&hdr), sizeof(hdr));
+	}
+	hwpp::Snapshot::FileHeader bad_hdr = hdr;
+	bad_hdr.bindings_offset = ~uint64_t(0) - 7;
+	patch_file(filename, 0, &bad_hdr, sizeof(bad_hdr));
+	try {
+		hwpp::Snapshot::open(filename);
+		TEST_FAIL("hwpp::Snapshot::open(): bindings offset");
+	} catch (hwpp::Snapshot::FormatError &e) {
+	}
+	patch_file(filename, 0, &hdr, sizeof(hdr));
+
+	hwpp::Snapshot::FileRecord rec;
+	{
+		std::ifstream in(filename.c_str());
+		in.seekg(hdr.records_offset);
+		in.read(reinterpret_cast<char *>(&rec), sizeof(rec));
+	}
+	rec.flags |= hwpp::Snapshot::RECORD_VALID;
+	rec.data_offset = ~uint64_t(0) - 1;
+	patch_file(filename, hdr.records_offset, &rec, sizeof(rec));
+	try {
+		hwpp::Snapshot::open(filename);
+		TEST_FAIL("hwpp::Snapshot::open(): record data offset");
+	} catch (hwpp::Snapshot::FormatError &e) {
+	}
+
+	filesystem::File::unlink(filename);
+}
+
+TEST(test_snapshot_binding)
+{
+	string filename = filesystem::File::tempname(
+	    string(TEST_TMP_DIR()) + "/snapshot.XXXXXX");
+	hwpp::write_snapshot(make_tree(), filename);
+	hwpp::SnapshotPtr snap = hwpp::Snapshot::open(filename);
+
+	hwpp::BindingPtr b = hwpp::new_snapshot_binding(snap, "dev0");
+	TEST_ASSERT(b->to_string() == "dev0", "SnapshotBinding::to_string()");
+	TEST_ASSERT(b->read(0x10, hwpp::BITS32) == 0x10101010,
+	    "SnapshotBinding::read()");
+
+	// a register the snapshot has, bound like the original
+	hwpp::RegisterPtr reg = new_hwpp_bound_register(b, 0x4, hwpp::BITS16);
+	TEST_ASSERT(reg->read() == 0x0404, "SnapshotBinding::read()");
+
+	// missing and failed registers
+	try {
+		b->read(0x10, hwpp::BITS64);
+		TEST_FAIL("SnapshotBinding::read()");
+	} catch (hwpp::Driver::IoError &e) {
+	}
+	try {
+		b->read(0xbad, hwpp::BITS8);
+		TEST_FAIL("SnapshotBinding::read()");
+	} catch (hwpp::Driver::IoError &e) {
+	}
+
+	// writes always fail
+	try {
+		b->write(0x10, hwpp::BITS8, 0);
+		TEST_FAIL("SnapshotBinding::write()");
+	} catch (hwpp::Driver::IoError &e) {
+	}
+
+	// a binding the snapshot does not have
+	hwpp::BindingPtr none = hwpp::new_snapshot_binding(snap, "nope");
+	try {
+		none->read(0x10, hwpp::BITS8);
+		TEST_FAIL("SnapshotBinding::read()");
+	} catch (hwpp::Driver::IoError &e) {
+	}
+
+	filesystem::File::unlink(filename);
+}
+
+TEST(test_snapshot_drivers)
+{
+	// Scopes bound to mem<> and io<>, as a device's MSI-X table or
+	// legacy ports would be.  These bindings are named just like the
+	// real ones, which would touch hardware.
+	hwpp::ScopePtr root = new_hwpp_scope();
+	hwpp::BindingPtr mb(new AddressBinding(
+	    to_string(hwpp::MemAddress(0xfebf0000, 0x1000))));
+	hwpp::ScopePtr msix = new_hwpp_scope(mb);
+	msix->set_parent(root);
+	root->add_dirent("msix", msix);
+	msix->add_dirent("%r0", new_hwpp_bound_register(mb, 0x4, hwpp::BITS32));
+	hwpp::BindingPtr ib(new AddressBinding(
+	    to_string(hwpp::IoAddress(0x70, 2))));
+	hwpp::ScopePtr rtc = new_hwpp_scope(ib);
+	rtc->set_parent(root);
+	root->add_dirent("rtc", rtc);
+	rtc->add_dirent("%r0", new_hwpp_bound_register(ib, 0x1, hwpp::BITS8));
+
+	string filename = filesystem::File::tempname(
+	    string(TEST_TMP_DIR()) + "/snapshot.XXXXXX");
+	hwpp::write_snapshot(root, filename);
+	hwpp::SnapshotPtr snap = hwpp::Snapshot::open(filename);
+
+	// the drivers find them by the args BIND() would get
+	std::vector<hwpp::Value> args;
+	args.push_back(0xfebf0000);
+	args.push_back(0x1000);
+	hwpp::MemDriver mem;
+	hwpp::BindingPtr b = hwpp::new_snapshot_binding(snap,
+	    mem.binding_name(args));
+	TEST_ASSERT(b->read(0x4, hwpp::BITS32) == 0x04040404,
+	    "MemDriver::binding_name()");
+
+	args.clear();
+	args.push_back(0x70);
+	args.push_back(2);
+	hwpp::IoDriver io;
+	b = hwpp::new_snapshot_binding(snap, io.binding_name(args));
+	TEST_ASSERT(b->read(0x1, hwpp::BITS8) == 0x01,
+	    "IoDriver::binding_name()");
+
+	// bad args are still caught
+	args.clear();
+	try {
+		mem.binding_name(args);
+		TEST_FAIL("MemDriver::binding_name()");
+	} catch (hwpp::Driver::ArgsError &e) {
+	}
+
+	filesystem::File::unlink(filename);
+}
@@ -0,0 +1,209 @@
+#include "hwpp.h"
+#include "trace.h"
+#include <pthread.h>
+#include <sstream>
+#include <stdexcept>
+#include "util/printfxx.h"
+#include "util/test.h"
+
+using namespace hwpp;
+
+// Drivers turn on tracing and hit trace points from static constructors,
+// which may run before or after any in trace.cc.  This one runs first if
+// the test is linked first, and must not be undone.
+static struct EarlyEnable {
+	EarlyEnable()
+	{
+		trace::enable(TRACE_BINDINGS);
+	}
+} early_enable;
+
+TEST(test_early_enable)
+{
+	TEST_ASSERT(trace::enabled(TRACE_BINDINGS), "trace::enable()");
+	trace::disable(TRACE_BINDINGS);
+}
+
+TEST(test_categories)
+{
+	TEST_ASSERT(trace::parse_categories("") == 0,
+	    "trace::parse_categories()");
+	TEST_ASSERT(trace::parse_categories("scopes") == TRACE_SCOPES,
+	    "trace::parse_categories()");
+	TEST_ASSERT(trace::parse_categories("TRACE_SCOPES, types")
+	            == (TRACE_SCOPES | TRACE_TYPES),
+	    "trace::parse_categories()");
+	TEST_ASSERT(trace::parse_categories("SCOPES DISCOVERY")
+	            == (TRACE_SCOPES | TRACE_DISCOVERY),
+	    "trace::parse_categories()");
+	TEST_ASSERT(trace::parse_categories("all") == TRACE_ALL,
+	    "trace::parse_categories()");
+	try {
+		trace::parse_categories("scopes,bogus");
+		TEST_FAIL("trace::parse_categories()");
+	} catch (std::invalid_argument &e) {
+	}
+
+	TEST_ASSERT(string(trace::category_name(TRACE_FIELD_BITS))
+	            == "FIELD_BITS", "trace::category_name()");
+}
+
+TEST(test_enable)
+{
+	trace::disable(TRACE_ALL);
+	TEST_ASSERT(!trace::enabled(TRACE_SCOPES), "trace::enabled()");
+
+	trace::enable(TRACE_SCOPES);
+	TEST_ASSERT(trace::enabled(TRACE_SCOPES), "trace::enabled()");
+	// all of the categories must be on
+	TEST_ASSERT(!trace::enabled(TRACE_SCOPES | TRACE_TYPES),
+	    "trace::enabled()");
+	trace::enable(TRACE_TYPES);
+	TEST_ASSERT(trace::enabled(TRACE_SCOPES | TRACE_TYPES),
+	    "trace::enabled()");
+
+	trace::disable(TRACE_SCOPES);
+	TEST_ASSERT(!trace::enabled(TRACE_SCOPES), "trace::enabled()");
+	TEST_ASSERT(trace::enabled(TRACE_TYPES), "trace::enabled()");
+	trace::disable(TRACE_ALL);
+}
+
+static int n_evaluated;
+
+static string
+evaluate_message()
+{
+	n_evaluated++;
+	return "evaluated";
+}
+
+TEST(test_dtrace)
+{
+	trace::disable(TRACE_ALL);
+	trace::clear();
+
+	// a trace point which is off records nothing, and does not even
+	// build its message
+	n_evaluated = 0;
+	DTRACE(TRACE_SCOPES, evaluate_message());
+	TEST_ASSERT(n_evaluated == 0, "DTRACE()");
+	TEST_ASSERT(trace::n_events() == 0, "DTRACE()");
+
+	trace::enable(TRACE_SCOPES);
+	DTRACE(TRACE_SCOPES, evaluate_message());
+	DTRACE(TRACE_SCOPES, "value " << 42);
+	DTRACE(TRACE_SCOPES | TRACE_TYPES, "scopes and types");
+	TEST_ASSERT(n_evaluated == 1, "DTRACE()");
+	TEST_ASSERT(trace::n_events() == 2, "DTRACE()");
+
+	{
+		DTRACE_SPAN(TRACE_SCOPES, "a span");
+	}
+	TEST_ASSERT(trace::n_events() == 3, "DTRACE_SPAN()");
+
+	trace::clear();
+	TEST_ASSERT(trace::n_events() == 0, "trace::clear()");
+	trace::disable(TRACE_ALL);
+}
+
+TEST(test_ring)
+{
+	trace::disable(TRACE_ALL);
+	trace::clear();
+
+	// the ring keeps the newest events
+	trace::enable(TRACE_REGS);
+	for (unsigned i = 0; i < trace::RING_SIZE + 10; i++) {
+		DTRACE(TRACE_REGS, "event " << i);
+	}
+	TEST_ASSERT(trace::n_events() == trace::RING_SIZE, "trace ring");
+
+	std::ostringstream oss;
+	trace::write_chrome_trace(oss);
+	string json = oss.str();
+	TEST_ASSERT(json.find("\"event 9\"") == string::npos, "trace ring");
+	TEST_ASSERT(json.find("\"event 10\"") != string::npos, "trace ring");
+	TEST_ASSERT(json.find(printfxx::sprintfxx("\"event %d\"",
+	                                           trace::RING_SIZE + 9))
+	            != string::npos, "trace ring");
+
+	// long messages are truncated
+	trace::clear();
+	DTRACE(TRACE_REGS, string(1000, 'x'));
+	oss.str("");
+	trace::write_chrome_trace(oss);
+	json = oss.str();
+	TEST_ASSERT(json.find(string(trace::MAX_MESSAGE, 'x') + "\"")
+	            != string::npos, "trace truncation");
+
+	trace::clear();
+	trace::disable(TRACE_ALL);
+}
+
+TEST(test_chrome_trace)
+{
+	trace::disable(TRACE_ALL);
+	trace::clear();
+
+	std::ostringstream oss;
+	trace::write_chrome_trace(oss);
+	TEST_ASSERT(oss.str() == "{\"traceEvents\":[\n"
+	                         "],\"displayTimeUnit\":\"ns\"}\n",
+	    "trace::write_chrome_trace()");
+
+	trace::enable(TRACE_SCOPES | TRACE_TYPES);
+	DTRACE(TRACE_SCOPES | TRACE_TYPES, "quote \" slash \\ tab \t");
+	{
+		DTRACE_SPAN(TRACE_TYPES, "span");
+	}
+	oss.str("");
+	trace::write_chrome_trace(oss);
+	string json = oss.str();
+	TEST_ASSERT(json.find("\"name\":\"quote \\\" slash \\\\ tab \\u0009\"")
+	            != string::npos, "trace::write_chrome_trace()");
+	TEST_ASSERT(json.find("\"cat\":\"SCOPES,TYPES\",\"ph\":\"i\"")
+	            != string::npos, "trace::write_chrome_trace()");
+	TEST_ASSERT(json.find("\"name\":\"span\",\"cat\":\"TYPES\","
+	                      "\"ph\":\"X\"") != string::npos,
+	    "trace::write_chrome_trace()");
+	TEST_ASSERT(json.find("\"dur\":") != string::npos,
+	    "trace::write_chrome_trace()");
+
+	trace::clear();
+	trace::disable(TRACE_ALL);
+}
+
+static void *
+trace_thread(void *arg)
+{
+	(void)arg;
+	for (int i = 0; i < 100; i++) {
+		DTRACE(TRACE_LIFETIMES, "thread event " << i);
+	}
+	return NULL;
+}
+
+TEST(test_threads)
+{
+	trace::disable(TRACE_ALL);
+	trace::clear();
+	trace::enable(TRACE_LIFETIMES);
+
+	// each thread gets its own ring, and rings outlive their threads
+	pthread_t threads[4];
+	for (int i = 0; i < 4; i++) {
+		pthread_create(&threads[i], NULL, trace_thread, NULL);
+	}
+	for (int i = 0; i < 4; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	TEST_ASSERT(trace::n_events() == 400, "trace threads");
+
+	// a new thread reuses a ring, keeping the old events
+	pthread_create(&threads[0], NULL, trace_thread, NULL);
+	pthread_join(threads[0], NULL);
+	TEST_ASSERT(trace::n_events() == 500, "trace threads");
+
+	trace::clear();
+	trace::disable(TRACE_ALL);
+}
@@ -0,0 +1,154 @@
+#include "hwpp.h"
+#include "tree_writer.h"
+#include "scope.h"
+#include "array.h"
+#include "alias.h"
+#include "register_types.h"
+#include "field_types.h"
+#include "datatype_types.h"
+#include "test_binding.h"
+#include "util/output_buffer.h"
+#include "util/test.h"
+
+#include <unistd.h>
+
+// Build a small tree:
+// 	/dev		a scope bound to a TestBinding
+// 	/dev/%r0	a 16 bit register
+// 	/dev/lo		a field of %r0
+// 	/dev/bad	a field which can not be read
+// 	/dev/link	an alias to lo
+// 	/dev/bit[]	an array of two fields
+// 	/dev/sub	an unbound scope
+// 	/dev/sub/hi	a field of %r0
+static hwpp::ScopePtr
+new_test_tree()
+{
+	hwpp::BindingPtr binding = new_test_binding();
+	hwpp::ScopePtr root = new_hwpp_scope();
+	hwpp::ScopePtr dev = new_hwpp_scope(binding);
+	dev->set_parent(root);
+	root->add_dirent("dev", dev);
+
+	hwpp::RegisterPtr r0 = new_hwpp_bound_register(binding, 0x0,
+	                                               hwpp::BITS16);
+	hwpp::RegisterPtr bad = new_hwpp_bound_register(binding, 0x12345678,
+	                                                hwpp::BITS8);
+	dev->add_dirent("%r0", r0);
+
+	hwpp::DatatypePtr hex = new_hwpp_hex_datatype(hwpp::BITS8);
+	dev->add_dirent("lo", new_hwpp_direct_field(hex,
+	                hwpp::RegBits(r0, 7, 0)));
+	dev->add_dirent("bad", new_hwpp_direct_field(hex,
+	                hwpp::RegBits(bad)));
+	dev->add_dirent("link", new_hwpp_alias("lo"));
+	hwpp::ArrayPtr bits = new_hwpp_array(hwpp::DIRENT_TYPE_FIELD);
+	dev->add_dirent("bit", bits);
+	bits->append(new_hwpp_direct_field(hex, hwpp::RegBits(r0, 0)));
+	bits->append(new_hwpp_direct_field(hex, hwpp::RegBits(r0, 1)));
+
+	hwpp::ScopePtr sub = new_hwpp_scope();
+	sub->set_parent(dev);
+	dev->add_dirent("sub", sub);
+	sub->add_dirent("hi", new_hwpp_direct_field(hex,
+	                hwpp::RegBits(r0, 15, 8)));
+	return root;
+}
+
+// Write a tree in some format and return the output.
+static string
+write_test_tree(const string &format, unsigned flags)
+{
+	int fds[2];
+	if (pipe(fds) < 0) {
+		TEST_FAIL("pipe()");
+	}
+	{
+		util::OutputBuffer out(fds[1]);
+		hwpp::TreeWriterPtr writer = hwpp::new_tree_writer(format,
+		                                                   &out);
+		writer->begin_output();
+		hwpp::write_tree(new_test_tree(), "", writer.get(), flags);
+		writer->end_output();
+	}
+	close(fds[1]);
+
+	string result;
+	char buf[4096];
+	ssize_t r;
+	while ((r = read(fds[0], buf, sizeof(buf))) > 0) {
+		result.append(buf, r);
+	}
+	close(fds[0]);
+	return result;
+}
+
+TEST(test_json)
+{
+	string s = write_test_tree("json", 0);
+	string expected =
+	    "[\n"
+	    "{\"path\":\"/\",\"name\":\"\",\"type\":\"scope\",\"children\":[\n"
+	    "{\"path\":\"/dev\",\"name\":\"dev\",\"type\":\"scope\","
+	        "\"binding\":\"test\",\"children\":[\n"
+	    "{\"path\":\"/dev/%r0\",\"name\":\"%r0\",\"type\":\"register\","
+	        "\"raw\":\"0xffff\"},\n"
+	    "{\"path\":\"/dev/lo\",\"name\":\"lo\",\"type\":\"field\","
+	        "\"raw\":\"0xff\",\"value\":\"0xff\"},\n"
+	    "{\"path\":\"/dev/bad\",\"name\":\"bad\",\"type\":\"error\","
+	        "\"error\":\"test binding read\"},\n"
+	    "{\"path\":\"/dev/link\",\"name\":\"link\",\"type\":\"alias\","
+	        "\"target\":\"lo\"},\n"
+	    "{\"path\":\"/dev/bit\",\"name\":\"bit\",\"type\":\"array\","
+	        "\"children\":[\n"
+	    "{\"path\":\"/dev/bit[0]\",\"name\":\"bit[0]\",\"type\":\"field\","
+	        "\"raw\":\"0x1\",\"value\":\"0x01\"},\n"
+	    "{\"path\":\"/dev/bit[1]\",\"name\":\"bit[1]\",\"type\":\"field\","
+	        "\"raw\":\"0x1\",\"value\":\"0x01\"}]},\n"
+	    "{\"path\":\"/dev/sub\",\"name\":\"sub\",\"type\":\"scope\","
+	        "\"children\":[\n"
+	    "{\"path\":\"/dev/sub/hi\",\"name\":\"hi\",\"type\":\"field\","
+	        "\"raw\":\"0xff\",\"value\":\"0xff\"}]}]}]}\n"
+	    "]\n";
+	TEST_ASSERT(s == expected, "hwpp::JsonTreeWriter") << "\n" << s;
+}
+
+TEST(test_csv)
+{
+	string s = write_test_tree("csv", 0);
+	TEST_ASSERT(s == "path,raw,decoded\n"
+	                 "/dev/%r0,0xffff,\n"
+	                 "/dev/lo,0xff,0xff\n"
+	                 "/dev/bad,,error: test binding read\n"
+	                 "/dev/bit[0],0x1,0x01\n"
+	                 "/dev/bit[1],0x1,0x01\n"
+	                 "/dev/sub/hi,0xff,0xff\n",
+	            "hwpp::FlatTreeWriter") << "\n" << s;
+
+	s = write_test_tree("csv", hwpp::TREE_SKIP_REGISTERS);
+	TEST_ASSERT(s == "path,raw,decoded\n"
+	                 "/dev/lo,0xff,0xff\n"
+	                 "/dev/bad,,error: test binding read\n"
+	                 "/dev/bit[0],0x1,0x01\n"
+	                 "/dev/bit[1],0x1,0x01\n"
+	                 "/dev/sub/hi,0xff,0xff\n",
+	            "hwpp::TREE_SKIP_REGISTERS") << "\n" << s;
+}
+
+TEST(test_tsv)
+{
+	string s = write_test_tree("tsv", hwpp::TREE_SKIP_FIELDS);
+	TEST_ASSERT(s == "path\traw\tdecoded\n"
+	                 "/dev/%r0\t0xffff\t\n",
+	            "hwpp::FlatTreeWriter") << "\n" << s;
+}
+
+TEST(test_bad_format)
+{
+	util::OutputBuffer out(-1);
+	try {
+		hwpp::new_tree_writer("xml", &out);
+		TEST_FAIL("hwpp::new_tree_writer()");
+	} catch (std::invalid_argument &e) {
+	}
+}
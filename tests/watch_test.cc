@@ -0,0 +1,145 @@
+#include "hwpp.h"
+#include "watch.h"
+#include "scope.h"
+#include "register_types.h"
+#include "field_types.h"
+#include "datatype_types.h"
+#include "test_binding.h"
+#include "util/test.h"
+
+#include <stdexcept>
+
+static const uint64_t SECOND = 1000000000ULL;
+
+// Build a tree:
+// 	/dev/%r0	a 16 bit register
+// 	/dev/count	bits 7:0 of %r0, of the named type "counter_t"
+// 	/dev/hi		bits 15:8 of %r0
+// 	/dev/const	a constant field
+static hwpp::ScopePtr
+new_test_tree(hwpp::RegisterPtr *reg)
+{
+	hwpp::ScopePtr root = new_hwpp_scope();
+	root->add_datatype("counter_t", new_hwpp_int_datatype());
+
+	hwpp::BindingPtr binding = new_test_binding();
+	hwpp::ScopePtr dev = new_hwpp_scope(binding);
+	dev->set_parent(root);
+	root->add_dirent("dev", dev);
+
+	*reg = new_hwpp_bound_register(binding, 0x0, hwpp::BITS16);
+	dev->add_dirent("%r0", *reg);
+	dev->add_dirent("count", new_hwpp_direct_field(
+	                root->datatype("counter_t"),
+	                hwpp::RegBits(*reg, 7, 0)));
+	dev->add_dirent("hi", new_hwpp_direct_field(
+	                new_hwpp_hex_datatype(hwpp::BITS8),
+	                hwpp::RegBits(*reg, 15, 8)));
+	dev->add_dirent("const", new_hwpp_constant_field(
+	                new_hwpp_int_datatype(), 7));
+	return root;
+}
+
+// Get the changed paths, separated by spaces.
+static string
+changed_paths(const std::vector<hwpp::WatchChange> &changes)
+{
+	string paths;
+	for (size_t i = 0; i < changes.size(); i++) {
+		if (i > 0) {
+			paths += " ";
+		}
+		paths += changes[i].path;
+	}
+	return paths;
+}
+
+TEST(test_add)
+{
+	hwpp::RegisterPtr reg;
+	hwpp::ScopePtr root = new_test_tree(&reg);
+	hwpp::Watch watch(root);
+
+	TEST_ASSERT(watch.add("dev/count") == 1, "hwpp::Watch::add()");
+	TEST_ASSERT(watch.add("dev/count") == 0,
+	            "hwpp::Watch::add(): duplicate");
+	TEST_ASSERT(watch.add("dev/nothing") == 0,
+	            "hwpp::Watch::add(): no match");
+	TEST_ASSERT(watch.add("dev") == 3,
+	            "hwpp::Watch::add(): scope") << watch.size();
+	TEST_ASSERT(watch.size() == 4, "hwpp::Watch::size()");
+
+	try {
+		watch.add("dev//count");
+		TEST_FAIL("hwpp::Watch::add(): invalid pattern");
+	} catch (std::invalid_argument &e) {
+	}
+}
+
+TEST(test_poll)
+{
+	hwpp::RegisterPtr reg;
+	hwpp::ScopePtr root = new_test_tree(&reg);
+	hwpp::Watch watch(root);
+	watch.add("dev/*");
+
+	std::vector<hwpp::WatchChange> changes;
+	watch.poll(0, &changes);
+	string s = changed_paths(changes);
+	TEST_ASSERT(s == "/dev/%r0 /dev/count /dev/hi /dev/const",
+	            "hwpp::Watch::poll(): first") << s;
+	TEST_ASSERT(changes[0].new_valid && !changes[0].old_valid
+	         && changes[0].new_value == 0xffff && !changes[0].is_field,
+	            "hwpp::Watch::poll(): register");
+	TEST_ASSERT(changes[2].is_field && changes[2].new_string == "0xff",
+	            "hwpp::Watch::poll(): field") << changes[2].new_string;
+
+	changes.clear();
+	watch.poll(SECOND, &changes);
+	TEST_ASSERT(changes.empty(), "hwpp::Watch::poll(): no change")
+	    << changed_paths(changes);
+
+	// only the low byte changes
+	reg->write(0xff10);
+	changes.clear();
+	watch.poll(2 * SECOND, &changes);
+	s = changed_paths(changes);
+	TEST_ASSERT(s == "/dev/%r0 /dev/count",
+	            "hwpp::Watch::poll(): changed bits") << s;
+	TEST_ASSERT(changes[1].old_value == 0xff
+	         && changes[1].new_value == 0x10
+	         && changes[1].old_string == "255"
+	         && changes[1].new_string == "16",
+	            "hwpp::Watch::poll(): values");
+	TEST_ASSERT(!changes[1].has_rate, "hwpp::Watch::poll(): not counter");
+}
+
+TEST(test_rates)
+{
+	hwpp::RegisterPtr reg;
+	hwpp::ScopePtr root = new_test_tree(&reg);
+	hwpp::Watch watch(root);
+	watch.set_counters("counter_*");
+	watch.add("dev");
+
+	reg->write(0x0010);
+	std::vector<hwpp::WatchChange> changes;
+	watch.poll(0, &changes);
+	TEST_ASSERT(!changes[1].has_rate, "hwpp::Watch::poll(): first");
+
+	reg->write(0x0030);
+	changes.clear();
+	watch.poll(SECOND / 2, &changes);
+	TEST_ASSERT(changed_paths(changes) == "/dev/%r0 /dev/count",
+	            "hwpp::Watch::poll()") << changed_paths(changes);
+	TEST_ASSERT(!changes[0].has_rate, "hwpp::Watch::poll(): register");
+	TEST_ASSERT(changes[1].has_rate && changes[1].rate == 64.0,
+	            "hwpp::Watch::poll(): rate") << changes[1].rate;
+
+	// 0x30 -> 0x08 wraps at 8 bits
+	reg->write(0x0008);
+	changes.clear();
+	watch.poll(SECOND / 2 + SECOND, &changes);
+	TEST_ASSERT(changes[1].has_rate && changes[1].rate == 216.0,
+	            "hwpp::Watch::poll(): wrapped rate") << changes[1].rate;
+}
@@ -0,0 +1,437 @@
+//
+// Runtime tracing.
+//
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace hwpp {
+namespace trace {
+
+// The names of the categories, in bit order.
+static const char *category_names[] = {
+	"DIRENTS",
+	"REGS",
+	"FIELDS",
+	"FIELD_BITS",
+	"SCOPES",
+	"TYPES",
+	"DRIVER_UTILS",
+	"DISCOVERY",
+	"LIFETIMES",
+	"BINDINGS",
+};
+static const unsigned n_categories =
+    sizeof(category_names) / sizeof(category_names[0]);
+
+const char *
+category_name(uint32_t category)
+{
+	for (unsigned i = 0; i < n_categories; i++) {
+		if (category == (1U << i)) {
+			return category_names[i];
+		}
+	}
+	return "UNKNOWN";
+}
+
+uint32_t
+parse_categories(const std::string &names)
+{
+	uint32_t mask = 0;
+	size_t pos = 0;
+	while (pos < names.size()) {
+		size_t end = names.find_first_of(", ", pos);
+		if (end == std::string::npos) {
+			end = names.size();
+		}
+		std::string name = names.substr(pos, end - pos);
+		pos = end + 1;
+		if (name.empty()) {
+			continue;
+		}
+		if (strncasecmp(name.c_str(), "TRACE_", 6) == 0) {
+			name = name.substr(6);
+		}
+		if (strcasecmp(name.c_str(), "ALL") == 0) {
+			mask |= TRACE_ALL;
+			continue;
+		}
+		unsigned i;
+		for (i = 0; i < n_categories; i++) {
+			if (strcasecmp(name.c_str(), category_names[i]) == 0) {
+				mask |= (1U << i);
+				break;
+			}
+		}
+		if (i == n_categories) {
+			throw std::invalid_argument(
+			    "unknown trace category: " + name);
+		}
+	}
+	return mask;
+}
+
+//
+// Which categories are on
+//
+
+// Categories can be turned on at build time with TRACE="FOO BAR" (see
+// MakeRules.mk), and at run time with HWPP_TRACE="FOO,BAR" in the
+// environment.  These are applied the first time anything looks at the
+// mask, which may be before main(), so a bad name is reported and ignored
+// rather than thrown.
+#ifndef HWPP_TRACE_DEFAULT
+#define HWPP_TRACE_DEFAULT ""
+#endif
+
+// Zero-initialized, so it is valid before any constructor runs.
+uint32_t enabled_mask;
+
+static bool echo_events;
+static pthread_once_t defaults_once = PTHREAD_ONCE_INIT;
+
+// stderr rather than std::cerr, which may not be constructed yet.
+static uint32_t
+parse_default(const char *what, const char *names)
+{
+	try {
+		return parse_categories(names);
+	} catch (std::invalid_argument &e) {
+		fprintf(stderr, "%s: %s\n", what, e.what());
+	}
+	return 0;
+}
+
+static void
+apply_defaults()
+{
+	uint32_t mask = parse_default("TRACE", HWPP_TRACE_DEFAULT);
+#if DEBUG
+	// Build-time tracing has always gone to stderr.
+	echo_events = (mask != 0);
+#endif
+	const char *env = getenv("HWPP_TRACE");
+	if (env) {
+		mask |= parse_default("HWPP_TRACE", env);
+	}
+	__sync_fetch_and_or(&enabled_mask, mask | INITIALIZED);
+}
+
+uint32_t
+initialize()
+{
+	pthread_once(&defaults_once, apply_defaults);
+	return __atomic_load_n(&enabled_mask, __ATOMIC_RELAXED);
+}
+
+void
+enable(uint32_t categories)
+{
+	initialize();
+	__sync_fetch_and_or(&enabled_mask, categories & ~INITIALIZED);
+}
+
+void
+disable(uint32_t categories)
+{
+	initialize();
+	__sync_fetch_and_and(&enabled_mask, ~(categories & ~INITIALIZED));
+}
+
+void
+set_echo(bool echo)
+{
+	initialize();
+	echo_events = echo;
+}
+
+uint64_t
+now_nsecs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//
+// The per-thread rings
+//
+
+namespace {
+
+struct Event {
+	uint64_t start_nsecs;
+	uint64_t duration_nsecs;
+	uint32_t categories;
+	uint32_t tid;
+	bool complete;
+	char message[MAX_MESSAGE + 1];
+};
+
+// Each ring is written by one thread at a time.  The lock is only ever
+// contended while the events are being exported or cleared.
+struct Ring {
+	Ring(): next(0), size(0), in_use(true), tid(0)
+	{
+		pthread_mutex_init(&lock, NULL);
+	}
+
+	pthread_mutex_t lock;
+	Event events[RING_SIZE];
+	size_t next;
+	size_t size;
+	bool in_use;
+	uint32_t tid;
+};
+
+}  // namespace
+
+// Every ring ever made.  Rings are not freed when their thread exits, so
+// that its events can still be exported.  Instead, they are handed on to
+// the next new thread, so short-lived threads don't keep adding rings.
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static __thread Ring *this_thread_ring;
+
+// this avoids the static initialization order fiasco
+static std::vector<Ring *> &
+all_rings()
+{
+	static std::vector<Ring *> the_rings;
+	return the_rings;
+}
+
+static void
+release_ring(void *arg)
+{
+	Ring *ring = static_cast<Ring *>(arg);
+	pthread_mutex_lock(&rings_lock);
+	ring->in_use = false;
+	pthread_mutex_unlock(&rings_lock);
+}
+
+static void
+make_ring_key()
+{
+	pthread_key_create(&ring_key, release_ring);
+}
+
+static Ring *
+acquire_ring()
+{
+	pthread_once(&ring_key_once, make_ring_key);
+
+	Ring *ring = NULL;
+	pthread_mutex_lock(&rings_lock);
+	std::vector<Ring *> &rings = all_rings();
+	for (size_t i = 0; i < rings.size(); i++) {
+		if (!rings[i]->in_use) {
+			ring = rings[i];
+			ring->in_use = true;
+			break;
+		}
+	}
+	if (!ring) {
+		ring = new Ring();
+		rings.push_back(ring);
+	}
+	pthread_mutex_unlock(&rings_lock);
+
+	ring->tid = syscall(SYS_gettid);
+	pthread_setspecific(ring_key, ring);
+	this_thread_ring = ring;
+	return ring;
+}
+
+static void
+record(uint32_t categories, const char *message, size_t length,
+       uint64_t start_nsecs, uint64_t duration_nsecs, bool complete)
+{
+	Ring *ring = this_thread_ring;
+	if (!ring) {
+		ring = acquire_ring();
+	}
+	if (length > MAX_MESSAGE) {
+		length = MAX_MESSAGE;
+	}
+
+	pthread_mutex_lock(&ring->lock);
+	Event &ev = ring->events[ring->next];
+	ev.start_nsecs = start_nsecs;
+	ev.duration_nsecs = duration_nsecs;
+	ev.categories = categories;
+	ev.tid = ring->tid;
+	ev.complete = complete;
+	memcpy(ev.message, message, length);
+	ev.message[length] = '\0';
+	ring->next = (ring->next + 1) % RING_SIZE;
+	if (ring->size < RING_SIZE) {
+		ring->size++;
+	}
+	pthread_mutex_unlock(&ring->lock);
+
+	if (echo_events) {
+		if (complete) {
+			fprintf(stderr, "DBG: %s (%llu ns)\n", ev.message,
+			        (unsigned long long)duration_nsecs);
+		} else {
+			fprintf(stderr, "DBG: %s\n", ev.message);
+		}
+	}
+}
+
+void
+record_instant(uint32_t categories, const std::string &message)
+{
+	record(categories, message.data(), message.size(),
+	       now_nsecs(), 0, false);
+}
+
+void
+record_complete(uint32_t categories, const char *name,
+                uint64_t start_nsecs)
+{
+	uint64_t now = now_nsecs();
+	record(categories, name, strlen(name),
+	       start_nsecs, now - start_nsecs, true);
+}
+
+//
+// Export
+//
+
+static bool
+earlier(const Event &lhs, const Event &rhs)
+{
+	return lhs.start_nsecs < rhs.start_nsecs;
+}
+
+// Take a copy of every event, oldest first.
+static std::vector<Event>
+copy_events()
+{
+	std::vector<Event> events;
+	pthread_mutex_lock(&rings_lock);
+	std::vector<Ring *> &rings = all_rings();
+	for (size_t i = 0; i < rings.size(); i++) {
+		Ring *ring = rings[i];
+		pthread_mutex_lock(&ring->lock);
+		size_t first = ring->next + RING_SIZE - ring->size;
+		for (size_t j = 0; j < ring->size; j++) {
+			events.push_back(ring->events[(first + j) % RING_SIZE]);
+		}
+		pthread_mutex_unlock(&ring->lock);
+	}
+	pthread_mutex_unlock(&rings_lock);
+
+	std::stable_sort(events.begin(), events.end(), earlier);
+	return events;
+}
+
+static void
+write_json_string(std::ostream &out, const char *str)
+{
+	out << '"';
+	for (const char *p = str; *p; p++) {
+		unsigned char c = *p;
+		if (c == '"' || c == '\\') {
+			out << '\\' << c;
+		} else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out << buf;
+		} else {
+			out << c;
+		}
+	}
+	out << '"';
+}
+
+// Chrome wants microseconds, but takes fractions.
+static void
+write_usecs(std::ostream &out, uint64_t nsecs)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%llu.%03u",
+	         (unsigned long long)(nsecs / 1000),
+	         (unsigned)(nsecs % 1000));
+	out << buf;
+}
+
+void
+write_chrome_trace(std::ostream &out)
+{
+	std::vector<Event> events = copy_events();
+	int pid = getpid();
+
+	out << "{\"traceEvents\":[";
+	for (size_t i = 0; i < events.size(); i++) {
+		const Event &ev = events[i];
+		out << (i ? ",\n" : "\n");
+		out << "{\"name\":";
+		write_json_string(out, ev.message);
+		out << ",\"cat\":\"";
+		const char *sep = "";
+		for (unsigned c = 0; c < n_categories; c++) {
+			if (ev.categories & (1U << c)) {
+				out << sep << category_names[c];
+				sep = ",";
+			}
+		}
+		out << "\",\"ph\":\"" << (ev.complete ? "X" : "i") << "\"";
+		out << ",\"ts\":";
+		write_usecs(out, ev.start_nsecs);
+		if (ev.complete) {
+			out << ",\"dur\":";
+			write_usecs(out, ev.duration_nsecs);
+		} else {
+			out << ",\"s\":\"t\"";
+		}
+		out << ",\"pid\":" << pid << ",\"tid\":" << ev.tid << "}";
+	}
+	out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+void
+clear()
+{
+	pthread_mutex_lock(&rings_lock);
+	std::vector<Ring *> &rings = all_rings();
+	for (size_t i = 0; i < rings.size(); i++) {
+		pthread_mutex_lock(&rings[i]->lock);
+		rings[i]->next = 0;
+		rings[i]->size = 0;
+		pthread_mutex_unlock(&rings[i]->lock);
+	}
+	pthread_mutex_unlock(&rings_lock);
+}
+
+size_t
+n_events()
+{
+	size_t n = 0;
+	pthread_mutex_lock(&rings_lock);
+	std::vector<Ring *> &rings = all_rings();
+	for (size_t i = 0; i < rings.size(); i++) {
+		pthread_mutex_lock(&rings[i]->lock);
+		n += rings[i]->size;
+		pthread_mutex_unlock(&rings[i]->lock);
+	}
+	pthread_mutex_unlock(&rings_lock);
+	return n;
+}
+
+}  // namespace trace
+}  // namespace hwpp
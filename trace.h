@@ -0,0 +1,162 @@
+#ifndef HWPP_TRACE_H__
+#define HWPP_TRACE_H__
+
+// This is included by debug.h, so it must not include hwpp.h.
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <ostream>
+
+namespace hwpp {
+
+// The trace categories.  A trace point may name more than one, in which
+// case it is only on when all of them are.
+enum TraceCategory {
+	TRACE_DIRENTS      = 1 << 0,  // dirents
+	TRACE_REGS         = 1 << 1,  // register creation
+	TRACE_FIELDS       = 1 << 2,  // field creation
+	TRACE_FIELD_BITS   = 1 << 3,  // field bit manipulation
+	TRACE_SCOPES       = 1 << 4,  // scope creation and lookups
+	TRACE_TYPES        = 1 << 5,  // datatype creation and lookups
+	TRACE_DRIVER_UTILS = 1 << 6,  // driver registration
+	TRACE_DISCOVERY    = 1 << 7,  // device discovery
+	TRACE_LIFETIMES    = 1 << 8,  // object lifetimes
+	TRACE_BINDINGS     = 1 << 9,  // binding creation
+	TRACE_ALL          = (1 << 10) - 1
+};
+
+/*
+ * Runtime tracing.
+ *
+ * Trace points are grouped into categories, each of which can be turned
+ * on or off while the program runs.  A trace point which is off costs
+ * one relaxed load and a branch, so they can stay in production builds.
+ * A trace point which is on records an event into a ring buffer owned by
+ * the calling thread, so threads never contend with each other.  When a
+ * ring fills up, the oldest events are overwritten.  The events of all
+ * threads can be written out in the Chrome trace event format, which
+ * chrome://tracing and Perfetto can load.
+ *
+ * Use the DTRACE() and DTRACE_SPAN() macros in debug.h rather than
+ * calling these directly.
+ */
+namespace trace {
+
+// The number of events each thread keeps.
+static const unsigned RING_SIZE = 4096;
+
+// Messages longer than this are truncated.
+static const unsigned MAX_MESSAGE = 119;
+
+// The enabled categories.  Use enabled() to read this.  It is zero until
+// the first trace point, or the first call to enable() or disable(), sets
+// it from the defaults (see initialize()).  There is no constructor, so
+// trace points in other static constructors see the same thing however
+// the program was linked.
+extern uint32_t enabled_mask;
+
+// This bit of enabled_mask is set once the defaults have been applied.
+static const uint32_t INITIALIZED = 1U << 31;
+
+// Apply the build-time and HWPP_TRACE defaults, if that has not been done
+// yet, and return enabled_mask.  This is safe to call at any time, from
+// any thread.
+extern uint32_t
+initialize();
+
+// Test whether all of a set of categories are on.
+inline bool
+enabled(uint32_t categories)
+{
+	uint32_t mask = __atomic_load_n(&enabled_mask, __ATOMIC_RELAXED);
+	if (!(mask & INITIALIZED)) {
+		mask = initialize();
+	}
+	return (mask & categories) == categories;
+}
+
+// Turn categories on or off.
+extern void
+enable(uint32_t categories);
+extern void
+disable(uint32_t categories);
+
+// Parse a list of category names, separated by commas or spaces, into a
+// mask.  Names are matched without regard to case, with or without the
+// "TRACE_" prefix, and "all" means every category.  Throws
+// std::invalid_argument for an unknown name.
+extern uint32_t
+parse_categories(const std::string &names);
+
+// The name of a single category, without the "TRACE_" prefix.
+extern const char *
+category_name(uint32_t category);
+
+// Copy events to stderr as they are recorded, as DTRACE() did before it
+// could be turned on at runtime.  This is on in DEBUG builds which turn
+// on categories at build time, and off otherwise.
+extern void
+set_echo(bool echo);
+
+// Record an event which happened at one point in time.
+extern void
+record_instant(uint32_t categories, const std::string &message);
+
+// Record an event which started at 'start_nsecs' and lasted until now.
+extern void
+record_complete(uint32_t categories, const char *name,
+                uint64_t start_nsecs);
+
+// The clock which events are stamped with, in nanoseconds.
+extern uint64_t
+now_nsecs();
+
+// Write every recorded event, from every thread, as a Chrome trace JSON
+// object.  Threads may keep tracing while this runs.
+extern void
+write_chrome_trace(std::ostream &out);
+
+// Forget every recorded event.
+extern void
+clear();
+
+// The number of events currently held, from every thread.
+extern size_t
+n_events();
+
+/*
+ * Span - record how long a block of code takes.
+ *
+ * Nothing is recorded if the categories were off when the span began.
+ * The name must outlive the span, which a string literal does.
+ */
+class Span
+{
+    public:
+	Span(uint32_t categories, const char *name)
+	    : m_categories(categories), m_name(name),
+	      m_start(enabled(categories) ? now_nsecs() : 0)
+	{
+	}
+	~Span()
+	{
+		if (m_start) {
+			record_complete(m_categories, m_name, m_start);
+		}
+	}
+
+    private:
+	uint32_t m_categories;
+	const char *m_name;
+	uint64_t m_start;
+
+	// not copyable
+	Span(const Span &);
+	Span &operator=(const Span &);
+};
+
+}  // namespace trace
+
+}  // namespace hwpp
+
+#endif // HWPP_TRACE_H__
@@ -0,0 +1,404 @@
+//
+// Serialize trees as JSON, CSV or TSV.
+//
+#include "hwpp.h"
+#include "tree_writer.h"
+
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+
+#include "scope.h"
+#include "array.h"
+#include "field.h"
+#include "register.h"
+#include "alias.h"
+#include "util/output_buffer.h"
+
+namespace hwpp {
+
+//
+// JSON
+//
+
+class JsonTreeWriter: public TreeWriter
+{
+    public:
+	explicit JsonTreeWriter(util::OutputBuffer *out): m_out(out)
+	{
+	}
+
+	virtual void
+	begin_output()
+	{
+		m_out->write('[');
+		m_first.push_back(true);
+	}
+	virtual void
+	end_output()
+	{
+		m_first.pop_back();
+		m_out->write("\n]\n");
+	}
+
+	virtual void
+	begin_scope(const string &path, const ConstBindingPtr &binding)
+	{
+		begin_object(path, "scope");
+		if (binding) {
+			m_out->write(",\"binding\":");
+			write_string(binding->to_string());
+		}
+		begin_children();
+	}
+	virtual void
+	end_scope()
+	{
+		end_children();
+	}
+	virtual void
+	begin_array(const string &path)
+	{
+		begin_object(path, "array");
+		begin_children();
+	}
+	virtual void
+	end_array()
+	{
+		end_children();
+	}
+
+	virtual void
+	write_field(const string &path, const Value &raw,
+	            const string &decoded)
+	{
+		begin_object(path, "field");
+		write_raw(raw);
+		m_out->write(",\"value\":");
+		write_string(decoded);
+		m_out->write('}');
+	}
+	virtual void
+	write_register(const string &path, const Value &raw)
+	{
+		begin_object(path, "register");
+		write_raw(raw);
+		m_out->write('}');
+	}
+	virtual void
+	write_alias(const string &path, const string &target)
+	{
+		begin_object(path, "alias");
+		m_out->write(",\"target\":");
+		write_string(target);
+		m_out->write('}');
+	}
+	virtual void
+	write_error(const string &path, const string &message)
+	{
+		begin_object(path, "error");
+		m_out->write(",\"error\":");
+		write_string(message);
+		m_out->write('}');
+	}
+
+    private:
+	// Start an object, on a line of its own, with a comma if it is not
+	// the first in its list.
+	void
+	begin_object(const string &path, const char *type)
+	{
+		m_out->write(m_first.back() ? "\n" : ",\n");
+		m_first.back() = false;
+
+		// the name is the last element of the path
+		size_t slash = path.rfind('/');
+		size_t name = (slash == string::npos) ? 0 : slash + 1;
+		m_out->write("{\"path\":");
+		write_string(path.empty() ? "/" : path);
+		m_out->write(",\"name\":");
+		write_string(path.c_str() + name, path.size() - name);
+		m_out->write(",\"type\":\"");
+		m_out->write(type);
+		m_out->write('"');
+	}
+	void
+	begin_children()
+	{
+		m_out->write(",\"children\":[");
+		m_first.push_back(true);
+	}
+	void
+	end_children()
+	{
+		m_first.pop_back();
+		m_out->write("]}");
+	}
+
+	void
+	write_raw(const Value &raw)
+	{
+		m_out->write(",\"raw\":\"0x");
+		m_out->write_hex(raw);
+		m_out->write('"');
+	}
+	void
+	write_string(const string &str)
+	{
+		write_string(str.data(), str.size());
+	}
+	void
+	write_string(const char *str, size_t len)
+	{
+		m_out->write('"');
+		for (size_t i = 0; i < len; i++) {
+			unsigned char c = str[i];
+			if (c == '"' || c == '\\') {
+				m_out->write('\\');
+				m_out->write(c);
+			} else if (c < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				m_out->write(buf);
+			} else {
+				m_out->write(c);
+			}
+		}
+		m_out->write('"');
+	}
+
+	util::OutputBuffer *m_out;
+	// for each open list, whether nothing has been written to it yet
+	std::vector<bool> m_first;
+};
+
+//
+// CSV and TSV
+//
+
+class FlatTreeWriter: public TreeWriter
+{
+    public:
+	FlatTreeWriter(util::OutputBuffer *out, char separator)
+	    : m_out(out), m_separator(separator)
+	{
+	}
+
+	virtual void
+	begin_output()
+	{
+		write_row("path", NULL, "decoded", "raw");
+	}
+
+	virtual void
+	begin_scope(const string &path, const ConstBindingPtr &binding)
+	{
+		(void)path;
+		(void)binding;
+	}
+	virtual void
+	end_scope()
+	{
+	}
+	virtual void
+	begin_array(const string &path)
+	{
+		(void)path;
+	}
+	virtual void
+	end_array()
+	{
+	}
+
+	virtual void
+	write_field(const string &path, const Value &raw,
+	            const string &decoded)
+	{
+		write_row(path, &raw, decoded);
+	}
+	virtual void
+	write_register(const string &path, const Value &raw)
+	{
+		write_row(path, &raw, "");
+	}
+	virtual void
+	write_alias(const string &path, const string &target)
+	{
+		(void)path;
+		(void)target;
+	}
+	virtual void
+	write_error(const string &path, const string &message)
+	{
+		write_row(path, NULL, "error: " + message);
+	}
+
+    private:
+	// Write one row.  The raw column is 'raw_title' in the header, and
+	// empty if there is no value.
+	void
+	write_row(const string &path, const Value *raw, const string &decoded,
+	          const char *raw_title = "")
+	{
+		write_column(path);
+		m_out->write(m_separator);
+		if (raw) {
+			m_out->write("0x");
+			m_out->write_hex(*raw);
+		} else {
+			m_out->write(raw_title);
+		}
+		m_out->write(m_separator);
+		write_column(decoded);
+		m_out->write('\n');
+	}
+
+	void
+	write_column(const string &str)
+	{
+		if (m_separator == '\t') {
+			write_tsv(str);
+		} else {
+			write_csv(str);
+		}
+	}
+	void
+	write_csv(const string &str)
+	{
+		if (str.find_first_of(",\"\r\n") == string::npos) {
+			m_out->write(str);
+			return;
+		}
+		m_out->write('"');
+		for (size_t i = 0; i < str.size(); i++) {
+			if (str[i] == '"') {
+				m_out->write('"');
+			}
+			m_out->write(str[i]);
+		}
+		m_out->write('"');
+	}
+	void
+	write_tsv(const string &str)
+	{
+		for (size_t i = 0; i < str.size(); i++) {
+			switch (str[i]) {
+			    case '\\':
+				m_out->write("\\\\");
+				break;
+			    case '\t':
+				m_out->write("\\t");
+				break;
+			    case '\n':
+				m_out->write("\\n");
+				break;
+			    case '\r':
+				m_out->write("\\r");
+				break;
+			    default:
+				m_out->write(str[i]);
+			}
+		}
+	}
+
+	util::OutputBuffer *m_out;
+	char m_separator;
+};
+
+TreeWriterPtr
+new_tree_writer(const string &format, util::OutputBuffer *out)
+{
+	if (format == "json") {
+		return TreeWriterPtr(new JsonTreeWriter(out));
+	}
+	if (format == "csv") {
+		return TreeWriterPtr(new FlatTreeWriter(out, ','));
+	}
+	if (format == "tsv") {
+		return TreeWriterPtr(new FlatTreeWriter(out, '\t'));
+	}
+	throw std::invalid_argument("unknown output format: " + format);
+}
+
+//
+// The walk
+//
+
+static void
+walk_dirent(const ConstDirentPtr &de, util::PathBuffer *path,
+            TreeWriter *writer, unsigned flags);
+
+static void
+walk_scope(const ConstScopePtr &scope, util::PathBuffer *path,
+           TreeWriter *writer, unsigned flags)
+{
+	// this populates lazy scopes, so do it before anything is written
+	size_t n = scope->n_dirents();
+
+	// binding() looks up the tree, so only pass the scope's own binding
+	writer->begin_scope(path->str(),
+	    scope->is_bound() ? scope->binding() : ConstBindingPtr());
+	for (size_t i = 0; i < n; i++) {
+		size_t mark = path->push("/", scope->dirent_name(i));
+		walk_dirent(scope->dirent(i), path, writer, flags);
+		path->pop(mark);
+	}
+	writer->end_scope();
+}
+
+static void
+walk_array(const ConstArrayPtr &array, util::PathBuffer *path,
+           TreeWriter *writer, unsigned flags)
+{
+	writer->begin_array(path->str());
+	for (size_t i = 0; i < array->size(); i++) {
+		size_t mark = path->push_index(i);
+		walk_dirent(array->at(i), path, writer, flags);
+		path->pop(mark);
+	}
+	writer->end_array();
+}
+
+static void
+walk_dirent(const ConstDirentPtr &de, util::PathBuffer *path,
+            TreeWriter *writer, unsigned flags)
+{
+	try {
+		if (de->is_field()) {
+			if (!(flags & TREE_SKIP_FIELDS)) {
+				// read once, so raw and decoded agree
+				ConstFieldPtr field = field_from_dirent(de);
+				Value raw = field->read();
+				writer->write_field(path->str(), raw,
+				    field->datatype()->evaluate(raw));
+			}
+		} else if (de->is_register()) {
+			if (!(flags & TREE_SKIP_REGISTERS)) {
+				writer->write_register(path->str(),
+				    register_from_dirent(de)->read());
+			}
+		} else if (de->is_scope()) {
+			walk_scope(scope_from_dirent(de), path, writer, flags);
+		} else if (de->is_array()) {
+			walk_array(array_from_dirent(de), path, writer, flags);
+		} else if (de->is_alias()) {
+			if (!(flags & TREE_SKIP_ALIASES)) {
+				writer->write_alias(path->str(),
+				    alias_from_dirent(de)->link_path()
+				    .to_string());
+			}
+		}
+	} catch (std::exception &e) {
+		writer->write_error(path->str(), e.what());
+	}
+}
+
+void
+write_tree(const ConstDirentPtr &dirent, const string &path,
+           TreeWriter *writer, unsigned flags)
+{
+	util::PathBuffer path_buffer(path);
+	walk_dirent(dirent, &path_buffer, writer, flags);
+}
+
+}  // namespace hwpp
@@ -0,0 +1,107 @@
+#ifndef HWPP_TREE_WRITER_H__
+#define HWPP_TREE_WRITER_H__
+
+#include "hwpp.h"
+#include <boost/shared_ptr.hpp>
+#include "binding.h"
+#include "dirent.h"
+#include "util/output_buffer.h"
+
+namespace hwpp {
+
+/*
+ * TreeWriter - serialize a tree in a machine-readable format.
+ *
+ * write_tree() walks a tree and calls a TreeWriter for each dirent it
+ * finds, in tree order.  Writers emit output as they are called, so the
+ * whole document is never built in memory.
+ *
+ * Paths are given as they are in hwpp_read: "/a/b" for scope members and
+ * "/a/b[3]" for array elements.  The root scope has the path "".
+ */
+class TreeWriter
+{
+    public:
+	virtual ~TreeWriter()
+	{
+	}
+
+	/* called once before and once after everything else */
+	virtual void
+	begin_output()
+	{
+	}
+	virtual void
+	end_output()
+	{
+	}
+
+	/* the members of a scope or array come between begin and end */
+	virtual void
+	begin_scope(const string &path, const ConstBindingPtr &binding) = 0;
+	virtual void
+	end_scope() = 0;
+	virtual void
+	begin_array(const string &path) = 0;
+	virtual void
+	end_array() = 0;
+
+	virtual void
+	write_field(const string &path, const Value &raw,
+	    const string &decoded) = 0;
+	virtual void
+	write_register(const string &path, const Value &raw) = 0;
+	virtual void
+	write_alias(const string &path, const string &target) = 0;
+
+	/* a dirent which could not be read */
+	virtual void
+	write_error(const string &path, const string &message) = 0;
+};
+typedef boost::shared_ptr<TreeWriter> TreeWriterPtr;
+
+/*
+ * new_tree_writer(format, out)
+ *
+ * Create a writer for the named format, which writes to 'out':
+ *
+ * 	json	one JSON document: an array holding an object per tree
+ * 		written, with the members of scopes and arrays nested
+ * 		in "children".  Values are hex strings, since they can be
+ * 		wider than a JSON number can hold.
+ * 	csv	one "path,raw,decoded" row per field and register, as in
+ * 		RFC 4180.  Registers have no decoded value.  Scopes and
+ * 		aliases are left out.
+ * 	tsv	the same as csv, separated by tabs.  Backslashes, tabs
+ * 		and newlines in values are escaped as \\, \t and \n.
+ *
+ * In csv and tsv, an unreadable field or register has an empty raw
+ * column and "error: <message>" in the decoded column.
+ *
+ * Throws: std::invalid_argument
+ */
+extern TreeWriterPtr
+new_tree_writer(const string &format, util::OutputBuffer *out);
+
+/* flags for write_tree() */
+enum {
+	TREE_SKIP_FIELDS = 0x01,
+	TREE_SKIP_REGISTERS = 0x02,
+	TREE_SKIP_ALIASES = 0x04
+};
+
+/*
+ * write_tree(dirent, path, writer, flags)
+ *
+ * Walk a tree from 'dirent', which is found at 'path', and feed it to a
+ * writer.  Lazy scopes are populated along the way.  Errors reading a
+ * dirent are passed to the writer rather than thrown.  Call the writer's
+ * begin_output() and end_output() around one or more calls to this.
+ */
+extern void
+write_tree(const ConstDirentPtr &dirent, const string &path,
+    TreeWriter *writer, unsigned flags = 0);
+
+}  // namespace hwpp
+
+#endif // HWPP_TREE_WRITER_H__
@@ -0,0 +1,122 @@
+// A simple region allocator.
+
+#ifndef HWPP_UTIL_ARENA_H__
+#define HWPP_UTIL_ARENA_H__
+
+#include <stdlib.h>
+#include <new>
+#include <vector>
+#include "util/assert.h"
+
+namespace util {
+
+// This hands out memory from large chunks, and frees it all at once when
+// the Arena is destroyed.  There is no way to free a single allocation.
+// This suits things which are built up piece by piece and torn down as a
+// whole, like a syntax tree.
+//
+// Objects placed in an Arena still need their destructors run if they
+// own other resources; only their own memory is released by the Arena.
+//
+// Usage:
+//   Arena arena;
+//   void *p = arena.allocate(sizeof(Foo));
+//   Foo *foo = new (p) Foo();
+class Arena {
+ public:
+	// The size of a normal chunk.  Bigger requests get a chunk of their
+	// own.
+	static const size_t CHUNK_SIZE = 64 * 1024;
+
+	Arena()
+	    : m_next(NULL), m_left(0), m_bytes(0)
+	{
+	}
+	~Arena()
+	{
+		for (size_t i = 0; i < m_chunks.size(); i++) {
+			free(m_chunks[i]);
+		}
+	}
+
+	// Allocate 'size' bytes, suitably aligned for any type.  Throws
+	// std::bad_alloc on failure.
+	void *
+	allocate(size_t size)
+	{
+		size = align(size);
+		if (size > m_left) {
+			if (size > CHUNK_SIZE / 4) {
+				// Don't waste the rest of the current chunk.
+				return new_chunk(size);
+			}
+			m_next = static_cast<char *>(new_chunk(CHUNK_SIZE));
+			m_left = CHUNK_SIZE;
+		}
+		void *p = m_next;
+		m_next += size;
+		m_left -= size;
+		m_bytes += size;
+		return p;
+	}
+
+	// How many bytes have been handed out?
+	size_t
+	bytes_allocated() const
+	{
+		return m_bytes;
+	}
+
+	// How many chunks have been taken from the system?
+	size_t
+	n_chunks() const
+	{
+		return m_chunks.size();
+	}
+
+	// Round a size up to the alignment of any type.
+	static size_t
+	align(size_t size)
+	{
+		const size_t alignment = sizeof(MaxAlign);
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+ private:
+	union MaxAlign {
+		long l;
+		double d;
+		long double ld;
+		void *p;
+		void (*f)();
+	};
+
+	void *
+	new_chunk(size_t size)
+	{
+		// Make room first, so the chunk can't leak.
+		m_chunks.reserve(m_chunks.size() + 1);
+		void *chunk = malloc(size);
+		if (chunk == NULL) {
+			throw std::bad_alloc();
+		}
+		m_chunks.push_back(chunk);
+		if (size != CHUNK_SIZE) {
+			m_bytes += size;
+		}
+		return chunk;
+	}
+
+	// These are not copyable.
+	Arena(const Arena &);
+	Arena &operator=(const Arena &);
+
+	std::vector<void *> m_chunks;
+	char *m_next;
+	size_t m_left;
+	size_t m_bytes;
+};
+
+}  // namespace util
+
+#endif  // HWPP_UTIL_ARENA_H__
@@ -0,0 +1,169 @@
+// A basic microbenchmark framework.
+//
+// This works like util/test.h: don't define main(), just #include this file
+// and write benchmark functions.  Each one is run with a growing number of
+// iterations until it runs for long enough to time reliably, and the time
+// per iteration is reported.
+//
+// Build benchmarks with DEBUG=0, or the numbers mean very little.
+//
+// As with util/test.h, all symbols which begin with "BENCH" are reserved
+// for use by this header, and all symbols which begin with "BENCH_"
+// followed by a lower-case letter are internal.
+//
+// Here is the public API:
+//
+// * BENCH(name)
+//
+//   Define a benchmark function.  The function must do the thing being
+//   measured BENCH_N times.
+//
+//   Example:
+//   	BENCH(bench_name) {
+//   		for (uint64_t i = 0; i < BENCH_N; i++) {
+//   			do_something();
+//   		}
+//   	}
+//
+// * BENCH_RESET_TIMER()
+//
+//   Restart the clock, so that setup done by the function is not counted.
+//
+// * BENCH_KEEP(var)
+//
+//   Stop the compiler from optimizing away the computation of 'var'.
+//
+// The resulting program takes optional arguments.  If any are given, only
+// benchmarks whose names contain one of them are run.  The BENCH_TIME
+// environment variable sets the minimum time to run each benchmark, in
+// seconds (default 0.5).
+
+#ifndef HWPP_UTIL_BENCH_H__
+#define HWPP_UTIL_BENCH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// The global list of benchmarks to run.
+struct BENCH_definition;
+static std::vector<BENCH_definition *> BENCH_list;
+
+// The main benchmark definition class.
+struct BENCH_definition
+{
+	std::string bench_name;
+	void (*bench_function)(uint64_t);
+
+	BENCH_definition(const std::string &name, void (*func)(uint64_t))
+	: bench_name(name), bench_function(func)
+	{
+		BENCH_list.push_back(this);
+	}
+};
+
+// Define a benchmark.
+#define BENCH(name_) \
+	void name_(uint64_t); \
+	static BENCH_definition BENCH_##name_##definition(#name_, name_); \
+	void name_(uint64_t BENCH_N)
+
+// Internal: the clock.
+static inline uint64_t
+BENCH_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// When the current run started.
+static uint64_t BENCH_start_time;
+
+#define BENCH_RESET_TIMER() (BENCH_start_time = BENCH_now())
+
+// Internal: an opaque use of a value.
+template<typename Tval>
+inline void
+BENCH_keep(const Tval &val)
+{
+	asm volatile("" : : "r"(&val) : "memory");
+}
+#define BENCH_KEEP(var_) BENCH_keep(var_)
+
+// Internal: time one run of a benchmark.
+static uint64_t
+BENCH_run(const BENCH_definition *bench, uint64_t n)
+{
+	BENCH_RESET_TIMER();
+	bench->bench_function(n);
+	return BENCH_now() - BENCH_start_time;
+}
+
+// Internal: should this benchmark be run?
+static bool
+BENCH_selected(const BENCH_definition *bench, int argc, const char *argv[])
+{
+	if (argc < 2) {
+		return true;
+	}
+	for (int i = 1; i < argc; i++) {
+		if (strstr(bench->bench_name.c_str(), argv[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// The benchmark main() entry point.
+int
+main(int argc, const char *argv[])
+{
+	double min_secs = 0.5;
+	if (getenv("BENCH_TIME")) {
+		min_secs = atof(getenv("BENCH_TIME"));
+	}
+	uint64_t min_nsecs = (uint64_t)(min_secs * 1e9);
+
+#if DEBUG
+	fprintf(stderr, "warning: benchmarks built with DEBUG=1\n");
+#endif
+	for (size_t i = 0; i < BENCH_list.size(); i++) {
+		const BENCH_definition *bench = BENCH_list[i];
+		if (!BENCH_selected(bench, argc, argv)) {
+			continue;
+		}
+
+		// Grow n until a run takes long enough, aiming a bit past the
+		// minimum so the last run is likely to be the only long one.
+		uint64_t n = 1;
+		uint64_t nsecs = BENCH_run(bench, n);
+		while (nsecs < min_nsecs) {
+			uint64_t next = n * 100;
+			if (nsecs > 0) {
+				uint64_t guess = (uint64_t)(n * 1.2 * min_nsecs
+				                            / nsecs);
+				if (guess < next) {
+					next = guess;
+				}
+			}
+			if (next <= n) {
+				next = n + 1;
+			}
+			n = next;
+			nsecs = BENCH_run(bench, n);
+		}
+
+		printf("%-48s %12llu %12.1f ns/op\n",
+		       bench->bench_name.c_str(), (unsigned long long)n,
+		       (double)nsecs / n);
+		fflush(stdout);
+	}
+	return EXIT_SUCCESS;
+}
+
+#endif // HWPP_UTIL_BENCH_H__
@@ -0,0 +1,145 @@
+#include "util/bignum.h"
+#include "util/bench.h"
+
+#include <stdint.h>
+
+// Each operation is timed on a BigInt and on a native uint64_t, with
+// values small enough for both.  The native loops use volatile inputs so
+// they can't be folded away.
+
+BENCH(bench_bigint_construct)
+{
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bignum::BigInt v(i);
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_bigint_copy)
+{
+	bignum::BigInt a(0x123456789abcdefULL);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bignum::BigInt v(a);
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_bigint_add)
+{
+	bignum::BigInt a(0x12345678), b(0x9abcdef);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bignum::BigInt v = a + b;
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_native_add)
+{
+	volatile uint64_t a = 0x12345678, b = 0x9abcdef;
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		uint64_t v = a + b;
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_bigint_mul)
+{
+	bignum::BigInt a(0x12345678), b(0x9abcdef);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bignum::BigInt v = a * b;
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_native_mul)
+{
+	volatile uint64_t a = 0x12345678, b = 0x9abcdef;
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		uint64_t v = a * b;
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_bigint_div)
+{
+	bignum::BigInt a(0x123456789abcdefULL), b(0x9abcdef);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bignum::BigInt v = a / b;
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_native_div)
+{
+	volatile uint64_t a = 0x123456789abcdefULL, b = 0x9abcdef;
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		uint64_t v = a / b;
+		BENCH_KEEP(v);
+	}
+}
+
+// The mask-and-shift that RegBits does for every access.
+BENCH(bench_bigint_extract)
+{
+	bignum::BigInt a(0x123456789abcdefULL), mask(0xff);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bignum::BigInt v = (a >> 12) & mask;
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_native_extract)
+{
+	volatile uint64_t a = 0x123456789abcdefULL, mask = 0xff;
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		uint64_t v = (a >> 12) & mask;
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_bigint_compare)
+{
+	bignum::BigInt a(0x12345678), b(0x9abcdef);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bool v = (a < b);
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_native_compare)
+{
+	volatile uint64_t a = 0x12345678, b = 0x9abcdef;
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bool v = (a < b);
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_bigint_to_uint)
+{
+	bignum::BigInt a(0x123456789abcdefULL);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		unsigned long long v = a.get_ui();
+		BENCH_KEEP(v);
+	}
+}
+
+BENCH(bench_bigint_wide_extract)
+{
+	// beyond 64 bits, where there is no native equivalent
+	bignum::BigInt a = (bignum::BigInt(0x123456789abcdefULL) << 64)
+	                 | bignum::BigInt(0xfedcba9876543210ULL);
+	bignum::BigInt mask(0xffff);
+	BENCH_RESET_TIMER();
+	for (uint64_t i = 0; i < BENCH_N; i++) {
+		bignum::BigInt v = (a >> 60) & mask;
+		BENCH_KEEP(v);
+	}
+}
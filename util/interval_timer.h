@@ -0,0 +1,117 @@
+// A periodic timer on absolute deadlines, for sampling loops.
+
+#ifndef HWPP_UTIL_INTERVAL_TIMER_H__
+#define HWPP_UTIL_INTERVAL_TIMER_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <stdexcept>
+#include "util/syserror.h"
+
+namespace util {
+
+// Return the CLOCK_MONOTONIC time, in nanoseconds.
+inline uint64_t
+monotonic_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// IntervalTimer wakes up once per interval, on a timerfd armed with
+// absolute CLOCK_MONOTONIC deadlines.  Tick N is due at start + N *
+// interval, no matter how long the work between ticks took, so time
+// spent working does not make the ticks drift.  If the work overruns one
+// or more ticks, the next wait() returns at once and says how many ticks
+// were missed.
+class IntervalTimer
+{
+    public:
+	// The first tick is due one interval from now.
+	//
+	// Throws: std::invalid_argument, syserr::ErrnoError
+	explicit
+	IntervalTimer(uint64_t interval_ns)
+	    : m_fd(-1), m_interval_ns(interval_ns)
+	{
+		if (interval_ns == 0) {
+			throw std::invalid_argument("interval must be > 0");
+		}
+		m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (m_fd < 0) {
+			syserr::throw_errno_error(errno, "timerfd_create()");
+		}
+		m_start_ns = monotonic_ns();
+
+		struct itimerspec its;
+		its.it_value = to_timespec(m_start_ns + interval_ns);
+		its.it_interval = to_timespec(interval_ns);
+		if (timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+			int error = errno;
+			close(m_fd);
+			syserr::throw_errno_error(error, "timerfd_settime()");
+		}
+	}
+
+	~IntervalTimer()
+	{
+		close(m_fd);
+	}
+
+	// Block until the next tick is due.  Returns the number of ticks
+	// which came due since the last call, which is more than 1 if the
+	// caller fell behind.
+	//
+	// Throws: syserr::ErrnoError
+	uint64_t
+	wait()
+	{
+		uint64_t expirations;
+		while (read(m_fd, &expirations, sizeof(expirations)) < 0) {
+			if (errno != EINTR) {
+				syserr::throw_errno_error(errno,
+				                          "read(timerfd)");
+			}
+		}
+		return expirations;
+	}
+
+	uint64_t
+	interval_ns() const
+	{
+		return m_interval_ns;
+	}
+
+	// The time the timer was started, from which all ticks count.
+	uint64_t
+	start_ns() const
+	{
+		return m_start_ns;
+	}
+
+    private:
+	static struct timespec
+	to_timespec(uint64_t ns)
+	{
+		struct timespec ts;
+		ts.tv_sec = ns / 1000000000ULL;
+		ts.tv_nsec = ns % 1000000000ULL;
+		return ts;
+	}
+
+	int m_fd;
+	uint64_t m_interval_ns;
+	uint64_t m_start_ns;
+
+	// not copyable
+	IntervalTimer(const IntervalTimer &);
+	IntervalTimer &operator=(const IntervalTimer &);
+};
+
+}  // namespace util
+
+#endif // HWPP_UTIL_INTERVAL_TIMER_H__
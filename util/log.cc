@@ -3,10 +3,14 @@
 
 #include "util/log.h"
 
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <time.h>
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace log {
 
@@ -30,17 +34,316 @@ enable_logging(uint8_t verbosity)
 	logging_verbosity_flag = verbosity;
 }
 
+std::string
+format_record(const Record &record)
+{
+	char line[16];
+	snprintf(line, sizeof(line), "%d", record.line);
+
+	std::string ret;
+	ret.reserve(record.message.size() + 64);
+	ret += record.level;
+	ret += "[";
+	ret += record.file;
+	ret += ":";
+	ret += line;
+	ret += "] ";
+	ret += record.func;
+	ret += "(): ";
+	ret += record.message;
+	ret += "\n";
+	return ret;
+}
+
+//
+// StreamSink
+//
+
+StreamSink::StreamSink(std::ostream &out)
+    : m_out(out)
+{
+	pthread_mutex_init(&m_lock, NULL);
+}
+
+StreamSink::~StreamSink()
+{
+	pthread_mutex_destroy(&m_lock);
+}
+
+void
+StreamSink::write(const Record &record)
+{
+	// Format outside the lock, and write the whole line at once, so
+	// lines from different threads don't get mixed up.
+	std::string line = format_record(record);
+	pthread_mutex_lock(&m_lock);
+	m_out << line;
+	pthread_mutex_unlock(&m_lock);
+}
+
+void
+StreamSink::flush()
+{
+	pthread_mutex_lock(&m_lock);
+	m_out.flush();
+	pthread_mutex_unlock(&m_lock);
+}
+
+//
+// AsyncSink
+//
+
+// A single-producer, single-consumer ring of records.  The owning thread
+// only writes 'tail', and the background thread only writes 'head'.
+// Slots are reused, so a message which fits in a slot's old string does
+// not allocate.
+struct AsyncSink::Queue {
+	explicit Queue(size_t size)
+	    : slots(size), mask(size - 1), head(0), tail(0), orphaned(0)
+	{
+	}
+
+	std::vector<Record> slots;
+	size_t mask;
+	size_t head;
+	size_t tail;
+	// set when the owning thread exits
+	int orphaned;
+};
+
+// How long the background thread sleeps when there is nothing to do.
+// Writers wake it when they see it sleeping, but one which races with it
+// going to sleep can wait this long to be written.
+static const long ASYNC_IDLE_NSECS = 100 * 1000 * 1000;
+
+AsyncSink::AsyncSink(Sink *target, size_t queue_size)
+    : m_target(target), m_queue_size(2), m_stopping(false),
+      m_flush_requests(0), m_flushes_done(0),
+      m_dropped(0), m_dropped_reported(0), m_idle(0)
+{
+	while (m_queue_size < queue_size) {
+		m_queue_size *= 2;
+	}
+	pthread_key_create(&m_key, release_queue);
+	pthread_mutex_init(&m_lock, NULL);
+	pthread_cond_init(&m_wake, NULL);
+	pthread_cond_init(&m_flushed, NULL);
+	pthread_create(&m_thread, NULL, run_thread, this);
+}
+
+AsyncSink::~AsyncSink()
+{
+	pthread_mutex_lock(&m_lock);
+	m_stopping = true;
+	pthread_cond_signal(&m_wake);
+	pthread_mutex_unlock(&m_lock);
+	pthread_join(m_thread, NULL);
+
+	// No thread exit can touch a queue after this.
+	pthread_key_delete(m_key);
+	for (size_t i = 0; i < m_queues.size(); i++) {
+		delete m_queues[i];
+	}
+	pthread_cond_destroy(&m_flushed);
+	pthread_cond_destroy(&m_wake);
+	pthread_mutex_destroy(&m_lock);
+}
+
+AsyncSink::Queue *
+AsyncSink::this_thread_queue()
+{
+	Queue *queue = static_cast<Queue *>(pthread_getspecific(m_key));
+	if (!queue) {
+		queue = new Queue(m_queue_size);
+		pthread_mutex_lock(&m_lock);
+		m_queues.push_back(queue);
+		pthread_mutex_unlock(&m_lock);
+		pthread_setspecific(m_key, queue);
+	}
+	return queue;
+}
+
+void
+AsyncSink::release_queue(void *arg)
+{
+	Queue *queue = static_cast<Queue *>(arg);
+	// The background thread frees it once it is empty.
+	__atomic_store_n(&queue->orphaned, 1, __ATOMIC_RELEASE);
+}
+
+void
+AsyncSink::write(const Record &record)
+{
+	Queue *queue = this_thread_queue();
+
+	size_t tail = queue->tail;
+	size_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	if (tail - head > queue->mask) {
+		__sync_fetch_and_add(&m_dropped, 1);
+		return;
+	}
+	queue->slots[tail & queue->mask] = record;
+	__atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (__atomic_load_n(&m_idle, __ATOMIC_RELAXED)) {
+		pthread_cond_signal(&m_wake);
+	}
+}
+
+void
+AsyncSink::flush()
+{
+	pthread_mutex_lock(&m_lock);
+	uint64_t request = ++m_flush_requests;
+	pthread_cond_signal(&m_wake);
+	while (m_flushes_done < request) {
+		pthread_cond_wait(&m_flushed, &m_lock);
+	}
+	pthread_mutex_unlock(&m_lock);
+}
+
+void *
+AsyncSink::run_thread(void *arg)
+{
+	static_cast<AsyncSink *>(arg)->run();
+	return NULL;
+}
+
+// Write everything which is queued right now.  Returns true if anything
+// was written.
+bool
+AsyncSink::drain()
+{
+	pthread_mutex_lock(&m_lock);
+	std::vector<Queue *> queues = m_queues;
+	pthread_mutex_unlock(&m_lock);
+
+	bool wrote = false;
+	for (size_t i = 0; i < queues.size(); i++) {
+		Queue *queue = queues[i];
+		size_t head = queue->head;
+		size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			m_target->write(queue->slots[head & queue->mask]);
+			head++;
+			__atomic_store_n(&queue->head, head, __ATOMIC_RELEASE);
+			wrote = true;
+		}
+	}
+
+	uint64_t dropped = __atomic_load_n(&m_dropped, __ATOMIC_RELAXED);
+	if (dropped != m_dropped_reported) {
+		m_target->write(Record('W', __FILE__, __LINE__, __func__,
+		    ::printfxx::sprintfxx("dropped %d log messages",
+		                          dropped - m_dropped_reported)));
+		m_dropped_reported = dropped;
+		wrote = true;
+	}
+
+	// Free the queues of threads which have exited.
+	pthread_mutex_lock(&m_lock);
+	for (size_t i = 0; i < m_queues.size(); ) {
+		Queue *queue = m_queues[i];
+		if (__atomic_load_n(&queue->orphaned, __ATOMIC_ACQUIRE)
+		 && queue->head == queue->tail) {
+			m_queues.erase(m_queues.begin() + i);
+			delete queue;
+		} else {
+			i++;
+		}
+	}
+	pthread_mutex_unlock(&m_lock);
+
+	return wrote;
+}
+
+void
+AsyncSink::run()
+{
+	bool unflushed = false;
+
+	pthread_mutex_lock(&m_lock);
+	while (true) {
+		uint64_t request = m_flush_requests;
+		bool stopping = m_stopping;
+		pthread_mutex_unlock(&m_lock);
+
+		bool wrote = drain();
+		unflushed = unflushed || wrote;
+		// Flush the target when asked to, or when there is a lull.
+		bool asked = (request != m_flushes_done);
+		if (unflushed && (asked || stopping || !wrote)) {
+			m_target->flush();
+			unflushed = false;
+		} else if (asked) {
+			m_target->flush();
+		}
+
+		pthread_mutex_lock(&m_lock);
+		if (asked) {
+			m_flushes_done = request;
+			pthread_cond_broadcast(&m_flushed);
+		}
+		if (stopping) {
+			break;
+		}
+		if (!wrote && !m_stopping && m_flush_requests == request) {
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += ASYNC_IDLE_NSECS;
+			if (deadline.tv_nsec >= 1000000000) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			__atomic_store_n(&m_idle, 1, __ATOMIC_RELAXED);
+			pthread_cond_timedwait(&m_wake, &m_lock, &deadline);
+			__atomic_store_n(&m_idle, 0, __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&m_lock);
+}
+
+//
+// The current sink
+//
+
+// this avoids the static initialization order fiasco
+static Sink *
+default_sink()
+{
+	static StreamSink the_default_sink(std::cerr);
+	return &the_default_sink;
+}
+
+static Sink *the_sink;
+
+Sink *
+set_sink(Sink *sink)
+{
+	Sink *old = current_sink();
+	the_sink = sink;
+	return old;
+}
+
+Sink *
+current_sink()
+{
+	return the_sink ? the_sink : default_sink();
+}
+
+void
+flush()
+{
+	current_sink()->flush();
+}
+
 namespace internal {
 
 static inline void
 log_msg(char prefix, const char *file, int line, const char *func,
         const std::string &msg)
 {
-	std::cerr
-	  << prefix << "[" << file << ":" << line << "]"
-	  << " " << func << "(): "
-	  << msg
-	  << std::endl;
+	current_sink()->write(Record(prefix, file, line, func, msg));
 }
 
 void
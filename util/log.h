@@ -9,8 +9,11 @@
 #ifndef HWPP_UTIL_LOG_H__
 #define HWPP_UTIL_LOG_H__
 
+#include <pthread.h>
 #include <stdint.h>
 #include <iostream>
+#include <string>
+#include <vector>
 #include "util/printfxx.h"
 
 namespace log {
@@ -29,6 +32,151 @@ logging_is_enabled();
 uint8_t
 logging_verbosity();
 
+// One logged message.  The file and func strings must live forever, as
+// __FILE__ and __func__ do.
+struct Record {
+	Record()
+	    : level('?'), file(""), line(0), func("")
+	{
+	}
+	Record(char level_, const char *file_, int line_, const char *func_,
+	       const std::string &message_)
+	    : level(level_), file(file_), line(line_), func(func_),
+	      message(message_)
+	{
+	}
+
+	char level;  // 'I', 'W' or 'E'
+	const char *file;
+	int line;
+	const char *func;
+	std::string message;
+};
+
+// Format a record as one line, with a trailing newline.
+std::string
+format_record(const Record &record);
+
+// Somewhere for log messages to go.  Apps can provide their own by
+// subclassing this and calling set_sink().
+class Sink {
+    public:
+	virtual ~Sink() {}
+
+	// Handle one message.  This may be called from any thread, so it
+	// must do its own locking.
+	virtual void
+	write(const Record &record) = 0;
+
+	// Make sure every message written so far has gone wherever it is
+	// going.
+	virtual void
+	flush() {}
+};
+
+// A sink which writes each message to a stream as it arrives.  This is
+// the default, on std::cerr.
+class StreamSink: public Sink {
+    public:
+	explicit StreamSink(std::ostream &out);
+	virtual ~StreamSink();
+
+	virtual void
+	write(const Record &record);
+
+	virtual void
+	flush();
+
+    private:
+	std::ostream &m_out;
+	pthread_mutex_t m_lock;
+};
+
+// A sink which hands messages to a background thread, which writes them
+// to another sink.  Logging threads never block on I/O or on each other:
+// each thread has its own bounded queue, which it adds to without
+// locking.  If a thread's queue is full, the message is dropped and
+// counted, and the background thread logs how many were lost.
+//
+// Messages from one thread stay in order, but messages from different
+// threads may be interleaved differently than they were logged.  Call
+// flush() before exiting, or messages still queued will be lost.
+class AsyncSink: public Sink {
+    public:
+	// The target must outlive this sink.  'queue_size' is the number
+	// of messages each thread can have queued, rounded up to a power
+	// of two.
+	explicit AsyncSink(Sink *target, size_t queue_size = 1024);
+	// Writes any queued messages and stops the background thread.
+	virtual ~AsyncSink();
+
+	virtual void
+	write(const Record &record);
+
+	// Wait for the background thread to write everything queued so
+	// far, then flush the target.
+	virtual void
+	flush();
+
+	// The number of messages dropped because a queue was full.
+	uint64_t
+	dropped() const
+	{
+		return m_dropped;
+	}
+
+    private:
+	struct Queue;
+
+	Queue *
+	this_thread_queue();
+
+	static void *
+	run_thread(void *arg);
+	static void
+	release_queue(void *arg);
+
+	void
+	run();
+	bool
+	drain();
+
+	Sink *m_target;
+	size_t m_queue_size;
+	pthread_key_t m_key;
+	pthread_t m_thread;
+	// m_lock protects everything below.
+	pthread_mutex_t m_lock;
+	pthread_cond_t m_wake;
+	pthread_cond_t m_flushed;
+	std::vector<Queue *> m_queues;
+	bool m_stopping;
+	uint64_t m_flush_requests;
+	uint64_t m_flushes_done;
+	// These are updated atomically.
+	uint64_t m_dropped;
+	uint64_t m_dropped_reported;
+	int m_idle;
+
+	// not copyable
+	AsyncSink(const AsyncSink &);
+	AsyncSink &operator=(const AsyncSink &);
+};
+
+// Send log messages to a sink, which must outlive its use.  A NULL sink
+// goes back to the default.  Returns the previous sink.  This should be
+// called before other threads start logging.
+Sink *
+set_sink(Sink *sink);
+
+// Get the current sink.
+Sink *
+current_sink();
+
+// Flush the current sink.
+void
+flush();
+
 namespace internal {
 
 // Unconditionally log a formatted INFO message.
@@ -0,0 +1,225 @@
+// A buffered writer for lots of small pieces of text.
+//
+// iostreams are slow for this: each insertion goes through locale and
+// sentry machinery, integers are formatted through the stream state, and
+// std::endl flushes every line.  OutputBuffer appends straight into one
+// large buffer, formats integers itself, and only calls write(2) when the
+// buffer is full or flush() is called.
+
+#ifndef HWPP_UTIL_OUTPUT_BUFFER_H__
+#define HWPP_UTIL_OUTPUT_BUFFER_H__
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmpxx.h>
+#include <string>
+#include <vector>
+#include "util/syserror.h"
+
+namespace util {
+
+class OutputBuffer
+{
+    public:
+	explicit OutputBuffer(int fd, size_t size = 64 * 1024)
+	    : m_fd(fd), m_buf(size < 64 ? 64 : size), m_used(0)
+	{
+	}
+
+	// Anything left is written, but errors can not be reported.  Call
+	// flush() first to find out about them.
+	~OutputBuffer()
+	{
+		try {
+			flush();
+		} catch (...) {
+		}
+	}
+
+	// Write everything buffered so far.
+	//
+	// Throws: syserr::ErrnoError
+	void
+	flush()
+	{
+		size_t done = 0;
+		while (done < m_used) {
+			ssize_t r = ::write(m_fd, &m_buf[done], m_used - done);
+			if (r < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				int err = errno;
+				m_used = 0;
+				syserr::throw_errno_error(err,
+				    "util::OutputBuffer::flush()");
+			}
+			done += r;
+		}
+		m_used = 0;
+	}
+
+	// Append text.
+	void
+	write(const char *data, size_t len)
+	{
+		if (len > m_buf.size() - m_used) {
+			flush();
+			if (len > m_buf.size()) {
+				m_buf.resize(len);
+			}
+		}
+		memcpy(&m_buf[m_used], data, len);
+		m_used += len;
+	}
+	void
+	write(const std::string &str)
+	{
+		write(str.data(), str.size());
+	}
+	void
+	write(const char *str)
+	{
+		write(str, strlen(str));
+	}
+	void
+	write(char c)
+	{
+		if (m_used == m_buf.size()) {
+			flush();
+		}
+		m_buf[m_used++] = c;
+	}
+
+	// Append an unsigned integer, in decimal or in hex (without a "0x").
+	void
+	write_dec(unsigned long long value)
+	{
+		char tmp[24];
+		char *p = tmp + sizeof(tmp);
+		do {
+			*--p = '0' + (value % 10);
+			value /= 10;
+		} while (value);
+		write(p, tmp + sizeof(tmp) - p);
+	}
+	void
+	write_hex(unsigned long long value)
+	{
+		static const char digits[] = "0123456789abcdef";
+		char tmp[16];
+		char *p = tmp + sizeof(tmp);
+		do {
+			*--p = digits[value & 0xf];
+			value >>= 4;
+		} while (value);
+		write(p, tmp + sizeof(tmp) - p);
+	}
+
+	// Append a big integer in hex (without a "0x"), as iostreams
+	// would print it with std::hex.  This formats straight into the
+	// buffer.
+	void
+	write_hex(const mpz_class &value)
+	{
+		if (value.fits_ulong_p()) {
+			write_hex((unsigned long long)value.get_ui());
+			return;
+		}
+		// room for the digits, a sign and GMP's NUL
+		size_t max = mpz_sizeinbase(value.get_mpz_t(), 16) + 2;
+		if (max > m_buf.size() - m_used) {
+			flush();
+			if (max > m_buf.size()) {
+				m_buf.resize(max);
+			}
+		}
+		mpz_get_str(&m_buf[m_used], 16, value.get_mpz_t());
+		m_used += strlen(&m_buf[m_used]);
+	}
+
+	// The number of bytes waiting to be written.
+	size_t
+	pending() const
+	{
+		return m_used;
+	}
+
+    private:
+	int m_fd;
+	std::vector<char> m_buf;
+	size_t m_used;
+
+	// not copyable
+	OutputBuffer(const OutputBuffer &);
+	OutputBuffer &operator=(const OutputBuffer &);
+};
+
+// A path which is built up and torn down one element at a time, as a
+// tree is walked, without making a new string for each element.
+//
+// Example:
+// 	size_t mark = path.push("/", name);
+// 	... use path.str() ...
+// 	path.pop(mark);
+class PathBuffer
+{
+    public:
+	PathBuffer()
+	{
+		m_path.reserve(256);
+	}
+	explicit PathBuffer(const std::string &base): m_path(base)
+	{
+		m_path.reserve(256);
+	}
+
+	// Append a separator and an element.  Returns the length to give
+	// to pop().
+	size_t
+	push(const char *sep, const std::string &element)
+	{
+		size_t mark = m_path.size();
+		m_path += sep;
+		m_path += element;
+		return mark;
+	}
+
+	// Append an array index, as "[N]".
+	size_t
+	push_index(unsigned long index)
+	{
+		size_t mark = m_path.size();
+		char tmp[24];
+		char *p = tmp + sizeof(tmp);
+		*--p = ']';
+		do {
+			*--p = '0' + (index % 10);
+			index /= 10;
+		} while (index);
+		*--p = '[';
+		m_path.append(p, tmp + sizeof(tmp) - p);
+		return mark;
+	}
+
+	// Go back to the path as it was before a push().
+	void
+	pop(size_t mark)
+	{
+		m_path.resize(mark);
+	}
+
+	const std::string &
+	str() const
+	{
+		return m_path;
+	}
+
+    private:
+	std::string m_path;
+};
+
+}  // namespace util
+
+#endif // HWPP_UTIL_OUTPUT_BUFFER_H__
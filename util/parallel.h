@@ -0,0 +1,152 @@
+// Simple fork/join parallelism on top of pthreads.
+
+#ifndef HWPP_UTIL_PARALLEL_H__
+#define HWPP_UTIL_PARALLEL_H__
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace parallel {
+
+// Thrown by for_each_index() when one or more calls to the work function
+// threw.  The message is the what() of the first failure.
+struct WorkerError: public std::runtime_error
+{
+	explicit WorkerError(const std::string &str)
+	    : runtime_error(str)
+	{
+	}
+};
+
+// Return the number of online CPUs, or 1 if that can't be determined.
+inline unsigned
+online_cpus()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? n : 1;
+}
+
+namespace internal {
+
+// This is the shared state for one for_each_index() call.
+template<typename Tfunc>
+struct ForEachState {
+	Tfunc &func;
+	size_t n_items;
+	size_t next;
+	bool failed;
+	std::string error;
+	pthread_mutex_t lock;
+
+	ForEachState(Tfunc &f, size_t n)
+	    : func(f), n_items(n), next(0), failed(false), error()
+	{
+		pthread_mutex_init(&lock, NULL);
+	}
+	~ForEachState()
+	{
+		pthread_mutex_destroy(&lock);
+	}
+
+	// Claim the next unprocessed index.  Returns false when there is
+	// no more work to do, or when a previous item has failed.
+	bool
+	claim(size_t *index)
+	{
+		bool ret = false;
+		pthread_mutex_lock(&lock);
+		if (!failed && next < n_items) {
+			*index = next++;
+			ret = true;
+		}
+		pthread_mutex_unlock(&lock);
+		return ret;
+	}
+
+	void
+	fail(const std::string &what)
+	{
+		pthread_mutex_lock(&lock);
+		if (!failed) {
+			failed = true;
+			error = what;
+		}
+		pthread_mutex_unlock(&lock);
+	}
+};
+
+template<typename Tfunc>
+void
+for_each_worker(ForEachState<Tfunc> *state)
+{
+	size_t index;
+	while (state->claim(&index)) {
+		try {
+			state->func(index);
+		} catch (std::exception &e) {
+			state->fail(e.what());
+		} catch (...) {
+			state->fail("unknown exception");
+		}
+	}
+}
+
+template<typename Tfunc>
+void *
+for_each_thread(void *arg)
+{
+	for_each_worker(static_cast<ForEachState<Tfunc> *>(arg));
+	return NULL;
+}
+
+}  // namespace internal
+
+// Call func(i) for every i in [0, n_items), using up to n_threads threads
+// (including the calling thread).  Items are handed out in increasing
+// order, but may complete in any order, so func must only touch state
+// that belongs to index i, or do its own locking.  This returns when all
+// items are done.
+//
+// If any call to func throws, no new items are started, and WorkerError
+// is thrown once the in-flight items are done.  If threads can not be
+// created, the work is done by the threads that were.
+//
+// Throws:
+// 	parallel::WorkerError		- func threw
+template<typename Tfunc>
+void
+for_each_index(size_t n_items, unsigned n_threads, Tfunc func)
+{
+	internal::ForEachState<Tfunc> state(func, n_items);
+
+	// don't start more threads than there are items
+	if (n_threads > n_items) {
+		n_threads = n_items;
+	}
+
+	// the calling thread counts as a worker
+	std::vector<pthread_t> threads;
+	for (unsigned i = 1; i < n_threads; i++) {
+		pthread_t tid;
+		if (pthread_create(&tid, NULL,
+		    internal::for_each_thread<Tfunc>, &state) != 0) {
+			break;
+		}
+		threads.push_back(tid);
+	}
+	internal::for_each_worker(&state);
+	for (size_t i = 0; i < threads.size(); i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	if (state.failed) {
+		throw WorkerError(state.error);
+	}
+}
+
+}  // namespace parallel
+
+#endif // HWPP_UTIL_PARALLEL_H__
@@ -1,32 +1,34 @@
 #ifndef HWPP_UTIL_SYMBOL_TABLE_H__
 #define HWPP_UTIL_SYMBOL_TABLE_H__
 
-#include <map>
 #include <vector>
+#include <boost/unordered_map.hpp>
 #include "util/assert.h"
 
 namespace util {
 
-// This class provides a stack of maps, which behave like a symbol table in a
-// language like C.  Each new context can have keys that override keys in
-// prior contexts.
+// This class provides a stack of contexts, which behave like a symbol table
+// in a language like C.  Each new context can have keys that override keys
+// in prior contexts.
+//
+// Rather than a map per context, this keeps one hash table from each key to
+// the stack of values it is bound to, innermost last.  Each context keeps
+// an undo log of the keys it added, so popping a context only touches
+// those keys.  Lookups cost the same no matter how deep the nesting is.
 template<typename Tkey, typename Tvalue>
 class SymbolTable {
  public:
-	// Ths type represents a single layer of the stack.
-	typedef std::map<Tkey, Tvalue> Context;
-
 	SymbolTable()
 	{
 		// Create the root context.
-		m_stack.push_back(Context());
+		m_undo_log.push_back(KeyList());
 	}
 
 	// Push a new context.
 	void
 	push_context()
 	{
-		m_stack.push_back(Context());
+		m_undo_log.push_back(KeyList());
 	}
 
 	// Pop the last context, always leaving 1.  Returns false when the
@@ -34,25 +36,34 @@ class SymbolTable {
 	bool
 	pop_context()
 	{
-		if (m_stack.size() > 1) {
-			m_stack.pop_back();
-			return true;
+		if (m_undo_log.size() <= 1) {
+			return false;
+		}
+		const KeyList &keys = m_undo_log.back();
+		for (size_t i = 0; i < keys.size(); i++) {
+			typename BindingMap::iterator it = m_bindings.find(keys[i]);
+			DASSERT(it != m_bindings.end());
+			it->second.pop_back();
+			if (it->second.empty()) {
+				m_bindings.erase(it);
+			}
 		}
-		return false;
+		m_undo_log.pop_back();
+		return true;
 	}
 
 	// How many contexts deep are we?
 	size_t
 	depth() const
 	{
-		return m_stack.size();
+		return m_undo_log.size();
 	}
 
 	// How many keys in the current context?
 	size_t
 	context_size() const
 	{
-		return current_context()->size();
+		return m_undo_log.back().size();
 	}
 
 	// Add a value to the current context.  If the key already exists,
@@ -60,13 +71,12 @@ class SymbolTable {
 	void
 	add(const Tkey &key, const Tvalue &val)
 	{
-		typename Context::iterator it = current_context()->find(key);
-		if (it != current_context()->end()) {
-			it->second = val;
-		} else {
-			// This avoids a default constructor call for Tvalue.
-			current_context()->insert(it, make_pair(key, val));
+		BindingStack &stack = m_bindings[key];
+		if (!stack.empty() && stack.back().depth == depth()) {
+			stack.back().value = val;
+			return;
 		}
+		push_binding(&stack, key, val);
 	}
 
 	// Add a value to the current context.  If the key already exists,
@@ -74,28 +84,48 @@ class SymbolTable {
 	bool
 	add_unique(const Tkey &key, const Tvalue &val)
 	{
-		typename Context::iterator it = current_context()->find(key);
-		if (it != current_context()->end()) {
+		BindingStack &stack = m_bindings[key];
+		if (!stack.empty() && stack.back().depth == depth()) {
+			return false;
+		}
+		push_binding(&stack, key, val);
+		return true;
+	}
+
+	// Remove a key from the current context, uncovering any value it
+	// overrode.  Returns false if the key is not in the current context.
+	bool
+	remove(const Tkey &key)
+	{
+		typename BindingMap::iterator it = m_bindings.find(key);
+		if (it == m_bindings.end() || it->second.back().depth != depth()) {
 			return false;
 		}
-		// This avoids a default constructor call for Tvalue.
-		current_context()->insert(it, make_pair(key, val));
+		it->second.pop_back();
+		if (it->second.empty()) {
+			m_bindings.erase(it);
+		}
+		KeyList &keys = m_undo_log.back();
+		for (size_t i = 0; i < keys.size(); i++) {
+			if (keys[i] == key) {
+				keys.erase(keys.begin() + i);
+				break;
+			}
+		}
 		return true;
 	}
 
 	// Look up a key in all contexts, backwards from the current. Returns
-	// NULL if not found.
+	// NULL if not found.  The pointer is only good until the next change
+	// to this symbol table.
 	const Tvalue *
 	lookup(const Tkey &key) const
 	{
-		typename ContextStack::const_reverse_iterator ctxt;
-		for (ctxt = m_stack.rbegin(); ctxt != m_stack.rend(); ++ctxt) {
-			typename Context::const_iterator it = ctxt->find(key);
-			if (it != ctxt->end()) {
-				return &it->second;
-			}
+		typename BindingMap::const_iterator it = m_bindings.find(key);
+		if (it == m_bindings.end()) {
+			return NULL;
 		}
-		return NULL;
+		return &it->second.back().value;
 	}
 
 	// Take a snapshot of this symbol table.
@@ -106,23 +136,30 @@ class SymbolTable {
 	}
 
  private:
-	Context *
-	current_context()
-	{
-		// This is safe because we never let the stack get empty.
-		DASSERT(m_stack.size() > 0);
-		return &m_stack.back();
-	}
-	const Context *
-	current_context() const
+	// One value of a key, and the depth of the context which added it.
+	struct Binding {
+		Binding(size_t d, const Tvalue &v)
+		    : depth(d), value(v)
+		{
+		}
+		size_t depth;
+		Tvalue value;
+	};
+	typedef std::vector<Binding> BindingStack;
+	typedef boost::unordered_map<Tkey, BindingStack> BindingMap;
+	typedef std::vector<Tkey> KeyList;
+
+	void
+	push_binding(BindingStack *stack, const Tkey &key, const Tvalue &val)
 	{
 		// This is safe because we never let the stack get empty.
-		DASSERT(m_stack.size() > 0);
-		return &m_stack.back();
+		DASSERT(m_undo_log.size() > 0);
+		stack->push_back(Binding(depth(), val));
+		m_undo_log.back().push_back(key);
 	}
 
-	typedef std::vector<Context> ContextStack;
-	ContextStack m_stack;
+	BindingMap m_bindings;
+	std::vector<KeyList> m_undo_log;
 };
 
 }  // namespace util
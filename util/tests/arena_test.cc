@@ -0,0 +1,56 @@
+#include "util/arena.h"
+#include "util/test.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace util {
+
+TEST(test_allocate)
+{
+	Arena arena;
+	TEST_ASSERT(arena.bytes_allocated() == 0, "Arena::Arena()");
+	TEST_ASSERT(arena.n_chunks() == 0, "Arena::Arena()");
+
+	// Small allocations share a chunk, and are aligned.
+	char *p1 = static_cast<char *>(arena.allocate(1));
+	char *p2 = static_cast<char *>(arena.allocate(3));
+	TEST_ASSERT(p1 != NULL && p2 != NULL, "Arena::allocate()");
+	TEST_ASSERT(p2 == p1 + Arena::align(1), "Arena::allocate()");
+	TEST_ASSERT(reinterpret_cast<uintptr_t>(p2) % Arena::align(1) == 0,
+	            "Arena::allocate()");
+	TEST_ASSERT(arena.n_chunks() == 1, "Arena::allocate()");
+	TEST_ASSERT(arena.bytes_allocated() == 2 * Arena::align(1),
+	            "Arena::allocate()");
+
+	// The memory is usable.
+	memset(p1, 0xaa, 1);
+	memset(p2, 0x55, 3);
+	TEST_ASSERT(p1[0] == (char)0xaa && p2[2] == 0x55, "Arena::allocate()");
+
+	// Filling a chunk starts another.
+	for (size_t i = 0; i < Arena::CHUNK_SIZE / 64; i++) {
+		arena.allocate(64);
+	}
+	TEST_ASSERT(arena.n_chunks() == 2, "Arena::allocate()");
+
+	// Big allocations get their own chunk, and don't waste the current
+	// one.
+	void *big = arena.allocate(Arena::CHUNK_SIZE * 2);
+	TEST_ASSERT(big != NULL, "Arena::allocate()");
+	memset(big, 0, Arena::CHUNK_SIZE * 2);
+	TEST_ASSERT(arena.n_chunks() == 3, "Arena::allocate()");
+	arena.allocate(16);
+	TEST_ASSERT(arena.n_chunks() == 3, "Arena::allocate()");
+}
+
+TEST(test_align)
+{
+	TEST_ASSERT(Arena::align(0) == 0, "Arena::align()");
+	TEST_ASSERT(Arena::align(1) >= sizeof(void *), "Arena::align()");
+	TEST_ASSERT(Arena::align(1) >= sizeof(double), "Arena::align()");
+	TEST_ASSERT(Arena::align(Arena::align(1) + 1) == 2 * Arena::align(1),
+	            "Arena::align()");
+}
+
+}  // namespace util
@@ -0,0 +1,63 @@
+#include "util/interval_timer.h"
+#include "util/test.h"
+
+#include <unistd.h>
+#include <stdexcept>
+
+namespace util {
+
+TEST(test_monotonic_ns)
+{
+	uint64_t t0 = monotonic_ns();
+	usleep(1000);
+	uint64_t t1 = monotonic_ns();
+	TEST_ASSERT(t1 - t0 >= 1000000, "util::monotonic_ns()")
+	    << t1 - t0;
+}
+
+TEST(test_ticks)
+{
+	const uint64_t interval = 10 * 1000 * 1000;
+	IntervalTimer timer(interval);
+	TEST_ASSERT(timer.interval_ns() == interval,
+	            "util::IntervalTimer::interval_ns()");
+
+	uint64_t ticks = 0;
+	for (int i = 0; i < 5; i++) {
+		ticks += timer.wait();
+	}
+	uint64_t elapsed = monotonic_ns() - timer.start_ns();
+	TEST_ASSERT(ticks >= 5, "util::IntervalTimer::wait()") << ticks;
+	TEST_ASSERT(elapsed >= ticks * interval,
+	            "util::IntervalTimer::wait(): early") << elapsed;
+}
+
+TEST(test_overrun)
+{
+	const uint64_t interval = 5 * 1000 * 1000;
+	IntervalTimer timer(interval);
+	timer.wait();
+	// miss at least two ticks
+	usleep(3 * interval / 1000);
+	uint64_t ticks = timer.wait();
+	TEST_ASSERT(ticks >= 2, "util::IntervalTimer::wait(): overrun")
+	    << ticks;
+
+	// the schedule does not drift after an overrun
+	uint64_t before = monotonic_ns() - timer.start_ns();
+	timer.wait();
+	uint64_t after = monotonic_ns() - timer.start_ns();
+	TEST_ASSERT(after / interval > before / interval,
+	            "util::IntervalTimer::wait(): drift");
+}
+
+TEST(test_errors)
+{
+	try {
+		IntervalTimer timer(0);
+		TEST_FAIL("util::IntervalTimer::IntervalTimer(0)");
+	} catch (std::invalid_argument &e) {
+	}
+}
+
+}  // namespace util
@@ -0,0 +1,218 @@
+#include "util/log.h"
+#include "util/test.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace log {
+
+// A sink which remembers what it was given.
+class SavingSink: public Sink {
+    public:
+	SavingSink()
+	    : n_flushes(0), m_blocked(false)
+	{
+		pthread_mutex_init(&m_lock, NULL);
+		pthread_cond_init(&m_unblocked, NULL);
+	}
+	~SavingSink()
+	{
+		pthread_cond_destroy(&m_unblocked);
+		pthread_mutex_destroy(&m_lock);
+	}
+
+	virtual void
+	write(const Record &record)
+	{
+		pthread_mutex_lock(&m_lock);
+		while (m_blocked) {
+			pthread_cond_wait(&m_unblocked, &m_lock);
+		}
+		records.push_back(record);
+		pthread_mutex_unlock(&m_lock);
+	}
+
+	virtual void
+	flush()
+	{
+		pthread_mutex_lock(&m_lock);
+		n_flushes++;
+		pthread_mutex_unlock(&m_lock);
+	}
+
+	// Make write() wait until unblock() is called.
+	void
+	block()
+	{
+		pthread_mutex_lock(&m_lock);
+		m_blocked = true;
+		pthread_mutex_unlock(&m_lock);
+	}
+	void
+	unblock()
+	{
+		pthread_mutex_lock(&m_lock);
+		m_blocked = false;
+		pthread_cond_broadcast(&m_unblocked);
+		pthread_mutex_unlock(&m_lock);
+	}
+
+	std::vector<Record> records;
+	int n_flushes;
+
+    private:
+	pthread_mutex_t m_lock;
+	pthread_cond_t m_unblocked;
+	bool m_blocked;
+};
+
+TEST(test_format)
+{
+	Record rec('W', "foo.cc", 42, "bar", "a message");
+	TEST_ASSERT(format_record(rec) == "W[foo.cc:42] bar(): a message\n",
+	            "log::format_record()");
+}
+
+TEST(test_stream_sink)
+{
+	std::ostringstream oss;
+	StreamSink sink(oss);
+	sink.write(Record('I', "foo.cc", 1, "f", "one"));
+	sink.write(Record('E', "foo.cc", 2, "g", "two"));
+	sink.flush();
+	TEST_ASSERT(oss.str() == "I[foo.cc:1] f(): one\n"
+	                         "E[foo.cc:2] g(): two\n",
+	            "log::StreamSink::write()");
+}
+
+TEST(test_set_sink)
+{
+	SavingSink saving;
+	Sink *old = set_sink(&saving);
+	TEST_ASSERT(old != NULL, "log::set_sink()");
+	TEST_ASSERT(current_sink() == &saving, "log::set_sink()");
+
+	enable_logging(0);
+	LOG(WARN, "value %d", 17);
+	TEST_ASSERT(saving.records.size() == 1, "log::set_sink()");
+	TEST_ASSERT(saving.records[0].level == 'W', "log::set_sink()");
+	TEST_ASSERT(saving.records[0].message == "value 17",
+	            "log::set_sink()");
+
+	// NULL goes back to the default
+	TEST_ASSERT(set_sink(NULL) == &saving, "log::set_sink()");
+	TEST_ASSERT(current_sink() == old, "log::set_sink()");
+}
+
+TEST(test_async_sink)
+{
+	SavingSink saving;
+	{
+		AsyncSink async(&saving);
+		for (int i = 0; i < 100; i++) {
+			async.write(Record('I', __FILE__, __LINE__, __func__,
+			                   ::printfxx::sprintfxx("%d", i)));
+		}
+		async.flush();
+		TEST_ASSERT(saving.records.size() == 100,
+		            "log::AsyncSink::flush()");
+		TEST_ASSERT(saving.n_flushes >= 1, "log::AsyncSink::flush()");
+		// one thread's messages stay in order
+		for (int i = 0; i < 100; i++) {
+			if (saving.records[i].message
+			    != ::printfxx::sprintfxx("%d", i)) {
+				TEST_FAIL("log::AsyncSink::write()") << i;
+			}
+		}
+
+		// the destructor writes anything left
+		async.write(Record('I', __FILE__, __LINE__, __func__, "last"));
+	}
+	TEST_ASSERT(saving.records.size() == 101,
+	            "log::AsyncSink::~AsyncSink()");
+	TEST_ASSERT(saving.records[100].message == "last",
+	            "log::AsyncSink::~AsyncSink()");
+}
+
+TEST(test_async_drops)
+{
+	SavingSink saving;
+	AsyncSink async(&saving, 4);
+
+	// With the target stuck, the queue fills up.  A message stays queued
+	// until the target has taken it.
+	saving.block();
+	for (int i = 0; i < 10; i++) {
+		async.write(Record('I', __FILE__, __LINE__, __func__, "msg"));
+	}
+	uint64_t dropped = async.dropped();
+	TEST_ASSERT(dropped == 6, "log::AsyncSink::dropped()") << dropped;
+	saving.unblock();
+	async.flush();
+
+	// the drops are reported, in among the messages which were kept
+	TEST_ASSERT(saving.records.size() == 10 - dropped + 1,
+	            "log::AsyncSink::dropped()") << saving.records.size();
+	int n_reports = 0;
+	for (size_t i = 0; i < saving.records.size(); i++) {
+		const Record &rec = saving.records[i];
+		if (rec.level != 'W') {
+			continue;
+		}
+		n_reports++;
+		TEST_ASSERT(rec.message == ::printfxx::sprintfxx(
+		                "dropped %d log messages", dropped),
+		            "log::AsyncSink::dropped()") << rec.message;
+	}
+	TEST_ASSERT(n_reports == 1, "log::AsyncSink::dropped()");
+}
+
+static AsyncSink *thread_sink;
+
+static void *
+log_thread(void *arg)
+{
+	long id = reinterpret_cast<long>(arg);
+	for (int i = 0; i < 50; i++) {
+		thread_sink->write(Record('I', __FILE__, __LINE__, __func__,
+		    ::printfxx::sprintfxx("%d %d", id, i)));
+	}
+	return NULL;
+}
+
+TEST(test_async_threads)
+{
+	SavingSink saving;
+	AsyncSink async(&saving, 64);
+	thread_sink = &async;
+
+	pthread_t threads[8];
+	for (long i = 0; i < 8; i++) {
+		pthread_create(&threads[i], NULL, log_thread,
+		               reinterpret_cast<void *>(i));
+	}
+	for (int i = 0; i < 8; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	async.flush();
+	TEST_ASSERT(saving.records.size() == 8 * 50,
+	            "log::AsyncSink threads") << saving.records.size();
+	TEST_ASSERT(async.dropped() == 0, "log::AsyncSink threads");
+
+	// each thread's messages stay in order
+	std::vector<int> next(8, 0);
+	for (size_t i = 0; i < saving.records.size(); i++) {
+		int id, n;
+		sscanf(saving.records[i].message.c_str(), "%d %d", &id, &n);
+		if (n != next[id]) {
+			TEST_FAIL("log::AsyncSink threads")
+			    << saving.records[i].message;
+		}
+		next[id] = n + 1;
+	}
+}
+
+}  // namespace log
@@ -0,0 +1,171 @@
+#include "util/output_buffer.h"
+#include "util/test.h"
+
+#include <unistd.h>
+#include <string>
+#include "util/printfxx.h"
+
+namespace util {
+
+// Read everything that is waiting in a pipe.
+static std::string
+drain(int fd)
+{
+	std::string result;
+	char buf[4096];
+	ssize_t r;
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		result.append(buf, r);
+	}
+	return result;
+}
+
+// A pipe which is closed when done, and which does not block reads.
+struct TestPipe {
+	TestPipe()
+	{
+		if (pipe(fds) < 0) {
+			TEST_FAIL("pipe()");
+		}
+	}
+	~TestPipe()
+	{
+		close(fds[0]);
+		if (fds[1] >= 0) {
+			close(fds[1]);
+		}
+	}
+	// Close the write side and read what was written.
+	std::string
+	contents()
+	{
+		close(fds[1]);
+		fds[1] = -1;
+		return drain(fds[0]);
+	}
+
+	int fds[2];
+};
+
+TEST(test_text)
+{
+	TestPipe p;
+	{
+		OutputBuffer out(p.fds[1]);
+		out.write("abc");
+		out.write(std::string("def"));
+		out.write('g');
+		out.write("hij", 2);
+		TEST_ASSERT(out.pending() == 9, "OutputBuffer::pending()");
+	}
+	std::string s = p.contents();
+	TEST_ASSERT(s == "abcdefghi", "OutputBuffer::write()") << s;
+}
+
+TEST(test_integers)
+{
+	TestPipe p;
+	{
+		OutputBuffer out(p.fds[1]);
+		out.write_dec(0ULL);
+		out.write(' ');
+		out.write_dec(1234567890ULL);
+		out.write(' ');
+		out.write_dec(18446744073709551615ULL);
+		out.write(' ');
+		out.write_hex(0ULL);
+		out.write(' ');
+		out.write_hex(0xdeadbeefULL);
+		out.write(' ');
+		out.write_hex(0xffffffffffffffffULL);
+	}
+	std::string s = p.contents();
+	TEST_ASSERT(s == "0 1234567890 18446744073709551615"
+	                 " 0 deadbeef ffffffffffffffff",
+	            "OutputBuffer::write_dec()") << s;
+}
+
+TEST(test_big_integers)
+{
+	TestPipe p;
+	{
+		OutputBuffer out(p.fds[1]);
+		out.write_hex(mpz_class(0x1234));
+		out.write(' ');
+		out.write_hex(mpz_class("0x112233445566778899aabbccddeeff00",
+		                        0));
+		out.write(' ');
+		out.write_hex(mpz_class(-255));
+	}
+	std::string s = p.contents();
+	TEST_ASSERT(s == "1234 112233445566778899aabbccddeeff00 -ff",
+	            "OutputBuffer::write_hex(mpz_class)") << s;
+}
+
+TEST(test_flushing)
+{
+	TestPipe p;
+	std::string expected;
+	{
+		// the smallest buffer, so it fills up often
+		OutputBuffer out(p.fds[1], 1);
+		for (int i = 0; i < 100; i++) {
+			out.write("line ");
+			out.write_dec((unsigned long long)i);
+			out.write('\n');
+			expected += ::printfxx::sprintfxx("line %d\n", i);
+			TEST_ASSERT(out.pending() <= 64,
+			            "OutputBuffer flushing") << out.pending();
+		}
+		// bigger than the whole buffer
+		std::string big(1000, 'x');
+		out.write(big);
+		expected += big;
+		out.write_hex(mpz_class(std::string(200, 'f'), 16));
+		expected += std::string(200, 'f');
+		out.flush();
+		TEST_ASSERT(out.pending() == 0, "OutputBuffer::flush()");
+	}
+	std::string s = p.contents();
+	TEST_ASSERT(s == expected, "OutputBuffer flushing") << s;
+}
+
+TEST(test_write_error)
+{
+	// nothing is written until the flush, which fails
+	OutputBuffer out(-1);
+	out.write("abc");
+	try {
+		out.flush();
+		TEST_FAIL("OutputBuffer::flush()");
+	} catch (syserr::ErrnoError &e) {
+	}
+	TEST_ASSERT(out.pending() == 0, "OutputBuffer::flush()");
+}
+
+TEST(test_path_buffer)
+{
+	PathBuffer path;
+	TEST_ASSERT(path.str() == "", "PathBuffer::str()");
+
+	size_t m1 = path.push("/", "foo");
+	size_t m2 = path.push("/", "bar");
+	TEST_ASSERT(path.str() == "/foo/bar", "PathBuffer::push()");
+	size_t m3 = path.push_index(0);
+	TEST_ASSERT(path.str() == "/foo/bar[0]", "PathBuffer::push_index()");
+	path.pop(m3);
+	m3 = path.push_index(1234);
+	TEST_ASSERT(path.str() == "/foo/bar[1234]",
+	            "PathBuffer::push_index()");
+	path.pop(m3);
+	path.pop(m2);
+	TEST_ASSERT(path.str() == "/foo", "PathBuffer::pop()");
+	path.pop(m1);
+	TEST_ASSERT(path.str() == "", "PathBuffer::pop()");
+
+	PathBuffer based("base");
+	based.push(".", "x");
+	TEST_ASSERT(based.str() == "base.x", "PathBuffer::PathBuffer()");
+}
+
+}  // namespace util
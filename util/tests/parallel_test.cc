@@ -0,0 +1,68 @@
+#include "util/parallel.h"
+#include <vector>
+#include <stdexcept>
+#include "util/test.h"
+
+namespace parallel {
+
+// Count how many times each index is run.
+struct CountFunc {
+	std::vector<int> *counts;
+	explicit CountFunc(std::vector<int> *c): counts(c) {}
+	void
+	operator()(size_t index)
+	{
+		(*counts)[index]++;
+	}
+};
+
+struct ThrowFunc {
+	void
+	operator()(size_t index)
+	{
+		if (index == 3) {
+			throw std::runtime_error("index 3");
+		}
+	}
+};
+
+TEST(test_online_cpus)
+{
+	TEST_ASSERT(online_cpus() >= 1, "online_cpus()");
+}
+
+TEST(test_for_each_index)
+{
+	unsigned thread_counts[] = { 0, 1, 2, 7, 64 };
+	for (size_t t = 0; t < sizeof(thread_counts)/sizeof(*thread_counts);
+	     t++) {
+		std::vector<int> counts(1000, 0);
+		for_each_index(counts.size(), thread_counts[t],
+		               CountFunc(&counts));
+		for (size_t i = 0; i < counts.size(); i++) {
+			if (counts[i] != 1) {
+				TEST_FAIL("for_each_index()")
+				    << thread_counts[t] << " threads, item "
+				    << i << " ran " << counts[i] << " times";
+				break;
+			}
+		}
+	}
+
+	// no items is not an error
+	std::vector<int> counts;
+	for_each_index(0, 4, CountFunc(&counts));
+}
+
+TEST(test_exceptions)
+{
+	try {
+		for_each_index(100, 4, ThrowFunc());
+		TEST_FAIL("for_each_index()");
+	} catch (WorkerError &e) {
+		TEST_ASSERT(std::string(e.what()) == "index 3",
+		    "for_each_index()");
+	}
+}
+
+}  // namespace parallel
@@ -115,6 +115,65 @@ TEST(test_symbol_table)
 		TEST_ASSERT(result != NULL, "SymbolTable::lookup()");
 		TEST_ASSERT(*result == "value2", "SymbolTable::lookup()");
 	}
+
+	{
+		SymbolTable<std::string, int> st;
+		const int *result;
+
+		// Keys added in a context go away with it.
+		st.push_context();
+		st.add("inner", 1);
+		TEST_ASSERT(st.add_unique("inner", 2) == false,
+		            "SymbolTable::add_unique()");
+		st.pop_context();
+		TEST_ASSERT(st.lookup("inner") == NULL, "SymbolTable::pop_context()");
+
+		// Deep nesting shadows and unshadows one level at a time.
+		for (int i = 0; i < 100; i++) {
+			st.push_context();
+			if (i % 10 == 0) {
+				TEST_ASSERT(st.add_unique("key", i) == true,
+				            "SymbolTable::add_unique()");
+			}
+		}
+		TEST_ASSERT(st.depth() == 101, "SymbolTable::push_context()");
+		result = st.lookup("key");
+		TEST_ASSERT(result != NULL && *result == 90,
+		            "SymbolTable::lookup()");
+		for (int i = 99; i >= 0; i--) {
+			st.pop_context();
+			result = st.lookup("key");
+			if (i == 0) {
+				TEST_ASSERT(result == NULL, "SymbolTable::lookup()");
+			} else {
+				TEST_ASSERT(result != NULL && *result == (i - 1) / 10 * 10)
+				    << "SymbolTable::lookup(): " << i;
+			}
+		}
+
+		// Snapshots are independent copies.
+		st.add("key", 1);
+		SymbolTable<std::string, int> snap = st.snapshot();
+		st.add("key", 2);
+		result = snap.lookup("key");
+		TEST_ASSERT(result != NULL && *result == 1,
+		            "SymbolTable::snapshot()");
+		result = st.lookup("key");
+		TEST_ASSERT(result != NULL && *result == 2,
+		            "SymbolTable::snapshot()");
+
+		// Removing a key uncovers the value it overrode.
+		st.push_context();
+		st.add("key", 3);
+		TEST_ASSERT(st.remove("key") == true, "SymbolTable::remove()");
+		TEST_ASSERT(st.context_size() == 0, "SymbolTable::remove()");
+		result = st.lookup("key");
+		TEST_ASSERT(result != NULL && *result == 2, "SymbolTable::remove()");
+		TEST_ASSERT(st.remove("key") == false, "SymbolTable::remove()");
+		st.pop_context();
+		result = st.lookup("key");
+		TEST_ASSERT(result != NULL && *result == 2, "SymbolTable::remove()");
+	}
 }
 
 }  // namespace util
@@ -0,0 +1,284 @@
+//
+// Poll registers and fields, and report what changed.
+//
+#include "hwpp.h"
+#include "watch.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "query.h"
+#include "regbits.h"
+#include "driver.h"
+
+namespace hwpp {
+
+// Collect the paths and dirents matched by a Query.
+struct WatchMatches
+{
+	explicit WatchMatches(std::vector<std::pair<string, ConstDirentPtr> > *m)
+	    : matches(m)
+	{
+	}
+	void
+	operator()(const string &path, const ConstDirentPtr &dirent)
+	{
+		matches->push_back(std::make_pair(path, dirent));
+	}
+	std::vector<std::pair<string, ConstDirentPtr> > *matches;
+};
+
+// Collect just the paths matched by a Query.
+struct WatchPaths
+{
+	explicit WatchPaths(std::set<string> *p): paths(p)
+	{
+	}
+	void
+	operator()(const string &path, const ConstDirentPtr &dirent)
+	{
+		(void)dirent;
+		paths->insert(path);
+	}
+	std::set<string> *paths;
+};
+
+Watch::Watch(const ConstScopePtr &root)
+    : m_root(root), m_first(true), m_last_ns(0), m_now_ns(0)
+{
+}
+
+size_t
+Watch::add(const string &pattern)
+{
+	typedef std::vector<std::pair<string, ConstDirentPtr> > MatchList;
+
+	// Scopes and arrays are watched by everything below them.
+	std::vector<string> patterns;
+	patterns.push_back(pattern);
+	MatchList containers;
+	Query query(pattern);
+	query.set_types("scope,array");
+	query.run(m_root, WatchMatches(&containers));
+	for (size_t i = 0; i < containers.size(); i++) {
+		patterns.push_back(containers[i].first + "/**");
+	}
+
+	size_t before = m_items.size();
+	for (size_t i = 0; i < patterns.size(); i++) {
+		MatchList leaves;
+		Query leaf_query(patterns[i]);
+		leaf_query.set_types("register,field");
+		leaf_query.run(m_root, WatchMatches(&leaves));
+
+		std::set<string> counters;
+		if (!m_counters.empty()) {
+			Query counter_query(patterns[i]);
+			counter_query.set_types("field");
+			counter_query.set_datatype(m_counters);
+			counter_query.run(m_root, WatchPaths(&counters));
+		}
+
+		for (size_t j = 0; j < leaves.size(); j++) {
+			const string &path = leaves[j].first;
+			add_dirent(path, leaves[j].second,
+			           counters.find(path) != counters.end());
+		}
+	}
+	return (m_items.size() - before);
+}
+
+void
+Watch::add_dirent(const string &path, const ConstDirentPtr &de,
+                  bool counter)
+{
+	if (m_paths.find(path) != m_paths.end()) {
+		return;
+	}
+
+	Item item;
+	item.path = path;
+	item.keyed = false;
+	item.indexed = false;
+	item.field_index = 0;
+	item.counter = false;
+	item.width = 0;
+	item.valid = false;
+	item.value = 0;
+
+	if (de->is_register()) {
+		item.reg = register_from_dirent(de);
+		if (register_key(item.reg, &item.key)) {
+			item.keyed = true;
+			m_index.add_register(item.reg);
+		}
+	} else {
+		item.field = field_from_dirent(de);
+		item.counter = counter;
+		if (m_index.add_field(path, item.field)) {
+			item.indexed = true;
+			item.field_index = m_index.n_fields() - 1;
+			const FieldIndex::Entry &entry =
+			    m_index.field(item.field_index);
+			for (size_t i = 0; i < entry.ranges.size(); i++) {
+				m_index.add_register(entry.ranges[i].reg);
+				item.width += entry.ranges[i].hi_bit
+				            - entry.ranges[i].lo_bit + 1;
+			}
+			m_indexed.push_back(m_items.size());
+		}
+	}
+
+	m_paths[path] = m_items.size();
+	m_items.push_back(item);
+}
+
+// Put a field's raw value back together from the register values read
+// this poll, the same way RegBits::read() does.
+bool
+Watch::decode(const FieldIndex::Entry &entry, Value *result) const
+{
+	Value value = 0;
+	for (size_t i = 0; i < entry.ranges.size(); i++) {
+		const RegBits::Range &range = entry.ranges[i];
+		std::map<RegisterKey, Slot>::const_iterator it =
+		    m_registers.find(entry.keys[i]);
+		if (it == m_registers.end() || !it->second.valid) {
+			return false;
+		}
+		BitWidth width = range.hi_bit - range.lo_bit + 1;
+		Value reg = it->second.value;
+		value <<= width;
+		reg >>= range.lo_bit;
+		reg &= MASK(width);
+		value |= reg;
+	}
+	*result = value;
+	return true;
+}
+
+void
+Watch::poll(uint64_t now_ns, std::vector<WatchChange> *changes)
+{
+	m_now_ns = now_ns;
+
+	// Read every keyed register once.  The index keeps them sorted by
+	// binding, so reads through each binding are grouped together.
+	std::map<RegisterKey, Value> changed;
+	const std::map<RegisterKey, ConstRegisterPtr> &regs =
+	    m_index.registers();
+	std::map<RegisterKey, ConstRegisterPtr>::const_iterator it;
+	for (it = regs.begin(); it != regs.end(); it++) {
+		Slot &slot = m_registers[it->first];
+		bool valid;
+		Value value;
+		try {
+			value = it->second->read();
+			valid = true;
+		} catch (Driver::IoError &e) {
+			valid = false;
+		}
+		if (m_first || valid != slot.valid
+		 || (valid && value != slot.value)) {
+			if (valid && slot.valid && !m_first) {
+				changed[it->first] = value ^ slot.value;
+			} else {
+				changed[it->first] = MASK(it->first.width);
+			}
+		}
+		slot.valid = valid;
+		slot.value = valid ? value : Value(0);
+	}
+
+	// Only decode the fields on bits which changed.
+	std::vector<size_t> dirty_fields;
+	m_index.affected_fields(changed, &dirty_fields);
+	std::vector<bool> dirty(m_items.size(), false);
+	for (size_t i = 0; i < dirty_fields.size(); i++) {
+		dirty[m_indexed[dirty_fields[i]]] = true;
+	}
+
+	for (size_t i = 0; i < m_items.size(); i++) {
+		Item &item = m_items[i];
+		bool valid = false;
+		Value value;
+		if (item.keyed) {
+			std::map<RegisterKey, Value>::const_iterator c =
+			    changed.find(item.key);
+			if (c == changed.end()) {
+				continue;
+			}
+			const Slot &slot = m_registers[item.key];
+			valid = slot.valid;
+			value = slot.value;
+		} else if (item.indexed) {
+			if (!dirty[i]) {
+				continue;
+			}
+			valid = decode(m_index.field(item.field_index),
+			               &value);
+		} else {
+			try {
+				value = item.reg ? item.reg->read()
+				                 : item.field->read();
+				valid = true;
+			} catch (Driver::IoError &e) {
+				valid = false;
+			}
+		}
+		update(&item, valid, value, changes);
+	}
+
+	m_first = false;
+	m_last_ns = now_ns;
+}
+
+// Record a new value for one item, and report it if it changed.
+void
+Watch::update(Item *item, bool valid, const Value &value,
+              std::vector<WatchChange> *changes) const
+{
+	if (valid == item->valid && (!valid || value == item->value)) {
+		return;
+	}
+
+	WatchChange wc;
+	wc.path = item->path;
+	wc.is_field = (item->field != NULL);
+	wc.old_valid = item->valid;
+	wc.new_valid = valid;
+	wc.old_value = item->valid ? item->value : Value(0);
+	wc.new_value = valid ? value : Value(0);
+	wc.has_rate = false;
+	wc.rate = 0;
+	if (wc.is_field) {
+		if (wc.old_valid) {
+			wc.old_string = item->field->datatype()->evaluate(
+			    wc.old_value);
+		}
+		if (wc.new_valid) {
+			wc.new_string = item->field->datatype()->evaluate(
+			    wc.new_value);
+		}
+	}
+
+	if (item->counter && wc.old_valid && wc.new_valid && !m_first
+	 && m_now_ns > m_last_ns) {
+		Value delta = wc.new_value - wc.old_value;
+		if (delta < 0 && item->width > 0) {
+			// it wrapped
+			delta += MASK(item->width) + 1;
+		}
+		if (delta >= 0) {
+			wc.has_rate = true;
+			wc.rate = delta.get_d() * 1e9 / (m_now_ns - m_last_ns);
+		}
+	}
+
+	item->valid = valid;
+	item->value = wc.new_value;
+	changes->push_back(wc);
+}
+
+}  // namespace hwpp
@@ -0,0 +1,148 @@
+#ifndef HWPP_WATCH_H__
+#define HWPP_WATCH_H__
+
+#include "hwpp.h"
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "scope.h"
+#include "register.h"
+#include "field.h"
+#include "field_index.h"
+
+namespace hwpp {
+
+/*
+ * WatchChange - one watched register or field whose value changed
+ * between two polls.
+ */
+struct WatchChange
+{
+	string path;
+	bool is_field;
+	bool old_valid;
+	bool new_valid;
+	// 0 if not valid
+	Value old_value;
+	Value new_value;
+	// the evaluated values of a field, or "" if not valid
+	string old_string;
+	string new_string;
+	// for counters only: the change per second since the last poll
+	bool has_rate;
+	double rate;
+};
+
+/*
+ * Watch - poll a set of registers and fields, and report what changed.
+ *
+ * Registers which talk straight to a binding are read once per poll, in
+ * key order, so all the reads through one binding happen together.  Fields
+ * built only on those registers (see FieldIndex) are decoded from the
+ * values just read, and only when their bits changed, rather than read
+ * again.  Everything else is read on its own each poll.
+ *
+ * Fields whose datatype name matches a counter glob are counters.  Their
+ * changes also carry a rate, in units per second.  A counter which goes
+ * down is taken to have wrapped once, at its width, if that is known.
+ */
+class Watch
+{
+    public:
+	explicit Watch(const ConstScopePtr &root);
+
+	/*
+	 * Watch::set_counters(datatype)
+	 *
+	 * Treat fields of datatypes whose names match this glob as
+	 * counters.  Only fields added after this call are affected.
+	 */
+	void
+	set_counters(const string &datatype)
+	{
+		m_counters = datatype;
+	}
+
+	/*
+	 * Watch::add(pattern)
+	 *
+	 * Watch every register and field which matches a path or Query
+	 * pattern.  Matching scopes and arrays are watched recursively.
+	 * Aliases are not followed.  Adding a path twice has no effect.
+	 *
+	 * Returns: the number of registers and fields added.
+	 * Throws: std::invalid_argument
+	 */
+	size_t
+	add(const string &pattern);
+
+	/*
+	 * Watch::size()
+	 *
+	 * Get the number of watched registers and fields.
+	 */
+	size_t
+	size() const
+	{
+		return m_items.size();
+	}
+
+	/*
+	 * Watch::poll(now_ns, changes)
+	 *
+	 * Read everything that is watched, and add what changed since the
+	 * last poll to 'changes', in the order it was added.  'now_ns' is
+	 * the time of this poll, in nanoseconds on any monotonic clock, and
+	 * is only used for rates.  The first poll reports every value.
+	 */
+	void
+	poll(uint64_t now_ns, std::vector<WatchChange> *changes);
+
+    private:
+	struct Item {
+		string path;
+		ConstRegisterPtr reg;
+		ConstFieldPtr field;
+		// the register's key, if 'keyed'
+		bool keyed;
+		RegisterKey key;
+		// the field's FieldIndex number, if 'indexed'
+		bool indexed;
+		size_t field_index;
+		bool counter;
+		// the field's width, or 0 if not known
+		unsigned width;
+		bool valid;
+		Value value;
+	};
+	struct Slot {
+		bool valid;
+		Value value;
+	};
+
+	void
+	add_dirent(const string &path, const ConstDirentPtr &de,
+	           bool counter);
+	bool
+	decode(const FieldIndex::Entry &entry, Value *result) const;
+	void
+	update(Item *item, bool valid, const Value &value,
+	       std::vector<WatchChange> *changes) const;
+
+	ConstScopePtr m_root;
+	string m_counters;
+	bool m_first;
+	uint64_t m_last_ns;
+	uint64_t m_now_ns;
+	FieldIndex m_index;
+	std::vector<Item> m_items;
+	std::map<string, size_t> m_paths;
+	// the last values of the keyed registers
+	std::map<RegisterKey, Slot> m_registers;
+	// item numbers, by field index
+	std::vector<size_t> m_indexed;
+};
+
+}  // namespace hwpp
+
+#endif // HWPP_WATCH_H__